@@ -0,0 +1,180 @@
+/*
+   source/bench/ljpeg-arenabench.c
+   LJPEG decode memory benchmark.
+
+   Decodes the images in a directory over and over, the way browsing
+   through them does, and every 1000 loads prints the resident size
+   next to what the decode pools hold.  With the pools the resident
+   size should level off after the first pass through the directory;
+   --no-arena leaves SDL on plain malloc to compare.  The time each
+   decoder took is printed at the end.
+
+   usage: ljpeg-arenabench [--no-arena] [--thumbs] [--count N] DIRECTORY
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* sysconf is hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_simd.h"
+
+
+/* file static variables */
+#define REPORT_EVERY 1000
+
+
+/* file static function prototypes */
+static double now_ms (void);
+static double resident_mib (void);
+static void   report (int loads, int batch, int failed, double ms);
+
+
+/* static function definitions */
+static double
+now_ms (void)
+{
+    return (double)SDL_GetPerformanceCounter () * 1000.0 / (double)SDL_GetPerformanceFrequency ();
+}
+
+
+/* 0 where /proc is missing */
+static double
+resident_mib (void)
+{
+    FILE *fp;
+    long pages = 0;
+    long resident = 0;
+
+    fp = fopen ("/proc/self/statm", "r");
+    if (fp == NULL)
+        return 0.0;
+    if (fscanf (fp, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose (fp);
+
+    return (double)resident * (double)sysconf (_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+
+static void
+report (int loads, int batch, int failed, double ms)
+{
+    arena_stats stats;
+    const double mib = 1024.0 * 1024.0;
+
+    arena_get_stats (&stats);
+    printf ("%7d loads %9.1f ms/load  rss %8.1f MiB  in use %8.1f  peak %8.1f  retained %8.1f  reused %5.1f%% %s\n",
+            loads, ms / batch, resident_mib (),
+            (double)stats.in_use / mib, (double)stats.peak / mib, (double)stats.retained / mib,
+            (stats.allocs > 0) ? (double)stats.reused * 100.0 / (double)stats.allocs : 0.0,
+            (failed > 0) ? "(some failed)" : "");
+    fflush (stdout);
+}
+
+
+/* main program-entry-point */
+int
+main (int argc, char *argv[])
+{
+    const char *directory = NULL;
+    bool use_arena = true;
+    bool thumbs = false;
+    int count = 10000;
+    filelist files;
+    mapped_file map;
+    SDL_Surface *surface;
+    double start;
+    int batch = 0;
+    int failed = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--no-arena") == 0)
+            use_arena = false;
+        else if (strcmp (argv[i], "--thumbs") == 0)
+            thumbs = true;
+        else if ((strcmp (argv[i], "--count") == 0) && (i + 1 < argc))
+            count = atoi (argv[++i]);
+        else
+            directory = argv[i];
+    }
+    if (directory == NULL)
+    {
+        fprintf (stderr, "usage: %s [--no-arena] [--thumbs] [--count N] DIRECTORY\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (use_arena && (arena_install () != EXIT_SUCCESS))
+        return EXIT_FAILURE;
+    simd_init ();
+
+    if ((filelist_load (&files, directory) != EXIT_SUCCESS) || (files.count == 0))
+    {
+        fprintf (stderr, "%s: no images found\n", directory);
+        return EXIT_FAILURE;
+    }
+
+    start = now_ms ();
+    for (i = 0; i < count; i++)
+    {
+        surface = NULL;
+        if (mapfile_open (&map, files.paths[i % files.count]) == EXIT_SUCCESS)
+        {
+            if (thumbs)
+                surface = decode_load_scaled (map.data, map.len, THUMB_SIZE, THUMB_SIZE);
+            else
+                surface = decode_load_mem (map.data, map.len);
+            mapfile_close (&map);
+        }
+        if (surface == NULL)
+            failed++;
+        else
+            SDL_FreeSurface (surface);
+
+        batch++;
+        if ((batch == REPORT_EVERY) || (i + 1 == count))
+        {
+            report (i + 1, batch, failed, now_ms () - start);
+            batch = 0;
+            start = now_ms ();
+        }
+    }
+
+    decode_print_timing (stdout);
+
+    filelist_free (&files);
+    return EXIT_SUCCESS;
+}
+
+
+/* End of File */
@@ -0,0 +1,261 @@
+/*
+   source/bench/ljpeg-fuzz.c
+   LJPEG built-in decoder fuzzer.
+
+   Runs the built-in jpeg, png and tiff decoders over files that once
+   got past them (kept below, each turned down now), then over every
+   file given and N copies of each with a few random bytes changed.
+   `make fuzz` builds it with the address and undefined behaviour
+   sanitizers, which stop the run at the first decoder that reads or
+   writes where it should not.  Exits EXIT_FAILURE when one of the
+   known bad files is decoded.
+
+   usage: ljpeg-fuzz [--mutations N] [--seed N] [FILE...]
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_baseline.h"
+#include "ljpeg_png.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_tiff.h"
+
+
+/* file static variables */
+/* a file one of the decoders must turn down */
+typedef struct fuzz_case
+{
+    const char          *name;
+    const unsigned char *data;
+    size_t               len;
+} fuzz_case;
+
+/* dht with three 1 bit codes, the third of which is past the table */
+static const unsigned char s_dht_overfull[] = {
+    0xFF, 0xD8,
+    0xFF, 0xC4, 0x00, 0x16, 0x00,
+    0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02,
+    0xFF, 0xD9,
+};
+
+/* dht whose 1 bit codes use up the space the 2 bit one is put in */
+static const unsigned char s_dht_carry[] = {
+    0xFF, 0xD8,
+    0xFF, 0xC4, 0x00, 0x16, 0x10,
+    0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02,
+    0xFF, 0xD9,
+};
+
+/* png claiming 1048576 squared rgba pixels from 8 bytes of image data */
+static const unsigned char s_png_huge[] = {
+    0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A,
+    0x00, 0x00, 0x00, 0x0D, 'I', 'H', 'D', 'R',
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x08, 0x06, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x08, 'I', 'D', 'A', 'T',
+    0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 'I', 'E', 'N', 'D',
+    0x00, 0x00, 0x00, 0x00,
+};
+
+/* png whose rows are each well past what its image data inflates to */
+static const unsigned char s_png_tall[] = {
+    0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A,
+    0x00, 0x00, 0x00, 0x0D, 'I', 'H', 'D', 'R',
+    0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10, 0x00, 0x08, 0x06, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x08, 'I', 'D', 'A', 'T',
+    0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 'I', 'E', 'N', 'D',
+    0x00, 0x00, 0x00, 0x00,
+};
+
+static const fuzz_case s_cases[] = {
+    { "dht-overfull", s_dht_overfull, sizeof (s_dht_overfull) },
+    { "dht-carry",    s_dht_carry,    sizeof (s_dht_carry) },
+    { "png-huge",     s_png_huge,     sizeof (s_png_huge) },
+    { "png-tall",     s_png_tall,     sizeof (s_png_tall) },
+};
+
+#define FUZZ_CASES ((int)(sizeof (s_cases) / sizeof (s_cases[0])))
+
+static uint32_t s_seed = 0x4C4A5047;
+
+
+/* file static function prototypes */
+static uint32_t fuzz_random (void);
+static bool fuzz_decode (const unsigned char *data, size_t len);
+static unsigned char *fuzz_read (const char *path, size_t *len);
+
+
+/* static function definitions */
+/* xorshift, the same run for the same seed */
+static uint32_t
+fuzz_random (void)
+{
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+
+/* through every built-in decoder, true when one of them takes it */
+static bool
+fuzz_decode (const unsigned char *data, size_t len)
+{
+    SDL_Surface *(*decoders[3]) (const unsigned char *, size_t) = {
+        baseline_decode, png_decode, tiff_decode
+    };
+    SDL_Surface *surface;
+    bool decoded = false;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        surface = decoders[i] (data, len);
+        if (surface != NULL)
+        {
+            SDL_FreeSurface (surface);
+            decoded = true;
+        }
+    }
+
+    return decoded;
+}
+
+
+static unsigned char *
+fuzz_read (const char *path, size_t *len)
+{
+    FILE *fp;
+    unsigned char *data = NULL;
+    long size;
+
+    fp = fopen (path, "rb");
+    if (fp == NULL)
+        goto fuzz_read_failure_0;
+    if ((fseek (fp, 0, SEEK_END) != 0) || ((size = ftell (fp)) <= 0) ||
+        (fseek (fp, 0, SEEK_SET) != 0))
+        goto fuzz_read_failure_1;
+    data = malloc ((size_t)size);
+    if (data == NULL)
+        goto fuzz_read_failure_1;
+    if (fread (data, 1, (size_t)size, fp) != (size_t)size)
+        goto fuzz_read_failure_2;
+    *len = (size_t)size;
+
+/* fuzz_read_success_0: */
+    fclose (fp);
+    return data;
+
+fuzz_read_failure_2:
+    free (data);
+fuzz_read_failure_1:
+    fclose (fp);
+fuzz_read_failure_0:
+    fprintf (stderr, "%s: could not read\n", path);
+    return (unsigned char *)NULL;
+}
+
+
+/* main program-entry-point */
+int
+main (int argc, char *argv[])
+{
+    unsigned char *data;
+    unsigned char *copy;
+    size_t len;
+    int mutations = 1000;
+    int failed = 0;
+    int i, m, n;
+    int a;
+
+    simd_init ();
+
+    for (i = 0; i < FUZZ_CASES; i++)
+    {
+        if (fuzz_decode (s_cases[i].data, s_cases[i].len))
+        {
+            fprintf (stderr, "%s: decoded\n", s_cases[i].name);
+            failed++;
+        }
+    }
+    printf ("%d of %d known bad files turned down\n", FUZZ_CASES - failed, FUZZ_CASES);
+
+    for (a = 1; a < argc; a++)
+    {
+        if ((strcmp (argv[a], "--mutations") == 0) && (a + 1 < argc))
+        {
+            mutations = atoi (argv[++a]);
+            mutations = SDL_max (mutations, 0);
+            continue;
+        }
+        if ((strcmp (argv[a], "--seed") == 0) && (a + 1 < argc))
+        {
+            s_seed = (uint32_t)strtoul (argv[++a], NULL, 0);
+            s_seed += (s_seed == 0);
+            continue;
+        }
+
+        data = fuzz_read (argv[a], &len);
+        if (data == NULL)
+            continue;
+        copy = malloc (len);
+        if (copy == NULL)
+        {
+            free (data);
+            continue;
+        }
+
+        fuzz_decode (data, len);
+        for (m = 0; m < mutations; m++)
+        {
+            /* a few bytes changed, sometimes cut short */
+            memcpy (copy, data, len);
+            for (n = 1 + (int)(fuzz_random () % 8); n > 0; n--)
+            {
+                copy[fuzz_random () % len] = (unsigned char)fuzz_random ();
+            }
+            fuzz_decode (copy, ((fuzz_random () & 7) == 0) ? fuzz_random () % len : len);
+        }
+        printf ("%s: %d mutations\n", argv[a], mutations);
+
+        free (copy);
+        free (data);
+    }
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* End of File */
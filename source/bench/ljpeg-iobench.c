@@ -0,0 +1,248 @@
+/*
+   source/bench/ljpeg-iobench.c
+   LJPEG file reading benchmark.
+
+   Reads every image in a directory into memory the ways ljpeg can:
+   mapped one at a time, with pread on the io pool, and through
+   io_uring.  With --cold each pass first asks the kernel to drop the
+   files from the page cache (POSIX_FADV_DONTNEED, which leaves pages
+   other processes have mapped alone; for a truly cold run drop the
+   caches as root: sync; echo 3 > /proc/sys/vm/drop_caches).
+
+   usage: ljpeg-iobench [--cold] [--passes N] DIRECTORY
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* posix_fadvise is hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_filelist.h"
+#include "ljpeg_io.h"
+#include "ljpeg_mapfile.h"
+
+
+/* file static variables */
+static filelist     s_files;
+static io_request  *s_requests;
+static SDL_atomic_t s_done;
+static SDL_atomic_t s_failed;
+static Uint64       s_bytes;
+static SDL_atomic_t s_sum;      /* keeps the reads from being optimized out */
+
+
+/* file static function prototypes */
+static void   drop_cache (void);
+static double now_ms (void);
+static void   report (const char *engine, bool cold, double ms);
+static void   bench_mapped (void);
+static void   bench_engine (io_engine *io);
+static void   bench_done (io_request *req);
+
+
+/* static function definitions */
+static void
+drop_cache (void)
+{
+    int fd;
+    int i;
+
+    for (i = 0; i < s_files.count; i++)
+    {
+        fd = open (s_files.paths[i], O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+        close (fd);
+    }
+}
+
+
+static double
+now_ms (void)
+{
+    return (double)SDL_GetPerformanceCounter () * 1000.0 / (double)SDL_GetPerformanceFrequency ();
+}
+
+
+static void
+report (const char *engine, bool cold, double ms)
+{
+    double mib = (double)s_bytes / (1024.0 * 1024.0);
+
+    printf ("%-8s %-4s %6d files %9.1f MiB %9.1f ms %9.1f MiB/s %9.0f files/s %s\n",
+            engine, cold ? "cold" : "warm", s_files.count, mib, ms,
+            mib * 1000.0 / ms, s_files.count * 1000.0 / ms,
+            (SDL_AtomicGet (&s_failed) > 0) ? "(some failed)" : "");
+}
+
+
+/* one file at a time, the way ljpeg did before the io engine */
+static void
+bench_mapped (void)
+{
+    mapped_file map;
+    size_t pos;
+    int sum = 0;
+    int i;
+
+    for (i = 0; i < s_files.count; i++)
+    {
+        if (mapfile_open (&map, s_files.paths[i]) != EXIT_SUCCESS)
+        {
+            SDL_AtomicAdd (&s_failed, 1);
+            continue;
+        }
+        for (pos = 0; pos < map.len; pos += 4096)
+        {
+            sum += map.data[pos];
+        }
+        s_bytes += map.len;
+        mapfile_close (&map);
+    }
+    SDL_AtomicAdd (&s_sum, sum);
+}
+
+
+/* everything submitted at once, like the thumbnail grid does */
+static void
+bench_engine (io_engine *io)
+{
+    int i;
+
+    for (i = 0; i < s_files.count; i++)
+    {
+        memset (&s_requests[i], 0, sizeof (io_request));
+        s_requests[i].path = s_files.paths[i];
+        s_requests[i].done = bench_done;
+        if (io_submit (io, &s_requests[i]) != EXIT_SUCCESS)
+        {
+            SDL_AtomicAdd (&s_failed, 1);
+            SDL_AtomicAdd (&s_done, 1);
+        }
+    }
+
+    while (SDL_AtomicGet (&s_done) < s_files.count)
+    {
+        SDL_Delay (1);
+    }
+
+    for (i = 0; i < s_files.count; i++)
+    {
+        s_bytes += s_requests[i].len;
+        SDL_free (s_requests[i].data);
+    }
+}
+
+
+static void
+bench_done (io_request *req)
+{
+    if (req->error != 0)
+        SDL_AtomicAdd (&s_failed, 1);
+    else
+        SDL_AtomicAdd (&s_sum, req->data[req->len / 2]);
+    SDL_AtomicAdd (&s_done, 1);
+}
+
+
+/* main program-entry-point */
+int
+main (int argc, char *argv[])
+{
+    const char *directory = NULL;
+    bool cold = false;
+    int passes = 3;
+    io_engine io;
+    double start;
+    int engine;
+    int pass;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--cold") == 0)
+            cold = true;
+        else if ((strcmp (argv[i], "--passes") == 0) && (i + 1 < argc))
+            passes = atoi (argv[++i]);
+        else
+            directory = argv[i];
+    }
+    if (directory == NULL)
+    {
+        fprintf (stderr, "usage: %s [--cold] [--passes N] DIRECTORY\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ((filelist_load (&s_files, directory) != EXIT_SUCCESS) || (s_files.count == 0))
+    {
+        fprintf (stderr, "%s: no images found\n", directory);
+        return EXIT_FAILURE;
+    }
+    s_requests = calloc ((size_t)s_files.count, sizeof (io_request));
+    if (s_requests == NULL)
+        return EXIT_FAILURE;
+
+    /* 0: mapped, 1: pread pool, 2: io_uring */
+    for (engine = 0; engine < 3; engine++)
+    {
+        if ((engine > 0) && (io_init (&io, engine == 2) != EXIT_SUCCESS))
+            continue;
+        if ((engine == 2) && (io.ring == NULL))
+        {
+            printf ("io_uring not available\n");
+            io_shutdown (&io);
+            continue;
+        }
+
+        for (pass = 0; pass < passes; pass++)
+        {
+            if (cold)
+                drop_cache ();
+            SDL_AtomicSet (&s_done, 0);
+            SDL_AtomicSet (&s_failed, 0);
+            s_bytes = 0;
+
+            start = now_ms ();
+            if (engine == 0)
+                bench_mapped ();
+            else
+                bench_engine (&io);
+            report ((engine == 0) ? "mmap" : (engine == 1) ? "pread" : "io_uring", cold, now_ms () - start);
+        }
+
+        if (engine > 0)
+            io_shutdown (&io);
+    }
+
+    free (s_requests);
+    filelist_free (&s_files);
+    return (SDL_AtomicGet (&s_sum) == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/* End of File */
@@ -0,0 +1,373 @@
+/*
+   source/bench/ljpeg-jpegbench.c
+   LJPEG built-in jpeg and png decoder benchmark.
+
+   Decodes every jpeg in a directory with libjpeg(-turbo) and every png
+   with SDL_image, then with the built-in decoder once for each vector
+   level the cpu has, and prints the megapixels a second of each next
+   to how far its pixels are from the library's.  Files the built-in
+   decoders turn down (progressive, interlaced and the like) are
+   counted but left out of their timings.
+
+   usage: ljpeg-jpegbench [--passes N] DIRECTORY
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <jpeglib.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_baseline.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_png.h"
+#include "ljpeg_simd.h"
+
+
+/* file static variables */
+typedef struct bench_error
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf               jump;
+} bench_error;
+
+typedef struct bench_result
+{
+    double   ms;
+    double   pixels;
+    int      decoded;
+    int      declined;
+    int      max_diff;
+    uint64_t sum_diff;
+    uint64_t samples;
+} bench_result;
+
+/* a library decoder to time the built-in one against */
+typedef struct bench_format
+{
+    const char   *library_name;
+    bool        (*is_format) (const unsigned char *magic, size_t len);
+    SDL_Surface *(*library) (const unsigned char *data, size_t len);
+    SDL_Surface *(*builtin) (const unsigned char *data, size_t len);
+} bench_format;
+
+#define BENCH_FORMATS 2
+
+
+/* file static function prototypes */
+static double now_ms (void);
+static void   bench_error_exit (j_common_ptr cinfo);
+static SDL_Surface *libjpeg_decode (const unsigned char *data, size_t len);
+static SDL_Surface *sdl_image_decode (const unsigned char *data, size_t len);
+static void   compare (const SDL_Surface *a, const SDL_Surface *b, bench_result *result);
+static void   report (const char *name, const bench_result *result, const bench_result *base);
+
+
+static const bench_format s_formats[BENCH_FORMATS] = {
+    { "libjpeg",   decode_is_jpeg, libjpeg_decode,   baseline_decode },
+    { "SDL_image", decode_is_png,  sdl_image_decode, png_decode },
+};
+
+
+/* static function definitions */
+static double
+now_ms (void)
+{
+    return (double)SDL_GetPerformanceCounter () * 1000.0 / (double)SDL_GetPerformanceFrequency ();
+}
+
+
+static void
+bench_error_exit (j_common_ptr cinfo)
+{
+    longjmp (((bench_error *)cinfo->err)->jump, 1);
+}
+
+
+/* straight libjpeg, default settings, no orientation */
+static SDL_Surface *
+libjpeg_decode (const unsigned char *data, size_t len)
+{
+    struct jpeg_decompress_struct cinfo;
+    bench_error jerr;
+    SDL_Surface *volatile surface = NULL;
+    unsigned char *volatile rgb = NULL;
+    unsigned char *dst;
+    JSAMPROW row;
+#ifndef JCS_EXTENSIONS
+    JDIMENSION x;
+#endif
+
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = bench_error_exit;
+    if (setjmp (jerr.jump))
+    {
+        jpeg_destroy_decompress (&cinfo);
+        SDL_free (rgb);
+        if (surface != NULL)
+            SDL_FreeSurface (surface);
+        return (SDL_Surface *)NULL;
+    }
+
+    jpeg_create_decompress (&cinfo);
+    jpeg_mem_src (&cinfo, (unsigned char *)data, (unsigned long)len);
+    jpeg_read_header (&cinfo, TRUE);
+#ifdef JCS_EXTENSIONS
+    cinfo.out_color_space = JCS_EXT_RGBA;
+#else
+    cinfo.out_color_space = JCS_RGB;
+#endif
+    jpeg_start_decompress (&cinfo);
+
+    surface = SDL_CreateRGBSurfaceWithFormat (0, (int)cinfo.output_width, (int)cinfo.output_height,
+                                              32, DECODE_PIXELFORMAT);
+    rgb = SDL_malloc ((size_t)cinfo.output_width * 3);
+    if ((surface == NULL) || (rgb == NULL))
+        longjmp (jerr.jump, 1);
+
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        dst = (unsigned char *)surface->pixels + (size_t)cinfo.output_scanline * (size_t)surface->pitch;
+#ifdef JCS_EXTENSIONS
+        row = dst;
+        jpeg_read_scanlines (&cinfo, &row, 1);
+#else
+        row = rgb;
+        jpeg_read_scanlines (&cinfo, &row, 1);
+        for (x = 0; x < cinfo.output_width; x++)
+        {
+            dst[x * 4 + 0] = rgb[x * 3 + 0];
+            dst[x * 4 + 1] = rgb[x * 3 + 1];
+            dst[x * 4 + 2] = rgb[x * 3 + 2];
+            dst[x * 4 + 3] = 0xFF;
+        }
+#endif
+    }
+
+    jpeg_finish_decompress (&cinfo);
+    jpeg_destroy_decompress (&cinfo);
+    SDL_free (rgb);
+
+    return surface;
+}
+
+
+/* as the viewer used to load pngs, converted included */
+static SDL_Surface *
+sdl_image_decode (const unsigned char *data, size_t len)
+{
+    SDL_Surface *loaded;
+    SDL_Surface *converted;
+
+    loaded = IMG_Load_RW (SDL_RWFromConstMem (data, (int)len), 1);
+    if ((loaded == NULL) || (loaded->format->format == DECODE_PIXELFORMAT))
+        return loaded;
+
+    converted = SDL_ConvertSurfaceFormat (loaded, DECODE_PIXELFORMAT, 0);
+    SDL_FreeSurface (loaded);
+
+    return converted;
+}
+
+
+static void
+compare (const SDL_Surface *a, const SDL_Surface *b, bench_result *result)
+{
+    const unsigned char *pa, *pb;
+    int diff;
+    int x, y;
+
+    if ((a->w != b->w) || (a->h != b->h))
+    {
+        result->max_diff = 255;
+        return;
+    }
+
+    for (y = 0; y < a->h; y++)
+    {
+        pa = (const unsigned char *)a->pixels + (size_t)y * (size_t)a->pitch;
+        pb = (const unsigned char *)b->pixels + (size_t)y * (size_t)b->pitch;
+        for (x = 0; x < a->w * 4; x++)
+        {
+            diff = abs ((int)pa[x] - (int)pb[x]);
+            result->max_diff = SDL_max (result->max_diff, diff);
+            result->sum_diff += (uint64_t)diff;
+        }
+        result->samples += (uint64_t)a->w * 4;
+    }
+}
+
+
+static void
+report (const char *name, const bench_result *result, const bench_result *base)
+{
+    printf ("%-9s %6d decoded %4d declined %9.1f MP/s", name, result->decoded, result->declined,
+            (result->ms > 0.0) ? result->pixels / 1000.0 / result->ms : 0.0);
+    if (base != NULL)
+    {
+        printf ("  max diff %3d  mean diff %.3f",
+                result->max_diff,
+                (result->samples > 0) ? (double)result->sum_diff / (double)result->samples : 0.0);
+    }
+    printf ("\n");
+}
+
+
+/* main program-entry-point */
+int
+main (int argc, char *argv[])
+{
+    const char *directory = NULL;
+    int passes = 3;
+    filelist files;
+    mapped_file map;
+    SDL_Surface *reference;
+    SDL_Surface *surface;
+    const bench_format *format;
+    bench_result base[BENCH_FORMATS];
+    bench_result results[BENCH_FORMATS][SIMD_LEVEL_COUNT];
+    bool have[SIMD_LEVEL_COUNT];
+    double start, ms;
+    int i, f;
+    int level;
+    int pass;
+    int a;
+
+    for (a = 1; a < argc; a++)
+    {
+        if ((strcmp (argv[a], "--passes") == 0) && (a + 1 < argc))
+        {
+            passes = atoi (argv[++a]);
+            passes = SDL_max (passes, 1);
+        }
+        else
+            directory = argv[a];
+    }
+    if (directory == NULL)
+    {
+        fprintf (stderr, "usage: %s [--passes N] DIRECTORY\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ((filelist_load (&files, directory) != EXIT_SUCCESS) || (files.count == 0))
+    {
+        fprintf (stderr, "%s: no images found\n", directory);
+        return EXIT_FAILURE;
+    }
+
+    memset (base, 0, sizeof (base));
+    memset (results, 0, sizeof (results));
+    for (level = 0; level < SIMD_LEVEL_COUNT; level++)
+    {
+        have[level] = simd_select ((simd_level)level);
+    }
+
+    for (i = 0; i < files.count; i++)
+    {
+        if (mapfile_open (&map, files.paths[i]) != EXIT_SUCCESS)
+            continue;
+        for (f = 0; f < BENCH_FORMATS; f++)
+        {
+            if (s_formats[f].is_format (map.data, map.len))
+                break;
+        }
+        if (f == BENCH_FORMATS)
+        {
+            mapfile_close (&map);
+            continue;
+        }
+        format = &s_formats[f];
+
+        /* best of passes, each way */
+        reference = NULL;
+        ms = 0.0;
+        for (pass = 0; pass < passes; pass++)
+        {
+            if (reference != NULL)
+                SDL_FreeSurface (reference);
+            start = now_ms ();
+            reference = format->library (map.data, map.len);
+            ms = (pass == 0) ? now_ms () - start : SDL_min (ms, now_ms () - start);
+        }
+        if (reference == NULL)
+        {
+            mapfile_close (&map);
+            continue;
+        }
+        base[f].ms += ms;
+        base[f].pixels += (double)reference->w * (double)reference->h;
+        base[f].decoded++;
+
+        for (level = 0; level < SIMD_LEVEL_COUNT; level++)
+        {
+            if (!have[level])
+                continue;
+            simd_select ((simd_level)level);
+
+            surface = NULL;
+            for (pass = 0; pass < passes; pass++)
+            {
+                if (surface != NULL)
+                    SDL_FreeSurface (surface);
+                start = now_ms ();
+                surface = format->builtin (map.data, map.len);
+                ms = (pass == 0) ? now_ms () - start : SDL_min (ms, now_ms () - start);
+            }
+            if (surface == NULL)
+            {
+                results[f][level].declined++;
+                continue;
+            }
+
+            results[f][level].ms += ms;
+            results[f][level].pixels += (double)surface->w * (double)surface->h;
+            results[f][level].decoded++;
+            compare (reference, surface, &results[f][level]);
+            SDL_FreeSurface (surface);
+        }
+
+        SDL_FreeSurface (reference);
+        mapfile_close (&map);
+    }
+
+    for (f = 0; f < BENCH_FORMATS; f++)
+    {
+        if (base[f].decoded == 0)
+            continue;
+        report (s_formats[f].library_name, &base[f], NULL);
+        for (level = 0; level < SIMD_LEVEL_COUNT; level++)
+        {
+            if (have[level])
+                report (simd_name ((simd_level)level), &results[f][level], &base[f]);
+        }
+    }
+
+    filelist_free (&files);
+    return EXIT_SUCCESS;
+}
+
+
+/* End of File */
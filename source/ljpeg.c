@@ -21,9 +21,31 @@
 
 /* include headers */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ljpeg_graphics.h"
 #include "ljpeg_config.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_thumbs.h"
+#include "ljpeg_anim.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_sequence.h"
+#include "ljpeg_stream.h"
+#include "ljpeg_raw.h"
+#include "ljpeg_watch.h"
+#include "ljpeg_io.h"
+#include "ljpeg_probe.h"
+#include "ljpeg_zip.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_memory.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_renderer.h"
+#include "ljpeg_compare.h"
+#include "ljpeg_stats.h"
+#include "ljpeg_hdr.h"
+#include "ljpeg_tiff.h"
+#include "ljpeg_icc.h"
 
 
 /* file static variables */
@@ -33,7 +55,21 @@ enum ARG_INDEX
     INPUT_FILE,
     ARG_COUNT
 };
+enum VIEW_MODE
+{
+    VIEW_IMAGE,
+    VIEW_GRID
+};
 static bool g_runtime_bool;
+static enum VIEW_MODE g_view;
+static bool g_sequence_mode;
+static double g_sequence_fps;
+static bool g_raw_mode;
+static raw_params g_raw_params = { 0, 0, 0, NULL, -1 };
+static probe_order g_grid_order = PROBE_ORDER_NAME;
+static const char *g_renderer = RENDERER;
+static const char *g_compare_path;
+static bool g_decode_stats;
 
 
 /* file static function prototypes */
@@ -41,6 +77,14 @@ static char *get_image_path (int argc, char *argv[]);
 static void key_event (SDL_Event *evt);
 static void mouse_btn_event (SDL_Event *evt);
 static void mouse_wheel_event (SDL_Event *evt);
+static int  grid_open (const char *directory);
+static void grid_open_image (int index);
+static void grid_step_image (int step);
+static void grid_return (void);
+static void grid_sort (void);
+static void grid_key_event (SDL_Event *evt);
+static void grid_mouse_btn_event (SDL_Event *evt);
+static void grid_mouse_wheel_event (SDL_Event *evt);
 
 
 /* main program-entry-point */
@@ -49,13 +93,30 @@ main (int argc, char *argv[])
 {
     int exit_code = EXIT_SUCCESS;
     char *image_path;
+    image_info info;
     SDL_Event evt;
+    int timeout;
+
+    /* decode buffers are reused between images, so SDL has to be
+       pointed at the pools before anything else allocates */
+    arena_install ();
+
+    /* the built-in decoders' kernels, for this cpu */
+    simd_init ();
 
     /* get the image path from console parameters */
     image_path = get_image_path (argc, argv);
+    if (strcmp (g_renderer, "list") == 0)
+    {
+        renderer_list (stdout);
+        goto main_exit_0;
+    }
     if (NULL == image_path)
     {
         fprintf (stderr, "%s: error: no input file\n", argv[EXEC_NAME]);
+        fprintf (stderr, "usage: %s [--max-memory MiB] [--renderer auto|probe|list|NAME] [--fixed|--fullscreen] [--sequence [--fps N]] [--decode-stats] FILE|-\n", argv[EXEC_NAME]);
+        fprintf (stderr, "       %s [--fixed|--fullscreen] --compare OTHER FILE\n", argv[EXEC_NAME]);
+        fprintf (stderr, "       %s --raw WxH [--format rgba] [--stride N] [--notify-fd N] FILE|/shm-name|fd:N\n", argv[EXEC_NAME]);
         exit_code = EXIT_FAILURE;
         goto main_exit_0;
     }
@@ -65,45 +126,136 @@ main (int argc, char *argv[])
     if (exit_code != EXIT_SUCCESS)
         goto main_exit_1;
 
-    exit_code = graphics_init_window ();
+    /* files are read through the io engine, without one they are mapped */
+    io_init (&g_io, IO_USE_URING);
+
+    /* image headers read to sort the grid, without it they are re-read */
+    probe_cache_open (&g_probe);
+
+    /* keep only screen sized images while the system is short */
+    memory_open (&g_memory);
+
+    exit_code = graphics_init_window (g_renderer);
     if (exit_code != EXIT_SUCCESS)
         goto main_exit_2;
 
-    exit_code = graphics_load_texture (image_path);
-    if (exit_code != EXIT_SUCCESS)
-        goto main_exit_3;
+    /* turn images into the display's colours */
+    icc_init (&g_icc, g_win);
 
-    /* set the window size and display the window */
-    SDL_SetWindowSize (g_win, (int)g_img.source.w, (int)g_img.source.h);
-    SDL_ShowWindow (g_win);
+    /* the workers that count each image's pixels for the statistics */
+    stats_init (&g_stats);
+
+    /* and the ones that tone map 16-bit and HDR images */
+    hdr_init (&g_hdr);
 
     /* set the background color for transparent images */
     /* 255 255 255 == White */
     /*   0   0   0 == Black */
     SDL_SetRenderDrawColor (g_rend, BACKGROUND_RED, BACKGROUND_GREEN, BACKGROUND_BLUE, SDL_ALPHA_OPAQUE);
 
+    /* a directory (or zip/cbz) opens as a thumbnail grid, anything else
+       as an image */
+    if (filelist_is_directory (image_path) || zip_is_archive (image_path))
+    {
+        exit_code = grid_open (image_path);
+        if (exit_code != EXIT_SUCCESS)
+            goto main_exit_3;
+    }
+    else
+    {
+        if (g_raw_mode)
+            exit_code = graphics_load_raw (image_path, &g_raw_params);
+        else if (g_compare_path != NULL)
+            exit_code = graphics_load_compare (image_path, g_compare_path);
+        else if (g_sequence_mode)
+            exit_code = graphics_load_sequence (image_path, g_sequence_fps);
+        else if (stream_is_stream (image_path))
+            exit_code = graphics_load_stream (image_path);
+        else
+        {
+            /* size and show the window from the headers alone, so it is
+               up while the image decodes */
+            if (probe_file (image_path, &info) == EXIT_SUCCESS)
+            {
+                /* the decoder turns it upright, turned sideways the
+                   window is too */
+                if (info.orientation >= 5)
+                    graphics_size_window ((int)info.h, (int)info.w);
+                else
+                    graphics_size_window ((int)info.w, (int)info.h);
+                SDL_ShowWindow (g_win);
+                SDL_RenderClear (g_rend);
+                SDL_RenderPresent (g_rend);
+            }
+
+            exit_code = graphics_load_texture (image_path);
+
+            /* pick up changes made to the file while it is open */
+            if (exit_code == EXIT_SUCCESS)
+                watch_open (&g_watch, image_path);
+        }
+        if (exit_code != EXIT_SUCCESS)
+            goto main_exit_3;
+
+        /* set the window size */
+        g_view = VIEW_IMAGE;
+        graphics_size_window ((int)g_img.source.w, (int)g_img.source.h);
+    }
+
+    /* display the window */
+    SDL_ShowWindow (g_win);
+
     /* initial draw */
     SDL_RenderClear (g_rend);
-    graphics_render (g_rend, &g_img);
+    if (g_view == VIEW_GRID)
+        thumbs_render (g_rend, &g_grid);
+    else
+        graphics_render (g_rend, &g_img);
     SDL_RenderPresent (g_rend);
 
     /* start the main runtime loop */
     g_runtime_bool = true;
     while (g_runtime_bool)
     {
-        /* await for an event */
-        if (SDL_WaitEvent (&evt) == 1)
+        /* await for an event, or until the next animation frame is due */
+        timeout = -1;
+        if (g_view == VIEW_IMAGE)
+            timeout = g_seq.active ? sequence_timeout (&g_seq) : anim_timeout (&g_anim);
+        if (SDL_WaitEventTimeout (&evt, timeout) == 1)
         {
             switch (evt.type)
             {
             case SDL_KEYDOWN:
-                key_event (&evt);
+                if (g_view == VIEW_GRID)
+                    grid_key_event (&evt);
+                else
+                    key_event (&evt);
                 break;
             case SDL_MOUSEBUTTONDOWN:
-                mouse_btn_event (&evt);
+                if (g_view == VIEW_GRID)
+                    grid_mouse_btn_event (&evt);
+                else
+                    mouse_btn_event (&evt);
                 break;
             case SDL_MOUSEWHEEL:
-                mouse_wheel_event (&evt);
+                if (g_view == VIEW_GRID)
+                    grid_mouse_wheel_event (&evt);
+                else
+                    mouse_wheel_event (&evt);
+                break;
+            case SDL_MOUSEMOTION:
+                /* dragging pans the image in a fixed viewport */
+                if ((g_view == VIEW_IMAGE) && g_viewport.fixed &&
+                    (evt.motion.state & SDL_BUTTON_LMASK))
+                    graphics_pan (&g_img, evt.motion.xrel, evt.motion.yrel);
+                break;
+            case SDL_WINDOWEVENT:
+                /* moved to a display with another profile, still images
+                   are decoded into its colours again */
+                if ((evt.window.event == SDL_WINDOWEVENT_ICCPROF_CHANGED) &&
+                    icc_update_display (&g_icc) && (g_view == VIEW_IMAGE) &&
+                    (g_watch.path != NULL) && ((g_img.path != NULL) || g_tiff.active))
+                    graphics_reload_texture (g_watch.path);
                 break;
             case SDL_QUIT:
                 g_runtime_bool = false;
@@ -111,9 +263,37 @@ main (int argc, char *argv[])
             }
         }
 
-        /* display the image */
+        /* hand back what can be had again once memory runs short */
+        if (memory_update (&g_memory) && memory_pressure (&g_memory))
+            arena_trim (0);
+
+        /* display the image or the grid */
         SDL_RenderClear (g_rend);
-        graphics_render (g_rend, &g_img);
+        if (g_view == VIEW_GRID)
+        {
+            thumbs_update (&g_grid);
+            thumbs_render (g_rend, &g_grid);
+        }
+        else
+        {
+            anim_update (&g_anim);
+            sequence_update (&g_seq);
+            stream_update (&g_stream);
+            raw_update (&g_raw);
+            hdr_update (&g_hdr);
+            if (watch_update (&g_watch))
+                graphics_reload_texture (g_watch.path);
+            graphics_update_detail (&g_img, memory_pressure (&g_memory));
+            if (g_compare.active)
+            {
+                compare_update (&g_compare, &g_img);
+                compare_render (&g_compare, g_rend, &g_img);
+            }
+            else
+                graphics_render (g_rend, &g_img);
+            stats_update (&g_stats);
+            stats_render (&g_stats, g_rend);
+        }
         SDL_RenderPresent (g_rend);
 
     }
@@ -121,32 +301,111 @@ main (int argc, char *argv[])
 
     /* exit routines */
 /* main_exit_4: */
-    SDL_RWclose (g_img.rwop);
-    SDL_DestroyTexture (g_img.texture);
+    watch_close (&g_watch);
+    thumbs_close (&g_grid);
+    graphics_unload_texture (&g_img);
 main_exit_3:
+    hdr_shutdown (&g_hdr);
+    stats_shutdown (&g_stats);
+    icc_close (&g_icc);
     SDL_DestroyRenderer (g_rend);
     SDL_DestroyWindow (g_win);
 main_exit_2:
+    memory_close (&g_memory);
+    probe_cache_close (&g_probe);
+    io_shutdown (&g_io);
+    IMG_Quit ();
     SDL_Quit ();
 main_exit_1:
+    if (g_decode_stats)
+        decode_print_timing (stderr);
 main_exit_0:
     return (exit_code);
 }
 
 
 /* function definitions */
-/* get the inputted file from the command line arguements */
+/* get the inputted file from the command line arguements, picking up
+   the options on the way */
 static char *
 get_image_path (int argc, char *argv[])
 {
-    /* make sure the user gave an input file */
-    if (argc < INPUT_FILE)
+    char *path = NULL;
+    int i;
+
+    for (i = INPUT_FILE; i < argc; i++)
     {
-        return (char *)NULL;
+        if ((strcmp (argv[i], "-s") == 0) || (strcmp (argv[i], "--sequence") == 0))
+        {
+            /* play the numbered files around the input as a sequence */
+            g_sequence_mode = true;
+        }
+        else if ((strcmp (argv[i], "--fps") == 0) && (i + 1 < argc))
+        {
+            g_sequence_fps = atof (argv[++i]);
+        }
+        else if ((strcmp (argv[i], "--raw") == 0) && (i + 1 < argc))
+        {
+            /* show a producer's pixel buffer as is, eg: --raw 1920x1080 */
+            g_raw_mode = true;
+            if (sscanf (argv[++i], "%dx%d", &g_raw_params.w, &g_raw_params.h) != 2)
+                g_raw_params.w = g_raw_params.h = 0;
+        }
+        else if ((strcmp (argv[i], "--format") == 0) && (i + 1 < argc))
+        {
+            g_raw_params.format = argv[++i];
+        }
+        else if ((strcmp (argv[i], "--stride") == 0) && (i + 1 < argc))
+        {
+            g_raw_params.stride = atoi (argv[++i]);
+        }
+        else if ((strcmp (argv[i], "--notify-fd") == 0) && (i + 1 < argc))
+        {
+            g_raw_params.notify_fd = atoi (argv[++i]);
+        }
+        else if ((strcmp (argv[i], "--compare") == 0) && (i + 1 < argc))
+        {
+            /* show the input file against this one, same size */
+            g_compare_path = argv[++i];
+        }
+        else if ((strcmp (argv[i], "--renderer") == 0) && (i + 1 < argc))
+        {
+            /* auto, probe (time the drivers again), list, or a driver */
+            g_renderer = argv[++i];
+        }
+        else if (strcmp (argv[i], "--fixed") == 0)
+        {
+            /* the window keeps its size, zoom and pan happen inside it */
+            g_viewport.fixed = true;
+        }
+        else if (strcmp (argv[i], "--fullscreen") == 0)
+        {
+            g_viewport.fixed = true;
+            g_viewport.fullscreen = true;
+        }
+        else if (strcmp (argv[i], "--decode-stats") == 0)
+        {
+            /* each decoder's count and time, printed on the way out */
+            g_decode_stats = true;
+        }
+        else if ((strcmp (argv[i], "--max-memory") == 0) && (i + 1 < argc))
+        {
+            /* decoded images and textures together, in MiB */
+            arena_set_limit ((size_t)atol (argv[++i]) * 1024 * 1024);
+        }
+        else if (path == NULL)
+        {
+            /* "-" reads the image from stdin */
+            path = argv[i];
+        }
     }
 
-    /* return first param */
-    return argv[INPUT_FILE];
+    /* nothing named but something piped in, eg: render | ljpeg */
+    if ((path == NULL) && stream_stdin_is_pipe ())
+        path = "-";
+
+    /* NULL when the user gave no input file */
+    return path;
 }
 
 
@@ -165,32 +424,32 @@ key_event (SDL_Event *evt)
     {
         /* Ctrl 1 or Alt 1 */
         /* scale to half size */
-        g_img.scale = SCALE_PRESET_1;
+        graphics_set_scale (&g_img, SCALE_PRESET_1);
     }
     else if (((e.key.keysym.sym == '2') && ((e.key.keysym.mod & (KMOD_CTRL | KMOD_ALT)) != 0)) ||
              ((e.key.keysym.sym == '0') && ((e.key.keysym.mod & KMOD_CTRL) != 0) && ((e.key.keysym.mod & KMOD_ALT) != 0)))
     {
         /* Ctrl 2 or Alt 2 or Ctrl Alt 0 */
         /* scale to original size */
-        g_img.scale = SCALE_PRESET_2;
+        graphics_set_scale (&g_img, SCALE_PRESET_2);
     }
     else if ((e.key.keysym.sym == '3') && ((e.key.keysym.mod & (KMOD_CTRL | KMOD_ALT)) != 0))
     {
         /* Ctrl 3 or Alt 3 */
         /* scale to 2x size */
-        g_img.scale = SCALE_PRESET_3;
+        graphics_set_scale (&g_img, SCALE_PRESET_3);
     }
     else if ((e.key.keysym.sym == '=') && ((e.key.keysym.mod & KMOD_CTRL) != 0))
     {
         /* Ctrl = */
         /* scale the image up */
-        g_img.scale *= 2;
+        graphics_set_scale (&g_img, g_img.scale * 2);
     }
     else if ((e.key.keysym.sym == '-') && ((e.key.keysym.mod & KMOD_CTRL) != 0))
     {
         /* Ctrl - */
         /* scale the image down */
-        g_img.scale /= 2;
+        graphics_set_scale (&g_img, g_img.scale / 2);
     }
     else if (((e.key.keysym.sym == 'r') && ((e.key.keysym.mod & KMOD_SHIFT) != 0)) ||
               (e.key.keysym.sym == SDLK_LEFT))
@@ -210,8 +469,93 @@ key_event (SDL_Event *evt)
     {
         /* a */
         /* reset image to original scale and rotation */
-        g_img.scale = 1.0;
-        g_img.rotation = 0.0;
+        graphics_view_reset (&g_img);
+    }
+    else if (e.key.keysym.sym == SDLK_SPACE)
+    {
+        /* Space */
+        /* pause or resume an animation or sequence */
+        anim_toggle_pause (&g_anim);
+        sequence_toggle_pause (&g_seq);
+    }
+    else if ((e.key.keysym.sym == SDLK_TAB) && g_compare.active)
+    {
+        /* Tab */
+        /* flip between the compared images */
+        compare_toggle (&g_compare, COMPARE_SHOW_B);
+    }
+    else if ((e.key.keysym.sym == 'd') && g_compare.active)
+    {
+        /* d */
+        /* difference heatmap on/off */
+        compare_toggle (&g_compare, COMPARE_SHOW_DIFF);
+    }
+    else if ((e.key.keysym.sym == 'v') && g_compare.active)
+    {
+        /* v */
+        /* split at the cursor, the first image left of it */
+        compare_toggle (&g_compare, COMPARE_SHOW_SPLIT);
+    }
+    else if ((e.key.keysym.sym == '[') && g_hdr.active)
+    {
+        /* [ */
+        /* darken a 16-bit or HDR image */
+        hdr_set_exposure (&g_hdr, g_hdr.exposure - HDR_EXPOSURE_STEP);
+    }
+    else if ((e.key.keysym.sym == ']') && g_hdr.active)
+    {
+        /* ] */
+        /* brighten a 16-bit or HDR image */
+        hdr_set_exposure (&g_hdr, g_hdr.exposure + HDR_EXPOSURE_STEP);
+    }
+    else if (e.key.keysym.sym == 'h')
+    {
+        /* h */
+        /* histogram overlay on/off, the figures go in the title */
+        stats_toggle (&g_stats);
+    }
+    else if ((e.key.keysym.sym == SDLK_PAGEDOWN) && (g_tiff.shown + 1 < g_tiff.page_count))
+    {
+        /* Page Down */
+        /* next page of a multi-page tiff, past the last one the grid's
+           next image */
+        graphics_load_page (g_tiff.shown + 1);
+    }
+    else if ((e.key.keysym.sym == SDLK_PAGEUP) && (g_tiff.shown > 0))
+    {
+        /* Page Up */
+        /* previous page of a multi-page tiff */
+        graphics_load_page (g_tiff.shown - 1);
+    }
+    else if ((e.key.keysym.sym == SDLK_HOME) && (g_tiff.page_count > 1))
+    {
+        /* Home */
+        /* first page */
+        graphics_load_page (0);
+    }
+    else if ((e.key.keysym.sym == SDLK_END) && (g_tiff.page_count > 1))
+    {
+        /* End */
+        /* last page */
+        graphics_load_page (g_tiff.page_count - 1);
+    }
+    else if ((e.key.keysym.sym == SDLK_BACKSPACE) && (g_grid.thumbs != NULL))
+    {
+        /* Backspace */
+        /* back to the thumbnail grid */
+        grid_return ();
+    }
+    else if ((e.key.keysym.sym == SDLK_PAGEDOWN) && (g_grid.thumbs != NULL))
+    {
+        /* Page Down */
+        /* next image in the grid */
+        grid_step_image (1);
+    }
+    else if ((e.key.keysym.sym == SDLK_PAGEUP) && (g_grid.thumbs != NULL))
+    {
+        /* Page Up */
+        /* previous image in the grid */
+        grid_step_image (-1);
     }
 }
 
@@ -231,12 +575,12 @@ mouse_btn_event (SDL_Event *evt)
     {
         /* Left Click (double) */
         /* reset scale to default */
-        g_img.scale = 1.0;
+        graphics_set_scale (&g_img, 1.0);
     }
-    else if (e.button.button == SDL_BUTTON_LEFT)
+    else if ((e.button.button == SDL_BUTTON_LEFT) && !g_viewport.fixed)
     {
         /* Left Click (hold) */
-        /* move window */
+        /* move window, a fixed viewport pans instead */
         graphics_manual_move_window ();
     }
 }
@@ -251,16 +595,242 @@ mouse_wheel_event (SDL_Event *evt)
     {
         /* Scroll Wheel forward */
         /* increase scale by 10% */
-        g_img.scale *= SCROLL_MULTDIV;
+        graphics_set_scale (&g_img, g_img.scale * SCROLL_MULTDIV);
     }
     else if (e.wheel.y < 0)
     {
         /* Scroll Wheel backward */
         /* decrease scale by 10% */
-        g_img.scale /= SCROLL_MULTDIV;
+        graphics_set_scale (&g_img, g_img.scale / SCROLL_MULTDIV);
+    }
+}
+
+
+/* open directory as a thumbnail grid, sized to fit the display */
+static int
+grid_open (const char *directory)
+{
+    SDL_Rect usable;
+    int view_w = GRID_WINDOW_WIDTH;
+    int view_h = GRID_WINDOW_HEIGHT;
+
+    if (SDL_GetDisplayUsableBounds (0, &usable) == 0)
+    {
+        if (view_w > usable.w)
+            view_w = usable.w;
+        if (view_h > usable.h)
+            view_h = usable.h;
+    }
+
+    /* a fixed viewport already has its size */
+    if (g_viewport.fixed && (g_viewport.sized || g_viewport.fullscreen))
+        SDL_GetWindowSize (g_win, &view_w, &view_h);
+
+    if (thumbs_open (&g_grid, directory, view_w, view_h, g_grid_order) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    g_view = VIEW_GRID;
+    graphics_size_window (view_w, view_h);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* switch from the grid to viewing one of its images */
+static void
+grid_open_image (int index)
+{
+    const char *path = thumbs_path (&g_grid, index);
+
+    if (path == NULL)
+        return;
+
+    graphics_unload_texture (&g_img);
+    if (graphics_load_texture (path) != EXIT_SUCCESS)
+        return;
+    watch_open (&g_watch, path);
+
+    g_view = VIEW_IMAGE;
+}
+
+
+/* view the grid's next (or previous) image in place of this one, the
+   selection follows so going back to the grid lands on it */
+static void
+grid_step_image (int step)
+{
+    int index = g_grid.selected + step;
+
+    if ((index < 0) || (index >= g_grid.files.count))
+        return;
+
+    watch_close (&g_watch);
+    thumbs_select (&g_grid, index);
+    grid_open_image (index);
+}
+
+
+/* switch from an image back to the grid it was opened from */
+static void
+grid_return (void)
+{
+    watch_close (&g_watch);
+    graphics_unload_texture (&g_img);
+
+    g_view = VIEW_GRID;
+    graphics_size_window (g_grid.view_w, g_grid.view_h);
+}
+
+
+/* cycle the grid through name, capture date and size order, keeping
+   the same image selected */
+static void
+grid_sort (void)
+{
+    char *directory;
+    char *selected;
+    int i;
+
+    if (g_grid.thumbs == NULL)
+        return;
+    directory = SDL_strdup (g_grid.files.directory);
+    selected = SDL_strdup (g_grid.files.paths[g_grid.selected]);
+    if ((directory == NULL) || (selected == NULL))
+        goto grid_sort_exit_0;
+
+    g_grid_order = (probe_order)((g_grid_order + 1) % PROBE_ORDER_COUNT);
+    thumbs_close (&g_grid);
+    if (grid_open (directory) != EXIT_SUCCESS)
+    {
+        g_runtime_bool = false;
+        goto grid_sort_exit_0;
+    }
+
+    for (i = 0; i < g_grid.files.count; i++)
+    {
+        if (strcmp (g_grid.files.paths[i], selected) == 0)
+            thumbs_select (&g_grid, i);
+    }
+
+grid_sort_exit_0:
+    SDL_free (selected);
+    SDL_free (directory);
+}
+
+
+static void
+grid_key_event (SDL_Event *evt)
+{
+    SDL_Event e = *evt;
+    int page = g_grid.columns * (g_grid.view_h / THUMB_CELL);
+
+    if (e.key.keysym.sym == SDLK_ESCAPE)
+    {
+        /* Escape */
+        /* quit */
+        g_runtime_bool = false;
+    }
+    else if (e.key.keysym.sym == SDLK_RETURN)
+    {
+        /* Enter */
+        /* view the selected image */
+        grid_open_image (g_grid.selected);
+    }
+    else if (e.key.keysym.sym == SDLK_LEFT)
+    {
+        /* Left Arrow */
+        thumbs_select (&g_grid, g_grid.selected - 1);
+    }
+    else if (e.key.keysym.sym == SDLK_RIGHT)
+    {
+        /* Right Arrow */
+        thumbs_select (&g_grid, g_grid.selected + 1);
+    }
+    else if (e.key.keysym.sym == SDLK_UP)
+    {
+        /* Up Arrow */
+        thumbs_select (&g_grid, g_grid.selected - g_grid.columns);
+    }
+    else if (e.key.keysym.sym == SDLK_DOWN)
+    {
+        /* Down Arrow */
+        thumbs_select (&g_grid, g_grid.selected + g_grid.columns);
+    }
+    else if (e.key.keysym.sym == SDLK_PAGEUP)
+    {
+        /* Page Up */
+        thumbs_select (&g_grid, g_grid.selected - page);
+    }
+    else if (e.key.keysym.sym == SDLK_PAGEDOWN)
+    {
+        /* Page Down */
+        thumbs_select (&g_grid, g_grid.selected + page);
+    }
+    else if (e.key.keysym.sym == SDLK_HOME)
+    {
+        /* Home */
+        thumbs_select (&g_grid, 0);
+    }
+    else if (e.key.keysym.sym == SDLK_END)
+    {
+        /* End */
+        thumbs_select (&g_grid, g_grid.files.count - 1);
+    }
+    else if (e.key.keysym.sym == SDLK_s)
+    {
+        /* s */
+        /* sort by name, capture date or size */
+        grid_sort ();
+    }
+}
+
+
+static void
+grid_mouse_btn_event (SDL_Event *evt)
+{
+    SDL_Event e = *evt;
+    int index;
+
+    if (e.button.button == SDL_BUTTON_RIGHT)
+    {
+        /* Right Click */
+        /* quit */
+        g_runtime_bool = false;
+    }
+    else if (e.button.button == SDL_BUTTON_LEFT)
+    {
+        index = thumbs_index_at (&g_grid, e.button.x, e.button.y);
+        if ((index >= 0) && (e.button.clicks == 2))
+        {
+            /* Left Click (double) on a thumbnail */
+            /* view the image */
+            grid_open_image (index);
+        }
+        else if (index >= 0)
+        {
+            /* Left Click on a thumbnail */
+            /* select it */
+            thumbs_select (&g_grid, index);
+        }
+        else
+        {
+            /* Left Click (hold) between thumbnails */
+            /* move window */
+            graphics_manual_move_window ();
+        }
     }
 }
 
 
+static void
+grid_mouse_wheel_event (SDL_Event *evt)
+{
+    SDL_Event e = *evt;
+
+    /* Scroll Wheel */
+    /* scroll by half a row per notch */
+    thumbs_scroll (&g_grid, -e.wheel.y * (THUMB_CELL / 2));
+}
+
 
 /* End of File */
@@ -0,0 +1,487 @@
+/*
+   source/ljpeg_anim.c
+   LJPEG animated image playback source code.
+
+   A decode thread composites frames ahead of time into a bounded ring
+   of surfaces (ANIM_BUDGET_MB), the main thread copies the due frame
+   into one streaming texture.  When the whole animation fits in the
+   ring it is decoded once and kept, otherwise the decode thread keeps
+   looping over the file and frames are decoded again every time round.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_anim.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#ifdef USE_LIBWEBP
+#include <webp/demux.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_graphics.h"
+
+
+/* global variable declarations */
+anim_player g_anim;
+Uint32      g_anim_event = (Uint32)-1;
+
+
+/* file static variables */
+#ifdef USE_LIBWEBP
+typedef struct webp_state
+{
+    WebPAnimDecoder *dec;
+    int              prev_timestamp;
+} webp_state;
+#endif
+
+
+/* file static function prototypes */
+static int  anim_decode_thread (void *data);
+static void anim_wake_main (anim_player *anim);
+#ifdef USE_LIBWEBP
+static int  webp_next (anim_source *src, SDL_Surface *canvas, int *delay_ms);
+static void webp_rewind (anim_source *src, SDL_Surface *canvas);
+static void webp_close (anim_source *src);
+#endif
+
+
+/* static function definitions */
+/* let the main loop know a frame arrived while it was waiting on one */
+static void
+anim_wake_main (anim_player *anim)
+{
+    SDL_Event evt;
+
+    if (SDL_AtomicSet (&anim->starved, 0) == 0)
+        return;
+
+    SDL_zero (evt);
+    evt.type = g_anim_event;
+    SDL_PushEvent (&evt);
+}
+
+
+static int
+anim_decode_thread (void *data)
+{
+    anim_player *anim = (anim_player *)data;
+    SDL_Surface *canvas;
+    anim_frame *slot;
+    int delay_ms;
+    int frame = 0;
+    int y;
+
+    canvas = SDL_CreateRGBSurfaceWithFormat (0, anim->source.w, anim->source.h, 32, DECODE_PIXELFORMAT);
+    if (canvas == NULL)
+        goto anim_decode_thread_exit_0;
+    anim->source.rewind (&anim->source, canvas);
+
+    for (;;)
+    {
+        /* wait for the presenter to free a slot */
+        SDL_LockMutex (anim->lock);
+        while (!anim->quit && !anim->resident && (anim->count == anim->ring_size))
+        {
+            SDL_CondWait (anim->changed, anim->lock);
+        }
+        if (anim->quit || (anim->resident && (anim->produced == anim->ring_size)))
+        {
+            SDL_UnlockMutex (anim->lock);
+            break;
+        }
+        slot = &anim->ring[(anim->head + anim->count) % anim->ring_size];
+        SDL_UnlockMutex (anim->lock);
+
+        /* start over once the last frame is out */
+        if (frame == anim->source.frame_count)
+        {
+            anim->source.rewind (&anim->source, canvas);
+            frame = 0;
+        }
+        if (anim->source.next (&anim->source, canvas, &delay_ms) != EXIT_SUCCESS)
+            break;
+        frame++;
+
+        for (y = 0; y < canvas->h; y++)
+        {
+            memcpy ((unsigned char *)slot->surface->pixels + (size_t)y * (size_t)slot->surface->pitch,
+                    (unsigned char *)canvas->pixels + (size_t)y * (size_t)canvas->pitch,
+                    (size_t)canvas->w * 4);
+        }
+        slot->delay_ms = delay_ms;
+
+        SDL_LockMutex (anim->lock);
+        anim->count++;
+        anim->produced++;
+        SDL_CondBroadcast (anim->changed);
+        SDL_UnlockMutex (anim->lock);
+
+        anim_wake_main (anim);
+    }
+
+    SDL_FreeSurface (canvas);
+
+anim_decode_thread_exit_0:
+    /* a broken file still shows whatever frames made it */
+    SDL_LockMutex (anim->lock);
+    if (!anim->quit && !(anim->resident && (anim->produced == anim->ring_size)))
+        anim->failed = true;
+    SDL_CondBroadcast (anim->changed);
+    SDL_UnlockMutex (anim->lock);
+    anim_wake_main (anim);
+
+    return 0;
+}
+
+
+#ifdef USE_LIBWEBP
+static int
+webp_next (anim_source *src, SDL_Surface *canvas, int *delay_ms)
+{
+    webp_state *st = (webp_state *)src->state;
+    uint8_t *pixels;
+    int timestamp;
+    int y;
+
+    if (!WebPAnimDecoderHasMoreFrames (st->dec) || !WebPAnimDecoderGetNext (st->dec, &pixels, &timestamp))
+        return EXIT_FAILURE;
+
+    /* libwebp composites for us, only the copy is left */
+    for (y = 0; y < src->h; y++)
+    {
+        memcpy ((unsigned char *)canvas->pixels + (size_t)y * (size_t)canvas->pitch,
+                pixels + (size_t)y * (size_t)src->w * 4, (size_t)src->w * 4);
+    }
+
+    /* webp gives end timestamps, not delays */
+    *delay_ms = timestamp - st->prev_timestamp;
+    if (*delay_ms < 10)
+        *delay_ms = 100;
+    st->prev_timestamp = timestamp;
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+webp_rewind (anim_source *src, SDL_Surface *canvas)
+{
+    webp_state *st = (webp_state *)src->state;
+
+    (void)canvas;
+    WebPAnimDecoderReset (st->dec);
+    st->prev_timestamp = 0;
+}
+
+
+static void
+webp_close (anim_source *src)
+{
+    webp_state *st = (webp_state *)src->state;
+
+    if (st != NULL)
+    {
+        WebPAnimDecoderDelete (st->dec);
+        free (st);
+    }
+    src->state = NULL;
+}
+#endif
+
+
+/* function definitions */
+#ifdef USE_LIBWEBP
+int
+webp_anim_open (anim_source *src, const unsigned char *data, size_t len)
+{
+    WebPAnimDecoderOptions options;
+    WebPAnimDecoder *dec;
+    WebPAnimInfo info;
+    WebPData webp_data;
+    webp_state *st;
+
+    if ((len < 12) || (memcmp (data, "RIFF", 4) != 0) || (memcmp (data + 8, "WEBP", 4) != 0))
+        return EXIT_FAILURE;
+
+    WebPAnimDecoderOptionsInit (&options);
+    options.color_mode = MODE_RGBA;
+    options.use_threads = 1;
+    webp_data.bytes = data;
+    webp_data.size = len;
+
+    dec = WebPAnimDecoderNew (&webp_data, &options);
+    if (dec == NULL)
+        return EXIT_FAILURE;
+    st = calloc (1, sizeof (webp_state));
+    if ((st == NULL) || !WebPAnimDecoderGetInfo (dec, &info) || (info.frame_count < 2))
+    {
+        free (st);
+        WebPAnimDecoderDelete (dec);
+        return EXIT_FAILURE;
+    }
+    st->dec = dec;
+
+    src->w = (int)info.canvas_width;
+    src->h = (int)info.canvas_height;
+    src->frame_count = (int)info.frame_count;
+    src->state = st;
+    src->next = webp_next;
+    src->rewind = webp_rewind;
+    src->close = webp_close;
+
+    return EXIT_SUCCESS;
+}
+#endif
+
+
+/* start playing data if it holds an animation (2 frames or more).
+   data is borrowed and has to stay put until anim_close */
+int
+anim_open (anim_player *anim, const unsigned char *data, size_t len)
+{
+    size_t frame_bytes;
+    int i;
+
+    memset (anim, 0, sizeof (anim_player));
+    if (g_anim_event == (Uint32)-1)
+        g_anim_event = SDL_RegisterEvents (1);
+
+    anim->data = data;
+    anim->data_len = len;
+
+    if ((gif_anim_open (&anim->source, anim->data, anim->data_len) != EXIT_SUCCESS) &&
+#ifdef USE_LIBWEBP
+        (webp_anim_open (&anim->source, anim->data, anim->data_len) != EXIT_SUCCESS) &&
+#endif
+        (apng_anim_open (&anim->source, anim->data, anim->data_len) != EXIT_SUCCESS))
+        goto anim_open_failure_0;
+
+    /* as many frames as the budget allows, but always double buffered */
+    frame_bytes = (size_t)anim->source.w * (size_t)anim->source.h * 4;
+    anim->ring_size = (int)(((size_t)ANIM_BUDGET_MB << 20) / frame_bytes);
+    if (anim->ring_size < 2)
+        anim->ring_size = 2;
+    if (anim->ring_size >= anim->source.frame_count)
+    {
+        anim->ring_size = anim->source.frame_count;
+        anim->resident = true;
+    }
+
+    anim->ring = calloc ((size_t)anim->ring_size, sizeof (anim_frame));
+    if (anim->ring == NULL)
+        goto anim_open_failure_2;
+    for (i = 0; i < anim->ring_size; i++)
+    {
+        anim->ring[i].surface = SDL_CreateRGBSurfaceWithFormat (0, anim->source.w, anim->source.h,
+                                                                32, DECODE_PIXELFORMAT);
+        if (anim->ring[i].surface == NULL)
+            goto anim_open_failure_3;
+    }
+
+    anim->texture = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING,
+                                       anim->source.w, anim->source.h);
+    if (anim->texture == NULL)
+        goto anim_open_failure_3;
+    SDL_SetTextureBlendMode (anim->texture, SDL_BLENDMODE_BLEND);
+
+    anim->lock = SDL_CreateMutex ();
+    anim->changed = SDL_CreateCond ();
+    if ((anim->lock == NULL) || (anim->changed == NULL))
+        goto anim_open_failure_4;
+
+    anim->thread = SDL_CreateThread (anim_decode_thread, "ljpeg-anim", anim);
+    if (anim->thread == NULL)
+        goto anim_open_failure_4;
+
+    /* hold the first frame back until it exists, so the window never
+       shows an empty texture */
+    SDL_LockMutex (anim->lock);
+    while ((anim->produced == 0) && !anim->failed)
+    {
+        SDL_CondWait (anim->changed, anim->lock);
+    }
+    SDL_UnlockMutex (anim->lock);
+    anim->active = true;
+
+    /* not a single frame decoded, let the still image loader try */
+    if (anim->produced == 0)
+    {
+        SDL_Texture *texture = anim->texture;
+        anim_close (anim);
+        SDL_DestroyTexture (texture);
+        return EXIT_FAILURE;
+    }
+    anim_update (anim);
+
+/* anim_open_success_0: */
+    return EXIT_SUCCESS;
+
+anim_open_failure_4:
+    if (anim->changed != NULL)
+        SDL_DestroyCond (anim->changed);
+    if (anim->lock != NULL)
+        SDL_DestroyMutex (anim->lock);
+    SDL_DestroyTexture (anim->texture);
+anim_open_failure_3:
+    for (i = 0; i < anim->ring_size; i++)
+    {
+        if (anim->ring[i].surface != NULL)
+            SDL_FreeSurface (anim->ring[i].surface);
+    }
+    free (anim->ring);
+anim_open_failure_2:
+    anim->source.close (&anim->source);
+anim_open_failure_0:
+    memset (anim, 0, sizeof (anim_player));
+    return EXIT_FAILURE;
+}
+
+
+/* stop the decode thread and free the ring.  the texture is owned by
+   whoever displays it (g_img) and is left alone */
+void
+anim_close (anim_player *anim)
+{
+    int i;
+
+    if (!anim->active)
+        return;
+
+    SDL_LockMutex (anim->lock);
+    anim->quit = true;
+    SDL_CondBroadcast (anim->changed);
+    SDL_UnlockMutex (anim->lock);
+    SDL_WaitThread (anim->thread, NULL);
+
+    SDL_DestroyCond (anim->changed);
+    SDL_DestroyMutex (anim->lock);
+    for (i = 0; i < anim->ring_size; i++)
+    {
+        SDL_FreeSurface (anim->ring[i].surface);
+    }
+    free (anim->ring);
+    anim->source.close (&anim->source);
+    memset (anim, 0, sizeof (anim_player));
+}
+
+
+/* upload the next frame once its time has come, timed against the
+   performance counter so delays do not drift.  returns true when the
+   texture changed */
+bool
+anim_update (anim_player *anim)
+{
+    anim_frame *frame;
+    Uint64 now, delay;
+    int index;
+
+    if (!anim->active || anim->paused)
+        return false;
+
+    now = SDL_GetPerformanceCounter ();
+    if ((anim->next_due != 0) && (now < anim->next_due))
+        return false;
+
+    SDL_LockMutex (anim->lock);
+    if (anim->resident)
+    {
+        /* a truncated file loops over the frames it did have */
+        index = anim->shown % (anim->failed ? anim->produced : anim->ring_size);
+        if (index >= anim->produced)
+            goto anim_update_starved_0;
+    }
+    else
+    {
+        if (anim->count == 0)
+            goto anim_update_starved_0;
+        index = anim->head;
+    }
+    frame = &anim->ring[index];
+    SDL_UnlockMutex (anim->lock);
+
+    /* the decode thread never writes a slot that is still queued */
+    SDL_UpdateTexture (anim->texture, NULL, frame->surface->pixels, frame->surface->pitch);
+    delay = (Uint64)frame->delay_ms * SDL_GetPerformanceFrequency () / 1000;
+
+    SDL_LockMutex (anim->lock);
+    if (!anim->resident)
+    {
+        anim->head = (anim->head + 1) % anim->ring_size;
+        anim->count--;
+        SDL_CondBroadcast (anim->changed);
+    }
+    SDL_UnlockMutex (anim->lock);
+    anim->shown++;
+
+    /* stay on the original schedule unless we fell a whole frame behind */
+    if ((anim->next_due == 0) || (now - anim->next_due > delay))
+        anim->next_due = now + delay;
+    else
+        anim->next_due += delay;
+
+    return true;
+
+anim_update_starved_0:
+    /* the decode thread sends g_anim_event when it catches up */
+    SDL_AtomicSet (&anim->starved, 1);
+    SDL_UnlockMutex (anim->lock);
+    return false;
+}
+
+
+/* milliseconds the main loop may sleep before the next frame is due,
+   -1 to wait on events alone */
+int
+anim_timeout (anim_player *anim)
+{
+    Uint64 now;
+    Uint64 ms;
+
+    if (!anim->active || anim->paused || (SDL_AtomicGet (&anim->starved) != 0))
+        return -1;
+
+    now = SDL_GetPerformanceCounter ();
+    if (now >= anim->next_due)
+        return 0;
+
+    /* round up, waking early would only spin */
+    ms = ((anim->next_due - now) * 1000 + SDL_GetPerformanceFrequency () - 1) / SDL_GetPerformanceFrequency ();
+    return (int)ms;
+}
+
+
+void
+anim_toggle_pause (anim_player *anim)
+{
+    if (!anim->active)
+        return;
+
+    anim->paused = !anim->paused;
+    if (!anim->paused)
+        anim->next_due = 0;
+}
+
+
+/* End of File */
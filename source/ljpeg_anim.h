@@ -0,0 +1,110 @@
+/*
+   source/ljpeg_anim.h
+   LJPEG animated image playback header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_ANIM_HEADER__
+#define __LJPEG_ANIM_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+/* a format specific frame decoder, frames are composited onto an rgba
+   canvas of w x h in order, rewind starts over from the first frame */
+typedef struct anim_source
+{
+    int   w, h;
+    int   frame_count;
+    void *state;
+
+    int  (*next)   (struct anim_source *src, SDL_Surface *canvas, int *delay_ms);
+    void (*rewind) (struct anim_source *src, SDL_Surface *canvas);
+    void (*close)  (struct anim_source *src);
+} anim_source;
+
+typedef struct anim_frame
+{
+    SDL_Surface *surface;
+    int          delay_ms;
+} anim_frame;
+
+typedef struct anim_player
+{
+    bool           active;
+    anim_source    source;
+    const unsigned char *data;  /* the whole file, borrowed */
+    size_t         data_len;
+
+    /* frames decoded ahead by the decode thread */
+    anim_frame    *ring;
+    int            ring_size;
+    int            head;
+    int            count;
+    int            produced;
+    bool           resident;    /* the whole animation fits in the ring */
+    bool           failed;
+    bool           quit;
+    SDL_mutex     *lock;
+    SDL_cond      *changed;
+    SDL_Thread    *thread;
+    SDL_atomic_t   starved;
+
+    /* presentation */
+    SDL_Texture   *texture;
+    int            shown;
+    Uint64         next_due;
+    bool           paused;
+} anim_player;
+
+
+/* constants */
+
+
+/* global variables */
+extern anim_player g_anim;
+extern Uint32      g_anim_event;
+
+
+/* external function prototypes */
+int  anim_open  (anim_player *anim, const unsigned char *data, size_t len);
+void anim_close (anim_player *anim);
+
+bool anim_update  (anim_player *anim);
+int  anim_timeout (anim_player *anim);
+void anim_toggle_pause (anim_player *anim);
+
+/* frame sources, see ljpeg_gif.c and ljpeg_apng.c */
+int gif_anim_open  (anim_source *src, const unsigned char *data, size_t len);
+int apng_anim_open (anim_source *src, const unsigned char *data, size_t len);
+#ifdef USE_LIBWEBP
+int webp_anim_open (anim_source *src, const unsigned char *data, size_t len);
+#endif
+
+#endif /* end run once */
+
+
+/* End of File */
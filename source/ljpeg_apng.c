@@ -0,0 +1,514 @@
+/*
+   source/ljpeg_apng.c
+   LJPEG incremental APNG frame source.
+
+   SDL_image only knows about the default image of an APNG, so every
+   frame is rewrapped as a tiny stand-alone PNG (the shared header
+   chunks plus that frame's fdAT data as IDAT) and decoded on its own,
+   by ljpeg_png when it can.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_anim.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_png.h"
+
+
+/* file static variables */
+typedef struct apng_span
+{
+    size_t offset;
+    size_t len;
+} apng_span;
+
+typedef struct apng_frame
+{
+    SDL_Rect rect;
+    int      delay_ms;
+    int      dispose;
+    int      blend;
+    int      first_span;
+    int      span_count;
+} apng_frame;
+
+typedef struct apng_state
+{
+    const unsigned char *data;
+    size_t               len;
+    const unsigned char *ihdr;
+
+    apng_span           *shared;     /* whole chunks replayed into every frame */
+    int                  shared_count;
+    apng_span           *spans;      /* compressed data of every frame */
+    int                  span_count;
+    apng_frame          *frames;
+    int                  frame_count;
+
+    int                  current;
+    int                  prev_dispose;
+    SDL_Rect             prev_rect;
+    unsigned char       *saved;
+
+    unsigned char       *scratch;
+    size_t               scratch_len;
+} apng_state;
+
+static const unsigned char s_png_signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+static uint32_t s_crc_table[256];
+
+
+/* file static function prototypes */
+static uint32_t read_be32 (const unsigned char *p);
+static void     write_be32 (unsigned char *p, uint32_t v);
+static void     png_crc_init (void);
+static uint32_t png_crc (const unsigned char *p, size_t len);
+static bool     apng_add_span (apng_span **spans, int *count, size_t offset, size_t len);
+static unsigned char *apng_put_chunk (unsigned char *out, const char *type, const unsigned char *data, size_t len);
+static SDL_Surface *apng_decode_frame (apng_state *st, const apng_frame *frame);
+static int  apng_next (anim_source *src, SDL_Surface *canvas, int *delay_ms);
+static void apng_rewind (anim_source *src, SDL_Surface *canvas);
+static void apng_close (anim_source *src);
+
+
+/* static function definitions */
+static uint32_t
+read_be32 (const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static void
+write_be32 (unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+
+/* called from apng_anim_open, before the decode thread can use the table */
+static void
+png_crc_init (void)
+{
+    uint32_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++)
+    {
+        c = (uint32_t)n;
+        for (k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        s_crc_table[n] = c;
+    }
+}
+
+
+static uint32_t
+png_crc (const unsigned char *p, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+
+    while (len-- > 0)
+    {
+        crc = s_crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+
+static bool
+apng_add_span (apng_span **spans, int *count, size_t offset, size_t len)
+{
+    apng_span *grown;
+
+    /* grow in steps of 64 */
+    if ((*count % 64) == 0)
+    {
+        grown = realloc (*spans, (size_t)(*count + 64) * sizeof (apng_span));
+        if (grown == NULL)
+            return false;
+        *spans = grown;
+    }
+
+    (*spans)[*count].offset = offset;
+    (*spans)[*count].len = len;
+    (*count)++;
+
+    return true;
+}
+
+
+/* write a complete chunk (length, type, data, crc), returns the end */
+static unsigned char *
+apng_put_chunk (unsigned char *out, const char *type, const unsigned char *data, size_t len)
+{
+    write_be32 (out, (uint32_t)len);
+    memcpy (out + 4, type, 4);
+    if (len > 0)
+        memcpy (out + 8, data, len);
+    write_be32 (out + 8 + len, png_crc (out + 4, len + 4));
+
+    return out + 12 + len;
+}
+
+
+/* rebuild one frame as a plain png and decode it */
+static SDL_Surface *
+apng_decode_frame (apng_state *st, const apng_frame *frame)
+{
+    unsigned char ihdr[13];
+    unsigned char *out, *idat;
+    SDL_Surface *loaded, *converted;
+    size_t needed, idat_len = 0;
+    int i;
+
+    needed = sizeof (s_png_signature) + 25 + 12;
+    for (i = 0; i < st->shared_count; i++)
+    {
+        needed += st->shared[i].len;
+    }
+    for (i = 0; i < frame->span_count; i++)
+    {
+        idat_len += st->spans[frame->first_span + i].len;
+    }
+    needed += idat_len + 12;
+
+    if (needed > st->scratch_len)
+    {
+        free (st->scratch);
+        st->scratch = malloc (needed);
+        st->scratch_len = (st->scratch != NULL) ? needed : 0;
+        if (st->scratch == NULL)
+            return (SDL_Surface *)NULL;
+    }
+
+    out = st->scratch;
+    memcpy (out, s_png_signature, sizeof (s_png_signature));
+    out += sizeof (s_png_signature);
+
+    memcpy (ihdr, st->ihdr, sizeof (ihdr));
+    write_be32 (ihdr + 0, (uint32_t)frame->rect.w);
+    write_be32 (ihdr + 4, (uint32_t)frame->rect.h);
+    out = apng_put_chunk (out, "IHDR", ihdr, sizeof (ihdr));
+
+    for (i = 0; i < st->shared_count; i++)
+    {
+        memcpy (out, st->data + st->shared[i].offset, st->shared[i].len);
+        out += st->shared[i].len;
+    }
+
+    /* the frame's data chunks become a single IDAT */
+    write_be32 (out, (uint32_t)idat_len);
+    memcpy (out + 4, "IDAT", 4);
+    idat = out + 8;
+    for (i = 0; i < frame->span_count; i++)
+    {
+        memcpy (idat, st->data + st->spans[frame->first_span + i].offset, st->spans[frame->first_span + i].len);
+        idat += st->spans[frame->first_span + i].len;
+    }
+    write_be32 (idat, png_crc (out + 4, idat_len + 4));
+    out = idat + 4;
+
+    out = apng_put_chunk (out, "IEND", NULL, 0);
+
+    loaded = NULL;
+#if NATIVE_PNG
+    loaded = png_decode (st->scratch, (size_t)(out - st->scratch));
+#endif
+    if (loaded == NULL)
+        loaded = IMG_Load_RW (SDL_RWFromConstMem (st->scratch, (int)(out - st->scratch)), 1);
+    if (loaded == NULL)
+        return (SDL_Surface *)NULL;
+    if (loaded->format->format == DECODE_PIXELFORMAT)
+        return loaded;
+
+    converted = SDL_ConvertSurfaceFormat (loaded, DECODE_PIXELFORMAT, 0);
+    SDL_FreeSurface (loaded);
+    return converted;
+}
+
+
+static int
+apng_next (anim_source *src, SDL_Surface *canvas, int *delay_ms)
+{
+    apng_state *st = (apng_state *)src->state;
+    const apng_frame *frame;
+    SDL_Surface *pixels;
+    const unsigned char *sp;
+    unsigned char *dp;
+    unsigned int sa, da, oa;
+    int x, y, c;
+
+    if (st->current >= st->frame_count)
+        return EXIT_FAILURE;
+    frame = &st->frames[st->current++];
+
+    /* finish off the previous frame */
+    for (y = 0; (st->prev_dispose != 0) && (y < st->prev_rect.h); y++)
+    {
+        dp = (unsigned char *)canvas->pixels + (size_t)(st->prev_rect.y + y) * (size_t)canvas->pitch + (size_t)st->prev_rect.x * 4;
+        if (st->prev_dispose == 1)
+            memset (dp, 0, (size_t)st->prev_rect.w * 4);
+        else
+            memcpy (dp, st->saved + (size_t)y * (size_t)st->prev_rect.w * 4, (size_t)st->prev_rect.w * 4);
+    }
+
+    pixels = apng_decode_frame (st, frame);
+    if (pixels == NULL)
+        return EXIT_FAILURE;
+
+    if (frame->dispose == 2)
+    {
+        for (y = 0; y < frame->rect.h; y++)
+        {
+            memcpy (st->saved + (size_t)y * (size_t)frame->rect.w * 4,
+                    (unsigned char *)canvas->pixels + (size_t)(frame->rect.y + y) * (size_t)canvas->pitch + (size_t)frame->rect.x * 4,
+                    (size_t)frame->rect.w * 4);
+        }
+    }
+
+    for (y = 0; y < frame->rect.h; y++)
+    {
+        sp = (const unsigned char *)pixels->pixels + (size_t)y * (size_t)pixels->pitch;
+        dp = (unsigned char *)canvas->pixels + (size_t)(frame->rect.y + y) * (size_t)canvas->pitch + (size_t)frame->rect.x * 4;
+        if (frame->blend == 0)
+        {
+            memcpy (dp, sp, (size_t)frame->rect.w * 4);
+            continue;
+        }
+
+        /* APNG_BLEND_OP_OVER, straight alpha */
+        for (x = 0; x < frame->rect.w; x++, sp += 4, dp += 4)
+        {
+            sa = sp[3];
+            if (sa == 0xFF)
+            {
+                memcpy (dp, sp, 4);
+                continue;
+            }
+            if (sa == 0)
+                continue;
+
+            da = dp[3] * (255 - sa) / 255;
+            oa = sa + da;
+            for (c = 0; c < 3; c++)
+            {
+                dp[c] = (unsigned char)((sp[c] * sa + dp[c] * da) / oa);
+            }
+            dp[3] = (unsigned char)oa;
+        }
+    }
+    SDL_FreeSurface (pixels);
+
+    *delay_ms = frame->delay_ms;
+    st->prev_dispose = frame->dispose;
+    st->prev_rect = frame->rect;
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+apng_rewind (anim_source *src, SDL_Surface *canvas)
+{
+    apng_state *st = (apng_state *)src->state;
+    int y;
+
+    for (y = 0; y < src->h; y++)
+    {
+        memset ((unsigned char *)canvas->pixels + (size_t)y * (size_t)canvas->pitch, 0, (size_t)src->w * 4);
+    }
+    st->current = 0;
+    st->prev_dispose = 0;
+}
+
+
+static void
+apng_close (anim_source *src)
+{
+    apng_state *st = (apng_state *)src->state;
+
+    if (st != NULL)
+    {
+        free (st->scratch);
+        free (st->saved);
+        free (st->frames);
+        free (st->spans);
+        free (st->shared);
+        free (st);
+    }
+    src->state = NULL;
+}
+
+
+/* function definitions */
+/* index the chunks of an apng, fails for plain (single image) pngs */
+int
+apng_anim_open (anim_source *src, const unsigned char *data, size_t len)
+{
+    apng_state *st;
+    apng_frame *frame = NULL;
+    const unsigned char *chunk;
+    size_t pos, chunk_len;
+    bool seen_idat = false;
+    bool animated = false;
+    unsigned int num, den;
+
+    if ((len < 8 + 25) || (memcmp (data, s_png_signature, sizeof (s_png_signature)) != 0))
+        return EXIT_FAILURE;
+
+    st = calloc (1, sizeof (apng_state));
+    if (st == NULL)
+        return EXIT_FAILURE;
+    st->data = data;
+    st->len = len;
+
+    for (pos = 8; pos + 12 <= len; pos += chunk_len + 12)
+    {
+        chunk = data + pos;
+        chunk_len = read_be32 (chunk);
+        if (chunk_len > len - pos - 12)
+            break;
+
+        if (memcmp (chunk + 4, "IHDR", 4) == 0)
+        {
+            if (chunk_len != 13)
+                goto apng_anim_open_failure_0;
+            st->ihdr = chunk + 8;
+            src->w = (int)read_be32 (chunk + 8);
+            src->h = (int)read_be32 (chunk + 12);
+        }
+        else if (memcmp (chunk + 4, "acTL", 4) == 0)
+        {
+            animated = true;
+        }
+        else if ((memcmp (chunk + 4, "fcTL", 4) == 0) && (chunk_len >= 26))
+        {
+            if ((st->frame_count % 64) == 0)
+            {
+                apng_frame *grown = realloc (st->frames, (size_t)(st->frame_count + 64) * sizeof (apng_frame));
+                if (grown == NULL)
+                    goto apng_anim_open_failure_0;
+                st->frames = grown;
+            }
+            frame = &st->frames[st->frame_count++];
+            frame->rect.w = (int)read_be32 (chunk + 12);
+            frame->rect.h = (int)read_be32 (chunk + 16);
+            frame->rect.x = (int)read_be32 (chunk + 20);
+            frame->rect.y = (int)read_be32 (chunk + 24);
+            num = (unsigned int)((chunk[28] << 8) | chunk[29]);
+            den = (unsigned int)((chunk[30] << 8) | chunk[31]);
+            frame->delay_ms = (int)(num * 1000 / ((den == 0) ? 100 : den));
+            if (frame->delay_ms < 10)
+                frame->delay_ms = 10;
+            frame->dispose = chunk[32];
+            frame->blend = chunk[33];
+            frame->first_span = st->span_count;
+            frame->span_count = 0;
+
+            /* the first frame can not restore to a previous frame */
+            if ((st->frame_count == 1) && (frame->dispose == 2))
+                frame->dispose = 1;
+        }
+        else if (memcmp (chunk + 4, "IDAT", 4) == 0)
+        {
+            /* without an fcTL first the default image is not a frame */
+            seen_idat = true;
+            if (frame != NULL)
+            {
+                if (!apng_add_span (&st->spans, &st->span_count, pos + 8, chunk_len))
+                    goto apng_anim_open_failure_0;
+                frame->span_count++;
+            }
+        }
+        else if ((memcmp (chunk + 4, "fdAT", 4) == 0) && (chunk_len > 4) && (frame != NULL))
+        {
+            if (!apng_add_span (&st->spans, &st->span_count, pos + 12, chunk_len - 4))
+                goto apng_anim_open_failure_0;
+            frame->span_count++;
+        }
+        else if (memcmp (chunk + 4, "IEND", 4) == 0)
+        {
+            break;
+        }
+        else if (!seen_idat)
+        {
+            /* PLTE, tRNS, gAMA, iCCP, ... apply to every frame */
+            if (!apng_add_span (&st->shared, &st->shared_count, pos, chunk_len + 12))
+                goto apng_anim_open_failure_0;
+        }
+    }
+
+    /* drop frames that are empty or fall outside of the canvas */
+    while ((st->frame_count > 0) && (st->frames[st->frame_count - 1].span_count == 0))
+    {
+        st->frame_count--;
+    }
+    for (num = 0; num < (unsigned int)st->frame_count; num++)
+    {
+        frame = &st->frames[num];
+        if ((frame->rect.x < 0) || (frame->rect.y < 0) || (frame->rect.w <= 0) || (frame->rect.h <= 0) ||
+            (frame->rect.x + frame->rect.w > src->w) || (frame->rect.y + frame->rect.h > src->h))
+            goto apng_anim_open_failure_0;
+    }
+
+    if (!animated || (st->ihdr == NULL) || (st->frame_count < 2))
+        goto apng_anim_open_failure_0;
+    /* the canvas is as big as the header says, which png_decode would
+       turn down past PNG_MAX_PIXELS */
+    if ((src->w <= 0) || (src->h <= 0) || ((uint64_t)src->w * (uint64_t)src->h > PNG_MAX_PIXELS))
+        goto apng_anim_open_failure_0;
+
+    st->saved = malloc ((size_t)src->w * (size_t)src->h * 4);
+    if (st->saved == NULL)
+        goto apng_anim_open_failure_0;
+    png_crc_init ();
+
+    src->frame_count = st->frame_count;
+    src->state = st;
+    src->next = apng_next;
+    src->rewind = apng_rewind;
+    src->close = apng_close;
+
+/* apng_anim_open_success_0: */
+    return EXIT_SUCCESS;
+
+apng_anim_open_failure_0:
+    src->state = st;
+    apng_close (src);
+    return EXIT_FAILURE;
+}
+
+
+/* End of File */
@@ -0,0 +1,565 @@
+/*
+   source/ljpeg_arena.c
+   LJPEG reusable decode memory source code.
+
+   Every image load used to allocate and free its surfaces, file data
+   and decoder scratch memory through malloc, which on a long browse
+   leaves the heap fragmented and the resident size creeping up.  SDL
+   is pointed at these functions instead, and everything of 4KiB and up
+   comes from size classes a quarter of a power of two apart.  Freed
+   buffers go on their class' free list, up to ARENA_RETAIN_MB, so the
+   next image of about the same size gets the same memory back.
+
+   The pools are shared rather than per thread: surfaces are decoded on
+   the workers but freed on the main thread once uploaded.
+
+   libjpeg's memory manager is hooked per decompress object, its small
+   and large requests are bumped out of pooled chunks which go back to
+   the free lists when libjpeg frees the pool.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_arena.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "ljpeg_config.h"
+
+
+/* file static variables */
+#define ARENA_ALIGN     64          /* a cache line, more than any simd load needs */
+#define ARENA_MIN_SHIFT 12          /* smaller requests are not pooled */
+#define ARENA_MAX_SHIFT 28          /* nor are ones over 256MiB */
+#define ARENA_CLASSES   ((ARENA_MAX_SHIFT - ARENA_MIN_SHIFT) * 4 + 1)
+#define ARENA_UNPOOLED  -1
+#define ARENA_FIT_CLASSES 2         /* up to 1.5x the size asked for */
+
+#define ARENA_JPEG_CHUNK (64 * 1024)
+
+/* sits just before every pointer handed out */
+typedef struct arena_block
+{
+    struct arena_block *next;       /* free list link */
+    void               *base;       /* what malloc returned */
+    size_t              size;       /* usable bytes */
+    int                 size_class;
+} arena_block;
+
+/* a run of libjpeg allocations */
+typedef struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t              used;
+    size_t              size;
+} arena_chunk;
+
+#define ARENA_CHUNK_HEADER (((sizeof (arena_chunk) + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN)
+
+static SDL_SpinLock  s_lock;
+static arena_block  *s_free[ARENA_CLASSES];
+static arena_stats   s_stats;
+
+
+/* file static function prototypes */
+static int          arena_class_of (size_t size);
+static size_t       arena_class_size (int size_class);
+static arena_block *arena_header (void *ptr);
+static void        *arena_jpeg_get (j_common_ptr cinfo, int pool_id, size_t size);
+static void         arena_jpeg_release (arena_jpeg *arena, int pool_id);
+static void        *arena_jpeg_alloc (j_common_ptr cinfo, int pool_id, size_t size);
+static JSAMPARRAY   arena_jpeg_alloc_sarray (j_common_ptr cinfo, int pool_id,
+                                             JDIMENSION samplesperrow, JDIMENSION numrows);
+static JBLOCKARRAY  arena_jpeg_alloc_barray (j_common_ptr cinfo, int pool_id,
+                                             JDIMENSION blocksperrow, JDIMENSION numrows);
+static void         arena_jpeg_free_pool (j_common_ptr cinfo, int pool_id);
+static void         arena_jpeg_self_destruct (j_common_ptr cinfo);
+
+
+/* static function definitions */
+/* class 0 is exactly 4KiB, after that each power of two is split in
+   four: 5K 6K 7K 8K, 10K 12K 14K 16K, ... */
+static int
+arena_class_of (size_t size)
+{
+    size_t m;
+    int k;
+    int sub;
+
+    if (size < ((size_t)1 << ARENA_MIN_SHIFT))
+        return ARENA_UNPOOLED;
+    if (size == ((size_t)1 << ARENA_MIN_SHIFT))
+        return 0;
+    if (size > ((size_t)1 << ARENA_MAX_SHIFT))
+        return ARENA_UNPOOLED;
+
+    m = size - 1;
+    for (k = ARENA_MIN_SHIFT; (m >> (k + 1)) != 0; k++)
+        ;
+    sub = (int)((m >> (k - 2)) & 3);
+
+    return (k - ARENA_MIN_SHIFT) * 4 + sub + 1;
+}
+
+
+static size_t
+arena_class_size (int size_class)
+{
+    int k;
+    int sub;
+
+    if (size_class == 0)
+        return (size_t)1 << ARENA_MIN_SHIFT;
+
+    k = (size_class - 1) / 4 + ARENA_MIN_SHIFT;
+    sub = (size_class - 1) % 4;
+
+    return (size_t)(5 + sub) << (k - 2);
+}
+
+
+static arena_block *
+arena_header (void *ptr)
+{
+    return (arena_block *)((unsigned char *)ptr - sizeof (arena_block));
+}
+
+
+/* size bytes from the pool's newest chunk, starting a new one when it
+   is full.  requests bigger than a quarter chunk get a chunk of their
+   own behind the newest, so its leftover space is not given up */
+static void *
+arena_jpeg_get (j_common_ptr cinfo, int pool_id, size_t size)
+{
+    arena_jpeg *arena = (arena_jpeg *)cinfo->client_data;
+    arena_chunk *chunk;
+    arena_chunk *head;
+    size_t need;
+    void *ptr;
+
+    if ((pool_id < 0) || (pool_id >= JPOOL_NUMPOOLS))
+        ERREXIT1 (cinfo, JERR_BAD_POOL_ID, pool_id);
+    if (size > SIZE_MAX - ARENA_CHUNK_HEADER - ARENA_ALIGN)
+        ERREXIT1 (cinfo, JERR_OUT_OF_MEMORY, 1);
+    size = ((size + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN;
+
+    head = arena->chunks[pool_id];
+    chunk = head;
+    if ((chunk == NULL) || (chunk->size - chunk->used < size))
+    {
+        need = ARENA_CHUNK_HEADER + size;
+        if (need < ARENA_JPEG_CHUNK)
+            need = ARENA_JPEG_CHUNK;
+
+        chunk = arena_malloc (need);
+        if (chunk == NULL)
+            ERREXIT1 (cinfo, JERR_OUT_OF_MEMORY, 2);
+        chunk->used = ARENA_CHUNK_HEADER;
+        chunk->size = need;
+
+        if ((head != NULL) && (size > ARENA_JPEG_CHUNK / 4))
+        {
+            chunk->next = head->next;
+            head->next = chunk;
+        }
+        else
+        {
+            chunk->next = head;
+            arena->chunks[pool_id] = chunk;
+        }
+    }
+
+    ptr = (unsigned char *)chunk + chunk->used;
+    chunk->used += size;
+
+    return ptr;
+}
+
+
+static void
+arena_jpeg_release (arena_jpeg *arena, int pool_id)
+{
+    arena_chunk *chunk;
+    arena_chunk *next;
+
+    for (chunk = arena->chunks[pool_id]; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        arena_free (chunk);
+    }
+    arena->chunks[pool_id] = NULL;
+}
+
+
+/* alloc_small and alloc_large, pooled memory needs no far pointers */
+static void *
+arena_jpeg_alloc (j_common_ptr cinfo, int pool_id, size_t size)
+{
+    return arena_jpeg_get (cinfo, pool_id, size);
+}
+
+
+/* rows are padded out to ARENA_ALIGN, libjpeg-turbo's simd routines
+   run past the end of a row to the next boundary */
+static JSAMPARRAY
+arena_jpeg_alloc_sarray (j_common_ptr cinfo, int pool_id,
+                         JDIMENSION samplesperrow, JDIMENSION numrows)
+{
+    JSAMPARRAY result;
+    unsigned char *rows;
+    size_t rowsize;
+    JDIMENSION i;
+
+    rowsize = (size_t)samplesperrow * sizeof (JSAMPLE);
+    rowsize = ((rowsize + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN;
+    if ((numrows != 0) && (rowsize > SIZE_MAX / 2 / numrows))
+        ERREXIT1 (cinfo, JERR_OUT_OF_MEMORY, 3);
+
+    result = arena_jpeg_get (cinfo, pool_id, (size_t)numrows * sizeof (JSAMPROW));
+    rows = arena_jpeg_get (cinfo, pool_id, rowsize * numrows);
+    for (i = 0; i < numrows; i++)
+    {
+        result[i] = (JSAMPROW)(rows + rowsize * i);
+    }
+
+    return result;
+}
+
+
+static JBLOCKARRAY
+arena_jpeg_alloc_barray (j_common_ptr cinfo, int pool_id,
+                         JDIMENSION blocksperrow, JDIMENSION numrows)
+{
+    JBLOCKARRAY result;
+    unsigned char *rows;
+    size_t rowsize;
+    JDIMENSION i;
+
+    rowsize = (size_t)blocksperrow * sizeof (JBLOCK);
+    if ((numrows != 0) && (rowsize > SIZE_MAX / 2 / numrows))
+        ERREXIT1 (cinfo, JERR_OUT_OF_MEMORY, 4);
+
+    result = arena_jpeg_get (cinfo, pool_id, (size_t)numrows * sizeof (JBLOCKROW));
+    rows = arena_jpeg_get (cinfo, pool_id, rowsize * numrows);
+    for (i = 0; i < numrows; i++)
+    {
+        result[i] = (JBLOCKROW)(rows + rowsize * i);
+    }
+
+    return result;
+}
+
+
+/* libjpeg still allocates virtual arrays through its own pools, so
+   both get freed */
+static void
+arena_jpeg_free_pool (j_common_ptr cinfo, int pool_id)
+{
+    arena_jpeg *arena = (arena_jpeg *)cinfo->client_data;
+
+    if ((pool_id < 0) || (pool_id >= JPOOL_NUMPOOLS))
+        ERREXIT1 (cinfo, JERR_BAD_POOL_ID, pool_id);
+
+    arena_jpeg_release (arena, pool_id);
+    (*arena->free_pool) (cinfo, pool_id);
+}
+
+
+static void
+arena_jpeg_self_destruct (j_common_ptr cinfo)
+{
+    arena_jpeg *arena = (arena_jpeg *)cinfo->client_data;
+    int pool_id;
+
+    for (pool_id = JPOOL_NUMPOOLS - 1; pool_id >= JPOOL_PERMANENT; pool_id--)
+    {
+        arena_jpeg_release (arena, pool_id);
+    }
+    (*arena->self_destruct) (cinfo);
+}
+
+
+/* function definitions */
+void *
+arena_malloc (size_t size)
+{
+    arena_block *block = NULL;
+    void *base;
+    uintptr_t user;
+    size_t used;
+    size_t limit;
+    int size_class = arena_class_of (size);
+    int fit;
+
+    if (size_class != ARENA_UNPOOLED)
+        size = arena_class_size (size_class);
+    if (size > SIZE_MAX - sizeof (arena_block) - ARENA_ALIGN)
+        return NULL;
+
+    SDL_AtomicLock (&s_lock);
+    used = s_stats.in_use + s_stats.external;
+    limit = s_stats.limit;
+
+    /* over --max-memory the allocation fails.  small ones are let
+       through, they are SDL's own bookkeeping rather than images */
+    if ((limit != 0) && (size >= ((size_t)1 << ARENA_MIN_SHIFT)) &&
+        ((used > limit) || (size > limit - used)))
+    {
+        SDL_AtomicUnlock (&s_lock);
+        return NULL;
+    }
+
+    /* a slightly bigger free block beats a new one */
+    for (fit = size_class; (size_class != ARENA_UNPOOLED) && (fit < ARENA_CLASSES) &&
+                           (fit <= size_class + ARENA_FIT_CLASSES); fit++)
+    {
+        block = s_free[fit];
+        if (block == NULL)
+            continue;
+        s_free[fit] = block->next;
+        s_stats.retained -= block->size;
+        s_stats.reused++;
+        break;
+    }
+    SDL_AtomicUnlock (&s_lock);
+
+    if (block == NULL)
+    {
+        /* make room from the free lists so the process as a whole stays
+           under the limit too */
+        if ((limit != 0) && (used + size <= limit))
+            arena_trim (limit - used - size);
+
+        base = malloc (size + sizeof (arena_block) + ARENA_ALIGN - 1);
+        if (base == NULL)
+            return NULL;
+
+        user = (uintptr_t)base + sizeof (arena_block);
+        user = (user + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+        block = arena_header ((void *)user);
+        block->base = base;
+        block->size = size;
+        block->size_class = size_class;
+    }
+    block->next = NULL;
+
+    SDL_AtomicLock (&s_lock);
+    if (size_class != ARENA_UNPOOLED)
+        s_stats.allocs++;
+    s_stats.in_use += block->size;
+    if (s_stats.in_use > s_stats.peak)
+        s_stats.peak = s_stats.in_use;
+    SDL_AtomicUnlock (&s_lock);
+
+    return (unsigned char *)block + sizeof (arena_block);
+}
+
+
+void *
+arena_calloc (size_t count, size_t size)
+{
+    void *ptr;
+
+    if ((size != 0) && (count > SIZE_MAX / size))
+        return NULL;
+
+    /* a reused block holds whatever the last image left in it */
+    ptr = arena_malloc (count * size);
+    if (ptr != NULL)
+        memset (ptr, 0, count * size);
+
+    return ptr;
+}
+
+
+void *
+arena_realloc (void *ptr, size_t size)
+{
+    arena_block *block;
+    void *grown;
+
+    if (ptr == NULL)
+        return arena_malloc (size);
+
+    block = arena_header (ptr);
+    if ((size <= block->size) && (size > block->size / 2))
+        return ptr;
+
+    grown = arena_malloc (size);
+    if (grown == NULL)
+        return NULL;
+    memcpy (grown, ptr, (size < block->size) ? size : block->size);
+    arena_free (ptr);
+
+    return grown;
+}
+
+
+void
+arena_free (void *ptr)
+{
+    arena_block *block;
+    size_t retain_max = (size_t)ARENA_RETAIN_MB * 1024 * 1024;
+
+    if (ptr == NULL)
+        return;
+    block = arena_header (ptr);
+
+    SDL_AtomicLock (&s_lock);
+    s_stats.in_use -= block->size;
+    if ((block->size_class != ARENA_UNPOOLED) && (s_stats.retained + block->size <= retain_max))
+    {
+        block->next = s_free[block->size_class];
+        s_free[block->size_class] = block;
+        s_stats.retained += block->size;
+        if (s_stats.retained > s_stats.retained_peak)
+            s_stats.retained_peak = s_stats.retained;
+        block = NULL;
+    }
+    SDL_AtomicUnlock (&s_lock);
+
+    if (block != NULL)
+        free (block->base);
+}
+
+
+/* route SDL_malloc (surfaces, file data, SDL_image) through the pools.
+   has to come before anything else calls into SDL */
+int
+arena_install (void)
+{
+    if (SDL_SetMemoryFunctions (arena_malloc, arena_calloc, arena_realloc, arena_free) != 0)
+    {
+        fprintf (stderr, "arena: %s\n", SDL_GetError ());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* hand held buffers back to the system, biggest first, until no more
+   than keep bytes are held */
+void
+arena_trim (size_t keep)
+{
+    arena_block *released = NULL;
+    arena_block *block;
+    int size_class;
+
+    SDL_AtomicLock (&s_lock);
+    for (size_class = ARENA_CLASSES - 1; size_class >= 0; size_class--)
+    {
+        while ((s_stats.retained > keep) && (s_free[size_class] != NULL))
+        {
+            block = s_free[size_class];
+            s_free[size_class] = block->next;
+            s_stats.retained -= block->size;
+            block->next = released;
+            released = block;
+        }
+    }
+    SDL_AtomicUnlock (&s_lock);
+
+    while (released != NULL)
+    {
+        block = released;
+        released = block->next;
+        free (block->base);
+    }
+}
+
+
+void
+arena_get_stats (arena_stats *stats)
+{
+    SDL_AtomicLock (&s_lock);
+    *stats = s_stats;
+    SDL_AtomicUnlock (&s_lock);
+}
+
+
+/* cap what the pools hand out plus what arena_account was told about,
+   0 for no cap */
+void
+arena_set_limit (size_t limit)
+{
+    SDL_AtomicLock (&s_lock);
+    s_stats.limit = limit;
+    SDL_AtomicUnlock (&s_lock);
+}
+
+
+/* count memory the pools did not hand out against the limit, eg: a
+   texture's pixels.  negative to give it back */
+void
+arena_account (ptrdiff_t bytes)
+{
+    SDL_AtomicLock (&s_lock);
+    if (bytes < 0)
+        s_stats.external -= (size_t)-bytes;
+    else
+        s_stats.external += (size_t)bytes;
+    SDL_AtomicUnlock (&s_lock);
+}
+
+
+/* bytes left under the limit, SIZE_MAX without one */
+size_t
+arena_available (void)
+{
+    size_t used;
+    size_t available = SIZE_MAX;
+
+    SDL_AtomicLock (&s_lock);
+    used = s_stats.in_use + s_stats.external;
+    if (s_stats.limit != 0)
+        available = (used < s_stats.limit) ? s_stats.limit - used : 0;
+    SDL_AtomicUnlock (&s_lock);
+
+    return available;
+}
+
+
+/* take over cinfo's small/large/array allocations, arena has to live
+   until jpeg_destroy.  uses cinfo->client_data */
+void
+arena_jpeg_attach (j_common_ptr cinfo, arena_jpeg *arena)
+{
+    memset (arena, 0, sizeof (arena_jpeg));
+    arena->free_pool = cinfo->mem->free_pool;
+    arena->self_destruct = cinfo->mem->self_destruct;
+
+    cinfo->client_data = arena;
+    cinfo->mem->alloc_small = arena_jpeg_alloc;
+    cinfo->mem->alloc_large = arena_jpeg_alloc;
+    cinfo->mem->alloc_sarray = arena_jpeg_alloc_sarray;
+    cinfo->mem->alloc_barray = arena_jpeg_alloc_barray;
+    cinfo->mem->free_pool = arena_jpeg_free_pool;
+    cinfo->mem->self_destruct = arena_jpeg_self_destruct;
+}
+
+
+/* End of File */
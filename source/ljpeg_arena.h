@@ -0,0 +1,90 @@
+/*
+   source/ljpeg_arena.h
+   LJPEG reusable decode memory header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_ARENA_HEADER__
+#define __LJPEG_ARENA_HEADER__
+
+/* include headers */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include <jpeglib.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+typedef struct arena_stats
+{
+    size_t   in_use;        /* bytes handed out right now */
+    size_t   peak;          /* most in_use has been */
+    size_t   retained;      /* freed bytes held for reuse */
+    size_t   retained_peak;
+    size_t   external;      /* accounted from outside, eg: textures */
+    size_t   limit;         /* in_use + external cap, 0 for none */
+    uint64_t allocs;        /* pooled allocations */
+    uint64_t reused;        /* of those, served from a free list */
+} arena_stats;
+
+struct arena_chunk;
+
+/* one libjpeg decompress object's allocations, bumped out of pooled
+   chunks and given back when libjpeg frees the pool */
+typedef struct arena_jpeg
+{
+    struct arena_chunk *chunks[JPOOL_NUMPOOLS];
+
+    /* libjpeg's own methods, still used for virtual arrays */
+    void (*free_pool)     (j_common_ptr cinfo, int pool_id);
+    void (*self_destruct) (j_common_ptr cinfo);
+} arena_jpeg;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+void *arena_malloc  (size_t size);
+void *arena_calloc  (size_t count, size_t size);
+void *arena_realloc (void *ptr, size_t size);
+void  arena_free    (void *ptr);
+
+int  arena_install (void);
+void arena_trim    (size_t keep);
+void arena_get_stats (arena_stats *stats);
+
+void   arena_set_limit (size_t limit);
+void   arena_account   (ptrdiff_t bytes);
+size_t arena_available (void);
+
+void arena_jpeg_attach (j_common_ptr cinfo, arena_jpeg *arena);
+
+#endif /* end run once */
+
+
+/* End of File */
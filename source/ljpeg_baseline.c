@@ -0,0 +1,760 @@
+/*
+   source/ljpeg_baseline.c
+   LJPEG built-in baseline jpeg decoder source code.
+
+   Decodes the jpegs most cameras and programs write, and nothing else:
+   sequential huffman coded, 8 bit, one scan, greyscale or ycbcr at
+   4:4:4, 4:2:2 or 4:2:0.  Anything else (progressive, arithmetic, 12
+   bit, cmyk, odd sampling, damaged data) returns NULL so the caller can
+   hand the file to libjpeg instead.
+
+   The idct, upsampling and colour conversion are the ljpeg_simd
+   kernels.  Each row of MCUs is decoded into small planes and turned
+   into rgba straight into the surface's rows as soon as the chroma
+   rows around it are known, one row behind for 4:2:0.  Upsampling is
+   libjpeg's "fancy" filter so the results match it to within rounding.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_baseline.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_simd.h"
+
+
+/* file static variables */
+/* codes up to this long are found with one lookup */
+#define HUFF_FAST_BITS 9
+
+typedef struct baseline_huff
+{
+    bool     present;
+    uint16_t fast[1 << HUFF_FAST_BITS]; /* length << 8 | symbol, 0 when longer */
+    int32_t  fast_ac[1 << HUFF_FAST_BITS];  /* ac codes and their value together:
+                                               value + 256 << 8 | run << 4 | length */
+    int32_t  maxcode[17];               /* first code past each length, 16 bit aligned */
+    int32_t  delta[17];                 /* code + delta is the symbol's index */
+    int      count;
+    uint8_t  symbols[256];
+} baseline_huff;
+
+typedef struct baseline_component
+{
+    int      id;
+    int      h, v;          /* sampling factors */
+    int      tq, td, ta;    /* quantization, dc and ac tables */
+    int      pred;          /* last dc value */
+    int      width;         /* samples in the image, after downsampling */
+    int      height;
+    int      stride;
+    uint8_t *plane;         /* one mcu row, after a row carried from the last */
+} baseline_component;
+
+typedef struct bit_reader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t       bits;    /* left aligned */
+    int            count;
+    int            padded;  /* zero bytes fed in past a marker */
+} bit_reader;
+
+typedef struct baseline_jpeg
+{
+    int                width, height;
+    int                ncomp;
+    int                hmax, vmax;
+    int                restart;         /* mcus between restart markers */
+    int                adobe_transform; /* -1 without an APP14 marker */
+    bool               quant_present[4];
+    uint16_t           quant[4][64];    /* natural order */
+    baseline_huff      dc[4];
+    baseline_huff      ac[4];
+    baseline_component comp[3];
+    float              qt[3][64];
+    bit_reader         br;
+} baseline_jpeg;
+
+/* zigzag position to natural order */
+static const uint8_t s_natural[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+
+/* file static function prototypes */
+static unsigned int baseline_get16 (const uint8_t *p);
+static int  baseline_huff_build (baseline_huff *huff, const uint8_t *counts, const uint8_t *symbols);
+static int  baseline_parse      (baseline_jpeg *jpeg, const uint8_t *data, size_t len);
+static int  baseline_frame      (baseline_jpeg *jpeg, const uint8_t *seg, size_t len);
+static int  baseline_scan       (baseline_jpeg *jpeg, const uint8_t *seg, size_t len);
+static void bits_fill   (bit_reader *br);
+static int  bits_decode (bit_reader *br, const baseline_huff *huff);
+static int  bits_get    (bit_reader *br, int n);
+static bool bits_overrun (const bit_reader *br);
+static int  baseline_restart (baseline_jpeg *jpeg);
+static int  baseline_block   (baseline_jpeg *jpeg, baseline_component *comp, const float *qt,
+                              int16_t *coef, uint8_t *out, int stride);
+static void baseline_emit_row (baseline_jpeg *jpeg, SDL_Surface *surface, int y, int mcu_row,
+                               uint8_t *up[2], const uint8_t *neutral);
+
+
+/* static function definitions */
+static unsigned int
+baseline_get16 (const uint8_t *p)
+{
+    return ((unsigned int)p[0] << 8) | p[1];
+}
+
+
+/* counts[i] codes of length i + 1, in canonical order */
+static int
+baseline_huff_build (baseline_huff *huff, const uint8_t *counts, const uint8_t *symbols)
+{
+    int32_t code = 0;
+    int fill, first;
+    int size, value;
+    int k = 0;
+    int l, i, j;
+
+    memset (huff, 0, sizeof (baseline_huff));
+    for (l = 1; l <= 16; l++)
+    {
+        huff->delta[l] = k - code;
+        for (i = 0; i < counts[l - 1]; i++, k++, code++)
+        {
+            /* an over-full length runs out of codes before the table
+               does, and past the end of fast */
+            if ((k >= 256) || (code >= (1 << l)))
+                return EXIT_FAILURE;
+            huff->symbols[k] = symbols[k];
+            if (l <= HUFF_FAST_BITS)
+            {
+                /* every lookup starting with this code */
+                fill = 1 << (HUFF_FAST_BITS - l);
+                first = code << (HUFF_FAST_BITS - l);
+                for (j = 0; j < fill; j++)
+                {
+                    huff->fast[first + j] = (uint16_t)((l << 8) | symbols[k]);
+                }
+            }
+        }
+        huff->maxcode[l] = code << (16 - l);
+        code <<= 1;
+    }
+    huff->count = k;
+    huff->present = true;
+
+    /* most ac coefficients are small, their code and value often fit in
+       one lookup as well */
+    for (i = 0; i < (1 << HUFF_FAST_BITS); i++)
+    {
+        l = huff->fast[i] >> 8;
+        size = huff->fast[i] & 15;
+        if ((l == 0) || (size == 0) || (l + size > HUFF_FAST_BITS))
+            continue;
+        value = (i >> (HUFF_FAST_BITS - l - size)) & ((1 << size) - 1);
+        if (value < (1 << (size - 1)))
+            value += 1 - (1 << size);
+        huff->fast_ac[i] = ((value + 256) << 8) | ((huff->fast[i] & 0xF0) | (l + size));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static int
+baseline_frame (baseline_jpeg *jpeg, const uint8_t *seg, size_t len)
+{
+    baseline_component *comp;
+    int i;
+
+    if ((len < 6) || (seg[0] != 8))
+        return EXIT_FAILURE;
+    jpeg->height = (int)baseline_get16 (seg + 1);
+    jpeg->width = (int)baseline_get16 (seg + 3);
+    jpeg->ncomp = seg[5];
+    if ((jpeg->width == 0) || (jpeg->height == 0) ||
+        ((jpeg->ncomp != 1) && (jpeg->ncomp != 3)) ||
+        (len < 6 + (size_t)jpeg->ncomp * 3))
+        return EXIT_FAILURE;
+
+    jpeg->hmax = jpeg->vmax = 1;
+    for (i = 0; i < jpeg->ncomp; i++)
+    {
+        comp = &jpeg->comp[i];
+        comp->id = seg[6 + i * 3];
+        comp->h = seg[7 + i * 3] >> 4;
+        comp->v = seg[7 + i * 3] & 15;
+        comp->tq = seg[8 + i * 3];
+        if ((comp->tq > 3) || (comp->h < 1) || (comp->v < 1))
+            return EXIT_FAILURE;
+        if (jpeg->ncomp == 1)
+            comp->h = comp->v = 1;   /* one component is never interleaved */
+        jpeg->hmax = SDL_max (jpeg->hmax, comp->h);
+        jpeg->vmax = SDL_max (jpeg->vmax, comp->v);
+    }
+
+    /* 4:4:4, 4:2:2 and 4:2:0 only, chroma at 1x1 */
+    if (jpeg->ncomp == 3)
+    {
+        if ((jpeg->comp[1].h != 1) || (jpeg->comp[1].v != 1) ||
+            (jpeg->comp[2].h != 1) || (jpeg->comp[2].v != 1) ||
+            (jpeg->comp[0].h > 2) || (jpeg->comp[0].v > jpeg->comp[0].h))
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static int
+baseline_scan (baseline_jpeg *jpeg, const uint8_t *seg, size_t len)
+{
+    baseline_component *comp;
+    int ns;
+    int i;
+
+    ns = (len > 0) ? seg[0] : 0;
+    if ((jpeg->ncomp == 0) || (ns != jpeg->ncomp) || (len < 4 + (size_t)ns * 2))
+        return EXIT_FAILURE;
+
+    /* libjpeg takes these for rgb, the APP14 may come after the frame */
+    if ((jpeg->ncomp == 3) &&
+        ((jpeg->adobe_transform == 0) ||
+         ((jpeg->comp[0].id == 'R') && (jpeg->comp[1].id == 'G') && (jpeg->comp[2].id == 'B'))))
+        return EXIT_FAILURE;
+
+    /* blocks come in frame order, a scan naming them differently is
+       left to libjpeg */
+    for (i = 0; i < ns; i++)
+    {
+        comp = &jpeg->comp[i];
+        if (seg[1 + i * 2] != comp->id)
+            return EXIT_FAILURE;
+        comp->td = seg[2 + i * 2] >> 4;
+        comp->ta = seg[2 + i * 2] & 15;
+        if ((comp->td > 3) || (comp->ta > 3) ||
+            !jpeg->dc[comp->td].present || !jpeg->ac[comp->ta].present ||
+            !jpeg->quant_present[comp->tq])
+            return EXIT_FAILURE;
+        simd_idct_table (jpeg->quant[comp->tq], jpeg->qt[i]);
+    }
+
+    /* the whole spectrum, no successive approximation */
+    if ((seg[1 + ns * 2] != 0) || (seg[2 + ns * 2] != 63) || (seg[3 + ns * 2] != 0))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* read the tables and the frame up to the start of the scan, which is
+   left in jpeg->br */
+static int
+baseline_parse (baseline_jpeg *jpeg, const uint8_t *data, size_t len)
+{
+    const uint8_t *p = data + 2;
+    const uint8_t *end = data + len;
+    const uint8_t *seg;
+    size_t seg_len;
+    size_t pos, total;
+    int marker;
+    int id, i;
+
+    jpeg->adobe_transform = -1;
+    for (;;)
+    {
+        /* a marker, after any fill bytes */
+        if ((p >= end) || (*p != 0xFF))
+            return EXIT_FAILURE;
+        while ((p < end) && (*p == 0xFF))
+            p++;
+        if (p + 3 > end)
+            return EXIT_FAILURE;
+        marker = *p++;
+        seg_len = baseline_get16 (p);
+        if ((seg_len < 2) || (seg_len > (size_t)(end - p)))
+            return EXIT_FAILURE;
+        seg = p + 2;
+        seg_len -= 2;
+        p = seg + seg_len;
+
+        switch (marker)
+        {
+        case 0xC0:  /* baseline */
+        case 0xC1:  /* extended sequential, huffman */
+            if ((jpeg->ncomp != 0) || (baseline_frame (jpeg, seg, seg_len) != EXIT_SUCCESS))
+                return EXIT_FAILURE;
+            break;
+
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            /* progressive, lossless, hierarchical or arithmetic */
+            return EXIT_FAILURE;
+
+        case 0xC4:
+            for (pos = 0; pos < seg_len; pos += 17 + total)
+            {
+                if (pos + 17 > seg_len)
+                    return EXIT_FAILURE;
+                id = seg[pos] & 15;
+                for (i = 0, total = 0; i < 16; i++)
+                {
+                    total += seg[pos + 1 + i];
+                }
+                if ((id > 3) || (total > 256) || (pos + 17 + total > seg_len))
+                    return EXIT_FAILURE;
+                if (baseline_huff_build (((seg[pos] >> 4) == 0) ? &jpeg->dc[id] : &jpeg->ac[id],
+                                         seg + pos + 1, seg + pos + 17) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+            }
+            break;
+
+        case 0xDB:
+            for (pos = 0; pos < seg_len; pos += 65)
+            {
+                /* 16 bit tables are for 12 bit images */
+                id = seg[pos] & 15;
+                if ((pos + 65 > seg_len) || ((seg[pos] >> 4) != 0) || (id > 3))
+                    return EXIT_FAILURE;
+                for (i = 0; i < 64; i++)
+                {
+                    jpeg->quant[id][s_natural[i]] = seg[pos + 1 + i];
+                }
+                jpeg->quant_present[id] = true;
+            }
+            break;
+
+        case 0xDD:
+            if (seg_len < 2)
+                return EXIT_FAILURE;
+            jpeg->restart = (int)baseline_get16 (seg);
+            break;
+
+        case 0xEE:
+            if ((seg_len >= 12) && (memcmp (seg, "Adobe", 5) == 0))
+                jpeg->adobe_transform = seg[11];
+            break;
+
+        case 0xDA:
+            if (baseline_scan (jpeg, seg, seg_len) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+            jpeg->br.p = p;
+            jpeg->br.end = end;
+            return EXIT_SUCCESS;
+
+        case 0xD9:
+            return EXIT_FAILURE;
+
+        default:
+            /* APPn, COM, and the rest we have no use for */
+            break;
+        }
+    }
+}
+
+
+/* top up to more than 56 bits, past a marker (or the end) with zeros */
+static void
+bits_fill (bit_reader *br)
+{
+    unsigned int byte;
+
+    while (br->count <= 56)
+    {
+        byte = 0;
+        if ((br->p < br->end) && (br->p[0] != 0xFF))
+        {
+            byte = *br->p++;
+        }
+        else if ((br->p + 1 < br->end) && (br->p[0] == 0xFF) && (br->p[1] == 0x00))
+        {
+            byte = 0xFF;
+            br->p += 2;
+        }
+        else
+        {
+            br->padded++;
+        }
+        br->bits |= (uint64_t)byte << (56 - br->count);
+        br->count += 8;
+    }
+}
+
+
+/* the next symbol, -1 for a code not in the table */
+static int
+bits_decode (bit_reader *br, const baseline_huff *huff)
+{
+    unsigned int peek;
+    int entry, l, index;
+
+    if (br->count < 16)
+        bits_fill (br);
+
+    entry = huff->fast[br->bits >> (64 - HUFF_FAST_BITS)];
+    if (entry != 0)
+    {
+        l = entry >> 8;
+        br->bits <<= l;
+        br->count -= l;
+        return entry & 0xFF;
+    }
+
+    peek = (unsigned int)(br->bits >> 48);
+    for (l = HUFF_FAST_BITS + 1; l <= 16; l++)
+    {
+        if ((int32_t)peek < huff->maxcode[l])
+            break;
+    }
+    if (l > 16)
+        return -1;
+    index = (int)(peek >> (16 - l)) + huff->delta[l];
+    if ((index < 0) || (index >= huff->count))
+        return -1;
+
+    br->bits <<= l;
+    br->count -= l;
+    return huff->symbols[index];
+}
+
+
+/* n (1-16) more bits, sign extended the jpeg way */
+static int
+bits_get (bit_reader *br, int n)
+{
+    int value;
+
+    if (br->count < n)
+        bits_fill (br);
+
+    value = (int)(br->bits >> (64 - n));
+    br->bits <<= n;
+    br->count -= n;
+
+    return (value < (1 << (n - 1))) ? value - (1 << n) + 1 : value;
+}
+
+
+/* true once bits from past the end of the data have been used */
+static bool
+bits_overrun (const bit_reader *br)
+{
+    return br->count < br->padded * 8;
+}
+
+
+/* skip to after the next RSTn marker and start the predictions over */
+static int
+baseline_restart (baseline_jpeg *jpeg)
+{
+    bit_reader *br = &jpeg->br;
+    int i;
+
+    if (bits_overrun (br))
+        return EXIT_FAILURE;
+
+    while ((br->p + 1 < br->end) &&
+           !((br->p[0] == 0xFF) && ((br->p[1] & 0xF8) == 0xD0)))
+    {
+        br->p++;
+    }
+    if (br->p + 1 >= br->end)
+        return EXIT_FAILURE;
+
+    br->p += 2;
+    br->bits = 0;
+    br->count = 0;
+    br->padded = 0;
+    for (i = 0; i < jpeg->ncomp; i++)
+    {
+        jpeg->comp[i].pred = 0;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* decode one 8x8 block of comp into out */
+static int
+baseline_block (baseline_jpeg *jpeg, baseline_component *comp, const float *qt,
+                int16_t *coef, uint8_t *out, int stride)
+{
+    bit_reader *br = &jpeg->br;
+    const baseline_huff *ac = &jpeg->ac[comp->ta];
+    bool dc_only = true;
+    uint8_t flat;
+    long value;
+    int rs, r, s, k;
+
+    s = bits_decode (br, &jpeg->dc[comp->td]);
+    if ((s < 0) || (s > 11))
+        return EXIT_FAILURE;
+    if (s > 0)
+        comp->pred += bits_get (br, s);
+
+    memset (coef, 0, 64 * sizeof (int16_t));
+    coef[0] = (int16_t)comp->pred;
+    for (k = 1; k < 64; k++)
+    {
+        if (br->count < HUFF_FAST_BITS)
+            bits_fill (br);
+        rs = ac->fast_ac[br->bits >> (64 - HUFF_FAST_BITS)];
+        if (rs != 0)
+        {
+            k += (rs >> 4) & 15;
+            if (k > 63)
+                return EXIT_FAILURE;
+            br->bits <<= rs & 15;
+            br->count -= rs & 15;
+            coef[s_natural[k]] = (int16_t)((rs >> 8) - 256);
+            dc_only = false;
+            continue;
+        }
+
+        rs = bits_decode (br, ac);
+        if (rs < 0)
+            return EXIT_FAILURE;
+        r = rs >> 4;
+        s = rs & 15;
+        if (s == 0)
+        {
+            if (r != 15)
+                break;      /* end of block */
+            k += 15;
+            continue;
+        }
+        k += r;
+        if (k > 63)
+            return EXIT_FAILURE;
+        coef[s_natural[k]] = (int16_t)bits_get (br, s);
+        dc_only = false;
+    }
+
+    /* a flat block is its dc value everywhere, which is most of them
+       in smooth areas */
+    if (dc_only)
+    {
+        value = lrintf ((float)coef[0] * qt[0] + 128.0f);
+        flat = (uint8_t)((value < 0) ? 0 : (value > 255) ? 255 : value);
+        for (k = 0; k < 8; k++)
+        {
+            memset (out + k * stride, flat, 8);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    g_simd.idct_8x8 (coef, qt, out, stride);
+    return EXIT_SUCCESS;
+}
+
+
+/* convert image row y, which is in (or just before) mcu row mcu_row */
+static void
+baseline_emit_row (baseline_jpeg *jpeg, SDL_Surface *surface, int y, int mcu_row,
+                   uint8_t *up[2], const uint8_t *neutral)
+{
+    const baseline_component *luma = &jpeg->comp[0];
+    const baseline_component *comp;
+    const uint8_t *yrow;
+    const uint8_t *near;
+    const uint8_t *chroma[2];
+    uint8_t *dst;
+    int cy, far;
+    int i;
+
+    dst = (uint8_t *)surface->pixels + (size_t)y * (size_t)surface->pitch;
+    yrow = luma->plane + (size_t)(y - mcu_row * jpeg->vmax * 8 + 1) * (size_t)luma->stride;
+
+    /* greyscale is ycbcr with nothing in the chroma */
+    if (jpeg->ncomp == 1)
+    {
+        g_simd.ycc_to_rgba (yrow, neutral, neutral, dst, jpeg->width);
+        return;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        comp = &jpeg->comp[i + 1];
+        cy = y / jpeg->vmax;
+        near = comp->plane + (size_t)(cy - mcu_row * 8 + 1) * (size_t)comp->stride;
+        chroma[i] = near;
+
+        if (jpeg->vmax == 2)
+        {
+            /* the other chroma row nearest this one, the edges repeat */
+            far = (y & 1) ? cy + 1 : cy - 1;
+            far = SDL_max (0, SDL_min (far, comp->height - 1));
+            g_simd.upsample_h2v2 (near, comp->plane + (size_t)(far - mcu_row * 8 + 1) * (size_t)comp->stride,
+                                  up[i], comp->width);
+            chroma[i] = up[i];
+        }
+        else if (jpeg->hmax == 2)
+        {
+            g_simd.upsample_h2v1 (near, up[i], comp->width);
+            chroma[i] = up[i];
+        }
+    }
+
+    g_simd.ycc_to_rgba (yrow, chroma[0], chroma[1], dst, jpeg->width);
+}
+
+
+/* function definitions */
+/* decode a baseline jpeg to a DECODE_PIXELFORMAT surface, NULL when it
+   is not one this decoder handles */
+SDL_Surface *
+baseline_decode (const unsigned char *data, size_t len)
+{
+    baseline_jpeg *jpeg;
+    baseline_component *comp;
+    SDL_Surface *surface = NULL;
+    uint8_t *buffer = NULL;
+    uint8_t *up[2];
+    uint8_t *neutral;
+    int16_t coef[64];
+    size_t size;
+    int mcu_w, mcu_h, mcus_x, mcus_y;
+    int mx, my, bx, by;
+    int todo;
+    int row, last;
+    int i;
+
+    if ((len < 4) || (data[0] != 0xFF) || (data[1] != 0xD8))
+        return (SDL_Surface *)NULL;
+
+    jpeg = SDL_calloc (1, sizeof (baseline_jpeg));
+    if (jpeg == NULL)
+        return (SDL_Surface *)NULL;
+    if (baseline_parse (jpeg, data, len) != EXIT_SUCCESS)
+        goto baseline_decode_failure_0;
+
+    mcu_w = jpeg->hmax * 8;
+    mcu_h = jpeg->vmax * 8;
+    mcus_x = (jpeg->width + mcu_w - 1) / mcu_w;
+    mcus_y = (jpeg->height + mcu_h - 1) / mcu_h;
+
+    /* one mcu row of each component plus the carried row, the
+       upsampled chroma rows and a neutral one for greyscale */
+    size = 0;
+    for (i = 0; i < jpeg->ncomp; i++)
+    {
+        comp = &jpeg->comp[i];
+        comp->width = (jpeg->width * comp->h + jpeg->hmax - 1) / jpeg->hmax;
+        comp->height = (jpeg->height * comp->v + jpeg->vmax - 1) / jpeg->vmax;
+        comp->stride = mcus_x * comp->h * 8;
+        size += (size_t)comp->stride * (size_t)(comp->v * 8 + 1);
+    }
+    size += (size_t)mcus_x * mcu_w * 3;
+    buffer = SDL_malloc (size);
+    surface = SDL_CreateRGBSurfaceWithFormat (0, jpeg->width, jpeg->height, 32, DECODE_PIXELFORMAT);
+    if ((buffer == NULL) || (surface == NULL))
+        goto baseline_decode_failure_1;
+
+    size = 0;
+    for (i = 0; i < jpeg->ncomp; i++)
+    {
+        comp = &jpeg->comp[i];
+        comp->plane = buffer + size;
+        size += (size_t)comp->stride * (size_t)(comp->v * 8 + 1);
+    }
+    up[0] = buffer + size;
+    up[1] = up[0] + (size_t)mcus_x * mcu_w;
+    neutral = up[1] + (size_t)mcus_x * mcu_w;
+    memset (neutral, 128, (size_t)mcus_x * mcu_w);
+
+    row = 0;
+    todo = jpeg->restart;
+    for (my = 0; my < mcus_y; my++)
+    {
+        for (mx = 0; mx < mcus_x; mx++)
+        {
+            if ((jpeg->restart > 0) && (todo-- == 0))
+            {
+                if (baseline_restart (jpeg) != EXIT_SUCCESS)
+                    goto baseline_decode_failure_1;
+                todo = jpeg->restart - 1;
+            }
+
+            for (i = 0; i < jpeg->ncomp; i++)
+            {
+                comp = &jpeg->comp[i];
+                for (by = 0; by < comp->v; by++)
+                {
+                    for (bx = 0; bx < comp->h; bx++)
+                    {
+                        if (baseline_block (jpeg, comp, jpeg->qt[i], coef,
+                                            comp->plane + (size_t)(by * 8 + 1) * (size_t)comp->stride
+                                                        + (size_t)(mx * comp->h + bx) * 8,
+                                            comp->stride) != EXIT_SUCCESS)
+                            goto baseline_decode_failure_1;
+                    }
+                }
+            }
+        }
+
+        /* every row whose chroma neighbours are in, the last row of
+           this mcu row may need the first chroma row of the next */
+        last = (my + 1 == mcus_y) ? jpeg->height : SDL_min (jpeg->height, (my + 1) * mcu_h - 1);
+        for (; row < last; row++)
+        {
+            baseline_emit_row (jpeg, surface, row, my, up, neutral);
+        }
+
+        for (i = 0; i < jpeg->ncomp; i++)
+        {
+            comp = &jpeg->comp[i];
+            memcpy (comp->plane, comp->plane + (size_t)(comp->v * 8) * (size_t)comp->stride,
+                    (size_t)comp->stride);
+        }
+    }
+
+    /* truncated data, let libjpeg decide what to make of it */
+    if (bits_overrun (&jpeg->br))
+        goto baseline_decode_failure_1;
+
+/* baseline_decode_success_0: */
+    SDL_free (buffer);
+    SDL_free (jpeg);
+    return surface;
+
+baseline_decode_failure_1:
+    if (surface != NULL)
+        SDL_FreeSurface (surface);
+    SDL_free (buffer);
+baseline_decode_failure_0:
+    SDL_free (jpeg);
+    return (SDL_Surface *)NULL;
+}
+
+
+/* End of File */
@@ -0,0 +1,635 @@
+/*
+   source/ljpeg_cache.c
+   LJPEG persistent thumbnail cache source code.
+
+   Thumbnails live in fixed size slots of one sparse data file under
+   $XDG_CACHE_HOME/ljpeg, which is mapped once, so a cache hit is handed
+   out as a surface pointing straight into the mapping.  A small index
+   file describes the slots and is read with a single fread at startup.
+   Each slot also starts with its own key, so a stale index (eg: after a
+   crash) can never show the wrong image.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* realpath, mmap and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_cache.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_zip.h"
+
+
+/* file static variables */
+typedef struct cache_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t thumb_size;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t clock;
+} cache_header;
+
+/* stored at the start of every slot in the data file */
+typedef struct cache_slot_header
+{
+    cache_key key;
+    uint32_t  w, h;
+} cache_slot_header;
+
+static const char s_cache_magic[8] = { 'L', 'J', 'P', 'G', 'T', 'H', 'M', 'B' };
+#define CACHE_VERSION 2
+
+
+/* file static function prototypes */
+static int   table_find   (thumb_cache *cache, uint64_t hash);
+static void  table_insert (thumb_cache *cache, int slot);
+static void  table_remove (thumb_cache *cache, int slot);
+static int   cache_take_slot (thumb_cache *cache);
+static void  cache_load_index (thumb_cache *cache);
+static void  cache_save_index (thumb_cache *cache);
+
+
+/* static function definitions */
+static int
+table_find (thumb_cache *cache, uint64_t hash)
+{
+    int mask = cache->table_size - 1;
+    int i = (int)(hash & (uint64_t)mask);
+
+    while (cache->table[i] >= 0)
+    {
+        if (cache->entries[cache->table[i]].key.hash == hash)
+            return cache->table[i];
+        i = (i + 1) & mask;
+    }
+
+    return -1;
+}
+
+
+static void
+table_insert (thumb_cache *cache, int slot)
+{
+    int mask = cache->table_size - 1;
+    int i = (int)(cache->entries[slot].key.hash & (uint64_t)mask);
+
+    while (cache->table[i] >= 0)
+    {
+        i = (i + 1) & mask;
+    }
+    cache->table[i] = slot;
+}
+
+
+/* linear probing removal, shifting later members of the cluster back */
+static void
+table_remove (thumb_cache *cache, int slot)
+{
+    int mask = cache->table_size - 1;
+    int hole, i, home;
+
+    hole = (int)(cache->entries[slot].key.hash & (uint64_t)mask);
+    while (cache->table[hole] != slot)
+    {
+        if (cache->table[hole] < 0)
+            return;
+        hole = (hole + 1) & mask;
+    }
+    cache->table[hole] = -1;
+
+    i = hole;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (cache->table[i] < 0)
+            break;
+
+        home = (int)(cache->entries[cache->table[i]].key.hash & (uint64_t)mask);
+        if (((i > hole) && ((home <= hole) || (home > i))) ||
+            ((i < hole) && ((home <= hole) && (home > i))))
+        {
+            cache->table[hole] = cache->table[i];
+            cache->table[i] = -1;
+            hole = i;
+        }
+    }
+}
+
+
+/* a free slot, or the least recently used one that nobody is reading.
+   cache must be locked.  returns -1 when every slot is pinned */
+static int
+cache_take_slot (thumb_cache *cache)
+{
+    int victim = -1;
+    int slot;
+
+    for (slot = 0; slot < cache->slot_count; slot++)
+    {
+        if (cache->pins[slot] > 0)
+            continue;
+        if (cache->entries[slot].used == 0)
+            return slot;
+        if ((victim < 0) || (cache->entries[slot].used < cache->entries[victim].used))
+            victim = slot;
+    }
+
+    if (victim >= 0)
+    {
+        table_remove (cache, victim);
+        memset (&cache->entries[victim], 0, sizeof (cache_entry));
+    }
+
+    return victim;
+}
+
+
+/* read the whole index in one go, anything that does not match the
+   current layout is ignored and the cache starts empty */
+static void
+cache_load_index (thumb_cache *cache)
+{
+    cache_header header;
+    unsigned char *buffer;
+    size_t expected;
+    FILE *fp;
+
+    expected = sizeof (cache_header) + (size_t)cache->slot_count * sizeof (cache_entry);
+
+    fp = fopen (cache->index_path, "rb");
+    if (fp == NULL)
+        return;
+
+    buffer = malloc (expected);
+    if (buffer == NULL)
+    {
+        fclose (fp);
+        return;
+    }
+
+    if (fread (buffer, 1, expected, fp) == expected)
+    {
+        memcpy (&header, buffer, sizeof (cache_header));
+        if ((memcmp (header.magic, s_cache_magic, sizeof (s_cache_magic)) == 0) &&
+            (header.version == CACHE_VERSION) &&
+            (header.thumb_size == (uint32_t)cache->thumb_size) &&
+            (header.slot_count == (uint32_t)cache->slot_count) &&
+            (header.slot_size == (uint32_t)cache->slot_size))
+        {
+            memcpy (cache->entries, buffer + sizeof (cache_header),
+                    (size_t)cache->slot_count * sizeof (cache_entry));
+            cache->clock = header.clock;
+        }
+    }
+
+    free (buffer);
+    fclose (fp);
+}
+
+
+/* write the index next to the old one and swap it in */
+static void
+cache_save_index (thumb_cache *cache)
+{
+    cache_header header;
+    char *tmp_path;
+    size_t len;
+    FILE *fp;
+    bool ok;
+
+    len = strlen (cache->index_path) + sizeof (".tmp");
+    tmp_path = malloc (len);
+    if (tmp_path == NULL)
+        return;
+    snprintf (tmp_path, len, "%s.tmp", cache->index_path);
+
+    memset (&header, 0, sizeof (cache_header));
+    memcpy (header.magic, s_cache_magic, sizeof (s_cache_magic));
+    header.version = CACHE_VERSION;
+    header.thumb_size = (uint32_t)cache->thumb_size;
+    header.slot_count = (uint32_t)cache->slot_count;
+    header.slot_size = (uint32_t)cache->slot_size;
+    header.clock = cache->clock;
+
+    fp = fopen (tmp_path, "wb");
+    if (fp == NULL)
+    {
+        free (tmp_path);
+        return;
+    }
+    ok = (fwrite (&header, sizeof (cache_header), 1, fp) == 1) &&
+         (fwrite (cache->entries, sizeof (cache_entry), (size_t)cache->slot_count, fp) == (size_t)cache->slot_count);
+    ok = (fclose (fp) == 0) && ok;
+
+    if (!ok || (rename (tmp_path, cache->index_path) != 0))
+        remove (tmp_path);
+    free (tmp_path);
+}
+
+
+/* function definitions */
+/* $XDG_CACHE_HOME/ljpeg, falling back to ~/.cache/ljpeg, created if needed */
+char *
+cache_directory (void)
+{
+    const char *base = getenv ("XDG_CACHE_HOME");
+    const char *home = getenv ("HOME");
+    char *path;
+    size_t len;
+
+    if ((base != NULL) && (base[0] != '\0'))
+    {
+        len = strlen (base) + sizeof ("/ljpeg");
+        path = malloc (len);
+        if (path == NULL)
+            return (char *)NULL;
+        snprintf (path, len, "%s", base);
+    }
+    else if ((home != NULL) && (home[0] != '\0'))
+    {
+        len = strlen (home) + sizeof ("/.cache/ljpeg");
+        path = malloc (len);
+        if (path == NULL)
+            return (char *)NULL;
+        snprintf (path, len, "%s/.cache", home);
+    }
+    else
+    {
+        return (char *)NULL;
+    }
+
+    mkdir (path, 0700);
+    strcat (path, "/ljpeg");
+    if ((mkdir (path, 0700) != 0) && (errno != EEXIST))
+    {
+        perror (path);
+        free (path);
+        return (char *)NULL;
+    }
+
+    return path;
+}
+
+
+/* open (or create) the cache for thumbnails of thumb_size squared.
+   on failure the cache is left disabled and every lookup misses */
+int
+cache_open (thumb_cache *cache, int thumb_size)
+{
+#ifdef _WIN32
+    memset (cache, 0, sizeof (thumb_cache));
+    (void)thumb_size;
+    return EXIT_FAILURE;
+#else
+    char *directory;
+    struct stat st;
+    size_t len;
+    int slot;
+
+    memset (cache, 0, sizeof (thumb_cache));
+    cache->thumb_size = thumb_size;
+    cache->data_fd = -1;
+
+    directory = cache_directory ();
+    if (directory == NULL)
+        goto cache_open_failure_0;
+
+    len = strlen (directory) + 32;
+    cache->index_path = malloc (len);
+    cache->data_path = malloc (len);
+    if ((cache->index_path == NULL) || (cache->data_path == NULL))
+        goto cache_open_failure_1;
+    snprintf (cache->index_path, len, "%s/thumbs-%d.index", directory, thumb_size);
+    snprintf (cache->data_path, len, "%s/thumbs-%d.data", directory, thumb_size);
+
+    /* page aligned slots big enough for a full thumbnail and its header */
+    cache->slot_size = sizeof (cache_slot_header) + (size_t)thumb_size * (size_t)thumb_size * 4;
+    cache->slot_size = (cache->slot_size + 4095) & ~(size_t)4095;
+    cache->slot_count = (int)(((size_t)THUMB_CACHE_MAX_MB << 20) / cache->slot_size);
+    if (cache->slot_count < 1)
+        goto cache_open_failure_1;
+
+    cache->table_size = 1;
+    while (cache->table_size < cache->slot_count * 2)
+    {
+        cache->table_size *= 2;
+    }
+
+    cache->entries = calloc ((size_t)cache->slot_count, sizeof (cache_entry));
+    cache->pins = calloc ((size_t)cache->slot_count, sizeof (int));
+    cache->table = malloc ((size_t)cache->table_size * sizeof (int));
+    if ((cache->entries == NULL) || (cache->pins == NULL) || (cache->table == NULL))
+        goto cache_open_failure_1;
+    memset (cache->table, 0xFF, (size_t)cache->table_size * sizeof (int));
+
+    cache->lock = SDL_CreateMutex ();
+    if (cache->lock == NULL)
+        goto cache_open_failure_1;
+
+    cache_load_index (cache);
+
+    /* the data file is sparse, unused slot tails never reach the disk */
+    cache->data_len = (size_t)cache->slot_count * cache->slot_size;
+    cache->data_fd = open (cache->data_path, O_RDWR | O_CREAT, 0600);
+    if ((cache->data_fd < 0) || (fstat (cache->data_fd, &st) != 0))
+    {
+        perror (cache->data_path);
+        goto cache_open_failure_2;
+    }
+    if ((size_t)st.st_size != cache->data_len)
+    {
+        memset (cache->entries, 0, (size_t)cache->slot_count * sizeof (cache_entry));
+        if ((ftruncate (cache->data_fd, 0) != 0) ||
+            (ftruncate (cache->data_fd, (off_t)cache->data_len) != 0))
+        {
+            perror (cache->data_path);
+            goto cache_open_failure_2;
+        }
+    }
+
+    cache->data = mmap (NULL, cache->data_len, PROT_READ | PROT_WRITE, MAP_SHARED, cache->data_fd, 0);
+    if (cache->data == MAP_FAILED)
+    {
+        perror (cache->data_path);
+        cache->data = NULL;
+        goto cache_open_failure_2;
+    }
+
+    for (slot = 0; slot < cache->slot_count; slot++)
+    {
+        if (cache->entries[slot].used != 0)
+            table_insert (cache, slot);
+    }
+
+    free (directory);
+    cache->enabled = true;
+
+/* cache_open_success_0: */
+    return EXIT_SUCCESS;
+
+cache_open_failure_2:
+    if (cache->data_fd >= 0)
+        close (cache->data_fd);
+    SDL_DestroyMutex (cache->lock);
+cache_open_failure_1:
+    free (cache->table);
+    free (cache->pins);
+    free (cache->entries);
+    free (cache->data_path);
+    free (cache->index_path);
+    free (directory);
+cache_open_failure_0:
+    memset (cache, 0, sizeof (thumb_cache));
+    return EXIT_FAILURE;
+#endif
+}
+
+
+void
+cache_close (thumb_cache *cache)
+{
+#ifndef _WIN32
+    if (!cache->enabled)
+        return;
+
+    cache_save_index (cache);
+
+    munmap (cache->data, cache->data_len);
+    close (cache->data_fd);
+    SDL_DestroyMutex (cache->lock);
+    free (cache->table);
+    free (cache->pins);
+    free (cache->entries);
+    free (cache->data_path);
+    free (cache->index_path);
+    memset (cache, 0, sizeof (thumb_cache));
+#else
+    (void)cache;
+#endif
+}
+
+
+/* build the key for the current contents of path */
+bool
+cache_key_for (const char *path, cache_key *key)
+{
+#ifndef _WIN32
+    char resolved[PATH_MAX];
+    const unsigned char *c;
+    struct stat st;
+    uint64_t hash = 14695981039346656037ULL;
+    zip_archive *zip;
+    int index;
+    bool found;
+
+    if (zip_find (path, &zip, &index))
+    {
+        found = zip_key (zip, index, key);
+        zip_close (zip);
+        return found;
+    }
+
+    if ((stat (path, &st) != 0) || (realpath (path, resolved) == NULL))
+        return false;
+
+    for (c = (const unsigned char *)resolved; *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+
+    key->hash = (hash != 0) ? hash : 1;
+    key->size = (int64_t)st.st_size;
+    key->mtime = (int64_t)st.st_mtime;
+
+    return true;
+#else
+    (void)path;
+    (void)key;
+    return false;
+#endif
+}
+
+
+/* a surface backed directly by the mapped cache, or NULL on a miss.
+   release it with cache_free_surface */
+SDL_Surface *
+cache_lookup (thumb_cache *cache, const cache_key *key)
+{
+    cache_slot_header *header;
+    SDL_Surface *surface;
+    cache_entry *entry;
+    int slot;
+
+    if (!cache->enabled)
+        return (SDL_Surface *)NULL;
+
+    SDL_LockMutex (cache->lock);
+
+    slot = table_find (cache, key->hash);
+    if (slot < 0)
+        goto cache_lookup_miss_0;
+
+    /* the file changed since it was cached, or the index is stale */
+    entry = &cache->entries[slot];
+    header = (cache_slot_header *)(cache->data + (size_t)slot * cache->slot_size);
+    if ((entry->key.size != key->size) || (entry->key.mtime != key->mtime) ||
+        (memcmp (&header->key, key, sizeof (cache_key)) != 0) ||
+        (header->w != entry->w) || (header->h != entry->h))
+    {
+        if (cache->pins[slot] == 0)
+        {
+            table_remove (cache, slot);
+            memset (entry, 0, sizeof (cache_entry));
+        }
+        goto cache_lookup_miss_0;
+    }
+
+    surface = SDL_CreateRGBSurfaceWithFormatFrom ((unsigned char *)(header + 1),
+                                                  (int)entry->w, (int)entry->h, 32,
+                                                  (int)entry->w * 4, DECODE_PIXELFORMAT);
+    if (surface == NULL)
+        goto cache_lookup_miss_0;
+
+    /* keep the slot from being reused until the surface is released */
+    surface->userdata = (void *)(intptr_t)(slot + 1);
+    cache->pins[slot]++;
+    entry->used = ++cache->clock;
+
+    SDL_UnlockMutex (cache->lock);
+    return surface;
+
+cache_lookup_miss_0:
+    SDL_UnlockMutex (cache->lock);
+    return (SDL_Surface *)NULL;
+}
+
+
+/* copy a freshly decoded thumbnail into the cache */
+void
+cache_store (thumb_cache *cache, const cache_key *key, SDL_Surface *surface)
+{
+    cache_slot_header *header;
+    unsigned char *pixels;
+    size_t row_len;
+    int slot;
+    int y;
+
+    if (!cache->enabled || (surface->format->format != DECODE_PIXELFORMAT) ||
+        (sizeof (cache_slot_header) + (size_t)surface->w * (size_t)surface->h * 4 > cache->slot_size))
+        return;
+
+    SDL_LockMutex (cache->lock);
+
+    /* replace an older version of the same file */
+    slot = table_find (cache, key->hash);
+    if ((slot >= 0) && (cache->pins[slot] == 0))
+    {
+        table_remove (cache, slot);
+        memset (&cache->entries[slot], 0, sizeof (cache_entry));
+    }
+    else if (slot >= 0)
+    {
+        SDL_UnlockMutex (cache->lock);
+        return;
+    }
+
+    slot = cache_take_slot (cache);
+    if (slot < 0)
+    {
+        SDL_UnlockMutex (cache->lock);
+        return;
+    }
+    cache->pins[slot]++;
+    cache->entries[slot].used = ++cache->clock;
+    SDL_UnlockMutex (cache->lock);
+
+    /* invalidate the slot header while the pixels are half written */
+    header = (cache_slot_header *)(cache->data + (size_t)slot * cache->slot_size);
+    memset (header, 0, sizeof (cache_slot_header));
+
+    pixels = (unsigned char *)(header + 1);
+    row_len = (size_t)surface->w * 4;
+    for (y = 0; y < surface->h; y++)
+    {
+        memcpy (pixels + (size_t)y * row_len,
+                (unsigned char *)surface->pixels + (size_t)y * (size_t)surface->pitch,
+                row_len);
+    }
+    header->w = (uint32_t)surface->w;
+    header->h = (uint32_t)surface->h;
+    header->key = *key;
+
+    SDL_LockMutex (cache->lock);
+    cache->pins[slot]--;
+    cache->entries[slot].key = *key;
+    cache->entries[slot].w = (uint32_t)surface->w;
+    cache->entries[slot].h = (uint32_t)surface->h;
+
+    /* another worker stored the same file first */
+    if (table_find (cache, key->hash) >= 0)
+        memset (&cache->entries[slot], 0, sizeof (cache_entry));
+    else
+        table_insert (cache, slot);
+    SDL_UnlockMutex (cache->lock);
+}
+
+
+/* free any thumbnail surface, unpinning it when it came from the cache */
+void
+cache_free_surface (thumb_cache *cache, SDL_Surface *surface)
+{
+    int slot;
+
+    if (surface == NULL)
+        return;
+
+    slot = (int)(intptr_t)surface->userdata - 1;
+    if (cache->enabled && (slot >= 0))
+    {
+        SDL_LockMutex (cache->lock);
+        cache->pins[slot]--;
+        SDL_UnlockMutex (cache->lock);
+    }
+
+    SDL_FreeSurface (surface);
+}
+
+
+/* End of File */
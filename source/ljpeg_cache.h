@@ -0,0 +1,94 @@
+/*
+   source/ljpeg_cache.h
+   LJPEG persistent thumbnail cache header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_CACHE_HEADER__
+#define __LJPEG_CACHE_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+/* identifies one version of one file */
+typedef struct cache_key
+{
+    uint64_t hash;      /* fnv-1a of the absolute path, never 0 */
+    int64_t  size;
+    int64_t  mtime;
+} cache_key;
+
+/* one index record, record n describes slot n of the data file */
+typedef struct cache_entry
+{
+    cache_key key;
+    uint64_t  used;     /* lru clock, 0 when the slot is free */
+    uint32_t  w, h;
+} cache_entry;
+
+typedef struct thumb_cache
+{
+    bool          enabled;
+    int           thumb_size;
+    char         *index_path;
+    char         *data_path;
+
+    SDL_mutex    *lock;
+    cache_entry  *entries;
+    int          *pins;
+    int          *table;        /* open addressing, slot numbers or -1 */
+    int           table_size;
+    int           slot_count;
+    size_t        slot_size;
+    uint64_t      clock;
+
+    int           data_fd;
+    unsigned char *data;
+    size_t        data_len;
+} thumb_cache;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+int  cache_open  (thumb_cache *cache, int thumb_size);
+void cache_close (thumb_cache *cache);
+
+char *cache_directory (void);
+bool  cache_key_for (const char *path, cache_key *key);
+
+SDL_Surface *cache_lookup (thumb_cache *cache, const cache_key *key);
+void         cache_store  (thumb_cache *cache, const cache_key *key, SDL_Surface *surface);
+void         cache_free_surface (thumb_cache *cache, SDL_Surface *surface);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,480 @@
+/*
+   source/ljpeg_compare.c
+   LJPEG A/B image comparison source code.
+
+   Two images of the same size are shown through one view: a, b, a
+   split between them at the cursor, or a heatmap of how far apart
+   they are.  The difference is worked out in COMPARE_TILE squares on
+   the worker threads, the ones on screen first, with the vector
+   kernels doing the per pixel work.  As tiles come in the heatmap
+   fills in and the title shows the PSNR and SSIM so far; the final
+   figures are printed once every tile is in.
+
+   SSIM is the mean over 8x8 windows of the luma, without the gaussian
+   weighting of the reference implementation.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_compare.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+compare_view g_compare;
+Uint32       g_compare_event = (Uint32)-1;
+
+
+/* file static variables */
+#define COMPARE_WINDOW 8
+
+/* ssim's stabilizers, (k * 255) squared */
+#define SSIM_C1 (0.01 * 255.0 * 0.01 * 255.0)
+#define SSIM_C2 (0.03 * 255.0 * 0.03 * 255.0)
+
+
+/* file static function prototypes */
+static void compare_heat_colors (compare_view *cmp);
+static int  compare_rank (void *arg);
+static void compare_tile_job (void *arg);
+static void compare_tile_ssim (compare_view *cmp, compare_tile *tile);
+static void compare_report (compare_view *cmp, bool done);
+
+
+/* static function definitions */
+/* black through purple, red and yellow to white, the largest channel
+   difference times COMPARE_GAIN picking the colour */
+static void
+compare_heat_colors (compare_view *cmp)
+{
+    static const Uint8 stops[5][3] = {
+        {   0,   0,   0 },
+        {  96,   0, 160 },
+        { 230,  30,  30 },
+        { 255, 200,   0 },
+        { 255, 255, 255 }
+    };
+    double t;
+    int level;
+    int d, s, c;
+    Uint8 rgb[3];
+
+    for (d = 0; d < 256; d++)
+    {
+        level = SDL_min (d * COMPARE_GAIN, 255);
+        s = SDL_min (level / 64, 3);
+        t = (level - s * 64) / (s == 3 ? 63.0 : 64.0);
+        for (c = 0; c < 3; c++)
+        {
+            rgb[c] = (Uint8)(stops[s][c] + (stops[s + 1][c] - stops[s][c]) * t + 0.5);
+        }
+        cmp->heat_colors[d] = SDL_MapRGBA (cmp->heat->format, rgb[0], rgb[1], rgb[2], SDL_ALPHA_OPAQUE);
+    }
+}
+
+
+/* how many tiles away from the screen a tile is, 0 when on it */
+static int
+compare_rank (void *arg)
+{
+    compare_tile *tile = (compare_tile *)arg;
+    compare_view *cmp = tile->cmp;
+    int tx = tile->rect.x / COMPARE_TILE;
+    int ty = tile->rect.y / COMPARE_TILE;
+    int dx = 0, dy = 0;
+
+    if (tx < SDL_AtomicGet (&cmp->visible[0]))
+        dx = SDL_AtomicGet (&cmp->visible[0]) - tx;
+    else if (tx > SDL_AtomicGet (&cmp->visible[2]))
+        dx = tx - SDL_AtomicGet (&cmp->visible[2]);
+    if (ty < SDL_AtomicGet (&cmp->visible[1]))
+        dy = SDL_AtomicGet (&cmp->visible[1]) - ty;
+    else if (ty > SDL_AtomicGet (&cmp->visible[3]))
+        dy = ty - SDL_AtomicGet (&cmp->visible[3]);
+
+    return SDL_max (dx, dy);
+}
+
+
+/* worker side: heatmap and squared error a row at a time, then the
+   ssim windows.  the main thread is woken to upload it */
+static void
+compare_tile_job (void *arg)
+{
+    compare_tile *tile = (compare_tile *)arg;
+    compare_view *cmp = tile->cmp;
+    SDL_Rect *r = &tile->rect;
+    uint8_t mag[COMPARE_TILE];
+    const uint8_t *pa, *pb;
+    Uint32 *heat;
+    SDL_Event evt;
+    int x, y;
+
+    for (y = r->y; y < r->y + r->h; y++)
+    {
+        pa = (const uint8_t *)cmp->a->pixels + (size_t)y * (size_t)cmp->a->pitch + (size_t)r->x * 4;
+        pb = (const uint8_t *)cmp->b->pixels + (size_t)y * (size_t)cmp->b->pitch + (size_t)r->x * 4;
+        heat = (Uint32 *)((uint8_t *)cmp->heat->pixels + (size_t)y * (size_t)cmp->heat->pitch) + r->x;
+
+        tile->sse += g_simd.diff_rgba (pa, pb, mag, r->w);
+        for (x = 0; x < r->w; x++)
+        {
+            heat[x] = cmp->heat_colors[mag[x]];
+            tile->max_diff = SDL_max (tile->max_diff, (int)mag[x]);
+        }
+    }
+    compare_tile_ssim (cmp, tile);
+
+    SDL_AtomicSet (&tile->done, 1);
+    if (SDL_AtomicSet (&cmp->pending, 1) == 0)
+    {
+        SDL_zero (evt);
+        evt.type = g_compare_event;
+        SDL_PushEvent (&evt);
+    }
+}
+
+
+/* the whole 8x8 windows in the tile, tiles start on a multiple of 8
+   so the windows line up across them */
+static void
+compare_tile_ssim (compare_view *cmp, compare_tile *tile)
+{
+    const int n = COMPARE_WINDOW * COMPARE_WINDOW;
+    SDL_Rect *r = &tile->rect;
+    const uint8_t *pa, *pb;
+    double ma, mb, va, vb, cov;
+    long sa, sb, saa, sbb, sab;
+    int ya, yb;
+    int wx, wy;
+    int x, y;
+
+    for (wy = r->y; wy + COMPARE_WINDOW <= r->y + r->h; wy += COMPARE_WINDOW)
+    {
+        for (wx = r->x; wx + COMPARE_WINDOW <= r->x + r->w; wx += COMPARE_WINDOW)
+        {
+            sa = sb = saa = sbb = sab = 0;
+            for (y = wy; y < wy + COMPARE_WINDOW; y++)
+            {
+                pa = (const uint8_t *)cmp->a->pixels + (size_t)y * (size_t)cmp->a->pitch + (size_t)wx * 4;
+                pb = (const uint8_t *)cmp->b->pixels + (size_t)y * (size_t)cmp->b->pitch + (size_t)wx * 4;
+                for (x = 0; x < COMPARE_WINDOW; x++)
+                {
+                    /* bt.601 luma, the weights add up to 256 */
+                    ya = (77 * pa[x * 4] + 150 * pa[x * 4 + 1] + 29 * pa[x * 4 + 2] + 128) >> 8;
+                    yb = (77 * pb[x * 4] + 150 * pb[x * 4 + 1] + 29 * pb[x * 4 + 2] + 128) >> 8;
+                    sa += ya;
+                    sb += yb;
+                    saa += ya * ya;
+                    sbb += yb * yb;
+                    sab += ya * yb;
+                }
+            }
+
+            ma = (double)sa / n;
+            mb = (double)sb / n;
+            va = (double)saa / n - ma * ma;
+            vb = (double)sbb / n - mb * mb;
+            cov = (double)sab / n - ma * mb;
+            tile->ssim += ((2.0 * ma * mb + SSIM_C1) * (2.0 * cov + SSIM_C2)) /
+                          ((ma * ma + mb * mb + SSIM_C1) * (va + vb + SSIM_C2));
+            tile->windows++;
+        }
+    }
+}
+
+
+/* the figures so far in the title, and on stdout once they are final */
+static void
+compare_report (compare_view *cmp, bool done)
+{
+    char title[256];
+    char psnr[32];
+    char ssim[32];
+    double mse;
+
+    mse = (double)cmp->sse / ((double)cmp->pixels * 3.0);
+    if (cmp->sse == 0)
+        snprintf (psnr, sizeof (psnr), "inf");
+    else
+        snprintf (psnr, sizeof (psnr), "%.3f", 10.0 * log10 (255.0 * 255.0 / mse));
+    if (cmp->windows == 0)
+        snprintf (ssim, sizeof (ssim), "n/a");
+    else
+        snprintf (ssim, sizeof (ssim), "%.5f", cmp->ssim / (double)cmp->windows);
+
+    if (done)
+    {
+        snprintf (title, sizeof (title), "LJPEG - %s vs %s - PSNR %s dB - SSIM %s - max diff %d",
+                  cmp->path_a, cmp->path_b, psnr, ssim, cmp->max_diff);
+        printf ("compare: %s vs %s: PSNR %s dB, SSIM %s, max diff %d (%.1f ms)\n",
+                cmp->path_a, cmp->path_b, psnr, ssim, cmp->max_diff,
+                (double)(SDL_GetPerformanceCounter () - cmp->opened) * 1000.0 /
+                (double)SDL_GetPerformanceFrequency ());
+        fflush (stdout);
+    }
+    else
+    {
+        /* both so far cover only the tiles counted */
+        snprintf (title, sizeof (title), "LJPEG - %s vs %s - %d%% - PSNR %s dB - SSIM %s",
+                  cmp->path_a, cmp->path_b, cmp->counted * 100 / cmp->tile_count, psnr, ssim);
+    }
+    SDL_SetWindowTitle (g_win, title);
+}
+
+
+/* function definitions */
+/* compare a and b, which have to be the same size.  takes the surfaces
+   on success, a's texture is left to the caller */
+int
+compare_open (compare_view *cmp, SDL_Surface *a, SDL_Surface *b,
+              const char *path_a, const char *path_b)
+{
+    compare_tile *tile;
+    int w, h;
+    int i;
+
+    memset (cmp, 0, sizeof (compare_view));
+    if (g_compare_event == (Uint32)-1)
+        g_compare_event = SDL_RegisterEvents (1);
+
+    if ((a->w != b->w) || (a->h != b->h))
+    {
+        SDL_SetError ("%s (%dx%d) and %s (%dx%d) differ in size",
+                      path_a, a->w, a->h, path_b, b->w, b->h);
+        goto compare_open_failure_0;
+    }
+    if ((a->format->format != DECODE_PIXELFORMAT) || (b->format->format != DECODE_PIXELFORMAT))
+    {
+        SDL_SetError ("%s, %s: unexpected pixel format", path_a, path_b);
+        goto compare_open_failure_0;
+    }
+    w = a->w;
+    h = a->h;
+
+    cmp->path_a = SDL_strdup (path_a);
+    cmp->path_b = SDL_strdup (path_b);
+    cmp->heat = SDL_CreateRGBSurfaceWithFormat (0, w, h, 32, DECODE_PIXELFORMAT);
+    if ((cmp->path_a == NULL) || (cmp->path_b == NULL) || (cmp->heat == NULL))
+        goto compare_open_failure_1;
+    cmp->a = a;
+    cmp->b = b;
+    compare_heat_colors (cmp);
+
+    /* the heatmap starts clear, tiles show up as they are done */
+    cmp->texture_b = SDL_CreateTextureFromSurface (g_rend, b);
+    cmp->texture_heat = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING, w, h);
+    if ((cmp->texture_b == NULL) || (cmp->texture_heat == NULL))
+        goto compare_open_failure_2;
+    SDL_SetTextureBlendMode (cmp->texture_heat, SDL_BLENDMODE_BLEND);
+    SDL_UpdateTexture (cmp->texture_heat, NULL, cmp->heat->pixels, cmp->heat->pitch);
+    cmp->bytes = (size_t)w * (size_t)h * 4 * 2;
+    arena_account ((ptrdiff_t)cmp->bytes);
+
+    cmp->tiles_x = (w + COMPARE_TILE - 1) / COMPARE_TILE;
+    cmp->tiles_y = (h + COMPARE_TILE - 1) / COMPARE_TILE;
+    cmp->tile_count = cmp->tiles_x * cmp->tiles_y;
+    cmp->tiles = calloc ((size_t)cmp->tile_count, sizeof (compare_tile));
+    if (cmp->tiles == NULL)
+        goto compare_open_failure_3;
+    for (i = 0; i < cmp->tile_count; i++)
+    {
+        tile = &cmp->tiles[i];
+        tile->cmp = cmp;
+        tile->rect.x = (i % cmp->tiles_x) * COMPARE_TILE;
+        tile->rect.y = (i / cmp->tiles_x) * COMPARE_TILE;
+        tile->rect.w = SDL_min (COMPARE_TILE, w - tile->rect.x);
+        tile->rect.h = SDL_min (COMPARE_TILE, h - tile->rect.y);
+    }
+
+    /* everything is on screen until the first update says otherwise */
+    SDL_AtomicSet (&cmp->visible[2], cmp->tiles_x - 1);
+    SDL_AtomicSet (&cmp->visible[3], cmp->tiles_y - 1);
+    cmp->pool = workers_create (workers_default_count (), compare_rank);
+    if (cmp->pool == NULL)
+        goto compare_open_failure_4;
+
+    cmp->opened = SDL_GetPerformanceCounter ();
+    for (i = 0; i < cmp->tile_count; i++)
+    {
+        if (workers_submit (cmp->pool, compare_tile_job, &cmp->tiles[i]) != EXIT_SUCCESS)
+            goto compare_open_failure_5;
+    }
+
+    cmp->show = COMPARE_SHOW_A;
+    cmp->active = true;
+
+/* compare_open_success_0: */
+    return EXIT_SUCCESS;
+
+compare_open_failure_5:
+    workers_destroy (cmp->pool);
+compare_open_failure_4:
+    free (cmp->tiles);
+compare_open_failure_3:
+    arena_account (-(ptrdiff_t)cmp->bytes);
+compare_open_failure_2:
+    if (cmp->texture_heat != NULL)
+        SDL_DestroyTexture (cmp->texture_heat);
+    if (cmp->texture_b != NULL)
+        SDL_DestroyTexture (cmp->texture_b);
+compare_open_failure_1:
+    if (cmp->heat != NULL)
+        SDL_FreeSurface (cmp->heat);
+    SDL_free (cmp->path_b);
+    SDL_free (cmp->path_a);
+compare_open_failure_0:
+    memset (cmp, 0, sizeof (compare_view));
+    return EXIT_FAILURE;
+}
+
+
+void
+compare_close (compare_view *cmp)
+{
+    if (!cmp->active)
+        return;
+
+    /* queued tiles are dropped, running ones finish first */
+    workers_destroy (cmp->pool);
+
+    free (cmp->tiles);
+    arena_account (-(ptrdiff_t)cmp->bytes);
+    SDL_DestroyTexture (cmp->texture_heat);
+    SDL_DestroyTexture (cmp->texture_b);
+    SDL_FreeSurface (cmp->heat);
+    SDL_FreeSurface (cmp->b);
+    SDL_FreeSurface (cmp->a);
+    SDL_free (cmp->path_b);
+    SDL_free (cmp->path_a);
+    memset (cmp, 0, sizeof (compare_view));
+}
+
+
+/* point the workers at what tex shows and take in the finished tiles,
+   true when any came in */
+bool
+compare_update (compare_view *cmp, texture *tex)
+{
+    compare_tile *tile;
+    SDL_Rect area;
+    bool changed = false;
+    int i;
+
+    if (!cmp->active)
+        return false;
+
+    if (graphics_visible_area (tex, &area))
+    {
+        SDL_AtomicSet (&cmp->visible[0], area.x / COMPARE_TILE);
+        SDL_AtomicSet (&cmp->visible[1], area.y / COMPARE_TILE);
+        SDL_AtomicSet (&cmp->visible[2], (area.x + area.w - 1) / COMPARE_TILE);
+        SDL_AtomicSet (&cmp->visible[3], (area.y + area.h - 1) / COMPARE_TILE);
+    }
+
+    if ((cmp->counted == cmp->tile_count) || (SDL_AtomicSet (&cmp->pending, 0) == 0))
+        return false;
+
+    for (i = 0; i < cmp->tile_count; i++)
+    {
+        tile = &cmp->tiles[i];
+        if (tile->counted || (SDL_AtomicGet (&tile->done) == 0))
+            continue;
+
+        SDL_UpdateTexture (cmp->texture_heat, &tile->rect,
+                           (uint8_t *)cmp->heat->pixels + (size_t)tile->rect.y * (size_t)cmp->heat->pitch +
+                           (size_t)tile->rect.x * 4,
+                           cmp->heat->pitch);
+        cmp->sse += tile->sse;
+        cmp->pixels += (uint64_t)tile->rect.w * (uint64_t)tile->rect.h;
+        cmp->ssim += tile->ssim;
+        cmp->windows += tile->windows;
+        cmp->max_diff = SDL_max (cmp->max_diff, tile->max_diff);
+        tile->counted = true;
+        cmp->counted++;
+        changed = true;
+    }
+
+    if (changed)
+        compare_report (cmp, cmp->counted == cmp->tile_count);
+
+    return changed;
+}
+
+
+/* draw what is being shown in tex's place */
+void
+compare_render (compare_view *cmp, SDL_Renderer *rend, texture *tex)
+{
+    SDL_Rect right;
+    int out_w, out_h;
+
+    switch (cmp->show)
+    {
+    case COMPARE_SHOW_B:
+        graphics_render_as (rend, tex, cmp->texture_b);
+        break;
+    case COMPARE_SHOW_DIFF:
+        graphics_render_as (rend, tex, cmp->texture_heat);
+        break;
+    case COMPARE_SHOW_SPLIT:
+        graphics_render (rend, tex);
+        SDL_GetRendererOutputSize (rend, &out_w, &out_h);
+        SDL_GetMouseState (&right.x, NULL);
+        right.x = SDL_max (0, SDL_min (right.x, out_w));
+        right.y = 0;
+        right.w = out_w - right.x;
+        right.h = out_h;
+        if (right.w > 0)
+        {
+            SDL_RenderSetClipRect (rend, &right);
+            graphics_render_as (rend, tex, cmp->texture_b);
+            SDL_RenderSetClipRect (rend, NULL);
+        }
+        break;
+    case COMPARE_SHOW_A:
+    default:
+        graphics_render (rend, tex);
+        break;
+    }
+}
+
+
+/* show show, or a again when it already is */
+void
+compare_toggle (compare_view *cmp, compare_show show)
+{
+    cmp->show = (cmp->show == show) ? COMPARE_SHOW_A : show;
+}
+
+
+/* End of File */
@@ -0,0 +1,114 @@
+/*
+   source/ljpeg_compare.h
+   LJPEG A/B image comparison header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_COMPARE_HEADER__
+#define __LJPEG_COMPARE_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+typedef enum compare_show
+{
+    COMPARE_SHOW_A,
+    COMPARE_SHOW_B,
+    COMPARE_SHOW_SPLIT,     /* a left of the cursor, b right of it */
+    COMPARE_SHOW_DIFF
+} compare_show;
+
+/* COMPARE_TILE squared of the difference, worked out on a worker */
+typedef struct compare_tile
+{
+    struct compare_view *cmp;
+    SDL_Rect      rect;
+    SDL_atomic_t  done;         /* the worker's figures are in */
+    bool          counted;      /* uploaded and added to the totals */
+
+    uint64_t      sse;          /* squared error over r, g and b */
+    double        ssim;         /* summed over the tile's windows */
+    int           windows;
+    int           max_diff;
+} compare_tile;
+
+typedef struct compare_view
+{
+    bool          active;
+    compare_show  show;
+    char         *path_a;
+    char         *path_b;
+
+    /* a is drawn through g_img, b and the heatmap follow its view */
+    SDL_Surface  *a;
+    SDL_Surface  *b;
+    SDL_Surface  *heat;
+    SDL_Texture  *texture_b;
+    SDL_Texture  *texture_heat;
+    size_t        bytes;        /* counted against --max-memory */
+    Uint32        heat_colors[256];
+
+    compare_tile *tiles;
+    int           tiles_x, tiles_y;
+    int           tile_count;
+    worker_pool  *pool;
+    SDL_atomic_t  visible[4];   /* first and last tile column and row on screen */
+    SDL_atomic_t  pending;      /* a tile finished since the last update */
+
+    /* totals of the counted tiles */
+    int           counted;
+    uint64_t      pixels;
+    uint64_t      sse;
+    double        ssim;
+    long          windows;
+    int           max_diff;
+    Uint64        opened;
+} compare_view;
+
+
+/* constants */
+
+
+/* global variables */
+extern compare_view g_compare;
+extern Uint32       g_compare_event;
+
+
+/* external function prototypes */
+int  compare_open  (compare_view *cmp, SDL_Surface *a, SDL_Surface *b,
+                    const char *path_a, const char *path_b);
+void compare_close (compare_view *cmp);
+
+bool compare_update (compare_view *cmp, texture *tex);
+void compare_render (compare_view *cmp, SDL_Renderer *rend, texture *tex);
+void compare_toggle (compare_view *cmp, compare_show show);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -76,6 +76,236 @@ Default: 200%
 #define SCALE_PRESET_3 2.0
 
 
+/*
+Worker threads used for background decoding
+0 picks one less than the number of CPUs
+Default: 0
+*/
+#define WORKER_THREADS 0
+
+
+/*
+Thumbnail grid (directory view) cell size in pixels, thumbnails are
+scaled to fit in a THUMB_SIZE square with THUMB_PADDING between cells
+Default: 160, 8
+*/
+#define THUMB_SIZE    160
+#define THUMB_PADDING 8
+
+
+/*
+Thumbnail atlas textures, thumbnails are packed into THUMB_ATLAS_COUNT
+textures of THUMB_ATLAS_SIZE squared.  Once every slot is used the
+thumbnails furthest from the view are evicted.
+Default: 2048, 8 (about 1150 thumbnails, 128MiB of video memory)
+*/
+#define THUMB_ATLAS_SIZE  2048
+#define THUMB_ATLAS_COUNT 8
+
+
+/*
+Screens worth of thumbnails decoded ahead of and behind the view, cut
+down to what fits in the atlases alongside the view on large windows
+Default: 2
+*/
+#define THUMB_PREFETCH_SCREENS 2
+
+
+/*
+Size cap of the on-disk thumbnail cache ($XDG_CACHE_HOME/ljpeg) in MiB,
+the least recently used thumbnails are replaced once it is full.
+0 disables the cache.
+Default: 512 (about 5000 thumbnails at THUMB_SIZE 160)
+*/
+#define THUMB_CACHE_MAX_MB 512
+
+
+/*
+Thumbnail grid window size
+Default: 1280x800
+*/
+#define GRID_WINDOW_WIDTH  1280
+#define GRID_WINDOW_HEIGHT 800
+
+
+/*
+Memory in MiB for decoded animation frames held ahead of playback.
+Animations that fit are decoded once and kept, longer ones are decoded
+again on every loop.
+Default: 256
+*/
+#define ANIM_BUDGET_MB 256
+
+
+/*
+Image sequence (--sequence) playback rate when --fps is not given
+Default: 24
+*/
+#define SEQUENCE_FPS 24
+
+
+/*
+Memory in MiB for image sequence frames read and decoded ahead, and the
+most frames to keep in flight however small they are
+Default: 512, 32
+*/
+#define SEQUENCE_BUDGET_MB 512
+#define SEQUENCE_MAX_AHEAD 32
+
+
+/*
+How long an open image has to go without being written to before it is
+reloaded, so a file is not re-read halfway through being saved.  With
+WATCH_DIRECTORY the directory is watched too, which catches programs
+that save to a temporary file and rename it over the original.
+Default: 150, 1
+*/
+#define WATCH_DEBOUNCE_MS 150
+#define WATCH_DIRECTORY   1
+
+
+/*
+File reading.  With IO_USE_URING, on Linux, up to IO_QUEUE_DEPTH files
+are read at once through io_uring.  Otherwise, or when the kernel does
+not allow it, IO_THREADS threads read them with pread.
+Default: 1, 64, 4
+*/
+#define IO_USE_URING   1
+#define IO_QUEUE_DEPTH 64
+#define IO_THREADS     4
+
+
+/*
+Image headers read for sorting a directory (dimensions, orientation,
+capture date) are kept in $XDG_CACHE_HOME/ljpeg, for up to this many
+files.  Each takes 64 bytes.
+Default: 65536
+*/
+#define PROBE_CACHE_ENTRIES 65536
+
+
+/*
+Memory in MiB of freed decode buffers (surfaces, file data, libjpeg
+scratch) kept to be reused by the next image instead of going back to
+the system.  0 gives every buffer straight back.
+Default: 256
+*/
+#define ARENA_RETAIN_MB 256
+
+
+/*
+Memory pressure (Linux).  The kernel is asked to report MEMORY_PSI_STALL_MS
+of stalls on memory within MEMORY_PSI_WINDOW_MS (read every MEMORY_POLL_MS
+where it refuses), and the cgroup's memory.events is checked as often.
+Under pressure the open image is swapped for a screen sized copy and the
+decode buffers are handed back, MEMORY_CALM_MS after the last stall the
+full image is decoded again once it is zoomed into.
+Default: 150, 2000, 1000, 10000
+*/
+#define MEMORY_PSI_STALL_MS  150
+#define MEMORY_PSI_WINDOW_MS 2000
+#define MEMORY_POLL_MS       1000
+#define MEMORY_CALM_MS       10000
+
+
+/*
+Full size JPEGs that are baseline, 8 bit and greyscale or YCbCr 4:4:4,
+4:2:2 or 4:2:0 (most of them) are decoded by the built-in decoder,
+using SSE2, AVX2 or NEON where the cpu has them.  Everything else, and
+everything with 0, goes to libjpeg.
+Default: 1
+*/
+#define BASELINE_JPEG 1
+
+
+/*
+Non-interlaced PNGs are decoded by the built-in decoder, which inflates
+the image data in one go (with libdeflate when built with
+USE_LIBDEFLATE=1) and undoes the row filters with SSE2 or NEON.
+Interlaced ones, and everything with 0, go to SDL_image.  One whose
+header claims more than PNG_MAX_PIXELS pixels, or more than its image
+data could inflate to, is turned down before anything is allocated.
+Default: 1, 268435456 (16384 squared)
+*/
+#define NATIVE_PNG 1
+#define PNG_MAX_PIXELS 268435456
+
+
+/*
+TIFFs that are uncompressed, LZW, Deflate or PackBits, and greyscale,
+palette or 8 bit RGB, are decoded by the built-in decoder, a page of
+more than TIFF_PARALLEL_PIXELS pixels a strip or tile per worker.
+Other pages, and everything with 0, go to SDL_image.  Multi-page ones
+turn pages with Page Up and Page Down, the next page decoded ahead.
+Default: 1, 1048576
+*/
+#define NATIVE_TIFF 1
+#define TIFF_PARALLEL_PIXELS 1048576
+
+
+/*
+Keep the window at the size it first opens with (fitted to the screen)
+instead of resizing it to the image on every zoom, as --fixed does.
+Zooming keeps the point under the cursor in place, dragging pans.
+Default: 0
+*/
+#define FIXED_VIEWPORT 0
+
+
+/*
+Render driver, as --renderer takes it: "auto" times the drivers SDL
+has the first time and keeps the fastest in $XDG_CACHE_HOME/ljpeg, or
+a driver name (opengl, software, ...) to use that one.
+Default: "auto"
+*/
+#define RENDERER "auto"
+
+
+/*
+--compare works out the difference in squares of COMPARE_TILE pixels
+(a multiple of 8), the ones on screen first.  The heatmap colours the
+largest channel difference of each pixel times COMPARE_GAIN, so small
+encoder errors still show.
+Default: 256, 8
+*/
+#define COMPARE_TILE 256
+#define COMPARE_GAIN 8
+
+
+/*
+Height in pixels of the histogram overlay 'h' brings up, which is 256
+wide (a column for each level).
+Default: 128
+*/
+#define HISTOGRAM_HEIGHT 128
+
+
+/*
+16-bit and HDR images: '[' and ']' change the exposure by
+HDR_EXPOSURE_STEP stops.  HDR images (radiance, pfm, exr) are tone
+mapped so that HDR_WHITE, in the file's own units, comes out white.
+Default: 0.5, 4.0
+*/
+#define HDR_EXPOSURE_STEP 0.5
+#define HDR_WHITE 4.0
+
+
+/*
+Images with an embedded ICC profile (JPEG, PNG, TIFF, WebP) are turned
+into the display's colours, sRGB where the display has no profile, as
+are untagged (sRGB) images on a display that has one.  The transform
+is sampled ICC_LUT_POINTS times along each of r, g and b, with
+LittleCMS when built with USE_LCMS2=1, and the last ICC_CACHE profile
+pairs keep theirs.  More points follow the steep start of a gamma
+curve more closely, each LUT being ICC_LUT_POINTS^3 * 4 bytes.  0 shows
+the file's values as they are.
+Default: 1, 33, 8
+*/
+#define ICC_CONVERT 1
+#define ICC_LUT_POINTS 33
+#define ICC_CACHE 8
+
+
 #endif /* end run once */
 
 
@@ -0,0 +1,930 @@
+/*
+   source/ljpeg_decode.c
+   LJPEG off-screen image decoding source code.
+
+   Files go to the first backend in s_backends whose magic bytes match,
+   and on down the list when it turns them down; SDL_image takes
+   whatever is left.  A backend that cannot scale (or turn) is passed
+   over when a later one for the same file can, so thumbnails and
+   turned JPEGs skip the built-in decoder for libjpeg.  Backends that
+   can decode part of an image without the rest serve decode_load_region.
+   Each backend's decodes are timed, see decode_print_timing.
+
+   Images come out the way up their exif orientation says.  JPEG
+   scanlines are written straight to their rotated/mirrored place in
+   the surface as libjpeg hands them over, other formats are turned
+   once after loading.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_decode.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <jpeglib.h>
+#ifdef USE_LIBWEBP
+#include <webp/decode.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_baseline.h"
+#include "ljpeg_png.h"
+#include "ljpeg_tiff.h"
+#include "ljpeg_probe.h"
+
+
+/* file static variables */
+typedef struct jpeg_error_jump
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf               jump;
+} jpeg_error_jump;
+
+
+/* file static function prototypes */
+static void jpeg_error_exit (j_common_ptr cinfo);
+static void decode_orient_row (SDL_Surface *dst, int src_w, int src_h, int y, int orientation,
+                               ptrdiff_t *start, ptrdiff_t *step);
+static SDL_Surface *jpeg_load_scaled (const unsigned char *data, size_t len, int max_w, int max_h,
+                                      int orientation);
+#ifdef LIBJPEG_TURBO_VERSION
+static SDL_Surface *jpeg_load_region (const unsigned char *data, size_t len, const SDL_Rect *area);
+#endif
+static SDL_Surface *decode_to_rgba (SDL_Surface *loaded);
+static SDL_Surface *decode_orient (SDL_Surface *src, int orientation);
+static int          decode_orientation (const unsigned char *data, size_t len);
+static bool         decode_stored_area (const image_info *info, const SDL_Rect *area,
+                                        SDL_Rect *stored);
+static bool         decode_match_any (const unsigned char *magic, size_t len);
+static SDL_Surface *baseline_load (const unsigned char *data, size_t len, int max_w, int max_h,
+                                   int orientation);
+static SDL_Surface *png_load (const unsigned char *data, size_t len, int max_w, int max_h,
+                              int orientation);
+static SDL_Surface *tiff_load (const unsigned char *data, size_t len, int max_w, int max_h,
+                               int orientation);
+#ifdef USE_LIBWEBP
+static bool         decode_is_webp (const unsigned char *magic, size_t len);
+static SDL_Surface *webp_load (const unsigned char *data, size_t len, int max_w, int max_h,
+                               int orientation);
+#endif
+static SDL_Surface *sdl_image_load (const unsigned char *data, size_t len, int max_w, int max_h,
+                                    int orientation);
+static bool         decode_better_later (int first, const unsigned char *data, size_t len,
+                                         unsigned int wanted);
+static void         decode_count (int backend, const SDL_Surface *loaded, Uint64 ticks);
+static SDL_Surface *decode_dispatch (const unsigned char *data, size_t len, int max_w, int max_h);
+
+
+/* libjpeg-turbo can crop scanlines and skip rows, plain libjpeg cannot.
+   libjpeg is also what ljpeg_stream feeds a jpeg to as it arrives */
+#ifdef LIBJPEG_TURBO_VERSION
+    #define JPEG_CAPS (DECODE_CAN_SCALE | DECODE_CAN_REGION | DECODE_INCREMENTAL | DECODE_ORIENTS)
+    #define JPEG_REGION jpeg_load_region
+#else
+    #define JPEG_CAPS (DECODE_CAN_SCALE | DECODE_INCREMENTAL | DECODE_ORIENTS)
+    #define JPEG_REGION NULL
+#endif
+
+/* the registry, in the order backends are tried */
+static const decode_backend s_backends[] = {
+#if BASELINE_JPEG
+    { "baseline",  0,
+      decode_is_jpeg, baseline_load, NULL },
+#endif
+    { "libjpeg",   JPEG_CAPS,
+      decode_is_jpeg, jpeg_load_scaled, JPEG_REGION },
+#if NATIVE_PNG
+    { "png",       0,
+      decode_is_png, png_load, NULL },
+#endif
+#if NATIVE_TIFF
+    { "tiff",      0,
+      decode_is_tiff, tiff_load, NULL },
+#endif
+#ifdef USE_LIBWEBP
+    { "libwebp",   DECODE_CAN_SCALE | DECODE_THREADED,
+      decode_is_webp, webp_load, NULL },
+#endif
+    { "SDL_image", 0,
+      decode_match_any, sdl_image_load, NULL },
+};
+
+#define DECODE_BACKENDS ((int)SDL_arraysize (s_backends))
+
+static decode_timing s_timing[SDL_arraysize (s_backends)];
+static SDL_SpinLock  s_timing_lock;
+
+
+/* static function definitions */
+/* libjpeg calls exit() by default, jump back into the decoder instead */
+static void
+jpeg_error_exit (j_common_ptr cinfo)
+{
+    jpeg_error_jump *err = (jpeg_error_jump *)cinfo->err;
+
+    longjmp (err->jump, 1);
+}
+
+
+/* where pixel 0 of source row y lands in dst (in bytes), and how far
+   apart the pixels after it land, for the exif orientation.  the source
+   is src_w x src_h, orientations 5-8 swap the axes */
+static void
+decode_orient_row (SDL_Surface *dst, int src_w, int src_h, int y, int orientation,
+                   ptrdiff_t *start, ptrdiff_t *step)
+{
+    ptrdiff_t pitch = dst->pitch;
+
+    switch (orientation)
+    {
+    case 2:     /* mirrored */
+        *start = y * pitch + (ptrdiff_t)(src_w - 1) * 4;
+        *step = -4;
+        break;
+    case 3:     /* upside down */
+        *start = (ptrdiff_t)(src_h - 1 - y) * pitch + (ptrdiff_t)(src_w - 1) * 4;
+        *step = -4;
+        break;
+    case 4:     /* mirrored upside down */
+        *start = (ptrdiff_t)(src_h - 1 - y) * pitch;
+        *step = 4;
+        break;
+    case 5:     /* transposed */
+        *start = (ptrdiff_t)y * 4;
+        *step = pitch;
+        break;
+    case 6:     /* needs turning clockwise */
+        *start = (ptrdiff_t)(src_h - 1 - y) * 4;
+        *step = pitch;
+        break;
+    case 7:     /* transversed */
+        *start = (ptrdiff_t)(src_w - 1) * pitch + (ptrdiff_t)(src_h - 1 - y) * 4;
+        *step = -pitch;
+        break;
+    case 8:     /* needs turning counter-clockwise */
+        *start = (ptrdiff_t)(src_w - 1) * pitch + (ptrdiff_t)y * 4;
+        *step = -pitch;
+        break;
+    default:
+        *start = y * pitch;
+        *step = 4;
+        break;
+    }
+}
+
+
+/* decode an in-memory jpeg using libjpeg's dct scaling, so only
+   1/denom of the image is ever reconstructed.  the
+   result is at least max_w x max_h where possible and is trimmed by
+   decode_fit_surface afterwards.  max_w of 0 decodes at full size and
+   full quality.  each scanline is written to where orientation puts
+   it, so the image is never turned as a separate pass */
+static SDL_Surface *
+jpeg_load_scaled (const unsigned char *data, size_t len, int max_w, int max_h,
+                  int orientation)
+{
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_jump jerr;
+    arena_jpeg arena;
+    SDL_Surface *volatile surface = NULL;
+    JSAMPROW row;
+    unsigned char *volatile rgb = NULL;
+    unsigned char *dst;
+    unsigned int denom;
+    ptrdiff_t start, step;
+    bool swap = (orientation >= 5);
+    int y;
+    JDIMENSION x;
+
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp (jerr.jump))
+    {
+        jpeg_destroy_decompress (&cinfo);
+        SDL_free (rgb);
+        if (surface != NULL)
+            SDL_FreeSurface (surface);
+        return (SDL_Surface *)NULL;
+    }
+
+    jpeg_create_decompress (&cinfo);
+    arena_jpeg_attach ((j_common_ptr)&cinfo, &arena);
+    jpeg_mem_src (&cinfo, (unsigned char *)data, (unsigned long)len);
+    jpeg_read_header (&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+
+    if (max_w > 0)
+    {
+        /* biggest power of two reduction that still covers the target
+           box, once turned */
+        for (denom = 8; denom > 1; denom /= 2)
+        {
+            if (((int)(cinfo.image_width / denom) >= (swap ? max_h : max_w)) ||
+                ((int)(cinfo.image_height / denom) >= (swap ? max_w : max_h)))
+                break;
+        }
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = denom;
+        cinfo.dct_method = JDCT_IFAST;
+        cinfo.do_fancy_upsampling = FALSE;
+    }
+
+    jpeg_start_decompress (&cinfo);
+
+    surface = SDL_CreateRGBSurfaceWithFormat (0,
+                                              (int)(swap ? cinfo.output_height : cinfo.output_width),
+                                              (int)(swap ? cinfo.output_width : cinfo.output_height),
+                                              32, DECODE_PIXELFORMAT);
+    rgb = SDL_malloc ((size_t)cinfo.output_width * 3);
+    if ((surface == NULL) || (rgb == NULL))
+        longjmp (jerr.jump, 1);
+
+    /* expand each rgb scanline into the rgba surface, the upright way
+       round */
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        y = (int)cinfo.output_scanline;
+        row = rgb;
+        jpeg_read_scanlines (&cinfo, &row, 1);
+
+        decode_orient_row (surface, (int)cinfo.output_width, (int)cinfo.output_height,
+                           y, orientation, &start, &step);
+        dst = (unsigned char *)surface->pixels + start;
+        if (step == 4)
+        {
+            for (x = 0; x < cinfo.output_width; x++)
+            {
+                dst[x * 4 + 0] = rgb[x * 3 + 0];
+                dst[x * 4 + 1] = rgb[x * 3 + 1];
+                dst[x * 4 + 2] = rgb[x * 3 + 2];
+                dst[x * 4 + 3] = 0xFF;
+            }
+            continue;
+        }
+        for (x = 0; x < cinfo.output_width; x++, dst += step)
+        {
+            dst[0] = rgb[x * 3 + 0];
+            dst[1] = rgb[x * 3 + 1];
+            dst[2] = rgb[x * 3 + 2];
+            dst[3] = 0xFF;
+        }
+    }
+
+    jpeg_finish_decompress (&cinfo);
+    jpeg_destroy_decompress (&cinfo);
+    SDL_free (rgb);
+
+    return surface;
+}
+
+
+#ifdef LIBJPEG_TURBO_VERSION
+/* decode only area of an in-memory jpeg, as stored.  the rows above it
+   are skipped without being reconstructed and each row is cropped to
+   the whole blocks around it before the idct */
+static SDL_Surface *
+jpeg_load_region (const unsigned char *data, size_t len, const SDL_Rect *area)
+{
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_jump jerr;
+    arena_jpeg arena;
+    SDL_Surface *volatile surface = NULL;
+    JSAMPROW row;
+    unsigned char *volatile rgb = NULL;
+    unsigned char *src;
+    unsigned char *dst;
+    JDIMENSION left, width;
+    int x, y;
+
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp (jerr.jump))
+    {
+        jpeg_destroy_decompress (&cinfo);
+        SDL_free (rgb);
+        if (surface != NULL)
+            SDL_FreeSurface (surface);
+        return (SDL_Surface *)NULL;
+    }
+
+    jpeg_create_decompress (&cinfo);
+    arena_jpeg_attach ((j_common_ptr)&cinfo, &arena);
+    jpeg_mem_src (&cinfo, (unsigned char *)data, (unsigned long)len);
+    jpeg_read_header (&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    if ((area->x < 0) || (area->y < 0) || (area->w <= 0) || (area->h <= 0) ||
+        ((JDIMENSION)area->x + (JDIMENSION)area->w > cinfo.image_width) ||
+        ((JDIMENSION)area->y + (JDIMENSION)area->h > cinfo.image_height))
+    {
+        SDL_SetError ("region is outside the image");
+        longjmp (jerr.jump, 1);
+    }
+
+    jpeg_start_decompress (&cinfo);
+
+    /* the crop starts on a block edge left of area, and takes a block
+       past its right edge where there is one, so the upsampled chroma
+       at area's own edges has its neighbours */
+    left = (JDIMENSION)SDL_max (area->x - 1, 0);
+    width = SDL_min ((JDIMENSION)(area->x + area->w) + 16, cinfo.output_width) - left;
+    jpeg_crop_scanline (&cinfo, &left, &width);
+
+    surface = SDL_CreateRGBSurfaceWithFormat (0, area->w, area->h, 32, DECODE_PIXELFORMAT);
+    rgb = SDL_malloc ((size_t)cinfo.output_width * 3);
+    if ((surface == NULL) || (rgb == NULL))
+        longjmp (jerr.jump, 1);
+
+    if (area->y > 0)
+        jpeg_skip_scanlines (&cinfo, (JDIMENSION)area->y);
+    for (y = 0; y < area->h; y++)
+    {
+        row = rgb;
+        jpeg_read_scanlines (&cinfo, &row, 1);
+
+        src = rgb + ((size_t)area->x - left) * 3;
+        dst = (unsigned char *)surface->pixels + (size_t)y * (size_t)surface->pitch;
+        for (x = 0; x < area->w; x++)
+        {
+            dst[x * 4 + 0] = src[x * 3 + 0];
+            dst[x * 4 + 1] = src[x * 3 + 1];
+            dst[x * 4 + 2] = src[x * 3 + 2];
+            dst[x * 4 + 3] = 0xFF;
+        }
+    }
+
+    /* the rows below area are never read */
+    jpeg_destroy_decompress (&cinfo);
+    SDL_free (rgb);
+
+    return surface;
+}
+#endif
+
+
+/* hand back loaded as DECODE_PIXELFORMAT, loaded is consumed */
+static SDL_Surface *
+decode_to_rgba (SDL_Surface *loaded)
+{
+    SDL_Surface *converted;
+
+    if ((loaded == NULL) || (loaded->format->format == DECODE_PIXELFORMAT))
+        return loaded;
+
+    converted = SDL_ConvertSurfaceFormat (loaded, DECODE_PIXELFORMAT, 0);
+    SDL_FreeSurface (loaded);
+
+    return converted;
+}
+
+
+/* turn an rgba surface upright, src is consumed */
+static SDL_Surface *
+decode_orient (SDL_Surface *src, int orientation)
+{
+    SDL_Surface *dst;
+    const Uint32 *sp;
+    ptrdiff_t start, step;
+    unsigned char *dp;
+    int x, y;
+
+    if ((src == NULL) || (orientation <= 1) || (orientation > 8))
+        return src;
+
+    dst = SDL_CreateRGBSurfaceWithFormat (0,
+                                          (orientation >= 5) ? src->h : src->w,
+                                          (orientation >= 5) ? src->w : src->h,
+                                          32, DECODE_PIXELFORMAT);
+    if (dst == NULL)
+        return src;
+
+    for (y = 0; y < src->h; y++)
+    {
+        sp = (const Uint32 *)((const unsigned char *)src->pixels + (size_t)y * (size_t)src->pitch);
+        decode_orient_row (dst, src->w, src->h, y, orientation, &start, &step);
+        dp = (unsigned char *)dst->pixels + start;
+        for (x = 0; x < src->w; x++, dp += step)
+        {
+            memcpy (dp, &sp[x], 4);
+        }
+    }
+    SDL_FreeSurface (src);
+
+    return dst;
+}
+
+
+/* the exif orientation, 1 (as stored) when there is none */
+static int
+decode_orientation (const unsigned char *data, size_t len)
+{
+    image_info info;
+
+    if (probe_mem (data, len, &info) != EXIT_SUCCESS)
+        return 1;
+
+    return (int)info.orientation;
+}
+
+
+
+/* area of the upright image as the rectangle of the stored one that
+   decode_orient turns into it.  false when it is not all inside */
+static bool
+decode_stored_area (const image_info *info, const SDL_Rect *area, SDL_Rect *stored)
+{
+    int orientation = (int)info->orientation;
+    int w = (int)info->w;
+    int h = (int)info->h;
+
+    /* first in the stored axes, then flipped along them */
+    *stored = *area;
+    if (orientation >= 5)
+    {
+        stored->x = area->y;
+        stored->y = area->x;
+        stored->w = area->h;
+        stored->h = area->w;
+    }
+    switch (orientation)
+    {
+    case 2:
+    case 3:
+    case 7:
+    case 8:
+        stored->x = w - stored->x - stored->w;
+        break;
+    default:
+        break;
+    }
+    switch (orientation)
+    {
+    case 3:
+    case 4:
+    case 6:
+    case 7:
+        stored->y = h - stored->y - stored->h;
+        break;
+    default:
+        break;
+    }
+
+    return (area->w > 0) && (area->h > 0) && (stored->x >= 0) && (stored->y >= 0) &&
+           (stored->x + stored->w <= w) && (stored->y + stored->h <= h);
+}
+
+
+static bool
+decode_match_any (const unsigned char *magic, size_t len)
+{
+    return true;
+}
+
+
+/* it only writes rows as stored and at full size */
+static SDL_Surface *
+baseline_load (const unsigned char *data, size_t len, int max_w, int max_h, int orientation)
+{
+    return baseline_decode (data, len);
+}
+
+
+static SDL_Surface *
+png_load (const unsigned char *data, size_t len, int max_w, int max_h, int orientation)
+{
+    return png_decode (data, len);
+}
+
+
+/* the first page, thumbnails and --compare have no page to turn to */
+static SDL_Surface *
+tiff_load (const unsigned char *data, size_t len, int max_w, int max_h, int orientation)
+{
+    return tiff_decode (data, len);
+}
+
+
+#ifdef USE_LIBWEBP
+static bool
+decode_is_webp (const unsigned char *magic, size_t len)
+{
+    return ((len >= 12) && (memcmp (magic, "RIFF", 4) == 0) && (memcmp (magic + 8, "WEBP", 4) == 0));
+}
+
+
+/* stills only, animations are ljpeg_anim's.  libwebp scales as it
+   decodes and splits the work over threads of its own */
+static SDL_Surface *
+webp_load (const unsigned char *data, size_t len, int max_w, int max_h, int orientation)
+{
+    WebPDecoderConfig config;
+    SDL_Surface *surface;
+    int w, h;
+    int t;
+
+    if (!WebPInitDecoderConfig (&config) ||
+        (WebPGetFeatures (data, len, &config.input) != VP8_STATUS_OK) ||
+        config.input.has_animation)
+        return (SDL_Surface *)NULL;
+
+    w = config.input.width;
+    h = config.input.height;
+    /* the box is for the image once turned */
+    if (orientation >= 5)
+    {
+        t = max_w;
+        max_w = max_h;
+        max_h = t;
+    }
+    if ((max_w > 0) && ((w > max_w) || (h > max_h)))
+    {
+        if ((long)w * max_h > (long)h * max_w)
+        {
+            h = SDL_max ((int)((long)h * max_w / w), 1);
+            w = max_w;
+        }
+        else
+        {
+            w = SDL_max ((int)((long)w * max_h / h), 1);
+            h = max_h;
+        }
+        config.options.use_scaling = 1;
+        config.options.scaled_width = w;
+        config.options.scaled_height = h;
+    }
+    config.options.use_threads = 1;
+
+    surface = SDL_CreateRGBSurfaceWithFormat (0, w, h, 32, DECODE_PIXELFORMAT);
+    if (surface == NULL)
+        return (SDL_Surface *)NULL;
+
+    config.output.colorspace = MODE_RGBA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = surface->pixels;
+    config.output.u.RGBA.stride = surface->pitch;
+    config.output.u.RGBA.size = (size_t)surface->pitch * (size_t)h;
+    if (WebPDecode (data, len, &config) != VP8_STATUS_OK)
+    {
+        SDL_FreeSurface (surface);
+        surface = NULL;
+    }
+    WebPFreeDecBuffer (&config.output);
+
+    return surface;
+}
+#endif
+
+
+static SDL_Surface *
+sdl_image_load (const unsigned char *data, size_t len, int max_w, int max_h, int orientation)
+{
+    /* SDL_RWops sizes are ints */
+    if (len > (size_t)INT_MAX)
+    {
+        SDL_SetError ("too big for SDL_image");
+        return (SDL_Surface *)NULL;
+    }
+
+    return decode_to_rgba (IMG_Load_RW (SDL_RWFromConstMem (data, (int)len), 1));
+}
+
+
+/* whether a backend after first takes the file and can do all of
+   wanted */
+static bool
+decode_better_later (int first, const unsigned char *data, size_t len, unsigned int wanted)
+{
+    int i;
+
+    for (i = first + 1; i < DECODE_BACKENDS; i++)
+    {
+        if (((s_backends[i].caps & wanted) == wanted) && s_backends[i].match (data, len))
+            return true;
+    }
+
+    return false;
+}
+
+
+/* called from the workers, hence the lock */
+static void
+decode_count (int backend, const SDL_Surface *loaded, Uint64 ticks)
+{
+    double ms = (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency ();
+
+    SDL_AtomicLock (&s_timing_lock);
+    if (loaded != NULL)
+    {
+        s_timing[backend].decoded++;
+        s_timing[backend].ms += ms;
+        s_timing[backend].pixels += (double)loaded->w * (double)loaded->h;
+    }
+    else
+    {
+        s_timing[backend].declined++;
+        s_timing[backend].declined_ms += ms;
+    }
+    SDL_AtomicUnlock (&s_timing_lock);
+}
+
+
+/* the first backend that decodes the file, upright.  max_w of 0 for
+   full size, otherwise the result is at least about max_w x max_h */
+static SDL_Surface *
+decode_dispatch (const unsigned char *data, size_t len, int max_w, int max_h)
+{
+    const decode_backend *backend = NULL;
+    SDL_Surface *loaded = NULL;
+    unsigned int wanted = 0;
+    int orientation = decode_orientation (data, len);
+    Uint64 start;
+    int i;
+
+    if (max_w > 0)
+        wanted |= DECODE_CAN_SCALE;
+    if (orientation > 1)
+        wanted |= DECODE_ORIENTS;
+
+    for (i = 0; (i < DECODE_BACKENDS) && (loaded == NULL); i++)
+    {
+        backend = &s_backends[i];
+        if (!backend->match (data, len))
+            continue;
+        if (((backend->caps & wanted) != wanted) && decode_better_later (i, data, len, wanted))
+            continue;
+
+        start = SDL_GetPerformanceCounter ();
+        loaded = backend->load (data, len, max_w, max_h, orientation);
+        decode_count (i, loaded, SDL_GetPerformanceCounter () - start);
+    }
+
+    if ((loaded != NULL) && !(backend->caps & DECODE_ORIENTS))
+        loaded = decode_orient (loaded, orientation);
+
+    return loaded;
+}
+
+/* function definitions */
+bool
+decode_is_jpeg (const unsigned char *magic, size_t len)
+{
+    return ((len >= 3) && (magic[0] == 0xFF) && (magic[1] == 0xD8) && (magic[2] == 0xFF));
+}
+
+
+bool
+decode_is_png (const unsigned char *magic, size_t len)
+{
+    return ((len >= 8) && (memcmp (magic, "\x89PNG\r\n\x1A\n", 8) == 0));
+}
+
+
+bool
+decode_is_tiff (const unsigned char *magic, size_t len)
+{
+    return ((len >= 4) && ((memcmp (magic, "II*\0", 4) == 0) || (memcmp (magic, "MM\0*", 4) == 0)));
+}
+
+
+/* whether a backend that takes the file can do all of caps */
+bool
+decode_can (const unsigned char *magic, size_t len, unsigned int caps)
+{
+    int i;
+
+    for (i = 0; i < DECODE_BACKENDS; i++)
+    {
+        if (((s_backends[i].caps & caps) == caps) && s_backends[i].match (magic, len))
+            return true;
+    }
+
+    return false;
+}
+
+
+/* decode an in-memory file no larger than max_w x max_h, keeping its
+   aspect ratio */
+SDL_Surface *
+decode_load_scaled (const unsigned char *data, size_t len, int max_w, int max_h)
+{
+    SDL_Surface *loaded;
+    SDL_Surface *fitted;
+
+    /* backends that cannot scale decode at full size, reduced here */
+    loaded = decode_dispatch (data, len, max_w, max_h);
+    if (loaded == NULL)
+        return (SDL_Surface *)NULL;
+
+    fitted = decode_fit_surface (loaded, max_w, max_h);
+    if (fitted != loaded)
+        SDL_FreeSurface (loaded);
+
+    return fitted;
+}
+
+
+/* decode a whole in-memory file at full size */
+SDL_Surface *
+decode_load_mem (const unsigned char *data, size_t len)
+{
+    return decode_dispatch (data, len, 0, 0);
+}
+
+
+/* decode only area of an in-memory file, in the upright image's
+   pixels.  NULL when no backend for the file can decode part of it, it
+   is not decoded whole to be cropped */
+SDL_Surface *
+decode_load_region (const unsigned char *data, size_t len, const SDL_Rect *area)
+{
+    SDL_Surface *loaded = NULL;
+    SDL_Rect stored;
+    image_info info;
+    bool tried = false;
+    Uint64 start;
+    int i;
+
+    if ((probe_mem (data, len, &info) != EXIT_SUCCESS) || (info.w == 0) ||
+        !decode_stored_area (&info, area, &stored))
+    {
+        SDL_SetError ("region is outside the image");
+        return (SDL_Surface *)NULL;
+    }
+
+    for (i = 0; (i < DECODE_BACKENDS) && (loaded == NULL); i++)
+    {
+        if ((s_backends[i].region == NULL) || !s_backends[i].match (data, len))
+            continue;
+
+        tried = true;
+        start = SDL_GetPerformanceCounter ();
+        loaded = s_backends[i].region (data, len, &stored);
+        decode_count (i, loaded, SDL_GetPerformanceCounter () - start);
+    }
+    if (loaded == NULL)
+    {
+        if (!tried)
+            SDL_SetError ("no decoder for the file decodes part of it");
+        return (SDL_Surface *)NULL;
+    }
+
+    return decode_orient (loaded, (int)info.orientation);
+}
+
+
+/* box filter an rgba surface down into max_w x max_h.
+   returns src itself when it already fits */
+SDL_Surface *
+decode_fit_surface (SDL_Surface *src, int max_w, int max_h)
+{
+    SDL_Surface *dst;
+    const unsigned char *sp;
+    unsigned char *dp;
+    unsigned int sum[4];
+    unsigned int count;
+    int dst_w, dst_h;
+    int x, y, sx, sy;
+    int x0, x1, y0, y1;
+    int c;
+
+    if ((src->w <= max_w) && (src->h <= max_h))
+        return src;
+
+    /* scale by the tighter of the two axes */
+    if ((long)src->w * max_h > (long)src->h * max_w)
+    {
+        dst_w = max_w;
+        dst_h = (int)((long)src->h * max_w / src->w);
+    }
+    else
+    {
+        dst_h = max_h;
+        dst_w = (int)((long)src->w * max_h / src->h);
+    }
+    if (dst_w < 1)
+        dst_w = 1;
+    if (dst_h < 1)
+        dst_h = 1;
+
+    dst = SDL_CreateRGBSurfaceWithFormat (0, dst_w, dst_h, 32, DECODE_PIXELFORMAT);
+    if (dst == NULL)
+        return (SDL_Surface *)NULL;
+
+    for (y = 0; y < dst_h; y++)
+    {
+        y0 = (int)((long)y * src->h / dst_h);
+        y1 = (int)((long)(y + 1) * src->h / dst_h);
+        if (y1 <= y0)
+            y1 = y0 + 1;
+
+        dp = (unsigned char *)dst->pixels + (size_t)y * (size_t)dst->pitch;
+        for (x = 0; x < dst_w; x++)
+        {
+            x0 = (int)((long)x * src->w / dst_w);
+            x1 = (int)((long)(x + 1) * src->w / dst_w);
+            if (x1 <= x0)
+                x1 = x0 + 1;
+
+            sum[0] = sum[1] = sum[2] = sum[3] = 0;
+            for (sy = y0; sy < y1; sy++)
+            {
+                sp = (const unsigned char *)src->pixels + (size_t)sy * (size_t)src->pitch + (size_t)x0 * 4;
+                for (sx = x0; sx < x1; sx++, sp += 4)
+                {
+                    sum[0] += sp[0];
+                    sum[1] += sp[1];
+                    sum[2] += sp[2];
+                    sum[3] += sp[3];
+                }
+            }
+
+            count = (unsigned int)((x1 - x0) * (y1 - y0));
+            for (c = 0; c < 4; c++)
+            {
+                dp[x * 4 + c] = (unsigned char)(sum[c] / count);
+            }
+        }
+    }
+
+    return dst;
+}
+
+
+/* copy out the figures of up to max backends, in registry order.
+   returns how many there are */
+int
+decode_get_timing (decode_timing *timing, int max)
+{
+    int i;
+
+    SDL_AtomicLock (&s_timing_lock);
+    for (i = 0; (i < DECODE_BACKENDS) && (i < max); i++)
+    {
+        timing[i] = s_timing[i];
+        timing[i].name = s_backends[i].name;
+        timing[i].caps = s_backends[i].caps;
+    }
+    SDL_AtomicUnlock (&s_timing_lock);
+
+    return DECODE_BACKENDS;
+}
+
+
+/* a line per backend that has been given anything.  caps are s(cale),
+   r(egion), t(hreads), i(ncremental) and o(rients) */
+void
+decode_print_timing (FILE *out)
+{
+    decode_timing timing[DECODE_BACKENDS];
+    char caps[6];
+    int i;
+
+    decode_get_timing (timing, DECODE_BACKENDS);
+
+    fprintf (out, "%-10s %-5s %8s %8s %11s %9s %11s\n",
+             "decoder", "caps", "decoded", "declined", "ms", "MP/s", "declined ms");
+    for (i = 0; i < DECODE_BACKENDS; i++)
+    {
+        if (timing[i].decoded + timing[i].declined == 0)
+            continue;
+
+        caps[0] = (timing[i].caps & DECODE_CAN_SCALE) ? 's' : '-';
+        caps[1] = (timing[i].caps & DECODE_CAN_REGION) ? 'r' : '-';
+        caps[2] = (timing[i].caps & DECODE_THREADED) ? 't' : '-';
+        caps[3] = (timing[i].caps & DECODE_INCREMENTAL) ? 'i' : '-';
+        caps[4] = (timing[i].caps & DECODE_ORIENTS) ? 'o' : '-';
+        caps[5] = '\0';
+        fprintf (out, "%-10s %-5s %8llu %8llu %11.1f %9.1f %11.1f\n",
+                 timing[i].name, caps,
+                 (unsigned long long)timing[i].decoded, (unsigned long long)timing[i].declined,
+                 timing[i].ms,
+                 (timing[i].ms > 0.0) ? timing[i].pixels / 1000.0 / timing[i].ms : 0.0,
+                 timing[i].declined_ms);
+    }
+}
+
+
+/* End of File */
@@ -0,0 +1,98 @@
+/*
+   source/ljpeg_decode.h
+   LJPEG off-screen image decoding header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_DECODE_HEADER__
+#define __LJPEG_DECODE_HEADER__
+
+/* include headers */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+
+/* custom datatypes */
+/* what a backend can do past decoding a whole file at full size */
+typedef enum decode_caps
+{
+    DECODE_CAN_SCALE   = 1 << 0,    /* decodes straight to about max_w x max_h */
+    DECODE_CAN_REGION  = 1 << 1,    /* decodes part of the image on its own */
+    DECODE_THREADED    = 1 << 2,    /* runs threads of its own */
+    DECODE_INCREMENTAL = 1 << 3,    /* can make use of a file still arriving */
+    DECODE_ORIENTS     = 1 << 4     /* applies the exif orientation itself */
+} decode_caps;
+
+/* one decoder, picked by the file's first bytes.  load hands back a
+   DECODE_PIXELFORMAT surface, or NULL to pass the file on to the next
+   backend that matches.  region, for DECODE_CAN_REGION backends, hands
+   back only area of the image, as stored and before any turning */
+typedef struct decode_backend
+{
+    const char   *name;
+    unsigned int  caps;
+    bool        (*match) (const unsigned char *magic, size_t len);
+    SDL_Surface *(*load) (const unsigned char *data, size_t len, int max_w, int max_h,
+                          int orientation);
+    SDL_Surface *(*region) (const unsigned char *data, size_t len, const SDL_Rect *area);
+} decode_backend;
+
+/* what a backend has been given since the program started */
+typedef struct decode_timing
+{
+    const char   *name;
+    unsigned int  caps;
+    uint64_t      decoded;
+    uint64_t      declined;
+    double        ms;           /* spent on the files it decoded */
+    double        declined_ms;  /* and on the ones it passed on */
+    double        pixels;
+} decode_timing;
+
+
+/* constants */
+/* every surface returned by this module uses this layout */
+#define DECODE_PIXELFORMAT SDL_PIXELFORMAT_RGBA32
+
+
+/* global variables */
+
+
+/* external function prototypes */
+/* these never touch the renderer, so they are safe to call from workers */
+bool decode_is_jpeg (const unsigned char *magic, size_t len);
+bool decode_is_png  (const unsigned char *magic, size_t len);
+bool decode_is_tiff (const unsigned char *magic, size_t len);
+bool decode_can     (const unsigned char *magic, size_t len, unsigned int caps);
+
+int  decode_get_timing   (decode_timing *timing, int max);
+void decode_print_timing (FILE *out);
+
+SDL_Surface *decode_load_scaled (const unsigned char *data, size_t len, int max_w, int max_h);
+SDL_Surface *decode_load_mem    (const unsigned char *data, size_t len);
+SDL_Surface *decode_load_region (const unsigned char *data, size_t len, const SDL_Rect *area);
+SDL_Surface *decode_fit_surface (SDL_Surface *src, int max_w, int max_h);
+
+#endif /* end run once */
+
+
+/* End of File */
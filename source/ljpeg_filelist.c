@@ -0,0 +1,280 @@
+/*
+   source/ljpeg_filelist.c
+   LJPEG directory listing source code.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_filelist.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_zip.h"
+
+
+/* file static variables */
+/* extensions SDL_image (or ljpeg_hdr) can usually open */
+static const char *s_image_extensions[] =
+{
+    "jpg", "jpeg", "jpe", "jfif", "png", "gif", "webp", "bmp", "tif",
+    "tiff", "tga", "pnm", "ppm", "pgm", "pbm", "xpm", "qoi", "avif",
+    "jxl", "svg", "lbm", "pcx", "hdr", "pfm", "exr",
+    NULL
+};
+
+
+/* file static function prototypes */
+static int  compare_paths (const void *a, const void *b);
+static int  filelist_load_archive (filelist *list, const char *path);
+static bool extension_equals (const char *ext, const char *want);
+
+
+/* static function definitions */
+static bool
+extension_equals (const char *ext, const char *want)
+{
+    while ((*ext != '\0') && (*want != '\0'))
+    {
+        if (tolower ((unsigned char)*ext) != *want)
+            return false;
+        ext++;
+        want++;
+    }
+
+    return ((*ext == '\0') && (*want == '\0'));
+}
+
+
+/* natural order, so "img_2" sorts before "img_10" */
+static int
+compare_paths (const void *a, const void *b)
+{
+    const char *s1 = *(const char * const *)a;
+    const char *s2 = *(const char * const *)b;
+    unsigned long n1, n2;
+    char *end1, *end2;
+
+    while ((*s1 != '\0') && (*s2 != '\0'))
+    {
+        if (isdigit ((unsigned char)*s1) && isdigit ((unsigned char)*s2))
+        {
+            n1 = strtoul (s1, &end1, 10);
+            n2 = strtoul (s2, &end2, 10);
+            if (n1 != n2)
+                return (n1 < n2) ? -1 : 1;
+            s1 = end1;
+            s2 = end2;
+            continue;
+        }
+        if (*s1 != *s2)
+            return ((unsigned char)*s1 < (unsigned char)*s2) ? -1 : 1;
+        s1++;
+        s2++;
+    }
+
+    return ((unsigned char)*s1 - (unsigned char)*s2);
+}
+
+
+/* list every image in a zip/cbz, the archive stays open (and its
+   entries readable by path) until the list is freed */
+static int
+filelist_load_archive (filelist *list, const char *path)
+{
+    char *member;
+    size_t len;
+    int i;
+
+    list->archive = zip_open (path);
+    if (list->archive == NULL)
+    {
+        fprintf (stderr, "%s\n", SDL_GetError ());
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < list->archive->count; i++)
+    {
+        len = strlen (path) + 1 + strlen (list->archive->entries[i].name) + 1;
+        member = malloc (len);
+        if (member == NULL)
+            return EXIT_FAILURE;
+        snprintf (member, len, "%s/%s", path, list->archive->entries[i].name);
+        if (filelist_add (list, member) != EXIT_SUCCESS)
+        {
+            free (member);
+            return EXIT_FAILURE;
+        }
+        free (member);
+    }
+
+    qsort (list->paths, (size_t)list->count, sizeof (char *), compare_paths);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* function definitions */
+bool
+filelist_is_directory (const char *path)
+{
+    struct stat st;
+
+    if (stat (path, &st) != 0)
+        return false;
+
+    return S_ISDIR (st.st_mode);
+}
+
+
+bool
+filelist_is_image (const char *name)
+{
+    const char *ext;
+    int i;
+
+    ext = strrchr (name, '.');
+    if ((ext == NULL) || (ext == name))
+        return false;
+    ext++;
+
+    for (i = 0; s_image_extensions[i] != NULL; i++)
+    {
+        if (extension_equals (ext, s_image_extensions[i]))
+            return true;
+    }
+
+    return false;
+}
+
+
+int
+filelist_add (filelist *list, const char *path)
+{
+    char **grown;
+    int new_cap;
+
+    if (list->count == list->capacity)
+    {
+        new_cap = (list->capacity == 0) ? 256 : list->capacity * 2;
+        grown = realloc (list->paths, (size_t)new_cap * sizeof (char *));
+        if (grown == NULL)
+            return EXIT_FAILURE;
+        list->paths = grown;
+        list->capacity = new_cap;
+    }
+
+    list->paths[list->count] = malloc (strlen (path) + 1);
+    if (list->paths[list->count] == NULL)
+        return EXIT_FAILURE;
+    strcpy (list->paths[list->count], path);
+    list->count++;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* list every image file directly inside of directory */
+int
+filelist_load (filelist *list, const char *directory)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char *path;
+    size_t dir_len, path_len;
+
+    memset (list, 0, sizeof (filelist));
+
+    list->directory = malloc (strlen (directory) + 1);
+    if (list->directory == NULL)
+        goto filelist_load_failure_0;
+    strcpy (list->directory, directory);
+
+    if (zip_is_archive (directory))
+    {
+        if (filelist_load_archive (list, directory) != EXIT_SUCCESS)
+            goto filelist_load_failure_1;
+        return EXIT_SUCCESS;
+    }
+
+    dir = opendir (directory);
+    if (dir == NULL)
+    {
+        perror (directory);
+        goto filelist_load_failure_1;
+    }
+
+    dir_len = strlen (directory);
+    while ((entry = readdir (dir)) != NULL)
+    {
+        if ((entry->d_name[0] == '.') || !filelist_is_image (entry->d_name))
+            continue;
+
+        path_len = dir_len + 1 + strlen (entry->d_name) + 1;
+        path = malloc (path_len);
+        if (path == NULL)
+            goto filelist_load_failure_2;
+        snprintf (path, path_len, "%s/%s", directory, entry->d_name);
+
+        if (filelist_is_directory (path) || (filelist_add (list, path) != EXIT_SUCCESS))
+        {
+            free (path);
+            continue;
+        }
+        free (path);
+    }
+    closedir (dir);
+
+    qsort (list->paths, (size_t)list->count, sizeof (char *), compare_paths);
+
+/* filelist_load_success_0: */
+    return EXIT_SUCCESS;
+
+filelist_load_failure_2:
+    closedir (dir);
+filelist_load_failure_1:
+    filelist_free (list);
+filelist_load_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+void
+filelist_free (filelist *list)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++)
+    {
+        free (list->paths[i]);
+    }
+    free (list->paths);
+    free (list->directory);
+    zip_close (list->archive);
+    memset (list, 0, sizeof (filelist));
+}
+
+
+/* End of File */
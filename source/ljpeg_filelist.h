@@ -0,0 +1,62 @@
+/*
+   source/ljpeg_filelist.h
+   LJPEG directory listing header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_FILELIST_HEADER__
+#define __LJPEG_FILELIST_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+
+#include "ljpeg_zip.h"
+
+
+/* custom datatypes */
+typedef struct filelist
+{
+    char  *directory;
+    char **paths;       /* full paths, sorted by name */
+    int    count;
+    int    capacity;
+    zip_archive *archive;   /* when directory is a zip/cbz, its paths
+                               are ARCHIVE/NAME */
+} filelist;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+bool filelist_is_directory (const char *path);
+bool filelist_is_image     (const char *name);
+
+int  filelist_load (filelist *list, const char *directory);
+int  filelist_add  (filelist *list, const char *path);
+void filelist_free (filelist *list);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,541 @@
+/*
+   source/ljpeg_gif.c
+   LJPEG incremental GIF frame source.
+
+   Decodes one frame per call straight from the file bytes, so the
+   player never needs more than its ring of composited frames.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_anim.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* file static variables */
+#define GIF_MAX_CODES 4096
+
+typedef struct gif_state
+{
+    const unsigned char *data;
+    size_t               len;
+    size_t               first_block;
+    size_t               pos;
+
+    unsigned char        global_palette[256 * 3];
+    int                  global_colors;
+
+    /* graphic control extension of the coming frame */
+    int                  transparent;
+    int                  delay_cs;
+    int                  dispose;
+
+    /* disposal still owed by the previous frame */
+    int                  prev_dispose;
+    SDL_Rect             prev_rect;
+    unsigned char       *saved;
+
+    unsigned char       *indices;
+    size_t               indices_len;
+
+    /* lzw sub-block reader */
+    int                  block_left;
+    bool                 data_done;
+
+    unsigned short       prefix[GIF_MAX_CODES];
+    unsigned char        suffix[GIF_MAX_CODES];
+    unsigned char        stack[GIF_MAX_CODES + 1];
+} gif_state;
+
+
+/* file static function prototypes */
+static bool gif_skip_blocks (const unsigned char *data, size_t len, size_t *pos);
+static int  gif_count_frames (const unsigned char *data, size_t len, size_t pos);
+static int  gif_read_byte (gif_state *st);
+static size_t gif_lzw_decode (gif_state *st, int min_code_size, unsigned char *out, size_t out_len);
+static void gif_clear_rect (SDL_Surface *canvas, const SDL_Rect *rect);
+static void gif_copy_rect (SDL_Surface *canvas, const SDL_Rect *rect, unsigned char *buffer, bool save);
+static int  gif_next (anim_source *src, SDL_Surface *canvas, int *delay_ms);
+static void gif_rewind (anim_source *src, SDL_Surface *canvas);
+static void gif_close (anim_source *src);
+
+
+/* static function definitions */
+/* step over a chain of data sub-blocks */
+static bool
+gif_skip_blocks (const unsigned char *data, size_t len, size_t *pos)
+{
+    while (*pos < len)
+    {
+        if (data[*pos] == 0)
+        {
+            (*pos)++;
+            return true;
+        }
+        *pos += (size_t)data[*pos] + 1;
+    }
+
+    return false;
+}
+
+
+/* walk the block structure without decoding any pixels */
+static int
+gif_count_frames (const unsigned char *data, size_t len, size_t pos)
+{
+    int frames = 0;
+    int flags;
+
+    while (pos < len)
+    {
+        switch (data[pos])
+        {
+        case 0x21:
+            pos += 2;
+            if (!gif_skip_blocks (data, len, &pos))
+                return frames;
+            break;
+        case 0x2C:
+            if (pos + 10 > len)
+                return frames;
+            flags = data[pos + 9];
+            pos += 10;
+            if (flags & 0x80)
+                pos += (size_t)3 << ((flags & 0x07) + 1);
+            pos++;
+            if (!gif_skip_blocks (data, len, &pos))
+                return frames;
+            frames++;
+            break;
+        default:
+            /* 0x3B trailer, or garbage */
+            return frames;
+        }
+    }
+
+    return frames;
+}
+
+
+/* next byte of lzw data, -1 at the end of the sub-block chain */
+static int
+gif_read_byte (gif_state *st)
+{
+    if (st->data_done || (st->pos >= st->len))
+        return -1;
+
+    if (st->block_left == 0)
+    {
+        st->block_left = st->data[st->pos++];
+        if ((st->block_left == 0) || (st->pos >= st->len))
+        {
+            st->data_done = true;
+            return -1;
+        }
+    }
+
+    st->block_left--;
+    return st->data[st->pos++];
+}
+
+
+static size_t
+gif_lzw_decode (gif_state *st, int min_code_size, unsigned char *out, size_t out_len)
+{
+    int clear = 1 << min_code_size;
+    int end = clear + 1;
+    int next_code = clear + 2;
+    int code_size = min_code_size + 1;
+    int prev = -1;
+    int first = 0;
+    int code, cur, byte;
+    unsigned int bits = 0;
+    int nbits = 0;
+    size_t written = 0;
+    int sp;
+
+    st->block_left = 0;
+    st->data_done = false;
+
+    while (written < out_len)
+    {
+        while (nbits < code_size)
+        {
+            byte = gif_read_byte (st);
+            if (byte < 0)
+                return written;
+            bits |= (unsigned int)byte << nbits;
+            nbits += 8;
+        }
+        code = (int)(bits & ((1u << code_size) - 1));
+        bits >>= code_size;
+        nbits -= code_size;
+
+        if (code == clear)
+        {
+            code_size = min_code_size + 1;
+            next_code = clear + 2;
+            prev = -1;
+            continue;
+        }
+        if ((code == end) || (code > next_code) || ((prev < 0) && (code >= clear)))
+            break;
+
+        if (prev < 0)
+        {
+            first = code;
+            out[written++] = (unsigned char)code;
+            prev = code;
+            continue;
+        }
+
+        /* unwind the string for code, the KwKwK case repeats its first byte */
+        sp = 0;
+        cur = code;
+        if (code == next_code)
+        {
+            st->stack[sp++] = (unsigned char)first;
+            cur = prev;
+        }
+        while ((cur >= clear) && (sp < GIF_MAX_CODES))
+        {
+            st->stack[sp++] = st->suffix[cur];
+            cur = st->prefix[cur];
+        }
+        first = cur;
+        st->stack[sp++] = (unsigned char)first;
+
+        while ((sp > 0) && (written < out_len))
+        {
+            out[written++] = st->stack[--sp];
+        }
+
+        if (next_code < GIF_MAX_CODES)
+        {
+            st->prefix[next_code] = (unsigned short)prev;
+            st->suffix[next_code] = (unsigned char)first;
+            next_code++;
+            if ((next_code == (1 << code_size)) && (code_size < 12))
+                code_size++;
+        }
+        prev = code;
+    }
+
+    return written;
+}
+
+
+static void
+gif_clear_rect (SDL_Surface *canvas, const SDL_Rect *rect)
+{
+    int y;
+
+    for (y = rect->y; y < rect->y + rect->h; y++)
+    {
+        memset ((unsigned char *)canvas->pixels + (size_t)y * (size_t)canvas->pitch + (size_t)rect->x * 4,
+                0, (size_t)rect->w * 4);
+    }
+}
+
+
+/* save a canvas rectangle into buffer, or restore it back */
+static void
+gif_copy_rect (SDL_Surface *canvas, const SDL_Rect *rect, unsigned char *buffer, bool save)
+{
+    unsigned char *row;
+    size_t row_len = (size_t)rect->w * 4;
+    int y;
+
+    for (y = 0; y < rect->h; y++)
+    {
+        row = (unsigned char *)canvas->pixels + (size_t)(rect->y + y) * (size_t)canvas->pitch + (size_t)rect->x * 4;
+        if (save)
+            memcpy (buffer + (size_t)y * row_len, row, row_len);
+        else
+            memcpy (row, buffer + (size_t)y * row_len, row_len);
+    }
+}
+
+
+static int
+gif_next (anim_source *src, SDL_Surface *canvas, int *delay_ms)
+{
+    gif_state *st = (gif_state *)src->state;
+    const unsigned char *palette;
+    const unsigned char *color;
+    unsigned char *dst;
+    SDL_Rect rect, clip;
+    int frame_w, frame_h;
+    int flags, colors;
+    int min_code_size;
+    int pass, step, row, y, x;
+    int index;
+
+    /* finish off the previous frame */
+    if (st->prev_dispose == 2)
+        gif_clear_rect (canvas, &st->prev_rect);
+    else if (st->prev_dispose == 3)
+        gif_copy_rect (canvas, &st->prev_rect, st->saved, false);
+    st->prev_dispose = 0;
+
+    while (st->pos < st->len)
+    {
+        if (st->data[st->pos] == 0x21)
+        {
+            /* graphic control extension, everything else is skipped */
+            if ((st->pos + 7 < st->len) && (st->data[st->pos + 1] == 0xF9) && (st->data[st->pos + 2] >= 4))
+            {
+                flags = st->data[st->pos + 3];
+                st->dispose = (flags >> 2) & 0x07;
+                st->delay_cs = st->data[st->pos + 4] | (st->data[st->pos + 5] << 8);
+                st->transparent = (flags & 0x01) ? st->data[st->pos + 6] : -1;
+            }
+            st->pos += 2;
+            if (!gif_skip_blocks (st->data, st->len, &st->pos))
+                return EXIT_FAILURE;
+            continue;
+        }
+        if (st->data[st->pos] != 0x2C)
+            return EXIT_FAILURE;
+        break;
+    }
+    if (st->pos + 10 > st->len)
+        return EXIT_FAILURE;
+
+    /* image descriptor */
+    frame_w = st->data[st->pos + 5] | (st->data[st->pos + 6] << 8);
+    frame_h = st->data[st->pos + 7] | (st->data[st->pos + 8] << 8);
+    rect.x = st->data[st->pos + 1] | (st->data[st->pos + 2] << 8);
+    rect.y = st->data[st->pos + 3] | (st->data[st->pos + 4] << 8);
+    rect.w = frame_w;
+    rect.h = frame_h;
+    flags = st->data[st->pos + 9];
+    st->pos += 10;
+
+    palette = st->global_palette;
+    colors = st->global_colors;
+    if (flags & 0x80)
+    {
+        colors = 1 << ((flags & 0x07) + 1);
+        if (st->pos + (size_t)colors * 3 > st->len)
+            return EXIT_FAILURE;
+        palette = st->data + st->pos;
+        st->pos += (size_t)colors * 3;
+    }
+    if (st->pos >= st->len)
+        return EXIT_FAILURE;
+    min_code_size = st->data[st->pos++];
+    if ((min_code_size < 2) || (min_code_size > 11))
+        return EXIT_FAILURE;
+
+    /* the part of the frame that is actually on the canvas */
+    clip = rect;
+    if (clip.x + clip.w > src->w)
+        clip.w = src->w - clip.x;
+    if (clip.y + clip.h > src->h)
+        clip.h = src->h - clip.y;
+    if (clip.w < 0)
+        clip.w = 0;
+    if (clip.h < 0)
+        clip.h = 0;
+
+    if (st->dispose == 3)
+        gif_copy_rect (canvas, &clip, st->saved, true);
+
+    /* frames may overhang the canvas, the index buffer has to hold all of it */
+    if ((size_t)frame_w * (size_t)frame_h > st->indices_len)
+    {
+        free (st->indices);
+        st->indices_len = (size_t)frame_w * (size_t)frame_h;
+        st->indices = malloc (st->indices_len);
+        if (st->indices == NULL)
+        {
+            st->indices_len = 0;
+            return EXIT_FAILURE;
+        }
+    }
+    memset (st->indices, 0, (size_t)frame_w * (size_t)frame_h);
+    gif_lzw_decode (st, min_code_size, st->indices, (size_t)frame_w * (size_t)frame_h);
+    if (!st->data_done)
+    {
+        /* the frame filled up before its end code, drop the rest */
+        st->pos += st->block_left;
+        if (!gif_skip_blocks (st->data, st->len, &st->pos))
+            return EXIT_FAILURE;
+    }
+
+    /* composite, walking the interlace passes when needed */
+    pass = (flags & 0x40) ? 0 : 3;
+    row = 0;
+    y = 0;
+    step = (flags & 0x40) ? 8 : 1;
+    for (index = 0; index < frame_h; index++)
+    {
+        if (y < clip.h)
+        {
+            dst = (unsigned char *)canvas->pixels + (size_t)(rect.y + y) * (size_t)canvas->pitch + (size_t)rect.x * 4;
+            for (x = 0; x < clip.w; x++)
+            {
+                int c = st->indices[(size_t)row * (size_t)frame_w + (size_t)x];
+                if ((c == st->transparent) || (c >= colors))
+                    continue;
+                color = palette + c * 3;
+                dst[x * 4 + 0] = color[0];
+                dst[x * 4 + 1] = color[1];
+                dst[x * 4 + 2] = color[2];
+                dst[x * 4 + 3] = 0xFF;
+            }
+        }
+
+        row++;
+        y += step;
+        while ((y >= frame_h) && (pass < 3))
+        {
+            pass++;
+            y = (pass == 1) ? 4 : (pass == 2) ? 2 : 1;
+            step = (pass == 1) ? 8 : (pass == 2) ? 4 : 2;
+        }
+    }
+
+    /* browsers treat 0 and 10ms delays as 100ms, so do we */
+    *delay_ms = (st->delay_cs <= 1) ? 100 : st->delay_cs * 10;
+
+    st->prev_dispose = st->dispose;
+    st->prev_rect = clip;
+    st->dispose = 0;
+    st->delay_cs = 0;
+    st->transparent = -1;
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+gif_rewind (anim_source *src, SDL_Surface *canvas)
+{
+    gif_state *st = (gif_state *)src->state;
+    SDL_Rect all = { 0, 0, 0, 0 };
+
+    all.w = src->w;
+    all.h = src->h;
+    gif_clear_rect (canvas, &all);
+
+    st->pos = st->first_block;
+    st->prev_dispose = 0;
+    st->dispose = 0;
+    st->delay_cs = 0;
+    st->transparent = -1;
+}
+
+
+static void
+gif_close (anim_source *src)
+{
+    gif_state *st = (gif_state *)src->state;
+
+    if (st != NULL)
+    {
+        free (st->saved);
+        free (st->indices);
+        free (st);
+    }
+    src->state = NULL;
+}
+
+
+/* function definitions */
+int
+gif_anim_open (anim_source *src, const unsigned char *data, size_t len)
+{
+    gif_state *st;
+    size_t pos;
+    int flags;
+    int i;
+
+    if ((len < 13) || ((memcmp (data, "GIF87a", 6) != 0) && (memcmp (data, "GIF89a", 6) != 0)))
+        return EXIT_FAILURE;
+
+    st = calloc (1, sizeof (gif_state));
+    if (st == NULL)
+        return EXIT_FAILURE;
+
+    src->w = data[6] | (data[7] << 8);
+    src->h = data[8] | (data[9] << 8);
+    flags = data[10];
+    pos = 13;
+
+    if (flags & 0x80)
+    {
+        st->global_colors = 1 << ((flags & 0x07) + 1);
+        if (pos + (size_t)st->global_colors * 3 > len)
+            goto gif_anim_open_failure_0;
+        memcpy (st->global_palette, data + pos, (size_t)st->global_colors * 3);
+        pos += (size_t)st->global_colors * 3;
+    }
+    else
+    {
+        st->global_colors = 256;
+        for (i = 0; i < 256; i++)
+        {
+            st->global_palette[i * 3 + 0] = (unsigned char)i;
+            st->global_palette[i * 3 + 1] = (unsigned char)i;
+            st->global_palette[i * 3 + 2] = (unsigned char)i;
+        }
+    }
+
+    src->frame_count = gif_count_frames (data, len, pos);
+    if ((src->w <= 0) || (src->h <= 0) || (src->frame_count < 2))
+        goto gif_anim_open_failure_0;
+
+    st->saved = malloc ((size_t)src->w * (size_t)src->h * 4);
+    st->indices_len = (size_t)src->w * (size_t)src->h;
+    st->indices = malloc (st->indices_len);
+    if ((st->saved == NULL) || (st->indices == NULL))
+        goto gif_anim_open_failure_1;
+
+    st->data = data;
+    st->len = len;
+    st->first_block = pos;
+    st->pos = pos;
+    st->transparent = -1;
+
+    src->state = st;
+    src->next = gif_next;
+    src->rewind = gif_rewind;
+    src->close = gif_close;
+
+/* gif_anim_open_success_0: */
+    return EXIT_SUCCESS;
+
+gif_anim_open_failure_1:
+    free (st->saved);
+    free (st->indices);
+gif_anim_open_failure_0:
+    free (st);
+    return EXIT_FAILURE;
+}
+
+
+/* End of File */
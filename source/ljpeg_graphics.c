@@ -29,12 +29,29 @@
 #include <math.h>
 
 #include "ljpeg_config.h"
+#include "ljpeg_anim.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_sequence.h"
+#include "ljpeg_stream.h"
+#include "ljpeg_raw.h"
+#include "ljpeg_io.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_memory.h"
+#include "ljpeg_probe.h"
+#include "ljpeg_renderer.h"
+#include "ljpeg_compare.h"
+#include "ljpeg_stats.h"
+#include "ljpeg_hdr.h"
+#include "ljpeg_tiff.h"
+#include "ljpeg_icc.h"
 
 
 /* global variable declarations */
 SDL_Window   *g_win;
 SDL_Renderer *g_rend;
 texture       g_img;
+viewport      g_viewport = { .fixed = FIXED_VIEWPORT };
 
 
 /* file static variables */
@@ -44,6 +61,25 @@ texture       g_img;
 static double deg2rad (double deg);
 /* static double rad2deg (double rad); */
 static void log_sdl_error (const char *string_template);
+static void graphics_texture_reset (texture *tex);
+static void graphics_source_size (texture *tex);
+static void graphics_account (texture *tex);
+static void graphics_drop_detail (texture *tex);
+static bool graphics_screen_size (int *w, int *h);
+static SDL_Surface *graphics_decode (const unsigned char *data, size_t len, bool reduce,
+                                     bool *reduced, int *full_w, int *full_h);
+static SDL_Surface *graphics_decode_path (const char *path);
+static void graphics_quarter_turn (double *x, double *y, int quarters);
+static bool graphics_fixed_area (texture *tex, int out_w, int out_h,
+                                 double corner_x[2], double corner_y[2]);
+static void graphics_render_fixed (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels);
+static void graphics_render_part (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels,
+                                  const SDL_Rect *part, const double corner_x[2],
+                                  const double corner_y[2]);
+static void graphics_update_region (texture *tex);
+static void graphics_page_title (void);
+static int  graphics_tiff_fill (void *arg, uint16_t *rgba);
+static int  graphics_deep_page (int page);
 
 /* static function definitions */
 /* 
@@ -67,6 +103,397 @@ log_sdl_error (const char *string_template)
 }
 
 
+/* size a freshly loaded texture and put it back to the defaults */
+static void
+graphics_texture_reset (texture *tex)
+{
+    /* set texture sizeing */
+    graphics_source_size (tex);
+    graphics_account (tex);
+    
+    /* set default positioning */ 
+    tex->source.x = 0;
+    tex->source.y = 0;
+
+    /* set default rotation and scale */
+    tex->scale    = INITIAL_SCALE;
+    tex->rotation = 0;
+    tex->view_fit = true;
+
+    /* project the texture onto projection */
+    graphics_project (tex);
+}
+
+
+/* a reduced texture still stands in for the whole image */
+static void
+graphics_source_size (texture *tex)
+{
+    if (tex->reduced)
+    {
+        tex->source.w = tex->full_w;
+        tex->source.h = tex->full_h;
+        return;
+    }
+
+    SDL_QueryTexture (tex->texture, NULL, NULL, &(tex->source.w), &(tex->source.h));
+}
+
+
+/* count tex's pixels, and its detail's, against --max-memory in place
+   of what was counted for it before */
+static void
+graphics_account (texture *tex)
+{
+    Uint32 format;
+    int w, h;
+
+    arena_account (-(ptrdiff_t)tex->bytes);
+    tex->bytes = 0;
+    if ((tex->texture != NULL) && (SDL_QueryTexture (tex->texture, &format, NULL, &w, &h) == 0))
+        tex->bytes += (size_t)w * (size_t)h * SDL_BYTESPERPIXEL (format);
+    if ((tex->detail != NULL) && (SDL_QueryTexture (tex->detail, &format, NULL, &w, &h) == 0))
+        tex->bytes += (size_t)w * (size_t)h * SDL_BYTESPERPIXEL (format);
+    arena_account ((ptrdiff_t)tex->bytes);
+}
+
+
+/* let go of the full size part drawn over a reduced texture */
+static void
+graphics_drop_detail (texture *tex)
+{
+    if (tex->detail != NULL)
+        SDL_DestroyTexture (tex->detail);
+    tex->detail = NULL;
+    tex->detail_area = (SDL_Rect){ 0, 0, 0, 0 };
+    graphics_account (tex);
+}
+
+
+static bool
+graphics_screen_size (int *w, int *h)
+{
+    SDL_Rect bounds;
+    int display = SDL_GetWindowDisplayIndex (g_win);
+
+    if ((display < 0) || (SDL_GetDisplayBounds (display, &bounds) != 0))
+        return false;
+
+    *w = bounds.w;
+    *h = bounds.h;
+    return true;
+}
+
+
+/* decode a still image.  with reduce, or when the whole image would
+   not fit under --max-memory, an image bigger than the screen comes
+   back screen sized and *reduced is set.  full_w x full_h is always the
+   upright size of the whole image.  either way it comes back in the
+   display's colours */
+static SDL_Surface *
+graphics_decode (const unsigned char *data, size_t len, bool reduce,
+                 bool *reduced, int *full_w, int *full_h)
+{
+    SDL_Surface *surface;
+    image_info info;
+    int max_w, max_h;
+
+    *reduced = false;
+    if ((probe_mem (data, len, &info) == EXIT_SUCCESS) && (info.w > 0))
+    {
+        *full_w = (int)((info.orientation >= 5) ? info.h : info.w);
+        *full_h = (int)((info.orientation >= 5) ? info.w : info.h);
+
+        /* the surface, and the texture made from it */
+        if ((size_t)*full_w * (size_t)*full_h * 8 > arena_available ())
+            reduce = true;
+
+        if (reduce && graphics_screen_size (&max_w, &max_h) &&
+            ((*full_w > max_w) || (*full_h > max_h)))
+        {
+            surface = decode_load_scaled (data, len, max_w, max_h);
+            if (surface != NULL)
+            {
+                *reduced = true;
+                icc_apply (&g_icc, surface, data, len);
+                return surface;
+            }
+        }
+    }
+
+    surface = decode_load_mem (data, len);
+    if (surface != NULL)
+    {
+        *full_w = surface->w;
+        *full_h = surface->h;
+        icc_apply (&g_icc, surface, data, len);
+    }
+
+    return surface;
+}
+
+
+/* path decoded at its full size, or NULL */
+static SDL_Surface *
+graphics_decode_path (const char *path)
+{
+    mapped_file map;
+    SDL_Surface *surface;
+    bool reduced;
+    int full_w, full_h;
+
+    if (io_read_file (&g_io, path, &map) != EXIT_SUCCESS)
+        return (SDL_Surface *)NULL;
+    surface = graphics_decode (map.data, map.len, false, &reduced, &full_w, &full_h);
+    mapfile_close (&map);
+
+    /* over --max-memory it comes back reduced */
+    if ((surface != NULL) && reduced)
+    {
+        SDL_FreeSurface (surface);
+        SDL_SetError ("%s: too big to hold at full size", path);
+        return (SDL_Surface *)NULL;
+    }
+
+    return surface;
+}
+
+
+/* turn the offset x, y by quarters of a turn clockwise, the way
+   SDL_RenderCopyEx turns */
+static void
+graphics_quarter_turn (double *x, double *y, int quarters)
+{
+    double t;
+
+    for (quarters = ((quarters % 4) + 4) % 4; quarters > 0; quarters--)
+    {
+        t = *x;
+        *x = -*y;
+        *y = t;
+    }
+}
+
+
+/* fit a new image to the out_w x out_h window, keep the view inside
+   the edges and find the corners of the part in the window, in the
+   unturned image's pixels.  false when none of it is */
+static bool
+graphics_fixed_area (texture *tex, int out_w, int out_h, double corner_x[2], double corner_y[2])
+{
+    double x0, y0, x1, y1;
+    double fit;
+    int i;
+
+    /* a new image is made to fit, and starts in the middle */
+    if (tex->view_fit)
+    {
+        if ((tex->display.w > out_w) || (tex->display.h > out_h))
+        {
+            fit = SDL_min ((double)out_w / tex->display.w, (double)out_h / tex->display.h);
+            tex->scale *= fit;
+            graphics_project (tex);
+        }
+        tex->view_x = out_w / 2.0;
+        tex->view_y = out_h / 2.0;
+        tex->view_fit = false;
+    }
+
+    /* no panning past the edges, and smaller than the window is centred */
+    if (tex->display.w <= out_w)
+        tex->view_x = out_w / 2.0;
+    else
+        tex->view_x = SDL_max (out_w - tex->display.w / 2.0, SDL_min (tex->view_x, tex->display.w / 2.0));
+    if (tex->display.h <= out_h)
+        tex->view_y = out_h / 2.0;
+    else
+        tex->view_y = SDL_max (out_h - tex->display.h / 2.0, SDL_min (tex->view_y, tex->display.h / 2.0));
+
+    /* the visible part, in the window */
+    x0 = SDL_max (0.0, tex->view_x - tex->display.w / 2.0);
+    y0 = SDL_max (0.0, tex->view_y - tex->display.h / 2.0);
+    x1 = SDL_min ((double)out_w, tex->view_x + tex->display.w / 2.0);
+    y1 = SDL_min ((double)out_h, tex->view_y + tex->display.h / 2.0);
+    if ((x1 <= x0) || (y1 <= y0))
+        return false;
+
+    /* and in the unturned image */
+    corner_x[0] = x0 - tex->view_x;
+    corner_y[0] = y0 - tex->view_y;
+    corner_x[1] = x1 - tex->view_x;
+    corner_y[1] = y1 - tex->view_y;
+    for (i = 0; i < 2; i++)
+    {
+        graphics_quarter_turn (&corner_x[i], &corner_y[i], -(tex->rotation / 90));
+        corner_x[i] = corner_x[i] / tex->scale + tex->source.w / 2.0;
+        corner_y[i] = corner_y[i] / tex->scale + tex->source.h / 2.0;
+    }
+
+    return true;
+}
+
+
+/* draw the part of tex that is in the window with pixels, the window
+   is not touched.  a reduced texture has its detail drawn over it */
+static void
+graphics_render_fixed (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels)
+{
+    double corner_x[2], corner_y[2];
+    int out_w, out_h;
+
+    if ((pixels == NULL) ||
+        (SDL_GetRendererOutputSize (rend, &out_w, &out_h) != 0) ||
+        (tex->source.w <= 0) || (tex->source.h <= 0))
+        return;
+    if (!graphics_fixed_area (tex, out_w, out_h, corner_x, corner_y))
+        return;
+
+    graphics_render_part (rend, tex, pixels, &(SDL_Rect){ 0, 0, tex->source.w, tex->source.h },
+                          corner_x, corner_y);
+    if ((pixels == tex->texture) && (tex->detail != NULL))
+        graphics_render_part (rend, tex, tex->detail, &tex->detail_area, corner_x, corner_y);
+}
+
+
+/* draw pixels, which hold the part of tex's image, where it is inside
+   the corners.  the visible part of the turned image is taken back to
+   a source rectangle of the texture so the gpu only samples that */
+static void
+graphics_render_part (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels,
+                      const SDL_Rect *part, const double corner_x[2], const double corner_y[2])
+{
+    SDL_Rect src;
+    SDL_FRect dst;
+    double kx, ky;
+    double cx, cy;
+    int tex_w, tex_h;
+
+    if ((SDL_QueryTexture (pixels, NULL, NULL, &tex_w, &tex_h) != 0) ||
+        (part->w <= 0) || (part->h <= 0))
+        return;
+
+    /* whole texels of the texture, which is smaller than the part when
+       it is reduced */
+    kx = (double)tex_w / part->w;
+    ky = (double)tex_h / part->h;
+    src.x = (int)floor ((SDL_min (corner_x[0], corner_x[1]) - part->x) * kx);
+    src.y = (int)floor ((SDL_min (corner_y[0], corner_y[1]) - part->y) * ky);
+    src.w = (int)ceil ((SDL_max (corner_x[0], corner_x[1]) - part->x) * kx) - src.x;
+    src.h = (int)ceil ((SDL_max (corner_y[0], corner_y[1]) - part->y) * ky) - src.y;
+    SDL_IntersectRect (&src, &(SDL_Rect){ 0, 0, tex_w, tex_h }, &src);
+    if ((src.w <= 0) || (src.h <= 0))
+        return;
+
+    /* where those texels go, SDL turns dst about its own centre */
+    cx = ((src.x + src.w / 2.0) / kx + part->x - tex->source.w / 2.0) * tex->scale;
+    cy = ((src.y + src.h / 2.0) / ky + part->y - tex->source.h / 2.0) * tex->scale;
+    graphics_quarter_turn (&cx, &cy, tex->rotation / 90);
+    dst.w = (float)(src.w / kx * tex->scale);
+    dst.h = (float)(src.h / ky * tex->scale);
+    dst.x = (float)(tex->view_x + cx - dst.w / 2.0);
+    dst.y = (float)(tex->view_y + cy - dst.h / 2.0);
+
+    SDL_RenderCopyExF (rend, pixels, &src, &dst, tex->rotation, NULL, SDL_FLIP_NONE);
+}
+
+
+/* a reduced copy zoomed in past in a fixed viewport, which cannot be
+   swapped for the whole image, gets the part in the window decoded at
+   full size to draw over it.  the part has a margin around it so
+   panning does not decode it again each frame, and it is only decoded
+   by a backend that can do that without the rest of the image */
+static void
+graphics_update_region (texture *tex)
+{
+    mapped_file map;
+    SDL_Surface *surface;
+    SDL_Rect area, wanted;
+    int w, h;
+
+    if (!g_viewport.fixed || !graphics_visible_area (tex, &area) ||
+        (SDL_QueryTexture (tex->texture, NULL, NULL, &w, &h) != 0) ||
+        ((tex->projection.w <= w) && (tex->projection.h <= h)))
+    {
+        if (tex->detail_area.w > 0)
+            graphics_drop_detail (tex);
+        return;
+    }
+
+    /* still inside the last part, decoded or not */
+    if ((area.x >= tex->detail_area.x) && (area.y >= tex->detail_area.y) &&
+        (area.x + area.w <= tex->detail_area.x + tex->detail_area.w) &&
+        (area.y + area.h <= tex->detail_area.y + tex->detail_area.h))
+        return;
+    graphics_drop_detail (tex);
+
+    /* the surface, and the texture made from it */
+    wanted.x = area.x - area.w / 2;
+    wanted.y = area.y - area.h / 2;
+    wanted.w = area.w * 2;
+    wanted.h = area.h * 2;
+    SDL_IntersectRect (&wanted, &(SDL_Rect){ 0, 0, tex->source.w, tex->source.h }, &wanted);
+    if ((size_t)wanted.w * (size_t)wanted.h * 8 > arena_available ())
+        wanted = area;
+    if ((size_t)wanted.w * (size_t)wanted.h * 8 > arena_available ())
+        return;
+
+    if (io_read_file (&g_io, tex->path, &map) != EXIT_SUCCESS)
+        return;
+    surface = decode_load_region (map.data, map.len, &wanted);
+    if (surface != NULL)
+        icc_apply (&g_icc, surface, map.data, map.len);
+    mapfile_close (&map);
+
+    /* a file no backend can decode part of is not tried again */
+    if (surface == NULL)
+    {
+        tex->detail_area = (SDL_Rect){ 0, 0, tex->source.w, tex->source.h };
+        return;
+    }
+    tex->detail = SDL_CreateTextureFromSurface (g_rend, surface);
+    SDL_FreeSurface (surface);
+    if (tex->detail == NULL)
+        log_sdl_error ("could not make the detail texture");
+    tex->detail_area = wanted;
+    graphics_account (tex);
+}
+
+
+/* "page n/count" in the title of a tiff with more than one */
+static void
+graphics_page_title (void)
+{
+    char title[64];
+
+    if (g_tiff.page_count < 2)
+        return;
+
+    snprintf (title, sizeof (title), "LJPEG - page %d/%d", g_tiff.shown + 1, g_tiff.page_count);
+    SDL_SetWindowTitle (g_win, title);
+}
+
+
+/* hdr_fill_fn for a tiff page, arg points at its number */
+static int
+graphics_tiff_fill (void *arg, uint16_t *rgba)
+{
+    return tiff_page_wide (&g_tiff, *(int *)arg, rgba);
+}
+
+
+/* a 16 bit tiff page into g_hdr at full depth, EXIT_FAILURE for the
+   pages that are left to tiff_page_surface */
+static int
+graphics_deep_page (int page)
+{
+    if (!g_tiff.pages[page].deep)
+        return EXIT_FAILURE;
+
+    return hdr_open_wide (&g_hdr, g_tiff.pages[page].w, g_tiff.pages[page].h,
+                          graphics_tiff_fill, &page);
+}
+
+
 /* function definitions */
 int
 graphics_init_sdl (void)
@@ -78,6 +505,9 @@ graphics_init_sdl (void)
         goto graphics_init_sdl_failure_0;
     }
 
+    /* load the codecs up front, decoder threads call IMG_Load too */
+    IMG_Init (IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF | IMG_INIT_WEBP);
+
 /* graphics_init_sdl_success_0: */
     return EXIT_SUCCESS;
 
@@ -87,13 +517,14 @@ graphics_init_sdl_failure_0:
 
 
 int
-graphics_init_window (void)
+graphics_init_window (const char *renderer)
 {
     /* try to create an empty window */
     g_win = SDL_CreateWindow ("LJPEG Image Viewer",
                               SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
                               0, 0,
-                              SDL_WINDOW_HIDDEN | SDL_WINDOW_BORDERLESS);
+                              SDL_WINDOW_HIDDEN | SDL_WINDOW_BORDERLESS |
+                              (g_viewport.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
     /* check that the window was created successfully */
     if (g_win == NULL)
     {
@@ -102,8 +533,9 @@ graphics_init_window (void)
     } 
 
 
-    /* try to create a renderer for the empty window */
-    g_rend = SDL_CreateRenderer (g_win, -1, SDL_RENDERER_ACCELERATED);
+    /* try to create a renderer for the empty window, the one asked for
+       or the fastest, with software as the last resort */
+    g_rend = renderer_create (g_win, renderer);
     /* check that it was created propperly */
     if (g_rend == NULL)
     {
@@ -125,47 +557,406 @@ graphics_init_window_failure_0:
 int
 graphics_load_texture (const char *filename)
 {
-    /* RWop */ 
-    g_img.rwop = SDL_RWFromFile (filename, "rb");
-    if (g_img.rwop == NULL)
+    SDL_Surface *surface;
+
+    /* read the file ahead of any thumbnails, the decoders work on the
+       buffer in place */
+    if (io_read_file (&g_io, filename, &g_img.map) != EXIT_SUCCESS)
     {
         log_sdl_error ("could not load texture");
         goto graphics_load_texture_failure_0;
     }
 
-    /* Load Texture */
-    g_img.texture = IMG_LoadTexture_RW (g_rend, g_img.rwop, 0);
+    /* Load Texture, animations get a streaming texture fed by g_anim
+       and keep the mapping until they are closed */
+    if (anim_open (&g_anim, g_img.map.data, g_img.map.len) == EXIT_SUCCESS)
+    {
+        g_img.texture = g_anim.texture;
+    }
+    else if (hdr_open (&g_hdr, g_img.map.data, g_img.map.len) == EXIT_SUCCESS)
+    {
+        /* 16-bit and HDR images keep their pixels in g_hdr, which maps
+           them into a streaming texture */
+        mapfile_close (&g_img.map);
+        g_img.texture = g_hdr.texture;
+    }
+    else if (tiff_open (&g_tiff, g_img.map.data, g_img.map.len) == EXIT_SUCCESS)
+    {
+        /* tiffs keep the mapping too, their pages are decoded from it
+           as they are turned to.  16 bit pages go through g_hdr */
+        surface = NULL;
+        if (graphics_deep_page (0) == EXIT_SUCCESS)
+            g_img.texture = g_hdr.texture;
+        else
+            surface = tiff_page_surface (&g_tiff, 0);
+        if (surface != NULL)
+        {
+            icc_apply (&g_icc, surface, g_tiff.data, g_tiff.len);
+            if (stats_open (&g_stats, surface) != EXIT_SUCCESS)
+                log_sdl_error ("could not count pixels");
+            g_img.texture = SDL_CreateTextureFromSurface (g_rend, surface);
+            SDL_FreeSurface (surface);
+        }
+        if (g_img.texture != NULL)
+            graphics_page_title ();
+    }
+    else
+    {
+        /* under memory pressure only a screen's worth is kept */
+        surface = graphics_decode (g_img.map.data, g_img.map.len, memory_pressure (&g_memory),
+                                   &g_img.reduced, &g_img.full_w, &g_img.full_h);
+        mapfile_close (&g_img.map);
+        if (surface != NULL)
+        {
+            /* counted on the workers while it is uploaded */
+            if (stats_open (&g_stats, surface) != EXIT_SUCCESS)
+                log_sdl_error ("could not count pixels");
+            g_img.texture = SDL_CreateTextureFromSurface (g_rend, surface);
+            SDL_FreeSurface (surface);
+            g_img.path = SDL_strdup (filename);
+        }
+    }
     if (g_img.texture == NULL)
     {
         log_sdl_error ("could not load texture");
         goto graphics_load_texture_failure_1;
     }
 
-    /* set texture sizeing */
-    SDL_QueryTexture (g_img.texture, NULL, NULL, &(g_img.source.w), &(g_img.source.h));
-    
-    /* set default positioning */ 
-    g_img.source.x = 0;
-    g_img.source.y = 0;
-
-    /* set default rotation and scale */
-    g_img.scale    = INITIAL_SCALE;
-    g_img.rotation = 0;
-
-    /* project the texture onto projection */
-    graphics_project (&g_img);
-
+    graphics_texture_reset (&g_img);
  
 /* graphics_load_texture_success_0: */
     return EXIT_SUCCESS; 
     
 graphics_load_texture_failure_1:
-    SDL_RWclose (g_img.rwop);
+    tiff_close (&g_tiff);
+    mapfile_close (&g_img.map);
 graphics_load_texture_failure_0:
     return EXIT_FAILURE;
 }
 
 
+/* play the numbered image sequence filename belongs to, at fps */
+int
+graphics_load_sequence (const char *filename, double fps)
+{
+    if (sequence_open (&g_seq, filename, fps) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    g_img.texture = g_seq.texture;
+    graphics_texture_reset (&g_img);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* show an image as it arrives on a pipe or stdin ("-") */
+int
+graphics_load_stream (const char *filename)
+{
+    if (stream_open (&g_stream, filename) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    g_img.texture = g_stream.texture;
+    graphics_texture_reset (&g_img);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* show a producer's raw pixel buffer, re-uploaded as it changes */
+int
+graphics_load_raw (const char *name, const raw_params *params)
+{
+    if (raw_open (&g_raw, name, params) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    g_img.texture = g_raw.texture;
+    graphics_texture_reset (&g_img);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* compare path_a with path_b: a is shown as g_img, b and the
+   difference between them follow its view */
+int
+graphics_load_compare (const char *path_a, const char *path_b)
+{
+    SDL_Surface *a;
+    SDL_Surface *b;
+
+    a = graphics_decode_path (path_a);
+    if (a == NULL)
+        goto graphics_load_compare_failure_0;
+    b = graphics_decode_path (path_b);
+    if (b == NULL)
+        goto graphics_load_compare_failure_1;
+
+    g_img.texture = SDL_CreateTextureFromSurface (g_rend, a);
+    if (g_img.texture == NULL)
+        goto graphics_load_compare_failure_2;
+    if (compare_open (&g_compare, a, b, path_a, path_b) != EXIT_SUCCESS)
+        goto graphics_load_compare_failure_3;
+    if (stats_open (&g_stats, a) != EXIT_SUCCESS)
+        log_sdl_error ("could not count pixels");
+
+    graphics_texture_reset (&g_img);
+
+/* graphics_load_compare_success_0: */
+    return EXIT_SUCCESS;
+
+graphics_load_compare_failure_3:
+    SDL_DestroyTexture (g_img.texture);
+    g_img.texture = NULL;
+graphics_load_compare_failure_2:
+    SDL_FreeSurface (b);
+graphics_load_compare_failure_1:
+    SDL_FreeSurface (a);
+graphics_load_compare_failure_0:
+    log_sdl_error ("could not load texture");
+    return EXIT_FAILURE;
+}
+
+
+/* the open image changed on disk: load it again keeping the scale and
+   rotation.  a still image of the same size gets its new pixels copied
+   into the existing texture instead of a new texture */
+int
+graphics_reload_texture (const char *filename)
+{
+    double scale = g_img.scale;
+    double exposure = g_hdr.exposure;
+    int rotation = g_img.rotation;
+    int page = g_tiff.shown;
+    mapped_file map;
+    SDL_Surface *surface;
+    SDL_Surface *converted;
+    SDL_Texture *replacement;
+    Uint32 format;
+    bool reduced;
+    int full_w, full_h;
+    int w, h;
+
+    if (g_anim.active || g_hdr.active || g_tiff.active || (g_img.texture == NULL))
+    {
+        /* animations own their texture, start them over.  HDR images
+           keep their exposure, tiffs their page */
+        graphics_unload_texture (&g_img);
+        if (graphics_load_texture (filename) != EXIT_SUCCESS)
+            goto graphics_reload_texture_failure_0;
+        if (g_tiff.active && (page > 0))
+            graphics_load_page (page);
+        if (g_hdr.active && (exposure != 0.0))
+            hdr_set_exposure (&g_hdr, exposure);
+    }
+    else
+    {
+        /* decode first, a half written file leaves the old image up.
+           a reduced image stays reduced until it is zoomed into */
+        if (io_read_file (&g_io, filename, &map) != EXIT_SUCCESS)
+            goto graphics_reload_texture_failure_0;
+        surface = graphics_decode (map.data, map.len, memory_pressure (&g_memory) || g_img.reduced,
+                                   &reduced, &full_w, &full_h);
+        mapfile_close (&map);
+        if (surface == NULL)
+            goto graphics_reload_texture_failure_0;
+        stats_close (&g_stats);
+        if (stats_open (&g_stats, surface) != EXIT_SUCCESS)
+            log_sdl_error ("could not count pixels");
+
+        SDL_QueryTexture (g_img.texture, &format, NULL, &w, &h);
+        if ((surface->w == w) && (surface->h == h))
+        {
+            converted = SDL_ConvertSurfaceFormat (surface, format, 0);
+            if (converted == NULL)
+                goto graphics_reload_texture_failure_1;
+            SDL_UpdateTexture (g_img.texture, NULL, converted->pixels, converted->pitch);
+            SDL_FreeSurface (converted);
+        }
+        else
+        {
+            replacement = SDL_CreateTextureFromSurface (g_rend, surface);
+            if (replacement == NULL)
+                goto graphics_reload_texture_failure_1;
+            SDL_DestroyTexture (g_img.texture);
+            g_img.texture = replacement;
+            graphics_account (&g_img);
+        }
+        SDL_FreeSurface (surface);
+        g_img.reduced = reduced;
+        g_img.full_w = full_w;
+        g_img.full_h = full_h;
+        graphics_drop_detail (&g_img);
+        graphics_source_size (&g_img);
+    }
+
+    g_img.scale    = scale;
+    g_img.rotation = rotation;
+    graphics_project (&g_img);
+
+/* graphics_reload_texture_success_0: */
+    return EXIT_SUCCESS;
+
+graphics_reload_texture_failure_1:
+    SDL_FreeSurface (surface);
+graphics_reload_texture_failure_0:
+    log_sdl_error ("could not reload texture");
+    return EXIT_FAILURE;
+}
+
+
+void
+graphics_unload_texture (texture *tex)
+{
+    if (tex == &g_img)
+    {
+        anim_close (&g_anim);
+        sequence_close (&g_seq);
+        stream_close (&g_stream);
+        raw_close (&g_raw);
+        compare_close (&g_compare);
+        stats_close (&g_stats);
+        hdr_close (&g_hdr);
+        tiff_close (&g_tiff);
+    }
+
+    graphics_drop_detail (tex);
+    if (tex->texture != NULL)
+        SDL_DestroyTexture (tex->texture);
+    mapfile_close (&tex->map);
+    arena_account (-(ptrdiff_t)tex->bytes);
+    SDL_free (tex->path);
+
+    tex->texture = NULL;
+    tex->path = NULL;
+    tex->reduced = false;
+    tex->bytes = 0;
+}
+
+
+/* turn a multi-page tiff to page, keeping the scale and rotation */
+int
+graphics_load_page (int page)
+{
+    SDL_Surface *surface;
+    SDL_Texture *replacement;
+    int w, h;
+
+    if (!g_tiff.active || (page < 0) || (page >= g_tiff.page_count) || (page == g_tiff.shown))
+        return EXIT_FAILURE;
+
+    /* a 16 bit page before this one gives up g_hdr, its texture stays
+       with g_img until it is replaced */
+    hdr_close (&g_hdr);
+    stats_close (&g_stats);
+    if (graphics_deep_page (page) == EXIT_SUCCESS)
+    {
+        replacement = g_hdr.texture;
+        w = g_hdr.w;
+        h = g_hdr.h;
+    }
+    else
+    {
+        surface = tiff_page_surface (&g_tiff, page);
+        if (surface == NULL)
+            goto graphics_load_page_failure_0;
+        icc_apply (&g_icc, surface, g_tiff.data, g_tiff.len);
+        replacement = SDL_CreateTextureFromSurface (g_rend, surface);
+        if (replacement == NULL)
+            goto graphics_load_page_failure_1;
+        w = surface->w;
+        h = surface->h;
+        if (stats_open (&g_stats, surface) != EXIT_SUCCESS)
+            log_sdl_error ("could not count pixels");
+        SDL_FreeSurface (surface);
+    }
+
+    /* a page of another size is fitted again in a fixed viewport */
+    if ((w != g_img.source.w) || (h != g_img.source.h))
+        g_img.view_fit = true;
+    SDL_DestroyTexture (g_img.texture);
+    g_img.texture = replacement;
+    graphics_account (&g_img);
+    graphics_source_size (&g_img);
+    graphics_project (&g_img);
+    graphics_page_title ();
+
+/* graphics_load_page_success_0: */
+    return EXIT_SUCCESS;
+
+graphics_load_page_failure_1:
+    SDL_FreeSurface (surface);
+graphics_load_page_failure_0:
+    log_sdl_error ("could not load page");
+    return EXIT_FAILURE;
+}
+
+
+/* under memory pressure swap a still image bigger than the screen for
+   a screen sized copy, once it has passed decode it whole again when
+   it is zoomed in past the copy.  while it stays a copy the part in
+   the window is decoded at full size instead, where it can be */
+void
+graphics_update_detail (texture *tex, bool pressure)
+{
+    mapped_file map;
+    SDL_Surface *surface;
+    SDL_Texture *replacement;
+    bool reduced;
+    int full_w, full_h;
+    int w, h;
+
+    if ((tex->path == NULL) || (tex->texture == NULL))
+        return;
+    if (pressure == tex->reduced)
+    {
+        if (tex->reduced)
+            graphics_update_region (tex);
+        return;
+    }
+    SDL_QueryTexture (tex->texture, NULL, NULL, &w, &h);
+
+    if (pressure)
+    {
+        if (!graphics_screen_size (&full_w, &full_h) || ((w <= full_w) && (h <= full_h)))
+            return;
+    }
+    else
+    {
+        graphics_project (tex);
+        /* --max-memory may still say no */
+        if (((tex->projection.w <= w) && (tex->projection.h <= h)) ||
+            ((size_t)tex->full_w * (size_t)tex->full_h * 8 > arena_available () + tex->bytes))
+        {
+            graphics_update_region (tex);
+            return;
+        }
+    }
+
+    if (io_read_file (&g_io, tex->path, &map) != EXIT_SUCCESS)
+        return;
+    surface = graphics_decode (map.data, map.len, pressure, &reduced, &full_w, &full_h);
+    mapfile_close (&map);
+    if (surface == NULL)
+        return;
+
+    replacement = SDL_CreateTextureFromSurface (g_rend, surface);
+    SDL_FreeSurface (surface);
+    if (replacement == NULL)
+    {
+        log_sdl_error ("could not replace texture");
+        return;
+    }
+    SDL_DestroyTexture (tex->texture);
+    tex->texture = replacement;
+    tex->reduced = reduced;
+    tex->full_w = full_w;
+    tex->full_h = full_h;
+    graphics_drop_detail (tex);
+    graphics_source_size (tex);
+}
+
+
 void
 graphics_project (texture *tex)
 {
@@ -190,9 +981,86 @@ graphics_project (texture *tex)
 void
 graphics_render (SDL_Renderer *rend, texture *tex)
 {
+    graphics_render_as (rend, tex, tex->texture);
+}
+
+
+/* draw pixels where tex would be drawn, pixels being the same image
+   (eg: the other one of a comparison) at any size */
+void
+graphics_render_as (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels)
+{
+    int w, h;
+
+    graphics_project (tex);
+    if (g_viewport.fixed)
+    {
+        graphics_render_fixed (rend, tex, pixels);
+        return;
+    }
+
+    /* the window follows the image, resizing only when it changed */
+    SDL_GetWindowSize (g_win, &w, &h);
+    if ((w != (int)g_img.display.w) || (h != (int)g_img.display.h))
+        SDL_SetWindowSize (g_win, (int)g_img.display.w, (int)g_img.display.h);
+    SDL_RenderCopyEx (rend, pixels, NULL, &tex->projection, tex->rotation, NULL, SDL_FLIP_NONE);
+}
+
+
+/* the part of tex's image on screen, in the image's full size pixels */
+bool
+graphics_visible_area (texture *tex, SDL_Rect *area)
+{
+    double corner_x[2], corner_y[2];
+    int out_w, out_h;
+
+    area->x = 0;
+    area->y = 0;
+    area->w = tex->source.w;
+    area->h = tex->source.h;
+    if (!g_viewport.fixed)
+        return (area->w > 0) && (area->h > 0);
+
     graphics_project (tex);
-    SDL_SetWindowSize (g_win, (int)g_img.display.w, (int)g_img.display.h);
-    SDL_RenderCopyEx (rend, tex->texture, NULL, &tex->projection, tex->rotation, NULL, SDL_FLIP_NONE);
+    if ((SDL_GetRendererOutputSize (g_rend, &out_w, &out_h) != 0) ||
+        (tex->source.w <= 0) || (tex->source.h <= 0) ||
+        !graphics_fixed_area (tex, out_w, out_h, corner_x, corner_y))
+        return false;
+
+    area->x = (int)floor (SDL_min (corner_x[0], corner_x[1]));
+    area->y = (int)floor (SDL_min (corner_y[0], corner_y[1]));
+    area->w = (int)ceil (SDL_max (corner_x[0], corner_x[1])) - area->x;
+    area->h = (int)ceil (SDL_max (corner_y[0], corner_y[1])) - area->y;
+
+    return SDL_IntersectRect (area, &(SDL_Rect){ 0, 0, tex->source.w, tex->source.h }, area);
+}
+
+
+/* size the window for w x h of content.  a fixed viewport is sized
+   once, fitted to the screen, a fullscreen one never */
+void
+graphics_size_window (int w, int h)
+{
+    SDL_Rect usable;
+    double fit;
+
+    if (!g_viewport.fixed)
+    {
+        SDL_SetWindowSize (g_win, w, h);
+        return;
+    }
+    if (g_viewport.sized || g_viewport.fullscreen)
+        return;
+
+    if ((SDL_GetDisplayUsableBounds (SDL_GetWindowDisplayIndex (g_win), &usable) == 0) &&
+        ((w > usable.w) || (h > usable.h)))
+    {
+        fit = SDL_min ((double)usable.w / w, (double)usable.h / h);
+        w = (int)(w * fit);
+        h = (int)(h * fit);
+    }
+    SDL_SetWindowSize (g_win, SDL_max (w, 1), SDL_max (h, 1));
+    g_viewport.sized = true;
 }
 
 
@@ -248,4 +1116,51 @@ graphics_texture_rotate (texture *tex, int direction)
 }
 
 
+/* zoom to scale.  in a fixed viewport the point under the cursor (the
+   middle of the window when it is elsewhere) stays where it is */
+void
+graphics_set_scale (texture *tex, double scale)
+{
+    int x, y;
+
+    if (g_viewport.fixed && !tex->view_fit && (tex->scale > 0.0))
+    {
+        if (SDL_GetMouseFocus () == g_win)
+        {
+            SDL_GetMouseState (&x, &y);
+        }
+        else
+        {
+            SDL_GetRendererOutputSize (g_rend, &x, &y);
+            x /= 2;
+            y /= 2;
+        }
+        tex->view_x = x + (tex->view_x - x) * scale / tex->scale;
+        tex->view_y = y + (tex->view_y - y) * scale / tex->scale;
+    }
+
+    tex->scale = scale;
+}
+
+
+/* move the image by dx, dy in a fixed viewport, held to its edges when
+   it is next drawn */
+void
+graphics_pan (texture *tex, int dx, int dy)
+{
+    tex->view_x += dx;
+    tex->view_y += dy;
+}
+
+
+/* original scale and rotation, a fixed viewport fits the image again */
+void
+graphics_view_reset (texture *tex)
+{
+    tex->scale = 1.0;
+    tex->rotation = 0;
+    tex->view_fit = true;
+}
+
+
 /* End of File */
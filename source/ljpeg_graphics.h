@@ -32,20 +32,42 @@
 #include <math.h>
 
 #include "ljpeg_config.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_raw.h"
 
 
 /* custom datatypes */
 typedef struct texture 
 {
-    SDL_RWops   *rwop;
+    mapped_file  map;       /* only held while an animation plays */
     SDL_Texture *texture;
     SDL_Rect     source;
     double       scale;
     int          rotation;
     SDL_Rect     projection;
     SDL_Rect     display;
+
+    char        *path;      /* still images, to decode again at another size */
+    bool         reduced;   /* texture is a screen sized copy of path */
+    int          full_w, full_h;
+    SDL_Texture *detail;        /* reduced: the part last zoomed into, at full size */
+    SDL_Rect     detail_area;   /* what detail covers, in the image's pixels */
+    size_t       bytes;     /* counted against --max-memory */
+
+    double       view_x, view_y;    /* fixed viewport: the image's centre in the window */
+    bool         view_fit;          /* fixed viewport: fit and centre on the next render */
 } texture;
 
+/* --fixed keeps the window the size it was first given, --fullscreen
+   the size of the screen, zooming and panning then only change what
+   part of the image is drawn where */
+typedef struct viewport
+{
+    bool fixed;
+    bool fullscreen;
+    bool sized;         /* the window has had its one size */
+} viewport;
+
 
 /* constants */
 #ifndef M_PI
@@ -60,17 +82,32 @@ typedef struct texture
 extern SDL_Window   *g_win;
 extern SDL_Renderer *g_rend;
 extern texture       g_img;
+extern viewport      g_viewport;
 
 
 /* external function prototypes */
 int graphics_init_sdl     (void);
-int graphics_init_window  (void);
+int graphics_init_window  (const char *renderer);
 int graphics_load_texture (const char *filename);
+int graphics_load_sequence (const char *filename, double fps);
+int graphics_load_stream   (const char *filename);
+int graphics_load_raw      (const char *name, const raw_params *params);
+int graphics_load_compare  (const char *path_a, const char *path_b);
+int graphics_reload_texture (const char *filename);
+int graphics_load_page      (int page);
+void graphics_unload_texture (texture *tex);
+void graphics_update_detail (texture *tex, bool pressure);
 
 void graphics_project (texture *tex);
 void graphics_render  (SDL_Renderer *rend, texture *tex);
+void graphics_render_as (SDL_Renderer *rend, texture *tex, SDL_Texture *pixels);
+bool graphics_visible_area (texture *tex, SDL_Rect *area);
+void graphics_size_window (int w, int h);
 void graphics_manual_move_window (void);
 void graphics_texture_rotate (texture *tex, int direction);
+void graphics_set_scale  (texture *tex, double scale);
+void graphics_pan        (texture *tex, int dx, int dy);
+void graphics_view_reset (texture *tex);
 
 #endif /* end run once */
 
@@ -0,0 +1,1179 @@
+/*
+   source/ljpeg_hdr.c
+   LJPEG 16-bit and HDR image source code.
+
+   SDL_image hands back 8 bits a channel at most, so images with more
+   are read here instead: Radiance RGBE (.hdr, .pic), portable float
+   maps (.pfm), OpenEXR scanline images (uncompressed, RLE or zip),
+   16-bit PPM/PGM and 16-bit PNG (through ljpeg_png's decoder), and
+   16-bit TIFF pages handed over by hdr_open_wide.  They are kept as
+   linear half floats and tone mapped to what is shown on the worker
+   threads, a band of rows each, with the vector kernels.  Changing the
+   exposure only maps them again, the file is not decoded again.  The
+   workers are started once, by hdr_init, and kept for every image.
+
+   SDL's renderer has no texture format past 8 bits a channel, so the
+   mapping is always done here.  Radiance, pfm and exr images are scene
+   referred and go through a tone curve that brings HDR_WHITE to white,
+   16-bit images are already meant for display and are only exposed
+   and clipped.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_hdr.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_png.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+hdr_image g_hdr;
+Uint32    g_hdr_event = (Uint32)-1;
+
+
+/* file static variables */
+/* rows a worker maps at once */
+#define HDR_BAND 64
+
+/* exposure goes no further than this many stops either way */
+#define HDR_EXPOSURE_RANGE 16.0
+
+#define HDR_TOKEN_MAX 32
+#define HDR_LINE_MAX  256
+
+/* exr channels past these are skipped */
+#define HDR_EXR_CHANNELS 64
+
+/* an exr channel, as its samples lie in a scanline */
+typedef struct hdr_exr_channel
+{
+    int           slot;         /* 0 to 3 for r, g, b and a, -1 skipped */
+    int           type;         /* 0 uint, 1 half, 2 float */
+    size_t        offset;       /* of its first sample in a line */
+} hdr_exr_channel;
+
+/* linear light to srgb, for every kernel */
+static uint8_t s_srgb[SIMD_TONEMAP_LUT + 3];
+static bool    s_srgb_ready;
+
+/* and 16 bit srgb levels back to linear light, as half floats */
+static uint16_t s_linear16[65536];
+static bool     s_linear16_ready;
+
+
+/* file static function prototypes */
+static uint16_t hdr_half (float value);
+static float    hdr_float (uint16_t half);
+static float    hdr_linear (double level);
+static int      hdr_alloc (hdr_image *hdr, int w, int h);
+
+static bool hdr_token (const unsigned char *data, size_t len, size_t *pos, char *token);
+static bool hdr_line (const unsigned char *data, size_t len, size_t *pos, char *line);
+static int  hdr_radiance_row (const unsigned char *data, size_t len, size_t *pos, int w, uint8_t *rgbe);
+static int  hdr_read_radiance (hdr_image *hdr, const unsigned char *data, size_t len);
+static int  hdr_read_pfm (hdr_image *hdr, const unsigned char *data, size_t len);
+static int  hdr_read_pnm (hdr_image *hdr, const unsigned char *data, size_t len);
+static uint32_t hdr_get32 (const unsigned char *p);
+static size_t hdr_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static size_t hdr_unrle (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static void hdr_exr_unpredict (uint8_t *in, uint8_t *out, size_t len);
+static int  hdr_read_exr (hdr_image *hdr, const unsigned char *data, size_t len);
+static void hdr_widen (hdr_image *hdr);
+static int  hdr_read_png (hdr_image *hdr, const unsigned char *data, size_t len);
+
+static void hdr_band_job (void *arg);
+static void hdr_map (hdr_image *hdr);
+static int  hdr_start (hdr_image *hdr);
+static void hdr_discard (hdr_image *hdr);
+static void hdr_reset (hdr_image *hdr);
+
+
+/* static function definitions */
+/* float to half float, rounded to nearest even.  past the largest half
+   is infinity, which the kernels take as 65536 */
+static uint16_t
+hdr_half (float value)
+{
+    union { float f; uint32_t u; } v;
+    uint32_t sign;
+    uint32_t bits;
+
+    v.f = value;
+    sign = (v.u >> 16) & 0x8000;
+    bits = v.u & 0x7FFFFFFF;
+
+    if (bits >= 0x477FF000)
+        return (uint16_t)(sign | 0x7C00);
+    if (bits < 0x38800000)
+    {
+        /* under the smallest normal half, 2^-14: counted in 2^-24s */
+        v.u = bits;
+        return (uint16_t)(sign | (uint32_t)(v.f * 16777216.0f + 0.5f));
+    }
+
+    bits -= 112u << 23;
+    bits += 0xFFF + ((bits >> 13) & 1);
+    return (uint16_t)(sign | (bits >> 13));
+}
+
+
+/* half float to float, exactly */
+static float
+hdr_float (uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1F;
+    float v;
+
+    if (exponent == 0x1F)
+        v = ((half & 0x3FF) != 0) ? 0.0f : 65536.0f;
+    else if (exponent == 0)
+        v = (float)ldexp ((double)(half & 0x3FF), -24);
+    else
+        v = (float)ldexp ((double)((half & 0x3FF) | 0x400), exponent - 25);
+
+    return ((half & 0x8000) != 0) ? -v : v;
+}
+
+
+/* srgb level, 0 to 1, to linear light */
+static float
+hdr_linear (double level)
+{
+    if (level <= 0.04045)
+        return (float)(level / 12.92);
+    return (float)pow ((level + 0.055) / 1.055, 2.4);
+}
+
+
+/* pixels and the surface they are mapped to, w by h */
+static int
+hdr_alloc (hdr_image *hdr, int w, int h)
+{
+    size_t bytes;
+
+    if ((w <= 0) || (h <= 0) || (w > 0x10000) || (h > 0x10000))
+    {
+        SDL_SetError ("%dx%d: bad image size", w, h);
+        goto hdr_alloc_failure_0;
+    }
+    /* the half floats and the mapped copy */
+    bytes = (size_t)w * (size_t)h * 4 * sizeof (uint16_t);
+    if (bytes + bytes / 2 > arena_available ())
+    {
+        SDL_SetError ("%dx%d is over --max-memory", w, h);
+        goto hdr_alloc_failure_0;
+    }
+
+    hdr->pixels = malloc (bytes);
+    if (hdr->pixels == NULL)
+    {
+        SDL_OutOfMemory ();
+        goto hdr_alloc_failure_0;
+    }
+    hdr->surface = SDL_CreateRGBSurfaceWithFormat (0, w, h, 32, DECODE_PIXELFORMAT);
+    if (hdr->surface == NULL)
+        goto hdr_alloc_failure_1;
+
+    hdr->w = w;
+    hdr->h = h;
+    hdr->bytes = bytes;
+    arena_account ((ptrdiff_t)hdr->bytes);
+
+/* hdr_alloc_success_0: */
+    return EXIT_SUCCESS;
+
+hdr_alloc_failure_1:
+    free (hdr->pixels);
+    hdr->pixels = NULL;
+hdr_alloc_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+/* the next whitespace separated token of a netpbm header, skipping
+   comments.  false at the end of data or for an overlong token */
+static bool
+hdr_token (const unsigned char *data, size_t len, size_t *pos, char *token)
+{
+    size_t p = *pos;
+    int n = 0;
+
+    while (p < len)
+    {
+        if (data[p] == '#')
+        {
+            while ((p < len) && (data[p] != '\n'))
+                p++;
+        }
+        else if ((data[p] == ' ') || (data[p] == '\t') || (data[p] == '\r') || (data[p] == '\n'))
+            p++;
+        else
+            break;
+    }
+    while ((p < len) && (data[p] > ' ') && (n < HDR_TOKEN_MAX - 1))
+    {
+        token[n++] = (char)data[p++];
+    }
+    token[n] = '\0';
+    *pos = p;
+
+    return (n > 0) && ((p >= len) || (data[p] <= ' '));
+}
+
+
+/* the next line, without its newline.  false at the end of data or for
+   an overlong line */
+static bool
+hdr_line (const unsigned char *data, size_t len, size_t *pos, char *line)
+{
+    size_t p = *pos;
+    int n = 0;
+
+    while ((p < len) && (data[p] != '\n'))
+    {
+        if (n == HDR_LINE_MAX - 1)
+            return false;
+        line[n++] = (char)data[p++];
+    }
+    if (p >= len)
+        return false;
+    line[n] = '\0';
+    *pos = p + 1;
+
+    return true;
+}
+
+
+/* a scanline of w rgbe pixels: run length encoded a component at a time
+   (2 2 and the width first), or flat */
+static int
+hdr_radiance_row (const unsigned char *data, size_t len, size_t *pos, int w, uint8_t *rgbe)
+{
+    size_t p = *pos;
+    int c, x, n;
+
+    if ((w >= 8) && (w < 0x8000) && (p + 4 <= len) && (data[p] == 2) && (data[p + 1] == 2) &&
+        (((data[p + 2] << 8) | data[p + 3]) == w))
+    {
+        p += 4;
+        for (c = 0; c < 4; c++)
+        {
+            for (x = 0; x < w; )
+            {
+                if (p >= len)
+                    return EXIT_FAILURE;
+                n = data[p++];
+                if (n > 128)
+                {
+                    /* a run of one byte */
+                    n -= 128;
+                    if ((x + n > w) || (p >= len))
+                        return EXIT_FAILURE;
+                    while (n-- > 0)
+                        rgbe[(x++) * 4 + c] = data[p];
+                    p++;
+                }
+                else
+                {
+                    if ((n == 0) || (x + n > w) || (p + (size_t)n > len))
+                        return EXIT_FAILURE;
+                    while (n-- > 0)
+                        rgbe[(x++) * 4 + c] = data[p++];
+                }
+            }
+        }
+    }
+    else
+    {
+        if (p + (size_t)w * 4 > len)
+            return EXIT_FAILURE;
+        memcpy (rgbe, data + p, (size_t)w * 4);
+        p += (size_t)w * 4;
+    }
+    *pos = p;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* radiance rgbe, top down rows only (-Y h +X w) */
+static int
+hdr_read_radiance (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+    char line[HDR_LINE_MAX];
+    uint8_t *rgbe;
+    uint16_t *out;
+    size_t pos = 0;
+    float scale;
+    int w, h;
+    int x, y, c;
+
+    if (((len < 10) || (memcmp (data, "#?RADIANCE", 10) != 0)) &&
+        ((len < 6) || (memcmp (data, "#?RGBE", 6) != 0)))
+        return EXIT_FAILURE;
+
+    /* header lines up to a blank one, then the size */
+    do
+    {
+        if (!hdr_line (data, len, &pos, line))
+            goto hdr_read_radiance_failure_0;
+        if ((strncmp (line, "FORMAT=", 7) == 0) && (strcmp (line + 7, "32-bit_rle_rgbe") != 0))
+        {
+            SDL_SetError ("radiance: %s is not supported", line + 7);
+            return EXIT_FAILURE;
+        }
+    } while (line[0] != '\0');
+    if (!hdr_line (data, len, &pos, line) || (sscanf (line, "-Y %d +X %d", &h, &w) != 2))
+        goto hdr_read_radiance_failure_0;
+
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    rgbe = malloc ((size_t)w * 4);
+    if (rgbe == NULL)
+    {
+        SDL_OutOfMemory ();
+        return EXIT_FAILURE;
+    }
+
+    for (y = 0; y < h; y++)
+    {
+        if (hdr_radiance_row (data, len, &pos, w, rgbe) != EXIT_SUCCESS)
+        {
+            free (rgbe);
+            goto hdr_read_radiance_failure_0;
+        }
+        out = hdr->pixels + (size_t)y * (size_t)w * 4;
+        for (x = 0; x < w; x++)
+        {
+            scale = (rgbe[x * 4 + 3] == 0) ? 0.0f : (float)ldexp (1.0, rgbe[x * 4 + 3] - (128 + 8));
+            for (c = 0; c < 3; c++)
+            {
+                out[x * 4 + c] = hdr_half ((rgbe[x * 4 + c] + 0.5f) * scale);
+            }
+            out[x * 4 + 3] = 0x3C00;
+        }
+    }
+    free (rgbe);
+    hdr->scene = true;
+
+    return EXIT_SUCCESS;
+
+hdr_read_radiance_failure_0:
+    SDL_SetError ("radiance: truncated or unsupported file");
+    return EXIT_FAILURE;
+}
+
+
+/* PF (rgb) or Pf (grey) floats, little endian when the scale is
+   negative, rows bottom up */
+static int
+hdr_read_pfm (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+    char token[HDR_TOKEN_MAX];
+    union { float f; uint32_t u; } v;
+    const unsigned char *in;
+    uint16_t *out;
+    size_t pos = 2;
+    bool little;
+    int channels;
+    int w, h;
+    int x, y, c;
+
+    if ((len < 3) || (data[0] != 'P') || ((data[1] != 'F') && (data[1] != 'f')))
+        return EXIT_FAILURE;
+    channels = (data[1] == 'F') ? 3 : 1;
+
+    if (!hdr_token (data, len, &pos, token) || ((w = atoi (token)) <= 0) ||
+        !hdr_token (data, len, &pos, token) || ((h = atoi (token)) <= 0) ||
+        !hdr_token (data, len, &pos, token))
+        goto hdr_read_pfm_failure_0;
+    little = (atof (token) < 0.0);
+    pos++;
+    if ((pos > len) || ((len - pos) / 4 / (size_t)channels / (size_t)w < (size_t)h))
+        goto hdr_read_pfm_failure_0;
+
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    for (y = 0; y < h; y++)
+    {
+        in = data + pos + (size_t)(h - 1 - y) * (size_t)w * (size_t)channels * 4;
+        out = hdr->pixels + (size_t)y * (size_t)w * 4;
+        for (x = 0; x < w; x++)
+        {
+            for (c = 0; c < channels; c++, in += 4)
+            {
+                if (little)
+                    v.u = (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+                else
+                    v.u = (uint32_t)in[3] | ((uint32_t)in[2] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[0] << 24);
+                out[x * 4 + c] = hdr_half (v.f);
+            }
+            if (channels == 1)
+                out[x * 4 + 1] = out[x * 4 + 2] = out[x * 4];
+            out[x * 4 + 3] = 0x3C00;
+        }
+    }
+    hdr->scene = true;
+
+    return EXIT_SUCCESS;
+
+hdr_read_pfm_failure_0:
+    SDL_SetError ("pfm: truncated or unsupported file");
+    return EXIT_FAILURE;
+}
+
+
+/* binary PPM (P6) and PGM (P5) with a maxval past 255, two big endian
+   bytes a sample.  anything 8 bit is left to SDL_image */
+static int
+hdr_read_pnm (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+    char token[HDR_TOKEN_MAX];
+    const unsigned char *in;
+    uint16_t *linear;
+    uint16_t *out;
+    size_t pos = 2;
+    int channels;
+    int maxval;
+    int w, h;
+    int x, y, c, i;
+
+    if ((len < 3) || (data[0] != 'P') || ((data[1] != '5') && (data[1] != '6')))
+        return EXIT_FAILURE;
+    channels = (data[1] == '6') ? 3 : 1;
+
+    if (!hdr_token (data, len, &pos, token) || ((w = atoi (token)) <= 0) ||
+        !hdr_token (data, len, &pos, token) || ((h = atoi (token)) <= 0) ||
+        !hdr_token (data, len, &pos, token))
+        return EXIT_FAILURE;
+    maxval = atoi (token);
+    if ((maxval < 256) || (maxval > 65535))
+        return EXIT_FAILURE;
+    pos++;
+    if ((pos > len) || ((len - pos) / 2 / (size_t)channels / (size_t)w < (size_t)h))
+    {
+        SDL_SetError ("pnm: truncated file");
+        return EXIT_FAILURE;
+    }
+
+    /* every level is srgb, linearized once */
+    linear = malloc (((size_t)maxval + 1) * sizeof (uint16_t));
+    if (linear == NULL)
+    {
+        SDL_OutOfMemory ();
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i <= maxval; i++)
+    {
+        linear[i] = hdr_half (hdr_linear ((double)i / maxval));
+    }
+
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+    {
+        free (linear);
+        return EXIT_FAILURE;
+    }
+
+    in = data + pos;
+    for (y = 0; y < h; y++)
+    {
+        out = hdr->pixels + (size_t)y * (size_t)w * 4;
+        for (x = 0; x < w; x++)
+        {
+            for (c = 0; c < channels; c++, in += 2)
+            {
+                out[x * 4 + c] = linear[SDL_min ((in[0] << 8) | in[1], maxval)];
+            }
+            if (channels == 1)
+                out[x * 4 + 1] = out[x * 4 + 2] = out[x * 4];
+            out[x * 4 + 3] = 0x3C00;
+        }
+    }
+    free (linear);
+    hdr->scene = false;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* 4 little endian bytes */
+static uint32_t
+hdr_get32 (const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/* one zlib stream, the bytes written to out, 0 on bad data */
+static size_t
+hdr_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+#ifdef USE_LIBDEFLATE
+    struct libdeflate_decompressor *inflater;
+    enum libdeflate_result result;
+    size_t got = 0;
+
+    inflater = libdeflate_alloc_decompressor ();
+    if (inflater == NULL)
+        return 0;
+    result = libdeflate_zlib_decompress (inflater, in, in_len, out, out_len, &got);
+    libdeflate_free_decompressor (inflater);
+
+    return (result == LIBDEFLATE_SUCCESS) ? got : 0;
+#else
+    uLongf got = (uLongf)out_len;
+
+    if ((in_len > ULONG_MAX) || (out_len > ULONG_MAX))
+        return 0;
+    if (uncompress (out, &got, in, (uLong)in_len) != Z_OK)
+        return 0;
+
+    return (size_t)got;
+#endif
+}
+
+
+/* exr's run length coding: a negative count of bytes as they are, or
+   one less than the times the next byte repeats.  the bytes written to
+   out, which stops when full */
+static size_t
+hdr_unrle (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+    size_t ip = 0, op = 0;
+    size_t n;
+    int run;
+
+    while ((ip < in_len) && (op < out_len))
+    {
+        run = (int8_t)in[ip++];
+        if (run < 0)
+        {
+            n = SDL_min ((size_t)-run, SDL_min (in_len - ip, out_len - op));
+            memcpy (out + op, in + ip, n);
+            ip += n;
+        }
+        else
+        {
+            if (ip >= in_len)
+                break;
+            n = SDL_min ((size_t)run + 1, out_len - op);
+            memset (out + op, in[ip++], n);
+        }
+        op += n;
+    }
+
+    return op;
+}
+
+
+/* rle and zip chunks are stored as byte differences, the even bytes
+   in the first half and the odd ones in the second.  in is undone in
+   place, out gets the bytes back in order */
+static void
+hdr_exr_unpredict (uint8_t *in, uint8_t *out, size_t len)
+{
+    const uint8_t *t1 = in;
+    const uint8_t *t2 = in + (len + 1) / 2;
+    size_t i;
+
+    for (i = 1; i < len; i++)
+    {
+        in[i] = (uint8_t)(in[i - 1] + in[i] - 128);
+    }
+    for (i = 0; i + 1 < len; i += 2)
+    {
+        out[i] = *t1++;
+        out[i + 1] = *t2++;
+    }
+    if (i < len)
+        out[i] = *t1;
+}
+
+
+/* single part scanline exr, r g b a or y channels of half or float
+   samples (premultiplied, as exr keeps them).  other channels are
+   skipped, tiled, deep and multi-part files and the lossy and wavelet
+   compressions are turned down */
+static int
+hdr_read_exr (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+    hdr_exr_channel channels[HDR_EXR_CHANNELS];
+    const unsigned char *p = data + 8;
+    const unsigned char *end = data + len;
+    const unsigned char *name;
+    const unsigned char *type;
+    const unsigned char *value;
+    const unsigned char *chunk;
+    const uint8_t *line;
+    uint8_t *packed = NULL;
+    uint8_t *unpacked = NULL;
+    uint16_t *out;
+    union { float f; uint32_t u; } v;
+    uint32_t size;
+    uint64_t off;
+    size_t line_bytes = 0;
+    size_t chunk_bytes;
+    size_t got;
+    float rgba[4];
+    float alpha;
+    int channel_count = 0;
+    int compression = -1;
+    int lines = 1;
+    int chunks;
+    int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+    int w, h;
+    int sample;
+    bool grey = false;
+    int i, c, x, y, row;
+
+    if ((len < 8) || (hdr_get32 (data) != 20000630))
+        return EXIT_FAILURE;
+    if ((data[4] != 2) || ((data[5] & 0x1A) != 0))
+    {
+        SDL_SetError ("exr: tiled, deep and multi-part files are not supported");
+        return EXIT_FAILURE;
+    }
+
+    /* attributes, name type size value, up to an empty name */
+    while ((p < end) && (*p != 0))
+    {
+        name = p;
+        p = memchr (p, 0, (size_t)(end - p));
+        if (p == NULL)
+            goto hdr_read_exr_failure_0;
+        type = ++p;
+        p = memchr (p, 0, (size_t)(end - p));
+        if ((p == NULL) || (end - ++p < 4))
+            goto hdr_read_exr_failure_0;
+        size = hdr_get32 (p);
+        value = p + 4;
+        if (size > (size_t)(end - value))
+            goto hdr_read_exr_failure_0;
+        p = value + size;
+
+        if ((strcmp ((const char *)type, "chlist") == 0) &&
+            (strcmp ((const char *)name, "channels") == 0))
+        {
+            /* name, type, linear flag and padding, x and y sampling */
+            while ((value < p) && (*value != 0))
+            {
+                name = value;
+                value = memchr (value, 0, (size_t)(p - value));
+                if ((value == NULL) || (p - ++value < 16) || (channel_count == HDR_EXR_CHANNELS))
+                    goto hdr_read_exr_failure_0;
+                channels[channel_count].type = (int)hdr_get32 (value);
+                channels[channel_count].slot = -1;
+                if (strcmp ((const char *)name, "R") == 0)
+                    channels[channel_count].slot = 0;
+                else if (strcmp ((const char *)name, "G") == 0)
+                    channels[channel_count].slot = 1;
+                else if (strcmp ((const char *)name, "B") == 0)
+                    channels[channel_count].slot = 2;
+                else if (strcmp ((const char *)name, "A") == 0)
+                    channels[channel_count].slot = 3;
+                else if (strcmp ((const char *)name, "Y") == 0)
+                    channels[channel_count].slot = 4;
+                if ((channels[channel_count].type < 0) || (channels[channel_count].type > 2) ||
+                    (hdr_get32 (value + 8) != 1) || (hdr_get32 (value + 12) != 1))
+                {
+                    SDL_SetError ("exr: subsampled channels are not supported");
+                    return EXIT_FAILURE;
+                }
+                if ((channels[channel_count].slot >= 0) && (channels[channel_count].type == 0))
+                    channels[channel_count].slot = -1;
+                value += 16;
+                channel_count++;
+            }
+        }
+        else if ((strcmp ((const char *)type, "compression") == 0) && (size >= 1))
+            compression = value[0];
+        else if ((strcmp ((const char *)type, "box2i") == 0) && (size >= 16) &&
+                 (strcmp ((const char *)name, "dataWindow") == 0))
+        {
+            x0 = (int32_t)hdr_get32 (value);
+            y0 = (int32_t)hdr_get32 (value + 4);
+            x1 = (int32_t)hdr_get32 (value + 8);
+            y1 = (int32_t)hdr_get32 (value + 12);
+        }
+    }
+    if ((p >= end) || (channel_count == 0) || (x1 < x0) || (y1 < y0) ||
+        ((int64_t)x1 - x0 >= 0x10000) || ((int64_t)y1 - y0 >= 0x10000))
+        goto hdr_read_exr_failure_0;
+    p++;
+    w = x1 - x0 + 1;
+    h = y1 - y0 + 1;
+
+    switch (compression)
+    {
+    case 0:
+    case 1:
+    case 2:
+        lines = 1;
+        break;
+    case 3:
+        lines = 16;
+        break;
+    default:
+        SDL_SetError ("exr: compression %d is not supported", compression);
+        return EXIT_FAILURE;
+    }
+
+    /* where each channel's samples start in a line, the channels being
+       stored in the order listed */
+    for (i = 0; i < channel_count; i++)
+    {
+        channels[i].offset = line_bytes;
+        line_bytes += (size_t)w * ((channels[i].type == 1) ? 2 : 4);
+        if (channels[i].slot == 4)
+            grey = true;
+    }
+    for (i = 0; i < channel_count; i++)
+    {
+        /* y only counts without r, g and b */
+        if ((channels[i].slot >= 0) && (channels[i].slot < 3))
+            grey = false;
+    }
+    chunk_bytes = line_bytes * (size_t)lines;
+    chunks = (h + lines - 1) / lines;
+    if ((size_t)(end - p) / 8 < (size_t)chunks)
+        goto hdr_read_exr_failure_0;
+
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    packed = malloc (chunk_bytes);
+    unpacked = malloc (chunk_bytes);
+    if ((packed == NULL) || (unpacked == NULL))
+    {
+        SDL_OutOfMemory ();
+        goto hdr_read_exr_failure_1;
+    }
+    for (i = 0; i < w * h * 4; i++)
+    {
+        hdr->pixels[i] = ((i & 3) == 3) ? 0x3C00 : 0;
+    }
+
+    /* the offset table, then each chunk as its line number and size */
+    for (i = 0; i < chunks; i++)
+    {
+        off = (uint64_t)hdr_get32 (p + i * 8) | ((uint64_t)hdr_get32 (p + i * 8 + 4) << 32);
+        if ((off > len) || (len - off < 8))
+            goto hdr_read_exr_failure_2;
+        chunk = data + off;
+        y = (int32_t)hdr_get32 (chunk) - y0;
+        size = hdr_get32 (chunk + 4);
+        if ((y < 0) || (y >= h) || (y % lines != 0) || (size > len - off - 8))
+            goto hdr_read_exr_failure_2;
+        chunk += 8;
+
+        /* a chunk that would not shrink is kept as it is */
+        got = SDL_min ((size_t)(h - y), (size_t)lines) * line_bytes;
+        if (size == got)
+            line = chunk;
+        else if (compression == 0)
+            goto hdr_read_exr_failure_2;
+        else
+        {
+            if (compression == 1)
+                size = (uint32_t)hdr_unrle (chunk, size, packed, got);
+            else
+                size = (uint32_t)hdr_inflate (chunk, size, packed, got);
+            if (size != got)
+                goto hdr_read_exr_failure_2;
+            hdr_exr_unpredict (packed, unpacked, got);
+            line = unpacked;
+        }
+
+        for (row = y; row < SDL_min (y + lines, h); row++, line += line_bytes)
+        {
+            out = hdr->pixels + (size_t)row * (size_t)w * 4;
+            for (x = 0; x < w; x++)
+            {
+                rgba[0] = rgba[1] = rgba[2] = 0.0f;
+                rgba[3] = 1.0f;
+                for (c = 0; c < channel_count; c++)
+                {
+                    if (channels[c].slot < 0)
+                        continue;
+                    sample = (channels[c].slot == 4) ? 0 : channels[c].slot;
+                    if ((channels[c].slot == 4) && !grey)
+                        continue;
+                    if (channels[c].type == 1)
+                        v.f = hdr_float ((uint16_t)(line[channels[c].offset + (size_t)x * 2] |
+                                                    (line[channels[c].offset + (size_t)x * 2 + 1] << 8)));
+                    else
+                        v.u = hdr_get32 (line + channels[c].offset + (size_t)x * 4);
+                    rgba[sample] = v.f;
+                }
+                if (grey)
+                    rgba[1] = rgba[2] = rgba[0];
+
+                /* SDL blends straight alpha */
+                alpha = rgba[3];
+                for (c = 0; c < 3; c++)
+                {
+                    out[x * 4 + c] = hdr_half ((alpha > 0.0f) ? rgba[c] / alpha : rgba[c]);
+                }
+                out[x * 4 + 3] = hdr_half (alpha);
+            }
+        }
+    }
+    free (unpacked);
+    free (packed);
+    hdr->scene = true;
+
+    return EXIT_SUCCESS;
+
+hdr_read_exr_failure_2:
+    SDL_SetError ("exr: damaged chunk");
+hdr_read_exr_failure_1:
+    free (unpacked);
+    free (packed);
+    return EXIT_FAILURE;
+
+hdr_read_exr_failure_0:
+    SDL_SetError ("exr: truncated or unsupported file");
+    return EXIT_FAILURE;
+}
+
+
+/* pixels holding 16 bit srgb samples, straight alpha, turned into
+   linear half floats where they lie */
+static void
+hdr_widen (hdr_image *hdr)
+{
+    uint16_t *p = hdr->pixels;
+    size_t n = (size_t)hdr->w * (size_t)hdr->h;
+    size_t i;
+
+    if (!s_linear16_ready)
+    {
+        for (i = 0; i < 65536; i++)
+        {
+            s_linear16[i] = hdr_half (hdr_linear ((double)i / 65535.0));
+        }
+        s_linear16_ready = true;
+    }
+
+    for (i = 0; i < n; i++, p += 4)
+    {
+        p[0] = s_linear16[p[0]];
+        p[1] = s_linear16[p[1]];
+        p[2] = s_linear16[p[2]];
+        p[3] = (p[3] == 0xFFFF) ? 0x3C00 : hdr_half ((float)p[3] / 65535.0f);
+    }
+}
+
+
+/* 16 bit pngs, 8 bit ones are left to the 8 bit decoders */
+static int
+hdr_read_png (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+#if NATIVE_PNG
+    int w, h;
+
+    if (!png_is_wide (data, len, &w, &h))
+        return EXIT_FAILURE;
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (png_decode_wide (data, len, hdr->pixels) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    hdr_widen (hdr);
+    hdr->scene = false;
+
+    return EXIT_SUCCESS;
+#else
+    (void)hdr;
+    (void)data;
+    (void)len;
+    return EXIT_FAILURE;
+#endif
+}
+
+
+/* worker side: the band's rows through the kernel into the surface,
+   the main thread is woken once the last band is in */
+static void
+hdr_band_job (void *arg)
+{
+    hdr_band *band = (hdr_band *)arg;
+    hdr_image *hdr = band->hdr;
+    SDL_Event evt;
+    int y;
+
+    for (y = band->y0; y < band->y1; y++)
+    {
+        g_simd.tonemap_rgba (hdr->pixels + (size_t)y * (size_t)hdr->w * 4,
+                             (uint8_t *)hdr->surface->pixels + (size_t)y * (size_t)hdr->surface->pitch,
+                             hdr->w, &hdr->tm);
+    }
+
+    if (SDL_AtomicAdd (&hdr->bands_left, -1) == 1)
+    {
+        SDL_zero (evt);
+        evt.type = g_hdr_event;
+        SDL_PushEvent (&evt);
+    }
+}
+
+
+/* map the whole image again at the current exposure, no bands may be
+   running */
+static void
+hdr_map (hdr_image *hdr)
+{
+    int i;
+
+    hdr->tm.gain = (float)pow (2.0, hdr->exposure);
+    hdr->tm.k = (float)(1.0 / (HDR_WHITE * HDR_WHITE));
+    hdr->tm.curve = hdr->scene;
+    hdr->tm.lut = s_srgb;
+
+    SDL_AtomicSet (&hdr->bands_left, hdr->band_count);
+    hdr->mapping = true;
+    for (i = 0; i < hdr->band_count; i++)
+    {
+        /* a band that cannot be queued is done here */
+        if (workers_submit (hdr->pool, hdr_band_job, &hdr->bands[i]) != EXIT_SUCCESS)
+            hdr_band_job (&hdr->bands[i]);
+    }
+}
+
+
+/* once the pixels are read: the texture, the bands, and the first
+   mapping, waited for.  hdr is discarded on failure */
+static int
+hdr_start (hdr_image *hdr)
+{
+    hdr_band *band;
+    double level;
+    int i;
+
+    if (g_hdr_event == (Uint32)-1)
+        g_hdr_event = SDL_RegisterEvents (1);
+
+    if (hdr->pool == NULL)
+    {
+        SDL_SetError ("hdr: no workers");
+        goto hdr_start_failure_0;
+    }
+    if (!s_srgb_ready)
+    {
+        for (i = 0; i < SIMD_TONEMAP_LUT; i++)
+        {
+            level = (double)i / (SIMD_TONEMAP_LUT - 1);
+            level = (level <= 0.0031308) ? level * 12.92 : 1.055 * pow (level, 1.0 / 2.4) - 0.055;
+            s_srgb[i] = (uint8_t)(level * 255.0 + 0.5);
+        }
+        s_srgb_ready = true;
+    }
+
+    hdr->texture = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING,
+                                      hdr->w, hdr->h);
+    if (hdr->texture == NULL)
+        goto hdr_start_failure_0;
+
+    hdr->band_count = (hdr->h + HDR_BAND - 1) / HDR_BAND;
+    hdr->bands = calloc ((size_t)hdr->band_count, sizeof (hdr_band));
+    if (hdr->bands == NULL)
+        goto hdr_start_failure_1;
+    for (i = 0; i < hdr->band_count; i++)
+    {
+        band = &hdr->bands[i];
+        band->hdr = hdr;
+        band->y0 = i * HDR_BAND;
+        band->y1 = SDL_min (band->y0 + HDR_BAND, hdr->h);
+    }
+
+    /* the first frame waits for the first mapping */
+    hdr_map (hdr);
+    workers_wait (hdr->pool);
+    hdr->active = true;
+    hdr_update (hdr);
+
+/* hdr_start_success_0: */
+    return EXIT_SUCCESS;
+
+hdr_start_failure_1:
+    SDL_DestroyTexture (hdr->texture);
+hdr_start_failure_0:
+    hdr_discard (hdr);
+    return EXIT_FAILURE;
+}
+
+
+/* the pixels and surface, with the memory they were counted as */
+static void
+hdr_discard (hdr_image *hdr)
+{
+    arena_account (-(ptrdiff_t)hdr->bytes);
+    SDL_FreeSurface (hdr->surface);
+    free (hdr->pixels);
+    hdr_reset (hdr);
+}
+
+
+/* all of hdr but the workers, which outlive the images */
+static void
+hdr_reset (hdr_image *hdr)
+{
+    worker_pool *pool = hdr->pool;
+
+    memset (hdr, 0, sizeof (hdr_image));
+    hdr->pool = pool;
+}
+
+
+/* function definitions */
+void
+hdr_init (hdr_image *hdr)
+{
+    memset (hdr, 0, sizeof (hdr_image));
+
+    /* without workers 16-bit and HDR images go to the other decoders */
+    hdr->pool = workers_create (workers_default_count (), (worker_rank_fn)NULL);
+}
+
+
+void
+hdr_shutdown (hdr_image *hdr)
+{
+    hdr_close (hdr);
+    workers_destroy (hdr->pool);
+    memset (hdr, 0, sizeof (hdr_image));
+}
+
+
+/* read data when it is a 16-bit or HDR image, and map it for the first
+   time before returning */
+int
+hdr_open (hdr_image *hdr, const unsigned char *data, size_t len)
+{
+    hdr_reset (hdr);
+
+    if ((hdr_read_radiance (hdr, data, len) != EXIT_SUCCESS) &&
+        (hdr_read_pfm (hdr, data, len) != EXIT_SUCCESS) &&
+        (hdr_read_exr (hdr, data, len) != EXIT_SUCCESS) &&
+        (hdr_read_png (hdr, data, len) != EXIT_SUCCESS) &&
+        (hdr_read_pnm (hdr, data, len) != EXIT_SUCCESS))
+        goto hdr_open_failure_0;
+
+/* hdr_open_success_0: */
+    return hdr_start (hdr);
+
+hdr_open_failure_0:
+    /* a reader that failed part way leaves its pixels */
+    hdr_discard (hdr);
+    return EXIT_FAILURE;
+}
+
+
+/* w by h pixels of 16 bit samples put in place by fill, for decoders
+   that keep their own state (tiff pages) */
+int
+hdr_open_wide (hdr_image *hdr, int w, int h, hdr_fill_fn fill, void *arg)
+{
+    hdr_reset (hdr);
+
+    if (hdr_alloc (hdr, w, h) != EXIT_SUCCESS)
+        goto hdr_open_wide_failure_0;
+    if (fill (arg, hdr->pixels) != EXIT_SUCCESS)
+        goto hdr_open_wide_failure_0;
+    hdr_widen (hdr);
+    hdr->scene = false;
+
+/* hdr_open_wide_success_0: */
+    return hdr_start (hdr);
+
+hdr_open_wide_failure_0:
+    hdr_discard (hdr);
+    return EXIT_FAILURE;
+}
+
+
+/* the texture is owned by whoever displays it (g_img) and is left alone */
+void
+hdr_close (hdr_image *hdr)
+{
+    if (!hdr->active)
+        return;
+
+    /* queued bands are dropped, running ones finish first */
+    workers_cancel (hdr->pool);
+    workers_wait (hdr->pool);
+
+    free (hdr->bands);
+    hdr_discard (hdr);
+}
+
+
+/* upload the mapping once every band is in, true when the texture
+   changed */
+bool
+hdr_update (hdr_image *hdr)
+{
+    if (!hdr->active || !hdr->mapping || (SDL_AtomicGet (&hdr->bands_left) > 0))
+        return false;
+
+    SDL_UpdateTexture (hdr->texture, NULL, hdr->surface->pixels, hdr->surface->pitch);
+    hdr->mapping = false;
+
+    return true;
+}
+
+
+/* map again at stops, dropping a mapping still under way */
+void
+hdr_set_exposure (hdr_image *hdr, double stops)
+{
+    char title[64];
+
+    if (!hdr->active)
+        return;
+
+    workers_cancel (hdr->pool);
+    workers_wait (hdr->pool);
+    hdr->exposure = SDL_max (-HDR_EXPOSURE_RANGE, SDL_min (stops, HDR_EXPOSURE_RANGE));
+    hdr_map (hdr);
+
+    snprintf (title, sizeof (title), "LJPEG - exposure %+.1f EV", hdr->exposure);
+    SDL_SetWindowTitle (g_win, title);
+}
+
+
+/* End of File */
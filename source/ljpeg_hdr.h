@@ -0,0 +1,95 @@
+/*
+   source/ljpeg_hdr.h
+   LJPEG 16-bit and HDR image header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_HDR_HEADER__
+#define __LJPEG_HDR_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+/* puts w x h rgba pixels of 16 bit srgb samples, straight alpha, into
+   rgba, returning EXIT_SUCCESS */
+typedef int (*hdr_fill_fn) (void *arg, uint16_t *rgba);
+
+/* rows y0 up to y1, tone mapped on a worker */
+typedef struct hdr_band
+{
+    struct hdr_image *hdr;
+    int           y0, y1;
+} hdr_band;
+
+typedef struct hdr_image
+{
+    bool          active;
+    int           w, h;
+    uint16_t     *pixels;       /* linear light, half float rgba */
+    size_t        bytes;        /* of pixels, counted against --max-memory */
+    bool          scene;        /* scene referred (radiance, pfm), through the tone curve */
+    double        exposure;     /* stops */
+    simd_tonemap  tm;
+
+    SDL_Surface  *surface;      /* tone mapped, DECODE_PIXELFORMAT */
+    SDL_Texture  *texture;      /* streaming, owned by g_img */
+
+    hdr_band     *bands;
+    int           band_count;
+    worker_pool  *pool;
+    SDL_atomic_t  bands_left;
+    bool          mapping;      /* bands are out, the texture waits for them */
+} hdr_image;
+
+
+/* constants */
+
+
+/* global variables */
+extern hdr_image g_hdr;
+extern Uint32    g_hdr_event;
+
+
+/* external function prototypes */
+/* EXIT_FAILURE too when data is not a file it reads, it is then left
+   to the other decoders */
+void hdr_init     (hdr_image *hdr);
+void hdr_shutdown (hdr_image *hdr);
+
+int  hdr_open  (hdr_image *hdr, const unsigned char *data, size_t len);
+int  hdr_open_wide (hdr_image *hdr, int w, int h, hdr_fill_fn fill, void *arg);
+void hdr_close (hdr_image *hdr);
+
+bool hdr_update       (hdr_image *hdr);
+void hdr_set_exposure (hdr_image *hdr, double stops);
+
+#endif /* end run once */
+
+
+/* End of File */
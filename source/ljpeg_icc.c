@@ -0,0 +1,1044 @@
+/*
+   source/ljpeg_icc.c
+   LJPEG colour management source code.
+
+   An image's colours are in the space of the ICC profile it carries (a
+   JPEG's APP2 segments, a PNG's iCCP chunk, a TIFF's tag 34675, a
+   WebP's ICCP chunk), or in sRGB when it carries none, and they are
+   shown in the space of the window's profile, or sRGB where the display
+   has none.  Instead of putting every pixel through a colour transform,
+   the transform from the one profile to the other is sampled once at
+   ICC_LUT_POINTS points along each of r, g and b, and every pixel is
+   interpolated from the four points of the tetrahedron around it by the
+   vector kernel, the workers taking bands of rows.  The last ICC_CACHE
+   of these luts are kept by the pair of profiles they are for, so a
+   directory of photos from one camera builds a single one, and a pair
+   that comes out the same (an sRGB image on an sRGB display) is not
+   applied at all.
+
+   Built with USE_LCMS2, LittleCMS samples the transform and any RGB
+   profile can be used.  Without it the built-in matrix/TRC model reads
+   the profiles cameras, editors and displays mostly use (sRGB, Adobe
+   RGB, Display P3, ProPhoto); the rest are left alone.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_icc.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+#ifdef USE_LCMS2
+#include <lcms2.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+icc_state g_icc;
+
+
+/* file static variables */
+/* rows a worker converts at once */
+#define ICC_BAND 64
+
+/* embedded profiles bigger than this are taken to be damaged */
+#define ICC_MAX_PROFILE (16 * 1024 * 1024)
+
+/* points in the display's curves turned around */
+#define ICC_INVERSE 4096
+
+/* a lut within this many levels of doing nothing does nothing */
+#define ICC_SAME 1
+
+/* a tone curve: count 16 bit points, or parametric function type
+   (0 to 4, a plain gamma being 0) with its params g a b c d e f */
+typedef struct icc_curve
+{
+    const uint8_t *table;
+    uint32_t       count;
+    int            type;
+    double         p[7];
+} icc_curve;
+
+/* a matrix/TRC profile, linear rgb to d50 xyz through m */
+typedef struct icc_model
+{
+    double         m[3][3];
+    icc_curve      trc[3];
+} icc_model;
+
+/* a surface on its way through a lut */
+typedef struct icc_job
+{
+    SDL_Surface   *surface;
+    simd_lut3d     lut;
+    int            bands;
+    SDL_atomic_t   next;        /* the next band to be taken */
+} icc_job;
+
+
+/* file static function prototypes */
+static uint16_t icc_get16 (const uint8_t *p, bool le);
+static uint32_t icc_get32 (const uint8_t *p, bool le);
+static uint64_t icc_hash (const uint8_t *p, size_t len);
+
+static uint8_t *icc_copy (const uint8_t *p, size_t len, size_t *out_len);
+static uint8_t *icc_inflate (const uint8_t *in, size_t in_len, size_t *out_len);
+static uint8_t *icc_from_jpeg (const uint8_t *data, size_t len, size_t *out_len);
+static uint8_t *icc_from_png (const uint8_t *data, size_t len, size_t *out_len);
+static uint8_t *icc_from_tiff (const uint8_t *data, size_t len, size_t *out_len);
+static uint8_t *icc_from_webp (const uint8_t *data, size_t len, size_t *out_len);
+static uint8_t *icc_extract (const uint8_t *data, size_t len, size_t *out_len);
+
+static const uint8_t *icc_tag (const uint8_t *profile, size_t len, const char *sig, uint32_t *size);
+static bool     icc_read_curve (const uint8_t *profile, size_t len, const char *sig, icc_curve *curve);
+static bool     icc_read_model (const uint8_t *profile, size_t len, icc_model *model);
+static void     icc_srgb (icc_model *model);
+static double   icc_curve_eval (const icc_curve *curve, double x);
+static bool     icc_invert (double m[3][3], double out[3][3]);
+static double   icc_encode (const float *inverse, double x);
+static uint32_t icc_level (double v);
+
+static uint32_t *icc_build_builtin (const uint8_t *source, size_t source_len,
+                                    const uint8_t *display, size_t display_len, int n);
+#ifdef USE_LCMS2
+static uint32_t *icc_build_lcms (const uint8_t *source, size_t source_len,
+                                 const uint8_t *display, size_t display_len, int n);
+#endif
+static bool      icc_is_identity (const uint32_t *table, int n);
+static uint32_t *icc_build (const uint8_t *source, size_t source_len,
+                            const uint8_t *display, size_t display_len);
+static const uint32_t *icc_lookup (icc_state *icc, const uint8_t *profile, size_t len);
+static void     icc_band_job (void *arg);
+
+
+/* static function definitions */
+static uint16_t
+icc_get16 (const uint8_t *p, bool le)
+{
+    if (le)
+        return (uint16_t)(p[0] | (p[1] << 8));
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+static uint32_t
+icc_get32 (const uint8_t *p, bool le)
+{
+    if (le)
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+/* fnv-1a, never 0 (which stands for srgb) */
+static uint64_t
+icc_hash (const uint8_t *p, size_t len)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return (hash != 0) ? hash : 1;
+}
+
+
+static uint8_t *
+icc_copy (const uint8_t *p, size_t len, size_t *out_len)
+{
+    uint8_t *profile;
+
+    if ((len == 0) || (len > ICC_MAX_PROFILE))
+        return (uint8_t *)NULL;
+    profile = SDL_malloc (len);
+    if (profile == NULL)
+        return (uint8_t *)NULL;
+    memcpy (profile, p, len);
+    *out_len = len;
+
+    return profile;
+}
+
+
+/* a zlib stream of unknown size, into a buffer doubled until it fits */
+static uint8_t *
+icc_inflate (const uint8_t *in, size_t in_len, size_t *out_len)
+{
+    uint8_t *out = NULL;
+    uint8_t *grown;
+    size_t cap = 65536;
+#ifdef USE_LIBDEFLATE
+    struct libdeflate_decompressor *inflater;
+    enum libdeflate_result result;
+    size_t got = 0;
+
+    inflater = libdeflate_alloc_decompressor ();
+    if (inflater == NULL)
+        return (uint8_t *)NULL;
+#else
+    uLongf got;
+    int result;
+
+    if (in_len > ULONG_MAX)
+        return (uint8_t *)NULL;
+#endif
+
+    for (; cap <= ICC_MAX_PROFILE; cap *= 2)
+    {
+        grown = SDL_realloc (out, cap);
+        if (grown == NULL)
+            break;
+        out = grown;
+#ifdef USE_LIBDEFLATE
+        result = libdeflate_zlib_decompress (inflater, in, in_len, out, cap, &got);
+        if (result == LIBDEFLATE_SUCCESS)
+        {
+            libdeflate_free_decompressor (inflater);
+            *out_len = got;
+            return out;
+        }
+        if (result != LIBDEFLATE_INSUFFICIENT_SPACE)
+            break;
+#else
+        got = (uLongf)cap;
+        result = uncompress (out, &got, in, (uLong)in_len);
+        if (result == Z_OK)
+        {
+            *out_len = (size_t)got;
+            return out;
+        }
+        if (result != Z_BUF_ERROR)
+            break;
+#endif
+    }
+
+#ifdef USE_LIBDEFLATE
+    libdeflate_free_decompressor (inflater);
+#endif
+    SDL_free (out);
+    return (uint8_t *)NULL;
+}
+
+
+/* APP2 segments of "ICC_PROFILE\0", the chunk's number (from 1) and the
+   number of chunks, then that part of the profile.  they come before
+   the scan */
+static uint8_t *
+icc_from_jpeg (const uint8_t *data, size_t len, size_t *out_len)
+{
+    const uint8_t *chunk[256] = { NULL };
+    size_t chunk_len[256];
+    size_t pos = 2;
+    size_t seglen;
+    size_t total = 0;
+    uint8_t *profile;
+    int marker, seq;
+    int count = 0;
+    int i;
+
+    while (pos + 4 <= len)
+    {
+        if (data[pos] != 0xFF)
+            break;
+        marker = data[pos + 1];
+
+        /* fill bytes and markers without a length */
+        if (marker == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        if ((marker == 0xD8) || (marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7)))
+        {
+            pos += 2;
+            continue;
+        }
+        if ((marker == 0xDA) || (marker == 0xD9))
+            break;
+
+        seglen = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if ((seglen < 2) || (seglen > len - pos - 2))
+            break;
+        if ((marker == 0xE2) && (seglen > 2 + 14) && (memcmp (data + pos + 4, "ICC_PROFILE", 12) == 0))
+        {
+            seq = data[pos + 16];
+            if ((seq > 0) && (chunk[seq] == NULL))
+            {
+                chunk[seq] = data + pos + 18;
+                chunk_len[seq] = seglen - 16;
+                count = SDL_max (count, (int)data[pos + 17]);
+            }
+        }
+
+        pos += 2 + seglen;
+    }
+
+    /* every chunk or none */
+    if (count == 0)
+        return (uint8_t *)NULL;
+    for (i = 1; i <= count; i++)
+    {
+        if (chunk[i] == NULL)
+            return (uint8_t *)NULL;
+        total += chunk_len[i];
+    }
+    if (total > ICC_MAX_PROFILE)
+        return (uint8_t *)NULL;
+
+    profile = SDL_malloc (total);
+    if (profile == NULL)
+        return (uint8_t *)NULL;
+    for (total = 0, i = 1; i <= count; i++)
+    {
+        memcpy (profile + total, chunk[i], chunk_len[i]);
+        total += chunk_len[i];
+    }
+    *out_len = total;
+
+    return profile;
+}
+
+
+/* iCCP: a name of 1 to 79 bytes and its nul, the compression method
+   (0, zlib) and the compressed profile.  it comes before IDAT */
+static uint8_t *
+icc_from_png (const uint8_t *data, size_t len, size_t *out_len)
+{
+    const uint8_t *p;
+    const uint8_t *name_end;
+    uint32_t size;
+    size_t pos = 8;
+
+    while (pos + 12 <= len)
+    {
+        size = icc_get32 (data + pos, false);
+        if (size > len - pos - 12)
+            break;
+        p = data + pos + 8;
+        if (memcmp (data + pos + 4, "IDAT", 4) == 0)
+            break;
+
+        if (memcmp (data + pos + 4, "iCCP", 4) == 0)
+        {
+            name_end = memchr (p, 0, SDL_min (size, 80));
+            if ((name_end == NULL) || ((size_t)(name_end - p) + 2 > size) || (name_end[1] != 0))
+                return (uint8_t *)NULL;
+            return icc_inflate (name_end + 2, size - (size_t)(name_end - p) - 2, out_len);
+        }
+
+        pos += 12 + (size_t)size;
+    }
+
+    return (uint8_t *)NULL;
+}
+
+
+/* tag 34675 of the first directory, so every page is taken to share it */
+static uint8_t *
+icc_from_tiff (const uint8_t *data, size_t len, size_t *out_len)
+{
+    const uint8_t *e;
+    uint32_t ifd, count, off;
+    uint16_t entries;
+    bool le;
+    int i;
+
+    if (len < 8)
+        return (uint8_t *)NULL;
+    le = (data[0] == 'I');
+    ifd = icc_get32 (data + 4, le);
+    if ((ifd < 8) || (ifd > len - 2))
+        return (uint8_t *)NULL;
+    entries = icc_get16 (data + ifd, le);
+    if ((size_t)entries * 12 > len - ifd - 2)
+        return (uint8_t *)NULL;
+
+    for (i = 0; i < entries; i++)
+    {
+        e = data + ifd + 2 + (size_t)i * 12;
+        if (icc_get16 (e, le) != 34675)
+            continue;
+
+        /* undefined (or byte) values, too many to be held in place */
+        count = icc_get32 (e + 4, le);
+        off = icc_get32 (e + 8, le);
+        if (((icc_get16 (e + 2, le) != 7) && (icc_get16 (e + 2, le) != 1)) ||
+            (count <= 4) || (off > len) || (count > len - off))
+            return (uint8_t *)NULL;
+        return icc_copy (data + off, count, out_len);
+    }
+
+    return (uint8_t *)NULL;
+}
+
+
+/* an ICCP chunk, which comes before the image */
+static uint8_t *
+icc_from_webp (const uint8_t *data, size_t len, size_t *out_len)
+{
+    uint32_t size;
+    size_t pos = 12;
+
+    while (pos + 8 <= len)
+    {
+        size = icc_get32 (data + pos + 4, true);
+        if (size > len - pos - 8)
+            break;
+        if (memcmp (data + pos, "ICCP", 4) == 0)
+            return icc_copy (data + pos + 8, size, out_len);
+        if ((memcmp (data + pos, "VP8 ", 4) == 0) || (memcmp (data + pos, "VP8L", 4) == 0) ||
+            (memcmp (data + pos, "ANIM", 4) == 0))
+            break;
+        pos += 8 + (size_t)size + (size & 1);
+    }
+
+    return (uint8_t *)NULL;
+}
+
+
+/* the profile embedded in the file, for the caller to free.  NULL when
+   it has none, or the format keeps none */
+static uint8_t *
+icc_extract (const uint8_t *data, size_t len, size_t *out_len)
+{
+    if (len < 12)
+        return (uint8_t *)NULL;
+
+    if ((data[0] == 0xFF) && (data[1] == 0xD8))
+        return icc_from_jpeg (data, len, out_len);
+    if (memcmp (data, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return icc_from_png (data, len, out_len);
+    if ((memcmp (data, "II*\0", 4) == 0) || (memcmp (data, "MM\0*", 4) == 0))
+        return icc_from_tiff (data, len, out_len);
+    if ((memcmp (data, "RIFF", 4) == 0) && (memcmp (data + 8, "WEBP", 4) == 0))
+        return icc_from_webp (data, len, out_len);
+
+    return (uint8_t *)NULL;
+}
+
+
+/* the tag sig of the profile, and its size */
+static const uint8_t *
+icc_tag (const uint8_t *profile, size_t len, const char *sig, uint32_t *size)
+{
+    const uint8_t *e;
+    uint32_t count, off, i;
+
+    count = icc_get32 (profile + 128, false);
+    if (count > (len - 132) / 12)
+        return (const uint8_t *)NULL;
+
+    for (i = 0; i < count; i++)
+    {
+        e = profile + 132 + (size_t)i * 12;
+        if (memcmp (e, sig, 4) != 0)
+            continue;
+        off = icc_get32 (e + 4, false);
+        *size = icc_get32 (e + 8, false);
+        if ((off > len) || (*size > len - off))
+            return (const uint8_t *)NULL;
+        return profile + off;
+    }
+
+    return (const uint8_t *)NULL;
+}
+
+
+static bool
+icc_read_curve (const uint8_t *profile, size_t len, const char *sig, icc_curve *curve)
+{
+    /* params each parametric type has */
+    static const int params[5] = { 1, 3, 4, 5, 7 };
+    const uint8_t *p;
+    uint32_t size;
+    uint32_t count;
+    int i;
+
+    p = icc_tag (profile, len, sig, &size);
+    if ((p == NULL) || (size < 12))
+        return false;
+    memset (curve, 0, sizeof (icc_curve));
+
+    if (memcmp (p, "curv", 4) == 0)
+    {
+        /* no points is no change, one is a gamma in 8.8 fixed point */
+        count = icc_get32 (p + 8, false);
+        if (count > (size - 12) / 2)
+            return false;
+        curve->p[0] = 1.0;
+        if (count == 1)
+            curve->p[0] = icc_get16 (p + 12, false) / 256.0;
+        else if (count > 1)
+        {
+            curve->table = p + 12;
+            curve->count = count;
+        }
+        return true;
+    }
+
+    if (memcmp (p, "para", 4) == 0)
+    {
+        curve->type = icc_get16 (p + 8, false);
+        if ((curve->type > 4) || (size < 12 + 4 * (uint32_t)params[curve->type]))
+            return false;
+        for (i = 0; i < params[curve->type]; i++)
+            curve->p[i] = (int32_t)icc_get32 (p + 12 + i * 4, false) / 65536.0;
+        if (((curve->type == 1) || (curve->type == 2)) && (curve->p[1] == 0.0))
+            return false;
+        return true;
+    }
+
+    return false;
+}
+
+
+static bool
+icc_read_model (const uint8_t *profile, size_t len, icc_model *model)
+{
+    static const char *const xyz[3] = { "rXYZ", "gXYZ", "bXYZ" };
+    static const char *const trc[3] = { "rTRC", "gTRC", "bTRC" };
+    const uint8_t *p;
+    uint32_t size;
+    int c, i;
+
+    /* rgb with an xyz connection space, the only kind with a matrix */
+    if ((len < 132) || (memcmp (profile + 36, "acsp", 4) != 0) ||
+        (memcmp (profile + 16, "RGB ", 4) != 0) || (memcmp (profile + 20, "XYZ ", 4) != 0))
+        return false;
+
+    for (c = 0; c < 3; c++)
+    {
+        p = icc_tag (profile, len, xyz[c], &size);
+        if ((p == NULL) || (size < 20) || (memcmp (p, "XYZ ", 4) != 0))
+            return false;
+        for (i = 0; i < 3; i++)
+            model->m[i][c] = (int32_t)icc_get32 (p + 8 + i * 4, false) / 65536.0;
+        if (!icc_read_curve (profile, len, trc[c], &model->trc[c]))
+            return false;
+    }
+
+    return true;
+}
+
+
+/* srgb as its icc profile has it, the primaries adapted to d50 and the
+   curve as parametric type 3 */
+static void
+icc_srgb (icc_model *model)
+{
+    static const double m[3][3] = {
+        { 0.4360747, 0.3850649, 0.1430804 },
+        { 0.2225045, 0.7168786, 0.0606169 },
+        { 0.0139322, 0.0971045, 0.7141733 }
+    };
+    int c;
+
+    memset (model, 0, sizeof (icc_model));
+    memcpy (model->m, m, sizeof (m));
+    for (c = 0; c < 3; c++)
+    {
+        model->trc[c].type = 3;
+        model->trc[c].p[0] = 2.4;
+        model->trc[c].p[1] = 1.0 / 1.055;
+        model->trc[c].p[2] = 0.055 / 1.055;
+        model->trc[c].p[3] = 1.0 / 12.92;
+        model->trc[c].p[4] = 0.04045;
+    }
+}
+
+
+/* x (0 to 1) through the curve, linear between table points */
+static double
+icc_curve_eval (const icc_curve *curve, double x)
+{
+    const double *p = curve->p;
+    double pos;
+    uint32_t i;
+
+    x = SDL_min (SDL_max (x, 0.0), 1.0);
+    if (curve->table != NULL)
+    {
+        pos = x * (double)(curve->count - 1);
+        i = SDL_min ((uint32_t)pos, curve->count - 2);
+        pos -= (double)i;
+        return (icc_get16 (curve->table + i * 2, false) * (1.0 - pos) +
+                icc_get16 (curve->table + i * 2 + 2, false) * pos) / 65535.0;
+    }
+
+    switch (curve->type)
+    {
+    case 1:
+        return (x >= -p[2] / p[1]) ? pow (SDL_max (p[1] * x + p[2], 0.0), p[0]) : 0.0;
+    case 2:
+        return (x >= -p[2] / p[1]) ? pow (SDL_max (p[1] * x + p[2], 0.0), p[0]) + p[3] : p[3];
+    case 3:
+        return (x >= p[4]) ? pow (SDL_max (p[1] * x + p[2], 0.0), p[0]) : p[3] * x;
+    case 4:
+        return (x >= p[4]) ? pow (SDL_max (p[1] * x + p[2], 0.0), p[0]) + p[5] : p[3] * x + p[6];
+    default:
+        return pow (x, p[0]);
+    }
+}
+
+
+static bool
+icc_invert (double m[3][3], double out[3][3])
+{
+    double det;
+    int r, c;
+
+    det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+        - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+        + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (fabs (det) < 1e-9)
+        return false;
+
+    /* the cofactors, transposed */
+    for (r = 0; r < 3; r++)
+    {
+        for (c = 0; c < 3; c++)
+        {
+            out[c][r] = (m[(r + 1) % 3][(c + 1) % 3] * m[(r + 2) % 3][(c + 2) % 3] -
+                         m[(r + 1) % 3][(c + 2) % 3] * m[(r + 2) % 3][(c + 1) % 3]) / det;
+        }
+    }
+
+    return true;
+}
+
+
+/* linear light x through the display's curve turned around, carried on
+   past 0 (mirrored) and 1 (straight on) */
+static double
+icc_encode (const float *inverse, double x)
+{
+    double pos;
+    int k;
+
+    if (x < 0.0)
+        return -icc_encode (inverse, -x);
+    pos = x * (ICC_INVERSE - 1);
+    k = SDL_min ((int)pos, ICC_INVERSE - 2);
+
+    return inverse[k] + (inverse[k + 1] - inverse[k]) * (pos - k);
+}
+
+
+/* v (0 to 1 in the gamut) as a lut level */
+static uint32_t
+icc_level (double v)
+{
+    v = (v - SIMD_LUT3D_MIN) / (SIMD_LUT3D_MAX - SIMD_LUT3D_MIN) * 1023.0 + 0.5;
+
+    return (uint32_t)SDL_min (SDL_max (v, 0.0), 1023.0);
+}
+
+
+/* the matrix/TRC lut: a point's levels through the source's curves to
+   linear light, to xyz and back out through the display's matrix and
+   its curves turned around.  a display profile the model cannot read
+   is taken to be srgb */
+static uint32_t *
+icc_build_builtin (const uint8_t *source, size_t source_len,
+                   const uint8_t *display, size_t display_len, int n)
+{
+    icc_model from, to;
+    double back[3][3], m[3][3];
+    double lin[3], x, lo, hi, mid;
+    float *inverse;
+    uint32_t *table;
+    int points = n * n * n;
+    int at[3];
+    int i, c, step;
+
+    if (source == NULL)
+        icc_srgb (&from);
+    else if (!icc_read_model (source, source_len, &from))
+        return (uint32_t *)NULL;
+    if ((display == NULL) || !icc_read_model (display, display_len, &to))
+        icc_srgb (&to);
+    if (!icc_invert (to.m, back))
+        return (uint32_t *)NULL;
+    for (i = 0; i < 9; i++)
+    {
+        m[i / 3][i % 3] = back[i / 3][0] * from.m[0][i % 3] + back[i / 3][1] * from.m[1][i % 3] +
+                          back[i / 3][2] * from.m[2][i % 3];
+    }
+
+    inverse = SDL_malloc (3 * ICC_INVERSE * sizeof (float));
+    if (inverse == NULL)
+        goto icc_build_builtin_failure_0;
+    table = SDL_malloc ((size_t)points * sizeof (uint32_t));
+    if (table == NULL)
+        goto icc_build_builtin_failure_1;
+
+    /* the display's curves only rise, so bisection finds where they
+       reach each point */
+    for (c = 0; c < 3; c++)
+    {
+        for (i = 0; i < ICC_INVERSE; i++)
+        {
+            lo = 0.0;
+            hi = 1.0;
+            for (step = 0; step < 24; step++)
+            {
+                mid = (lo + hi) * 0.5;
+                if (icc_curve_eval (&to.trc[c], mid) < (double)i / (ICC_INVERSE - 1))
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            inverse[c * ICC_INVERSE + i] = (float)((lo + hi) * 0.5);
+        }
+    }
+
+    for (i = 0; i < points; i++)
+    {
+        at[0] = i / (n * n);
+        at[1] = (i / n) % n;
+        at[2] = i % n;
+        for (c = 0; c < 3; c++)
+            lin[c] = icc_curve_eval (&from.trc[c], (double)at[c] / (n - 1));
+
+        table[i] = 0;
+        for (c = 0; c < 3; c++)
+        {
+            x = m[c][0] * lin[0] + m[c][1] * lin[1] + m[c][2] * lin[2];
+            table[i] |= icc_level (icc_encode (inverse + c * ICC_INVERSE, x)) << (c * 10);
+        }
+    }
+
+/* icc_build_builtin_success_0: */
+    SDL_free (inverse);
+    return table;
+
+icc_build_builtin_failure_1:
+    SDL_free (inverse);
+icc_build_builtin_failure_0:
+    return (uint32_t *)NULL;
+}
+
+
+#ifdef USE_LCMS2
+/* the lut sampled by LittleCMS, in place.  in floating point it does
+   not clip */
+static uint32_t *
+icc_build_lcms (const uint8_t *source, size_t source_len,
+                const uint8_t *display, size_t display_len, int n)
+{
+    cmsHPROFILE from;
+    cmsHPROFILE to = NULL;
+    cmsHTRANSFORM transform;
+    float *grid;
+    uint32_t *table;
+    int points = n * n * n;
+    int i, c;
+
+    if (source != NULL)
+        from = cmsOpenProfileFromMem (source, (cmsUInt32Number)source_len);
+    else
+        from = cmsCreate_sRGBProfile ();
+    if (from == NULL)
+        goto icc_build_lcms_failure_0;
+    if (display != NULL)
+        to = cmsOpenProfileFromMem (display, (cmsUInt32Number)display_len);
+    if ((to != NULL) && (cmsGetColorSpace (to) != cmsSigRgbData))
+    {
+        cmsCloseProfile (to);
+        to = NULL;
+    }
+    if (to == NULL)
+        to = cmsCreate_sRGBProfile ();
+    if ((to == NULL) || (cmsGetColorSpace (from) != cmsSigRgbData))
+        goto icc_build_lcms_failure_1;
+
+    transform = cmsCreateTransform (from, TYPE_RGB_FLT, to, TYPE_RGB_FLT, INTENT_PERCEPTUAL, 0);
+    if (transform == NULL)
+        goto icc_build_lcms_failure_1;
+    grid = SDL_malloc ((size_t)points * 3 * sizeof (float));
+    if (grid == NULL)
+        goto icc_build_lcms_failure_2;
+    table = SDL_malloc ((size_t)points * sizeof (uint32_t));
+    if (table == NULL)
+        goto icc_build_lcms_failure_3;
+
+    for (i = 0; i < points; i++)
+    {
+        grid[i * 3 + 0] = (float)(i / (n * n)) / (float)(n - 1);
+        grid[i * 3 + 1] = (float)((i / n) % n) / (float)(n - 1);
+        grid[i * 3 + 2] = (float)(i % n) / (float)(n - 1);
+    }
+    cmsDoTransform (transform, grid, grid, (cmsUInt32Number)points);
+    for (i = 0; i < points; i++)
+    {
+        table[i] = 0;
+        for (c = 0; c < 3; c++)
+            table[i] |= icc_level (grid[i * 3 + c]) << (c * 10);
+    }
+
+/* icc_build_lcms_success_0: */
+    SDL_free (grid);
+    cmsDeleteTransform (transform);
+    cmsCloseProfile (to);
+    cmsCloseProfile (from);
+    return table;
+
+icc_build_lcms_failure_3:
+    SDL_free (grid);
+icc_build_lcms_failure_2:
+    cmsDeleteTransform (transform);
+icc_build_lcms_failure_1:
+    if (to != NULL)
+        cmsCloseProfile (to);
+    cmsCloseProfile (from);
+icc_build_lcms_failure_0:
+    return (uint32_t *)NULL;
+}
+#endif
+
+
+static bool
+icc_is_identity (const uint32_t *table, int n)
+{
+    int at[3];
+    int i, c;
+
+    for (i = 0; i < n * n * n; i++)
+    {
+        at[0] = i / (n * n);
+        at[1] = (i / n) % n;
+        at[2] = i % n;
+        for (c = 0; c < 3; c++)
+        {
+            if (abs ((int)((table[i] >> (c * 10)) & 0x3FF) - (int)icc_level ((double)at[c] / (n - 1))) > ICC_SAME)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* the lut from source to display (NULL for srgb), NULL when there is
+   none to be had or it would change nothing */
+static uint32_t *
+icc_build (const uint8_t *source, size_t source_len,
+           const uint8_t *display, size_t display_len)
+{
+    uint32_t *table;
+
+#ifdef USE_LCMS2
+    table = icc_build_lcms (source, source_len, display, display_len, ICC_LUT_POINTS);
+#else
+    table = icc_build_builtin (source, source_len, display, display_len, ICC_LUT_POINTS);
+#endif
+    if ((table != NULL) && icc_is_identity (table, ICC_LUT_POINTS))
+    {
+        SDL_free (table);
+        table = NULL;
+    }
+
+    return table;
+}
+
+
+/* the lut for profile (NULL for srgb) to the display, built when it is
+   not cached, over the one used longest ago */
+static const uint32_t *
+icc_lookup (icc_state *icc, const uint8_t *profile, size_t len)
+{
+    icc_lut *slot = &icc->cache[0];
+    uint64_t key;
+    int i;
+
+    key = (profile != NULL) ? icc_hash (profile, len) : 0;
+    if (key == icc->display_key)
+        return (const uint32_t *)NULL;
+
+    for (i = 0; i < ICC_CACHE; i++)
+    {
+        if ((icc->cache[i].used != 0) && (icc->cache[i].source == key) &&
+            (icc->cache[i].display == icc->display_key))
+        {
+            icc->cache[i].used = ++icc->clock;
+            return icc->cache[i].table;
+        }
+        if (icc->cache[i].used < slot->used)
+            slot = &icc->cache[i];
+    }
+
+    SDL_free (slot->table);
+    slot->source = key;
+    slot->display = icc->display_key;
+    slot->table = icc_build (profile, len, icc->display, icc->display_len);
+    slot->used = ++icc->clock;
+
+    return slot->table;
+}
+
+
+/* worker side, and the caller's: bands until there are none left */
+static void
+icc_band_job (void *arg)
+{
+    icc_job *job = (icc_job *)arg;
+    SDL_Surface *surface = job->surface;
+    uint8_t *row;
+    int band, y, y1;
+
+    for (;;)
+    {
+        band = SDL_AtomicAdd (&job->next, 1);
+        if (band >= job->bands)
+            break;
+        y1 = SDL_min ((band + 1) * ICC_BAND, surface->h);
+        for (y = band * ICC_BAND; y < y1; y++)
+        {
+            row = (uint8_t *)surface->pixels + (size_t)y * (size_t)surface->pitch;
+            g_simd.lut3d_rgba (row, surface->w, &job->lut);
+        }
+    }
+}
+
+
+/* function definitions */
+void
+icc_init (icc_state *icc, SDL_Window *win)
+{
+    memset (icc, 0, sizeof (icc_state));
+#if ICC_CONVERT
+    icc->win = win;
+    icc->active = true;
+    icc_update_display (icc);
+
+    /* without workers images are converted on the main thread */
+    icc->pool = workers_create (workers_default_count (), (worker_rank_fn)NULL);
+#else
+    (void)win;
+#endif
+}
+
+
+void
+icc_close (icc_state *icc)
+{
+    int i;
+
+    workers_destroy (icc->pool);
+    for (i = 0; i < ICC_CACHE; i++)
+        SDL_free (icc->cache[i].table);
+    SDL_free (icc->display);
+    memset (icc, 0, sizeof (icc_state));
+}
+
+
+/* luts for the display before stay cached, in case the window goes
+   back to it */
+bool
+icc_update_display (icc_state *icc)
+{
+    uint8_t *profile;
+    size_t len = 0;
+    uint64_t key;
+
+    if (!icc->active)
+        return false;
+
+    profile = SDL_GetWindowICCProfile (icc->win, &len);
+    if ((profile != NULL) && (len == 0))
+    {
+        SDL_free (profile);
+        profile = NULL;
+    }
+    key = (profile != NULL) ? icc_hash (profile, len) : 0;
+    if (key == icc->display_key)
+    {
+        SDL_free (profile);
+        return false;
+    }
+
+    SDL_free (icc->display);
+    icc->display = profile;
+    icc->display_len = len;
+    icc->display_key = key;
+    return true;
+}
+
+
+bool
+icc_apply (icc_state *icc, SDL_Surface *surface, const unsigned char *data, size_t len)
+{
+    icc_job job;
+    uint8_t *profile;
+    size_t profile_len = 0;
+    int helpers = 0;
+
+    if (!icc->active || (surface == NULL) || (surface->format->format != DECODE_PIXELFORMAT))
+        return false;
+
+    profile = icc_extract (data, len, &profile_len);
+    job.lut.table = icc_lookup (icc, profile, profile_len);
+    SDL_free (profile);
+    if (job.lut.table == NULL)
+        return false;
+    job.lut.n = ICC_LUT_POINTS;
+    job.surface = surface;
+    job.bands = (surface->h + ICC_BAND - 1) / ICC_BAND;
+    SDL_AtomicSet (&job.next, 0);
+
+    /* the workers take bands alongside this thread, which does them all
+       itself if none can be queued */
+    if (icc->pool != NULL)
+    {
+        for (; helpers < SDL_min (icc->pool->thread_count, job.bands - 1); helpers++)
+        {
+            if (workers_submit (icc->pool, icc_band_job, &job) != EXIT_SUCCESS)
+                break;
+        }
+    }
+    icc_band_job (&job);
+    if (helpers > 0)
+        workers_wait (icc->pool);
+
+    return true;
+}
+
+
+/* End of File */
@@ -0,0 +1,86 @@
+/*
+   source/ljpeg_icc.h
+   LJPEG colour management header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_ICC_HEADER__
+#define __LJPEG_ICC_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+/* the lut from one profile to another, by their keys (0 being srgb) */
+typedef struct icc_lut
+{
+    uint64_t      source;
+    uint64_t      display;
+    uint32_t     *table;        /* NULL when the two come out the same */
+    Uint64        used;         /* lru clock, 0 for an empty slot */
+} icc_lut;
+
+typedef struct icc_state
+{
+    bool          active;
+    SDL_Window   *win;
+
+    /* the window's profile, NULL where the display has none (srgb) */
+    uint8_t      *display;
+    size_t        display_len;
+    uint64_t      display_key;
+
+    icc_lut       cache[ICC_CACHE];
+    Uint64        clock;
+    worker_pool  *pool;         /* bands of rows of large images */
+} icc_state;
+
+
+/* constants */
+
+
+/* global variables */
+extern icc_state g_icc;
+
+
+/* external function prototypes */
+/* win's profile is read now and whenever icc_update_display is called */
+void icc_init  (icc_state *icc, SDL_Window *win);
+void icc_close (icc_state *icc);
+
+/* read the window's profile again, true when it changed */
+bool icc_update_display (icc_state *icc);
+
+/* surface, decoded from the len bytes of data, turned from the profile
+   the file carries (srgb without one) to the display's.  true when its
+   pixels changed.  main thread only */
+bool icc_apply (icc_state *icc, SDL_Surface *surface, const unsigned char *data, size_t len);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,650 @@
+/*
+   source/ljpeg_io.c
+   LJPEG batched file reading source code.
+
+   Whole files are read into memory for the decoders, many at a time.
+   On Linux the reads go through one io_uring (raw syscalls, no
+   liburing): a thread keeps up to IO_QUEUE_DEPTH of them in flight and
+   passes each buffer to the request's done callback as it completes.
+   Where io_uring is missing or refused (old kernels, seccomp) the same
+   requests are read with pread on a small worker pool instead.  Every
+   file gets posix_fadvise readahead hints before it is read.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* pread, posix_fadvise, syscall and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_io.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IO_HAVE_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_zip.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+io_engine g_io;
+
+
+/* file static variables */
+#ifdef IO_HAVE_URING
+/* the rings shared with the kernel */
+typedef struct io_ring
+{
+    int                    fd;
+    unsigned               entries;
+    unsigned               inflight;    /* reads handed to the kernel */
+    unsigned               unsubmitted; /* sqes the kernel has not seen */
+
+    void                  *sq_map;
+    size_t                 sq_map_len;
+    void                  *cq_map;
+    size_t                 cq_map_len;
+    struct io_uring_sqe   *sqes;
+    size_t                 sqes_len;
+
+    volatile unsigned     *sq_tail;
+    unsigned              *sq_mask;
+    unsigned              *sq_array;
+    volatile unsigned     *cq_head;
+    volatile unsigned     *cq_tail;
+    unsigned              *cq_mask;
+    struct io_uring_cqe   *cqes;
+} io_ring;
+#endif
+
+
+/* file static function prototypes */
+static int  io_prepare (io_request *req);
+static void io_read_blocking (io_request *req);
+static void io_finish (io_request *req);
+static void io_pread_job (void *arg);
+static void io_wake (io_request *req);
+static void io_enqueue (io_engine *io, io_request *req, bool urgent);
+
+#ifdef IO_HAVE_URING
+static io_ring *io_ring_create (unsigned entries);
+static void     io_ring_free (io_ring *ring);
+static void     io_ring_queue_read (io_ring *ring, io_request *req);
+static void     io_ring_enter (io_ring *ring, unsigned wait_for);
+static void     io_ring_reap (io_ring *ring);
+static int      io_ring_thread (void *data);
+#endif
+
+
+/* static function definitions */
+/* open the file, size its buffer and hint the kernel to start reading it
+   in.  on failure req->error says why */
+static int
+io_prepare (io_request *req)
+{
+#ifndef _WIN32
+    struct stat st;
+
+    if ((req->cancel != NULL) && (SDL_AtomicGet (req->cancel) != 0))
+    {
+        req->error = ECANCELED;
+        return EXIT_FAILURE;
+    }
+
+    req->fd = open (req->path, O_RDONLY | O_CLOEXEC);
+    if (req->fd < 0)
+    {
+        req->error = errno;
+        return EXIT_FAILURE;
+    }
+    if (fstat (req->fd, &st) != 0)
+    {
+        req->error = errno;
+        return EXIT_FAILURE;
+    }
+    if (!S_ISREG (st.st_mode) || (st.st_size == 0))
+    {
+        req->error = EINVAL;
+        return EXIT_FAILURE;
+    }
+
+    /* read the file front to back, all of it, starting now */
+    posix_fadvise (req->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise (req->fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    req->len = (size_t)st.st_size;
+    req->data = SDL_malloc (req->len);
+    if (req->data == NULL)
+    {
+        req->error = ENOMEM;
+        return EXIT_FAILURE;
+    }
+#endif
+
+    return EXIT_SUCCESS;
+}
+
+
+/* read whatever is left of a prepared request on this thread */
+static void
+io_read_blocking (io_request *req)
+{
+#ifndef _WIN32
+    ssize_t got;
+
+    while (req->got < req->len)
+    {
+        got = pread (req->fd, req->data + req->got, req->len - req->got, (off_t)req->got);
+        if ((got < 0) && (errno == EINTR))
+            continue;
+        if (got < 0)
+        {
+            req->error = errno;
+            return;
+        }
+        if (got == 0)
+        {
+            /* the file shrank since it was opened */
+            req->len = req->got;
+            return;
+        }
+        req->got += (size_t)got;
+    }
+#else
+    (void)req;
+#endif
+}
+
+
+/* close up and hand the request back */
+static void
+io_finish (io_request *req)
+{
+#ifndef _WIN32
+    if (req->fd >= 0)
+        close (req->fd);
+#endif
+    req->fd = -1;
+
+    if ((req->error != 0) || (req->len == 0))
+    {
+        if (req->error == 0)
+            req->error = EIO;
+        SDL_free (req->data);
+        req->data = NULL;
+        req->len = 0;
+    }
+
+    req->done (req);
+}
+
+
+/* fallback: one whole request on a pool thread */
+static void
+io_pread_job (void *arg)
+{
+    io_request *req = (io_request *)arg;
+
+#ifdef _WIN32
+    req->data = SDL_LoadFile (req->path, &req->len);
+#else
+    if (io_prepare (req) == EXIT_SUCCESS)
+        io_read_blocking (req);
+#endif
+
+    io_finish (req);
+}
+
+
+/* io_read_file's done callback */
+static void
+io_wake (io_request *req)
+{
+    SDL_SemPost ((SDL_sem *)req->arg);
+}
+
+
+/* give the ring thread another request, urgent ones skip the line */
+static void
+io_enqueue (io_engine *io, io_request *req, bool urgent)
+{
+    SDL_LockMutex (io->lock);
+    if (io->head == NULL)
+    {
+        io->head = io->tail = req;
+    }
+    else if (urgent)
+    {
+        req->next = io->head;
+        io->head = req;
+    }
+    else
+    {
+        io->tail->next = req;
+        io->tail = req;
+    }
+    SDL_CondSignal (io->queued);
+    SDL_UnlockMutex (io->lock);
+}
+
+
+#ifdef IO_HAVE_URING
+static io_ring *
+io_ring_create (unsigned entries)
+{
+    struct io_uring_params params;
+    io_ring *ring;
+    unsigned char *sq;
+    unsigned char *cq;
+
+    ring = calloc (1, sizeof (io_ring));
+    if (ring == NULL)
+        goto io_ring_create_failure_0;
+
+    memset (&params, 0, sizeof (params));
+    ring->fd = (int)syscall (__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        goto io_ring_create_failure_1;
+    ring->entries = params.sq_entries;
+
+    /* the submission and completion rings share one mapping on any
+       kernel new enough to have IORING_OP_READ anyway */
+    ring->sq_map_len = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring->cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0)
+        goto io_ring_create_failure_2;
+    if (ring->cq_map_len > ring->sq_map_len)
+        ring->sq_map_len = ring->cq_map_len;
+
+    ring->sq_map = mmap (NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+        goto io_ring_create_failure_2;
+    ring->cq_map = ring->sq_map;
+
+    ring->sqes_len = params.sq_entries * sizeof (struct io_uring_sqe);
+    ring->sqes = mmap (NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto io_ring_create_failure_3;
+
+    sq = ring->sq_map;
+    cq = ring->cq_map;
+    ring->sq_tail  = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head  = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail  = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask  = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+/* io_ring_create_success_0: */
+    return ring;
+
+io_ring_create_failure_3:
+    munmap (ring->sq_map, ring->sq_map_len);
+io_ring_create_failure_2:
+    close (ring->fd);
+io_ring_create_failure_1:
+    free (ring);
+io_ring_create_failure_0:
+    return (io_ring *)NULL;
+}
+
+
+static void
+io_ring_free (io_ring *ring)
+{
+    munmap (ring->sqes, ring->sqes_len);
+    munmap (ring->sq_map, ring->sq_map_len);
+    close (ring->fd);
+    free (ring);
+}
+
+
+/* queue a read of the rest of req, the caller makes sure there is room */
+static void
+io_ring_queue_read (io_ring *ring, io_request *req)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    size_t left = req->len - req->got;
+
+    memset (sqe, 0, sizeof (struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(req->data + req->got);
+    sqe->len = (left > 0x40000000u) ? 0x40000000u : (unsigned)left;
+    sqe->off = req->got;
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    ring->sq_array[index] = index;
+
+    /* the sqe has to be visible before the kernel sees the new tail */
+    SDL_MemoryBarrierRelease ();
+    *ring->sq_tail = tail + 1;
+
+    ring->unsubmitted++;
+    ring->inflight++;
+}
+
+
+/* submit what is queued and wait until wait_for reads have completed */
+static void
+io_ring_enter (io_ring *ring, unsigned wait_for)
+{
+    long submitted;
+
+    submitted = syscall (__NR_io_uring_enter, ring->fd, ring->unsubmitted, wait_for,
+                         (wait_for > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted > 0)
+        ring->unsubmitted -= (unsigned)submitted;
+}
+
+
+/* finish or continue every completed read */
+static void
+io_ring_reap (io_ring *ring)
+{
+    struct io_uring_cqe *cqe;
+    io_request *req;
+    unsigned head = *ring->cq_head;
+    unsigned tail;
+    int res;
+
+    tail = *ring->cq_tail;
+    SDL_MemoryBarrierAcquire ();
+
+    while (head != tail)
+    {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        req = (io_request *)(uintptr_t)cqe->user_data;
+        res = cqe->res;
+        head++;
+        ring->inflight--;
+
+        if ((res == -EINTR) || (res == -EAGAIN))
+        {
+            io_ring_queue_read (ring, req);
+            continue;
+        }
+        if (res == -EINVAL)
+        {
+            /* kernel without IORING_OP_READ (before 5.6) */
+            io_read_blocking (req);
+        }
+        else if (res < 0)
+        {
+            req->error = -res;
+        }
+        else if (res == 0)
+        {
+            /* the file shrank since it was opened */
+            req->len = req->got;
+        }
+        else
+        {
+            req->got += (size_t)res;
+            if (req->got < req->len)
+            {
+                io_ring_queue_read (ring, req);
+                continue;
+            }
+        }
+        io_finish (req);
+    }
+
+    SDL_MemoryBarrierRelease ();
+    *ring->cq_head = head;
+}
+
+
+/* move queued requests into the ring as room frees up */
+static int
+io_ring_thread (void *data)
+{
+    io_engine *io = (io_engine *)data;
+    io_ring *ring = io->ring;
+    io_request *batch;
+    io_request *req;
+    unsigned room;
+    bool quit;
+
+    while (true)
+    {
+        SDL_LockMutex (io->lock);
+        while (!io->quit && (io->head == NULL) && (ring->inflight == 0))
+        {
+            SDL_CondWait (io->queued, io->lock);
+        }
+        quit = io->quit;
+
+        /* take as much as fits, or everything when quitting */
+        batch = NULL;
+        room = ring->entries - ring->inflight;
+        while ((io->head != NULL) && (quit || (room > 0)))
+        {
+            req = io->head;
+            io->head = req->next;
+            req->next = batch;
+            batch = req;
+            room--;
+        }
+        if (io->head == NULL)
+            io->tail = NULL;
+        SDL_UnlockMutex (io->lock);
+
+        while (batch != NULL)
+        {
+            req = batch;
+            batch = req->next;
+            req->next = NULL;
+
+            if (quit)
+                req->error = ECANCELED;
+            if ((req->error != 0) || (io_prepare (req) != EXIT_SUCCESS))
+                io_finish (req);
+            else
+                io_ring_queue_read (ring, req);
+        }
+
+        if (ring->inflight == 0)
+        {
+            if (quit)
+                break;
+            continue;
+        }
+
+        io_ring_enter (ring, 1);
+        io_ring_reap (ring);
+    }
+
+    return 0;
+}
+#endif
+
+
+/* function definitions */
+/* start the engine, with io_uring when use_uring and the kernel allows
+   it, otherwise with a pread pool */
+int
+io_init (io_engine *io, bool use_uring)
+{
+    memset (io, 0, sizeof (io_engine));
+
+#ifdef IO_HAVE_URING
+    if (use_uring)
+        io->ring = io_ring_create (IO_QUEUE_DEPTH);
+    if (io->ring != NULL)
+    {
+        io->lock = SDL_CreateMutex ();
+        io->queued = SDL_CreateCond ();
+        if ((io->lock == NULL) || (io->queued == NULL))
+            goto io_init_failure_0;
+        io->thread = SDL_CreateThread (io_ring_thread, "ljpeg-io", io);
+        if (io->thread == NULL)
+            goto io_init_failure_0;
+
+        io->running = true;
+        return EXIT_SUCCESS;
+    }
+#else
+    (void)use_uring;
+#endif
+
+    io->pool = workers_create (IO_THREADS, NULL);
+    if (io->pool == NULL)
+        return EXIT_FAILURE;
+
+    io->running = true;
+    return EXIT_SUCCESS;
+
+#ifdef IO_HAVE_URING
+io_init_failure_0:
+    if (io->queued != NULL)
+        SDL_DestroyCond (io->queued);
+    if (io->lock != NULL)
+        SDL_DestroyMutex (io->lock);
+    io_ring_free (io->ring);
+    memset (io, 0, sizeof (io_engine));
+    return EXIT_FAILURE;
+#endif
+}
+
+
+/* stop the engine.  everyone with requests in flight has to be gone
+   already, reads still queued may never be called back */
+void
+io_shutdown (io_engine *io)
+{
+    if (!io->running)
+        return;
+
+#ifdef IO_HAVE_URING
+    if (io->ring != NULL)
+    {
+        SDL_LockMutex (io->lock);
+        io->quit = true;
+        SDL_CondSignal (io->queued);
+        SDL_UnlockMutex (io->lock);
+        SDL_WaitThread (io->thread, NULL);
+
+        SDL_DestroyCond (io->queued);
+        SDL_DestroyMutex (io->lock);
+        io_ring_free (io->ring);
+    }
+#endif
+    workers_destroy (io->pool);
+
+    memset (io, 0, sizeof (io_engine));
+}
+
+
+/* read req->path in the background, req->done gets the result */
+int
+io_submit (io_engine *io, io_request *req)
+{
+    /* archive entries are inflated, not read, the caller does that
+       (mapfile_open) where the cpu time belongs */
+    if (!io->running || zip_find (req->path, NULL, NULL))
+        return EXIT_FAILURE;
+
+    req->data = NULL;
+    req->len = 0;
+    req->error = 0;
+    req->fd = -1;
+    req->got = 0;
+    req->next = NULL;
+
+    if (io->ring == NULL)
+        return workers_submit (io->pool, io_pread_job, req);
+
+    io_enqueue (io, req, false);
+    return EXIT_SUCCESS;
+}
+
+
+/* read one file and wait for it, ahead of anything already queued.  on
+   failure the reason is left in SDL_GetError */
+int
+io_read_file (io_engine *io, const char *path, mapped_file *out)
+{
+    io_request req;
+    SDL_sem *sem;
+
+    /* no engine (or an archive entry), map it instead */
+    if (!io->running || zip_find (path, NULL, NULL))
+        return mapfile_open (out, path);
+
+    sem = SDL_CreateSemaphore (0);
+    if (sem == NULL)
+        return mapfile_open (out, path);
+
+    memset (&req, 0, sizeof (io_request));
+    req.path = path;
+    req.done = io_wake;
+    req.arg = sem;
+    if (io->ring != NULL)
+    {
+        req.fd = -1;
+        io_enqueue (io, &req, true);
+    }
+    else if (io_submit (io, &req) != EXIT_SUCCESS)
+    {
+        SDL_DestroySemaphore (sem);
+        return mapfile_open (out, path);
+    }
+    SDL_SemWait (sem);
+    SDL_DestroySemaphore (sem);
+
+    memset (out, 0, sizeof (mapped_file));
+    if (req.error != 0)
+    {
+        SDL_SetError ("%s: %s", path, strerror (req.error));
+        return EXIT_FAILURE;
+    }
+    out->data = req.data;
+    out->len = req.len;
+    out->mapped = false;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* End of File */
@@ -0,0 +1,96 @@
+/*
+   source/ljpeg_io.h
+   LJPEG batched file reading header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_IO_HEADER__
+#define __LJPEG_IO_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+struct io_request;
+
+/* called on an io thread once the read finished or failed, keep it
+   short (eg: hand the buffer on to a worker pool) */
+typedef void (*io_done_fn) (struct io_request *req);
+
+typedef struct io_request
+{
+    const char        *path;    /* kept alive by the caller until done */
+    io_done_fn         done;
+    void              *arg;
+    SDL_atomic_t      *cancel;  /* optional, once set reads not yet
+                                   started fail with ECANCELED */
+
+    /* the whole file, SDL_malloc'd, owned by whoever done hands it to */
+    unsigned char     *data;
+    size_t             len;
+    int                error;   /* 0, or an errno value */
+
+    /* engine side */
+    int                fd;
+    size_t             got;
+    struct io_request *next;
+} io_request;
+
+typedef struct io_engine
+{
+    bool          running;
+    struct io_ring *ring;       /* NULL when reading with pread on pool */
+    worker_pool  *pool;
+
+    /* requests waiting for room in the ring */
+    SDL_Thread   *thread;
+    SDL_mutex    *lock;
+    SDL_cond     *queued;
+    io_request   *head;
+    io_request   *tail;
+    bool          quit;
+} io_engine;
+
+
+/* constants */
+
+
+/* global variables */
+extern io_engine g_io;
+
+
+/* external function prototypes */
+int  io_init     (io_engine *io, bool use_uring);
+void io_shutdown (io_engine *io);
+
+int  io_submit    (io_engine *io, io_request *req);
+int  io_read_file (io_engine *io, const char *path, mapped_file *out);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,150 @@
+/*
+   source/ljpeg_mapfile.c
+   LJPEG memory mapped file input source code.
+
+   Files are mapped read only and the descriptor is closed straight
+   away, the decoders then read the mapped bytes in place.  Where mmap
+   is missing or refused (_WIN32, some fuse mounts) the file is read
+   into memory instead, so callers never need to care which it was.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* mmap and madvise are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_mapfile.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_zip.h"
+
+
+/* file static variables */
+
+
+/* file static function prototypes */
+
+
+/* static function definitions */
+
+
+/* function definitions */
+/* map path into memory, on failure the reason is left in SDL_GetError */
+int
+mapfile_open (mapped_file *map, const char *path)
+{
+#ifndef _WIN32
+    struct stat st;
+    void *data;
+    int fd;
+#endif
+    zip_archive *zip;
+    int index;
+    int result;
+
+    memset (map, 0, sizeof (mapped_file));
+
+    /* an entry of an open archive, inflated into memory */
+    if (zip_find (path, &zip, &index))
+    {
+        result = zip_read (zip, index, map);
+        zip_close (zip);
+        return result;
+    }
+
+#ifndef _WIN32
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+    {
+        SDL_SetError ("%s: %s", path, strerror (errno));
+        return EXIT_FAILURE;
+    }
+    if (fstat (fd, &st) != 0)
+    {
+        SDL_SetError ("%s: %s", path, strerror (errno));
+        close (fd);
+        return EXIT_FAILURE;
+    }
+    if (st.st_size == 0)
+    {
+        SDL_SetError ("%s: empty file", path);
+        close (fd);
+        return EXIT_FAILURE;
+    }
+
+    /* the mapping outlives the descriptor, so nothing is held open */
+    data = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (data != MAP_FAILED)
+    {
+        /* decoders walk the file front to back exactly once */
+        madvise (data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+        map->data = (unsigned char *)data;
+        map->len = (size_t)st.st_size;
+        map->mapped = true;
+        return EXIT_SUCCESS;
+    }
+#endif
+
+    map->data = SDL_LoadFile (path, &map->len);
+    if (map->data == NULL)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* give the pages back as soon as the decoder is finished with them */
+void
+mapfile_close (mapped_file *map)
+{
+    if (map->data == NULL)
+        return;
+
+#ifndef _WIN32
+    if (map->mapped)
+    {
+        madvise (map->data, map->len, MADV_DONTNEED);
+        munmap (map->data, map->len);
+    }
+    else
+#endif
+    {
+        SDL_free (map->data);
+    }
+
+    memset (map, 0, sizeof (mapped_file));
+}
+
+
+/* End of File */
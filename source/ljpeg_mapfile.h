@@ -0,0 +1,54 @@
+/*
+   source/ljpeg_mapfile.h
+   LJPEG memory mapped file input header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_MAPFILE_HEADER__
+#define __LJPEG_MAPFILE_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* custom datatypes */
+typedef struct mapped_file
+{
+    unsigned char *data;
+    size_t         len;
+    bool           mapped;  /* false when the bytes were read into memory */
+} mapped_file;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+int  mapfile_open  (mapped_file *map, const char *path);
+void mapfile_close (mapped_file *map);
+
+#endif /* end run once */
+
+
+/* End of File */
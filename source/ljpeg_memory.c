@@ -0,0 +1,342 @@
+/*
+   source/ljpeg_memory.c
+   LJPEG memory pressure monitor source code.
+
+   Watches for the system running short of memory on a background
+   thread, Linux only.  A PSI trigger on /proc/pressure/memory wakes it
+   when tasks stall on memory for MEMORY_PSI_STALL_MS in a window; where
+   the kernel will not take the trigger the averages in the same file
+   are read instead.  The cgroup's memory.events is read as well, a
+   rise in its high or max count means the group hit its limit even if
+   the rest of the system is fine.  Pressure is reported from the first
+   stall until MEMORY_CALM_MS pass without another.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* poll, open and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_memory.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* global variable declarations */
+memory_monitor g_memory = { .psi_fd = -1 };
+Uint32         g_memory_event = (Uint32)-1;
+
+
+/* file static variables */
+#define MEMORY_PSI_PATH "/proc/pressure/memory"
+#define MEMORY_TICK_MS  100
+
+
+/* file static function prototypes */
+#ifdef __linux__
+static bool     memory_psi_stalled (void);
+static char    *memory_events_path (void);
+static uint64_t memory_events_count (const char *path);
+static int      memory_thread (void *data);
+#endif
+
+
+/* static function definitions */
+#ifdef __linux__
+/* polling fallback, true when the last 10s averaged more stalling than
+   the trigger would have allowed */
+static bool
+memory_psi_stalled (void)
+{
+    const double limit = MEMORY_PSI_STALL_MS * 100.0 / MEMORY_PSI_WINDOW_MS;
+    FILE *fp;
+    double avg10 = 0.0;
+
+    fp = fopen (MEMORY_PSI_PATH, "r");
+    if (fp == NULL)
+        return false;
+    if (fscanf (fp, "some avg10=%lf", &avg10) != 1)
+        avg10 = 0.0;
+    fclose (fp);
+
+    return avg10 >= limit;
+}
+
+
+/* the unified hierarchy's memory.events for our cgroup, NULL on cgroup
+   v1 or when it is not readable */
+static char *
+memory_events_path (void)
+{
+    /* mounted on its own, or beside v1 controllers */
+    static const char *const mounts[] = { "/sys/fs/cgroup", "/sys/fs/cgroup/unified" };
+    char line[4096];
+    char *path = NULL;
+    FILE *fp;
+    size_t len;
+    size_t i;
+
+    fp = fopen ("/proc/self/cgroup", "r");
+    if (fp == NULL)
+        return (char *)NULL;
+    while (fgets (line, sizeof (line), fp) != NULL)
+    {
+        if (strncmp (line, "0::", 3) != 0)
+            continue;
+        line[strcspn (line, "\n")] = '\0';
+
+        len = strlen (mounts[1]) + strlen (line + 3) + strlen ("/memory.events") + 1;
+        path = malloc (len);
+        for (i = 0; (path != NULL) && (i < sizeof (mounts) / sizeof (mounts[0])); i++)
+        {
+            snprintf (path, len, "%s%s/memory.events", mounts[i], (strcmp (line + 3, "/") == 0) ? "" : line + 3);
+            if (access (path, R_OK) == 0)
+                break;
+        }
+        if ((path != NULL) && (i == sizeof (mounts) / sizeof (mounts[0])))
+        {
+            free (path);
+            path = NULL;
+        }
+        break;
+    }
+    fclose (fp);
+
+    return path;
+}
+
+
+/* times the group went over memory.high or hit memory.max */
+static uint64_t
+memory_events_count (const char *path)
+{
+    char name[64];
+    unsigned long long count;
+    uint64_t total = 0;
+    FILE *fp;
+
+    fp = fopen (path, "r");
+    if (fp == NULL)
+        return 0;
+    while (fscanf (fp, "%63s %llu", name, &count) == 2)
+    {
+        if ((strcmp (name, "high") == 0) || (strcmp (name, "max") == 0))
+            total += count;
+    }
+    fclose (fp);
+
+    return total;
+}
+
+
+static int
+memory_thread (void *data)
+{
+    memory_monitor *mem = (memory_monitor *)data;
+    struct pollfd pfd;
+    Uint32 last_check = SDL_GetTicks ();
+    Uint32 last_stall = 0;
+    Uint32 now;
+    uint64_t events;
+    bool pressure = false;
+    bool stalled;
+    bool quit = false;
+    SDL_Event evt;
+
+    while (!quit)
+    {
+        /* the trigger wakes us straight away, otherwise look every
+           MEMORY_POLL_MS, either way notice memory_close quickly */
+        stalled = false;
+        pfd.fd = mem->psi_fd;
+        pfd.events = POLLPRI;
+        pfd.revents = 0;
+        if (poll (&pfd, (mem->psi_fd >= 0) ? 1 : 0, MEMORY_TICK_MS) > 0)
+        {
+            if ((pfd.revents & POLLERR) != 0)
+            {
+                /* the trigger went away, fall back to reading */
+                close (mem->psi_fd);
+                mem->psi_fd = -1;
+            }
+            else if ((pfd.revents & POLLPRI) != 0)
+            {
+                stalled = true;
+            }
+        }
+
+        now = SDL_GetTicks ();
+        if (SDL_TICKS_PASSED (now, last_check + MEMORY_POLL_MS))
+        {
+            last_check = now;
+            if ((mem->psi_fd < 0) && memory_psi_stalled ())
+                stalled = true;
+            if (mem->events_path != NULL)
+            {
+                events = memory_events_count (mem->events_path);
+                if (events > mem->events_seen)
+                    stalled = true;
+                mem->events_seen = events;
+            }
+        }
+
+        if (stalled)
+            last_stall = now;
+        if (stalled != pressure)
+        {
+            if (stalled || SDL_TICKS_PASSED (now, last_stall + MEMORY_CALM_MS))
+            {
+                pressure = stalled;
+                SDL_AtomicSet (&mem->pressure, pressure ? 1 : 0);
+                if (SDL_AtomicSet (&mem->changed, 1) == 0)
+                {
+                    SDL_zero (evt);
+                    evt.type = g_memory_event;
+                    SDL_PushEvent (&evt);
+                }
+            }
+        }
+
+        SDL_LockMutex (mem->lock);
+        quit = mem->quit;
+        SDL_UnlockMutex (mem->lock);
+    }
+
+    return 0;
+}
+#endif
+
+
+/* function definitions */
+/* start watching, without anything to watch memory_pressure stays false */
+int
+memory_open (memory_monitor *mem)
+{
+#ifdef __linux__
+    char trigger[64];
+
+    memset (mem, 0, sizeof (memory_monitor));
+    mem->psi_fd = -1;
+    if (g_memory_event == (Uint32)-1)
+        g_memory_event = SDL_RegisterEvents (1);
+
+    /* unprivileged triggers need the window to be a multiple of 2s */
+    mem->psi_fd = open (MEMORY_PSI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (mem->psi_fd >= 0)
+    {
+        snprintf (trigger, sizeof (trigger), "some %d %d",
+                  MEMORY_PSI_STALL_MS * 1000, MEMORY_PSI_WINDOW_MS * 1000);
+        if (write (mem->psi_fd, trigger, strlen (trigger) + 1) < 0)
+        {
+            close (mem->psi_fd);
+            mem->psi_fd = -1;
+        }
+    }
+
+    mem->events_path = memory_events_path ();
+    if (mem->events_path != NULL)
+        mem->events_seen = memory_events_count (mem->events_path);
+
+    if ((mem->psi_fd < 0) && (mem->events_path == NULL) && (access (MEMORY_PSI_PATH, R_OK) != 0))
+        goto memory_open_failure_0;
+
+    mem->lock = SDL_CreateMutex ();
+    if (mem->lock == NULL)
+        goto memory_open_failure_0;
+    mem->monitor = SDL_CreateThread (memory_thread, "ljpeg-memory", mem);
+    if (mem->monitor == NULL)
+        goto memory_open_failure_1;
+    mem->active = true;
+
+/* memory_open_success_0: */
+    return EXIT_SUCCESS;
+
+memory_open_failure_1:
+    SDL_DestroyMutex (mem->lock);
+memory_open_failure_0:
+    if (mem->psi_fd >= 0)
+        close (mem->psi_fd);
+    free (mem->events_path);
+    memset (mem, 0, sizeof (memory_monitor));
+    mem->psi_fd = -1;
+    return EXIT_FAILURE;
+#else
+    memset (mem, 0, sizeof (memory_monitor));
+    mem->psi_fd = -1;
+    return EXIT_FAILURE;
+#endif
+}
+
+
+void
+memory_close (memory_monitor *mem)
+{
+    if (!mem->active)
+        return;
+
+#ifdef __linux__
+    SDL_LockMutex (mem->lock);
+    mem->quit = true;
+    SDL_UnlockMutex (mem->lock);
+    SDL_WaitThread (mem->monitor, NULL);
+
+    SDL_DestroyMutex (mem->lock);
+    if (mem->psi_fd >= 0)
+        close (mem->psi_fd);
+    free (mem->events_path);
+#endif
+    memset (mem, 0, sizeof (memory_monitor));
+    mem->psi_fd = -1;
+}
+
+
+/* true, once, when pressure has started or ended since last time */
+bool
+memory_update (memory_monitor *mem)
+{
+    if (!mem->active)
+        return false;
+
+    return SDL_AtomicSet (&mem->changed, 0) != 0;
+}
+
+
+bool
+memory_pressure (memory_monitor *mem)
+{
+    if (!mem->active)
+        return false;
+
+    return SDL_AtomicGet (&mem->pressure) != 0;
+}
+
+
+/* End of File */
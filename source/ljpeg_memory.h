@@ -0,0 +1,68 @@
+/*
+   source/ljpeg_memory.h
+   LJPEG memory pressure monitor header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_MEMORY_HEADER__
+#define __LJPEG_MEMORY_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+typedef struct memory_monitor
+{
+    bool          active;
+    int           psi_fd;       /* pressure trigger, -1 when polling */
+    char         *events_path;  /* the cgroup's memory.events, or NULL */
+    uint64_t      events_seen;  /* high + max events counted so far */
+
+    SDL_mutex    *lock;
+    SDL_Thread   *monitor;
+    bool          quit;
+    SDL_atomic_t  pressure;     /* 1 from the first stall until calm */
+    SDL_atomic_t  changed;
+} memory_monitor;
+
+
+/* constants */
+
+
+/* global variables */
+extern memory_monitor g_memory;
+extern Uint32         g_memory_event;
+
+
+/* external function prototypes */
+int  memory_open     (memory_monitor *mem);
+void memory_close    (memory_monitor *mem);
+bool memory_update   (memory_monitor *mem);
+bool memory_pressure (memory_monitor *mem);
+
+#endif /* end run once */
+
+
+/* End of File */
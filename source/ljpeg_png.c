@@ -0,0 +1,568 @@
+/*
+   source/ljpeg_png.c
+   LJPEG built-in png decoder source code.
+
+   Decodes non-interlaced pngs of any colour type and bit depth to a
+   DECODE_PIXELFORMAT surface, the layout the streaming textures take
+   as is.  Interlaced files (and damaged ones) return NULL so the caller
+   can hand them to SDL_image instead.
+
+   The IDAT chunks are gathered into one buffer and inflated in a
+   single call (libdeflate when built with USE_LIBDEFLATE, zlib's
+   uncompress otherwise) rather than a few kilobytes at a time.  The
+   rows are then unfiltered in place by the ljpeg_simd kernels and
+   expanded to rgba straight into the surface.  16 bit samples keep
+   their high byte there, as SDL_image does, for thumbnails and the
+   like; png_decode_wide hands all 16 bits to ljpeg_hdr for the image
+   that is shown.  Ancillary chunks (gamma, icc, text) are skipped and
+   chunk crcs are not checked, the zlib stream's own checksum still is.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_png.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <SDL2/SDL.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_simd.h"
+
+
+/* file static variables */
+typedef struct png_header
+{
+    int            width, height;
+    int            depth;           /* bits a sample */
+    int            color;           /* png colour type */
+    int            channels;
+    int            bpp;             /* bytes a pixel for the filters, at least 1 */
+    size_t         rowbytes;        /* without the filter byte */
+
+    uint8_t        palette[256][4];
+    bool           has_key;
+    uint16_t       key[3];          /* tRNS colour of grey and rgb images */
+
+    const uint8_t *idat;            /* the first IDAT chunk */
+    size_t         idat_len;        /* of all of them together */
+    int            idat_count;
+} png_header;
+
+static const unsigned char s_png_signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+/* the most deflate can inflate a byte to, 258 bytes every 2 bits */
+#define PNG_INFLATE_RATIO 1032
+
+
+/* file static function prototypes */
+static uint32_t png_get32 (const uint8_t *p);
+static int      png_parse (png_header *png, const uint8_t *data, size_t len);
+static int      png_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static unsigned int png_sample (const uint8_t *row, int i, int depth);
+static void     png_emit_row (const png_header *png, const uint8_t *row, uint8_t *rgba);
+static void     png_emit_wide (const png_header *png, const uint8_t *row, uint16_t *rgba);
+static png_header *png_open (const unsigned char *data, size_t len);
+static uint8_t *png_unpack (const png_header *png);
+
+
+/* static function definitions */
+static uint32_t
+png_get32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+/* read the header chunks and find the image data, up to IEND */
+static int
+png_parse (png_header *png, const uint8_t *data, size_t len)
+{
+    const uint8_t *p = data + sizeof (s_png_signature);
+    const uint8_t *end = data + len;
+    const uint8_t *chunk;
+    const uint8_t *idat_end = NULL;
+    size_t chunk_len;
+    uint32_t w, h;
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        png->palette[i][3] = 0xFF;
+    }
+
+    for (;;)
+    {
+        if ((size_t)(end - p) < 12)
+            return EXIT_FAILURE;
+        chunk_len = png_get32 (p);
+        if (chunk_len > (size_t)(end - p) - 12)
+            return EXIT_FAILURE;
+        chunk = p + 8;
+
+        if (memcmp (p + 4, "IHDR", 4) == 0)
+        {
+            if ((png->width != 0) || (chunk_len < 13))
+                return EXIT_FAILURE;
+            w = png_get32 (chunk);
+            h = png_get32 (chunk + 4);
+            png->depth = chunk[8];
+            png->color = chunk[9];
+
+            /* deflate, adaptive filtering, and no interlacing */
+            if ((w == 0) || (h == 0) || (w > INT_MAX / 8) || (h > INT_MAX) ||
+                (chunk[10] != 0) || (chunk[11] != 0) || (chunk[12] != 0))
+                return EXIT_FAILURE;
+            png->width = (int)w;
+            png->height = (int)h;
+
+            switch (png->color)
+            {
+            case 0: png->channels = 1; break;
+            case 2: png->channels = 3; break;
+            case 3: png->channels = 1; break;
+            case 4: png->channels = 2; break;
+            case 6: png->channels = 4; break;
+            default: return EXIT_FAILURE;
+            }
+            if (((png->depth != 1) && (png->depth != 2) && (png->depth != 4) &&
+                 (png->depth != 8) && (png->depth != 16)) ||
+                ((png->depth < 8) && (png->color != 0) && (png->color != 3)) ||
+                ((png->depth == 16) && (png->color == 3)))
+                return EXIT_FAILURE;
+
+            png->bpp = SDL_max (png->channels * png->depth / 8, 1);
+            png->rowbytes = ((size_t)png->width * (size_t)(png->channels * png->depth) + 7) / 8;
+        }
+        else if (png->width == 0)
+        {
+            /* IHDR comes first */
+            return EXIT_FAILURE;
+        }
+        else if (memcmp (p + 4, "PLTE", 4) == 0)
+        {
+            if ((chunk_len % 3 != 0) || (chunk_len > 256 * 3))
+                return EXIT_FAILURE;
+            for (i = 0; i < (int)chunk_len / 3; i++)
+            {
+                memcpy (png->palette[i], chunk + i * 3, 3);
+            }
+        }
+        else if (memcmp (p + 4, "tRNS", 4) == 0)
+        {
+            if (png->color == 3)
+            {
+                for (i = 0; (i < (int)chunk_len) && (i < 256); i++)
+                {
+                    png->palette[i][3] = chunk[i];
+                }
+            }
+            else if ((png->color == 0) && (chunk_len >= 2))
+            {
+                png->key[0] = (uint16_t)((chunk[0] << 8) | chunk[1]);
+                png->has_key = true;
+            }
+            else if ((png->color == 2) && (chunk_len >= 6))
+            {
+                for (i = 0; i < 3; i++)
+                {
+                    png->key[i] = (uint16_t)((chunk[i * 2] << 8) | chunk[i * 2 + 1]);
+                }
+                png->has_key = true;
+            }
+        }
+        else if (memcmp (p + 4, "IDAT", 4) == 0)
+        {
+            /* the IDATs have to follow each other */
+            if ((png->idat != NULL) && (p != idat_end))
+                return EXIT_FAILURE;
+            if (png->idat == NULL)
+                png->idat = p;
+            png->idat_len += chunk_len;
+            png->idat_count++;
+            idat_end = chunk + chunk_len + 4;
+        }
+        else if (memcmp (p + 4, "IEND", 4) == 0)
+        {
+            break;
+        }
+        else if ((p[4] & 0x20) == 0)
+        {
+            /* a critical chunk this decoder does not know */
+            return EXIT_FAILURE;
+        }
+
+        p = chunk + chunk_len + 4;
+    }
+    if (png->idat == NULL)
+        return EXIT_FAILURE;
+
+    /* the size in the header is only believed as far as the image data
+       could inflate to it, nothing has been allocated for it yet */
+    if (((uint64_t)png->width * (uint64_t)png->height > PNG_MAX_PIXELS) ||
+        ((uint64_t)(png->rowbytes + 1) * (uint64_t)png->height >
+         (uint64_t)png->idat_len * PNG_INFLATE_RATIO))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* the whole zlib stream in one call, it has to fill out exactly */
+static int
+png_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+#ifdef USE_LIBDEFLATE
+    struct libdeflate_decompressor *inflater;
+    enum libdeflate_result result;
+
+    inflater = libdeflate_alloc_decompressor ();
+    if (inflater == NULL)
+        return EXIT_FAILURE;
+    result = libdeflate_zlib_decompress (inflater, in, in_len, out, out_len, NULL);
+    libdeflate_free_decompressor (inflater);
+
+    return (result == LIBDEFLATE_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+    uLongf got = (uLongf)out_len;
+
+    if ((in_len > ULONG_MAX) || (out_len > ULONG_MAX))
+        return EXIT_FAILURE;
+    if (uncompress (out, &got, in, (uLong)in_len) != Z_OK)
+        return EXIT_FAILURE;
+
+    return (got == out_len) ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
+
+
+/* sample i of an unfiltered row, as stored */
+static unsigned int
+png_sample (const uint8_t *row, int i, int depth)
+{
+    int bit;
+
+    switch (depth)
+    {
+    case 8:
+        return row[i];
+    case 16:
+        return ((unsigned int)row[i * 2] << 8) | row[i * 2 + 1];
+    default:
+        /* packed from the high bits down */
+        bit = i * depth;
+        return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1u << depth) - 1);
+    }
+}
+
+
+/* one unfiltered row to w DECODE_PIXELFORMAT pixels.  8 bit rgba and
+   opaque rgb, most of what there is, take the quick way */
+static void
+png_emit_row (const png_header *png, const uint8_t *row, uint8_t *rgba)
+{
+    unsigned int v[4];
+    unsigned int scale;
+    int shift;
+    int x, c;
+
+    if ((png->depth == 8) && (png->color == 6))
+    {
+        memcpy (rgba, row, (size_t)png->width * 4);
+        return;
+    }
+    if ((png->depth == 8) && (png->color == 2) && !png->has_key)
+    {
+        g_simd.rgb_to_rgba (row, rgba, png->width);
+        return;
+    }
+
+    /* grey levels below 8 bits are stretched over 0 to 255 */
+    scale = (png->depth < 8) ? 255 / ((1u << png->depth) - 1) : 1;
+    shift = (png->depth == 16) ? 8 : 0;
+    for (x = 0; x < png->width; x++, rgba += 4)
+    {
+        for (c = 0; c < png->channels; c++)
+        {
+            v[c] = png_sample (row, x * png->channels + c, png->depth);
+        }
+
+        switch (png->color)
+        {
+        case 0:
+            rgba[0] = rgba[1] = rgba[2] = (uint8_t)((v[0] * scale) >> shift);
+            rgba[3] = (png->has_key && (v[0] == png->key[0])) ? 0 : 0xFF;
+            break;
+        case 2:
+            rgba[0] = (uint8_t)(v[0] >> shift);
+            rgba[1] = (uint8_t)(v[1] >> shift);
+            rgba[2] = (uint8_t)(v[2] >> shift);
+            rgba[3] = (png->has_key && (v[0] == png->key[0]) &&
+                       (v[1] == png->key[1]) && (v[2] == png->key[2])) ? 0 : 0xFF;
+            break;
+        case 3:
+            memcpy (rgba, png->palette[v[0]], 4);
+            break;
+        case 4:
+            rgba[0] = rgba[1] = rgba[2] = (uint8_t)(v[0] >> shift);
+            rgba[3] = (uint8_t)(v[1] >> shift);
+            break;
+        default:
+            rgba[0] = (uint8_t)(v[0] >> shift);
+            rgba[1] = (uint8_t)(v[1] >> shift);
+            rgba[2] = (uint8_t)(v[2] >> shift);
+            rgba[3] = (uint8_t)(v[3] >> shift);
+            break;
+        }
+    }
+}
+
+
+/* one unfiltered 16 bit row to w rgba pixels of 16 bit samples */
+static void
+png_emit_wide (const png_header *png, const uint8_t *row, uint16_t *rgba)
+{
+    unsigned int v[4];
+    int x, c;
+
+    for (x = 0; x < png->width; x++, rgba += 4)
+    {
+        for (c = 0; c < png->channels; c++)
+        {
+            v[c] = png_sample (row, x * png->channels + c, 16);
+        }
+
+        switch (png->color)
+        {
+        case 0:
+            rgba[0] = rgba[1] = rgba[2] = (uint16_t)v[0];
+            rgba[3] = (png->has_key && (v[0] == png->key[0])) ? 0 : 0xFFFF;
+            break;
+        case 2:
+            rgba[0] = (uint16_t)v[0];
+            rgba[1] = (uint16_t)v[1];
+            rgba[2] = (uint16_t)v[2];
+            rgba[3] = (png->has_key && (v[0] == png->key[0]) &&
+                       (v[1] == png->key[1]) && (v[2] == png->key[2])) ? 0 : 0xFFFF;
+            break;
+        case 4:
+            rgba[0] = rgba[1] = rgba[2] = (uint16_t)v[0];
+            rgba[3] = (uint16_t)v[1];
+            break;
+        default:
+            rgba[0] = (uint16_t)v[0];
+            rgba[1] = (uint16_t)v[1];
+            rgba[2] = (uint16_t)v[2];
+            rgba[3] = (uint16_t)v[3];
+            break;
+        }
+    }
+}
+
+
+/* the header of data, NULL when it is not a png this decoder handles */
+static png_header *
+png_open (const unsigned char *data, size_t len)
+{
+    png_header *png;
+
+    if ((len < sizeof (s_png_signature)) || (memcmp (data, s_png_signature, sizeof (s_png_signature)) != 0))
+        return (png_header *)NULL;
+
+    png = SDL_calloc (1, sizeof (png_header));
+    if (png == NULL)
+        return (png_header *)NULL;
+    if (png_parse (png, data, len) != EXIT_SUCCESS)
+    {
+        SDL_free (png);
+        return (png_header *)NULL;
+    }
+
+    return png;
+}
+
+
+/* every row inflated and unfiltered, each after its filter byte and
+   below a row of zeros for the first one to look up at.  NULL on
+   damaged data */
+static uint8_t *
+png_unpack (const png_header *png)
+{
+    uint8_t *gathered = NULL;
+    uint8_t *rows = NULL;
+    const uint8_t *stream;
+    const uint8_t *p;
+    uint8_t *row, *prev;
+    size_t stride;
+    size_t pos;
+    int y;
+
+    /* one IDAT is inflated where it lies, more are joined up first */
+    stream = png->idat + 8;
+    if (png->idat_count > 1)
+    {
+        gathered = SDL_malloc (png->idat_len);
+        if (gathered == NULL)
+            goto png_unpack_failure_0;
+        for (p = png->idat, pos = 0; pos < png->idat_len; p += 12 + png_get32 (p))
+        {
+            memcpy (gathered + pos, p + 8, png_get32 (p));
+            pos += png_get32 (p);
+        }
+        stream = gathered;
+    }
+
+    stride = png->rowbytes + 1;
+    if ((size_t)png->height + 1 > SIZE_MAX / stride)
+        goto png_unpack_failure_1;
+    rows = SDL_malloc (stride * ((size_t)png->height + 1));
+    if (rows == NULL)
+        goto png_unpack_failure_1;
+    memset (rows, 0, stride);
+    if (png_inflate (stream, png->idat_len, rows + stride, stride * (size_t)png->height) != EXIT_SUCCESS)
+        goto png_unpack_failure_2;
+    SDL_free (gathered);
+    gathered = NULL;
+
+    for (y = 0; y < png->height; y++)
+    {
+        prev = rows + stride * (size_t)y + 1;
+        row = prev + stride;
+        if (row[-1] > 4)
+            goto png_unpack_failure_2;
+        g_simd.unfilter_row (row, prev, (int)png->rowbytes, png->bpp, row[-1]);
+    }
+
+/* png_unpack_success_0: */
+    return rows;
+
+png_unpack_failure_2:
+    SDL_free (rows);
+png_unpack_failure_1:
+    SDL_free (gathered);
+png_unpack_failure_0:
+    return (uint8_t *)NULL;
+}
+
+
+/* function definitions */
+/* decode a png to a DECODE_PIXELFORMAT surface, NULL when it is not
+   one this decoder handles */
+SDL_Surface *
+png_decode (const unsigned char *data, size_t len)
+{
+    png_header *png;
+    SDL_Surface *surface;
+    uint8_t *rows;
+    size_t stride;
+    int y;
+
+    png = png_open (data, len);
+    if (png == NULL)
+        return (SDL_Surface *)NULL;
+    surface = SDL_CreateRGBSurfaceWithFormat (0, png->width, png->height, 32, DECODE_PIXELFORMAT);
+    if (surface == NULL)
+        goto png_decode_failure_0;
+    rows = png_unpack (png);
+    if (rows == NULL)
+        goto png_decode_failure_1;
+
+    stride = png->rowbytes + 1;
+    for (y = 0; y < png->height; y++)
+    {
+        png_emit_row (png, rows + stride * ((size_t)y + 1) + 1,
+                      (uint8_t *)surface->pixels + (size_t)y * (size_t)surface->pitch);
+    }
+
+/* png_decode_success_0: */
+    SDL_free (rows);
+    SDL_free (png);
+    return surface;
+
+png_decode_failure_1:
+    SDL_FreeSurface (surface);
+png_decode_failure_0:
+    SDL_free (png);
+    return (SDL_Surface *)NULL;
+}
+
+
+bool
+png_is_wide (const unsigned char *data, size_t len, int *w, int *h)
+{
+    png_header *png;
+    bool wide;
+
+    png = png_open (data, len);
+    if (png == NULL)
+        return false;
+    wide = (png->depth == 16);
+    *w = png->width;
+    *h = png->height;
+    SDL_free (png);
+
+    return wide;
+}
+
+
+int
+png_decode_wide (const unsigned char *data, size_t len, uint16_t *rgba)
+{
+    png_header *png;
+    uint8_t *rows;
+    size_t stride;
+    int y;
+
+    png = png_open (data, len);
+    if ((png == NULL) || (png->depth != 16))
+        goto png_decode_wide_failure_0;
+    rows = png_unpack (png);
+    if (rows == NULL)
+        goto png_decode_wide_failure_0;
+
+    stride = png->rowbytes + 1;
+    for (y = 0; y < png->height; y++)
+    {
+        png_emit_wide (png, rows + stride * ((size_t)y + 1) + 1,
+                       rgba + (size_t)y * (size_t)png->width * 4);
+    }
+
+/* png_decode_wide_success_0: */
+    SDL_free (rows);
+    SDL_free (png);
+    return EXIT_SUCCESS;
+
+png_decode_wide_failure_0:
+    SDL_free (png);
+    SDL_SetError ("png: damaged or not 16 bits a sample");
+    return EXIT_FAILURE;
+}
+
+
+/* End of File */
@@ -0,0 +1,58 @@
+/*
+   source/ljpeg_png.h
+   LJPEG built-in png decoder header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_PNG_HEADER__
+#define __LJPEG_PNG_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+/* safe to call from workers, once simd_init has run */
+SDL_Surface *png_decode (const unsigned char *data, size_t len);
+
+/* true for a 16 bit png the decoder handles, w x h being its size */
+bool png_is_wide (const unsigned char *data, size_t len, int *w, int *h);
+
+/* its w x h rgba pixels of 16 bit samples (straight alpha) into rgba */
+int  png_decode_wide (const unsigned char *data, size_t len, uint16_t *rgba);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,1029 @@
+/*
+   source/ljpeg_probe.c
+   LJPEG image header probing source code.
+
+   Reads just enough of a file to know what it is without decoding it:
+   the SOF and APP1 (exif) markers of a JPEG, the IHDR chunk of a PNG,
+   the logical screen of a GIF and the VP8X/VP8/VP8L (and EXIF) chunks
+   of a WebP.  Files are read a few KiB at a time with pread, skipping
+   over everything else, so probing costs one or two small reads a file
+   rather than a decode (archive entries are inflated only as far as
+   their headers).  Whole directories are probed on a worker pool
+   and the results kept in $XDG_CACHE_HOME/ljpeg/probe, keyed like the
+   thumbnail cache, so sorting a directory a second time reads nothing.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* pread is hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_probe.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_workers.h"
+#include "ljpeg_zip.h"
+
+
+/* global variable declarations */
+probe_cache g_probe;
+
+
+/* file static variables */
+/* the bytes being probed, either all in memory or read from fd (or rw,
+   for archive entries) on demand into buf */
+typedef struct probe_src
+{
+    const unsigned char *data;
+    size_t               len;
+    int                  fd;
+    SDL_RWops           *rw;
+    unsigned char       *buf;
+    size_t               buf_off;
+    size_t               buf_len;
+} probe_src;
+
+/* big enough for the largest JPEG segment, most reads are PROBE_READ */
+#define PROBE_BUFFER 65536
+#define PROBE_READ   4096
+
+/* files handed to a worker at a time */
+#define PROBE_BATCH 32
+
+typedef struct probe_batch
+{
+    probe_cache      *cache;
+    const filelist   *files;
+    image_info       *infos;
+    int               first;
+    int               count;
+} probe_batch;
+
+typedef struct probe_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t clock;
+} probe_header;
+
+typedef struct probe_rank
+{
+    int64_t key;
+    int     index;
+} probe_rank;
+
+static const char s_probe_magic[8] = { 'L', 'J', 'P', 'G', 'P', 'R', 'O', 'B' };
+#define PROBE_VERSION 1
+
+
+/* file static function prototypes */
+static const unsigned char *probe_bytes (probe_src *src, size_t off, size_t n);
+
+static uint32_t probe_get16 (const unsigned char *p, bool le);
+static uint32_t probe_get32 (const unsigned char *p, bool le);
+static int64_t  probe_days  (int64_t y, int m, int d);
+static int64_t  probe_date  (const unsigned char *p);
+static void     probe_ifd   (const unsigned char *tiff, size_t len, bool le, uint32_t off,
+                             image_info *info, uint32_t *exif_ifd);
+static void     probe_exif  (const unsigned char *tiff, size_t len, image_info *info);
+
+static int probe_jpeg (probe_src *src, image_info *info);
+static int probe_png  (probe_src *src, image_info *info);
+static int probe_gif  (probe_src *src, image_info *info);
+static int probe_webp (probe_src *src, image_info *info);
+static int probe_src_run (probe_src *src, image_info *info);
+
+static int  table_find   (probe_cache *cache, uint64_t hash);
+static void table_insert (probe_cache *cache, int entry);
+static void table_rebuild (probe_cache *cache);
+static void probe_cache_forget (probe_cache *cache);
+static void probe_cache_load (probe_cache *cache);
+static void probe_cache_save (probe_cache *cache);
+static bool probe_cache_lookup (probe_cache *cache, const cache_key *key, image_info *info);
+static void probe_cache_store  (probe_cache *cache, const cache_key *key, const image_info *info);
+
+static void probe_batch_job (void *arg);
+static int  compare_ranks (const void *a, const void *b);
+static int  compare_used  (const void *a, const void *b);
+
+
+/* static function definitions */
+/* n bytes at off, or NULL past the end of the file */
+static const unsigned char *
+probe_bytes (probe_src *src, size_t off, size_t n)
+{
+#ifndef _WIN32
+    size_t want;
+    ssize_t got;
+#endif
+
+    if ((off > src->len) || (n > src->len - off))
+        return (const unsigned char *)NULL;
+    if (src->data != NULL)
+        return src->data + off;
+
+#ifndef _WIN32
+    if ((off >= src->buf_off) && (off + n <= src->buf_off + src->buf_len))
+        return src->buf + (off - src->buf_off);
+    if (n > PROBE_BUFFER)
+        return (const unsigned char *)NULL;
+
+    /* read a little past what was asked for, the next marker is
+       usually right behind it */
+    want = SDL_min (SDL_max (n, (size_t)PROBE_READ), src->len - off);
+    src->buf_off = off;
+    src->buf_len = 0;
+    if ((src->rw != NULL) && (SDL_RWseek (src->rw, (Sint64)off, RW_SEEK_SET) == (Sint64)off))
+        src->buf_len = SDL_RWread (src->rw, src->buf, 1, want);
+    while ((src->rw == NULL) && (src->buf_len < want))
+    {
+        got = pread (src->fd, src->buf + src->buf_len, want - src->buf_len, (off_t)(off + src->buf_len));
+        if ((got < 0) && (errno == EINTR))
+            continue;
+        if (got <= 0)
+            break;
+        src->buf_len += (size_t)got;
+    }
+    if (src->buf_len < n)
+        return (const unsigned char *)NULL;
+
+    return src->buf;
+#else
+    return (const unsigned char *)NULL;
+#endif
+}
+
+
+static uint32_t
+probe_get16 (const unsigned char *p, bool le)
+{
+    return le ? ((uint32_t)p[0] | ((uint32_t)p[1] << 8))
+              : (((uint32_t)p[0] << 8) | (uint32_t)p[1]);
+}
+
+
+static uint32_t
+probe_get32 (const unsigned char *p, bool le)
+{
+    return le ? (probe_get16 (p, true) | (probe_get16 (p + 2, true) << 16))
+              : ((probe_get16 (p, false) << 16) | probe_get16 (p + 2, false));
+}
+
+
+/* days from 1970-01-01 to y-m-d in the proleptic gregorian calendar */
+static int64_t
+probe_days (int64_t y, int m, int d)
+{
+    int64_t era, yoe, doy, doe;
+
+    y -= (m <= 2);
+    era = ((y >= 0) ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + ((m > 2) ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+
+/* exif "YYYY:MM:DD HH:MM:SS" as seconds since 1970, 0 when malformed
+   (cameras with no clock set write spaces or zeros) */
+static int64_t
+probe_date (const unsigned char *p)
+{
+    static const char pattern[] = "dddd:dd:dd dd:dd:dd";
+    int v[6] = { 0, 0, 0, 0, 0, 0 };
+    int field = 0;
+    int i;
+
+    for (i = 0; pattern[i] != '\0'; i++)
+    {
+        if (pattern[i] != 'd')
+        {
+            field++;
+            continue;
+        }
+        if ((p[i] < '0') || (p[i] > '9'))
+            return 0;
+        v[field] = v[field] * 10 + (p[i] - '0');
+    }
+    if ((v[0] == 0) || (v[1] < 1) || (v[1] > 12) || (v[2] < 1) || (v[2] > 31))
+        return 0;
+
+    return probe_days (v[0], v[1], v[2]) * 86400 + v[3] * 3600 + v[4] * 60 + v[5];
+}
+
+
+/* pick orientation and dates out of one ifd, and where the exif ifd is */
+static void
+probe_ifd (const unsigned char *tiff, size_t len, bool le, uint32_t off,
+           image_info *info, uint32_t *exif_ifd)
+{
+    const unsigned char *e;
+    uint32_t count, tag, type, n, value;
+    uint32_t i;
+
+    if ((len < 2) || (off > len - 2))
+        return;
+    count = probe_get16 (tiff + off, le);
+    if (count > (len - off - 2) / 12)
+        count = (uint32_t)((len - off - 2) / 12);
+
+    for (i = 0; i < count; i++)
+    {
+        e = tiff + off + 2 + i * 12;
+        tag = probe_get16 (e, le);
+        type = probe_get16 (e + 2, le);
+        n = probe_get32 (e + 4, le);
+
+        if ((tag == 0x0112) && (type == 3))
+        {
+            /* Orientation */
+            value = probe_get16 (e + 8, le);
+            if ((value >= 1) && (value <= 8))
+                info->orientation = value;
+        }
+        else if ((tag == 0x8769) && (exif_ifd != NULL))
+        {
+            /* ExifIFDPointer */
+            *exif_ifd = probe_get32 (e + 8, le);
+        }
+        else if (((tag == 0x9003) || ((tag == 0x0132) && (info->taken == 0))) &&
+                 (type == 2) && (n >= 19))
+        {
+            /* DateTimeOriginal, or DateTime when there is nothing better */
+            value = probe_get32 (e + 8, le);
+            if ((value < len) && (len - value >= 19))
+                info->taken = probe_date (tiff + value);
+        }
+    }
+}
+
+
+/* tiff points at the "II*\0" or "MM\0*" header */
+static void
+probe_exif (const unsigned char *tiff, size_t len, image_info *info)
+{
+    uint32_t exif_ifd = 0;
+    bool le;
+
+    if (len < 8)
+        return;
+    if ((tiff[0] == 'I') && (tiff[1] == 'I'))
+        le = true;
+    else if ((tiff[0] == 'M') && (tiff[1] == 'M'))
+        le = false;
+    else
+        return;
+    if (probe_get16 (tiff + 2, le) != 42)
+        return;
+
+    probe_ifd (tiff, len, le, probe_get32 (tiff + 4, le), info, &exif_ifd);
+    if (exif_ifd != 0)
+        probe_ifd (tiff, len, le, exif_ifd, info, (uint32_t *)NULL);
+}
+
+
+/* walk the markers up to the first SOF, stopping at the scan data */
+static int
+probe_jpeg (probe_src *src, image_info *info)
+{
+    const unsigned char *p;
+    size_t pos = 2;
+    size_t seglen;
+    int marker;
+
+    for (;;)
+    {
+        p = probe_bytes (src, pos, 4);
+        if ((p == NULL) || (p[0] != 0xFF))
+            return EXIT_FAILURE;
+        marker = p[1];
+
+        /* fill bytes and markers without a length */
+        if (marker == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        if ((marker == 0xD8) || (marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7)))
+        {
+            pos += 2;
+            continue;
+        }
+        /* SOS or EOI before any SOF */
+        if ((marker == 0xDA) || (marker == 0xD9))
+            return EXIT_FAILURE;
+
+        seglen = ((size_t)p[2] << 8) | p[3];
+        if (seglen < 2)
+            return EXIT_FAILURE;
+
+        if ((marker >= 0xC0) && (marker <= 0xCF) &&
+            (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+        {
+            /* SOFn: precision, height, width */
+            p = probe_bytes (src, pos + 4, 5);
+            if (p == NULL)
+                return EXIT_FAILURE;
+            info->h = ((uint32_t)p[1] << 8) | p[2];
+            info->w = ((uint32_t)p[3] << 8) | p[4];
+            return ((info->w > 0) && (info->h > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if ((marker == 0xE1) && (seglen >= 2 + 6 + 8))
+        {
+            /* APP1, only exif is of interest */
+            p = probe_bytes (src, pos + 4, seglen - 2);
+            if ((p != NULL) && (memcmp (p, "Exif\0\0", 6) == 0))
+                probe_exif (p + 6, seglen - 2 - 6, info);
+        }
+
+        pos += 2 + seglen;
+    }
+}
+
+
+/* IHDR always comes first */
+static int
+probe_png (probe_src *src, image_info *info)
+{
+    const unsigned char *p;
+
+    p = probe_bytes (src, 8, 16);
+    if ((p == NULL) || (memcmp (p + 4, "IHDR", 4) != 0))
+        return EXIT_FAILURE;
+    info->w = probe_get32 (p + 8, false);
+    info->h = probe_get32 (p + 12, false);
+
+    return ((info->w > 0) && (info->h > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int
+probe_gif (probe_src *src, image_info *info)
+{
+    const unsigned char *p;
+
+    p = probe_bytes (src, 6, 4);
+    if (p == NULL)
+        return EXIT_FAILURE;
+    info->w = probe_get16 (p, true);
+    info->h = probe_get16 (p + 2, true);
+
+    return ((info->w > 0) && (info->h > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* the size is in the first chunk, VP8X files with exif keep walking
+   the chunks until they reach it */
+static int
+probe_webp (probe_src *src, image_info *info)
+{
+    const unsigned char *p;
+    uint32_t size;
+    uint32_t bits;
+    size_t pos = 12;
+    bool want_exif = false;
+
+    for (;;)
+    {
+        p = probe_bytes (src, pos, 8);
+        if (p == NULL)
+            break;
+        size = probe_get32 (p + 4, true);
+
+        if ((memcmp (p, "VP8X", 4) == 0) && (info->w == 0))
+        {
+            p = probe_bytes (src, pos + 8, 10);
+            if (p == NULL)
+                break;
+            want_exif = (p[0] & 0x08) != 0;
+            info->w = 1 + (probe_get32 (p + 4, true) & 0xFFFFFF);
+            info->h = 1 + (probe_get32 (p + 6, true) >> 8);
+        }
+        else if ((memcmp (p, "VP8 ", 4) == 0) && (info->w == 0))
+        {
+            /* key frame tag, start code, 14 bit width and height */
+            p = probe_bytes (src, pos + 8, 10);
+            if ((p == NULL) || (p[3] != 0x9D) || (p[4] != 0x01) || (p[5] != 0x2A))
+                break;
+            info->w = probe_get16 (p + 6, true) & 0x3FFF;
+            info->h = probe_get16 (p + 8, true) & 0x3FFF;
+        }
+        else if ((memcmp (p, "VP8L", 4) == 0) && (info->w == 0))
+        {
+            /* signature, then 14 bits each of width - 1 and height - 1 */
+            p = probe_bytes (src, pos + 8, 5);
+            if ((p == NULL) || (p[0] != 0x2F))
+                break;
+            bits = probe_get32 (p + 1, true);
+            info->w = 1 + (bits & 0x3FFF);
+            info->h = 1 + ((bits >> 14) & 0x3FFF);
+        }
+        else if ((memcmp (p, "EXIF", 4) == 0) && want_exif)
+        {
+            /* some writers keep the jpeg style prefix */
+            p = probe_bytes (src, pos + 8, size);
+            if ((p != NULL) && (size >= 6) && (memcmp (p, "Exif\0\0", 6) == 0))
+                probe_exif (p + 6, size - 6, info);
+            else if (p != NULL)
+                probe_exif (p, size, info);
+            want_exif = false;
+        }
+
+        if ((info->w > 0) && !want_exif)
+            break;
+        pos += 8 + (size_t)size + (size & 1);
+    }
+
+    return ((info->w > 0) && (info->h > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int
+probe_src_run (probe_src *src, image_info *info)
+{
+    const unsigned char *p;
+
+    info->orientation = 1;
+
+    p = probe_bytes (src, 0, 12);
+    if (p == NULL)
+        return EXIT_FAILURE;
+
+    if ((p[0] == 0xFF) && (p[1] == 0xD8))
+    {
+        info->format = PROBE_JPEG;
+        return probe_jpeg (src, info);
+    }
+    if (memcmp (p, "\x89PNG\r\n\x1A\n", 8) == 0)
+    {
+        info->format = PROBE_PNG;
+        return probe_png (src, info);
+    }
+    if ((memcmp (p, "GIF87a", 6) == 0) || (memcmp (p, "GIF89a", 6) == 0))
+    {
+        info->format = PROBE_GIF;
+        return probe_gif (src, info);
+    }
+    if ((memcmp (p, "RIFF", 4) == 0) && (memcmp (p + 8, "WEBP", 4) == 0))
+    {
+        info->format = PROBE_WEBP;
+        return probe_webp (src, info);
+    }
+
+    return EXIT_FAILURE;
+}
+
+
+static int
+table_find (probe_cache *cache, uint64_t hash)
+{
+    int mask = cache->table_size - 1;
+    int i = (int)(hash & (uint64_t)mask);
+
+    while (cache->table[i] >= 0)
+    {
+        if (cache->entries[cache->table[i]].key.hash == hash)
+            return cache->table[i];
+        i = (i + 1) & mask;
+    }
+
+    return -1;
+}
+
+
+static void
+table_insert (probe_cache *cache, int entry)
+{
+    int mask = cache->table_size - 1;
+    int i = (int)(cache->entries[entry].key.hash & (uint64_t)mask);
+
+    while (cache->table[i] >= 0)
+    {
+        i = (i + 1) & mask;
+    }
+    cache->table[i] = entry;
+}
+
+
+static void
+table_rebuild (probe_cache *cache)
+{
+    int i;
+
+    for (i = 0; i < cache->table_size; i++)
+    {
+        cache->table[i] = -1;
+    }
+    for (i = 0; i < cache->count; i++)
+    {
+        table_insert (cache, i);
+    }
+}
+
+
+/* full, drop the older half in one go rather than one at a time */
+static void
+probe_cache_forget (probe_cache *cache)
+{
+    uint64_t *used;
+    uint64_t cutoff;
+    int kept = 0;
+    int i;
+
+    used = malloc ((size_t)cache->count * sizeof (uint64_t));
+    if (used == NULL)
+    {
+        cache->count = 0;
+        table_rebuild (cache);
+        return;
+    }
+    for (i = 0; i < cache->count; i++)
+    {
+        used[i] = cache->entries[i].used;
+    }
+    qsort (used, (size_t)cache->count, sizeof (uint64_t), compare_used);
+    cutoff = used[cache->count / 2];
+    free (used);
+
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].used >= cutoff)
+            cache->entries[kept++] = cache->entries[i];
+    }
+    cache->count = kept;
+    table_rebuild (cache);
+}
+
+
+static void
+probe_cache_load (probe_cache *cache)
+{
+    probe_header header;
+    FILE *fp;
+
+    fp = fopen (cache->path, "rb");
+    if (fp == NULL)
+        return;
+
+    if ((fread (&header, sizeof (probe_header), 1, fp) == 1) &&
+        (memcmp (header.magic, s_probe_magic, sizeof (s_probe_magic)) == 0) &&
+        (header.version == PROBE_VERSION) &&
+        (header.count <= (uint32_t)cache->capacity) &&
+        (fread (cache->entries, sizeof (probe_entry), header.count, fp) == header.count))
+    {
+        cache->count = (int)header.count;
+        cache->clock = header.clock;
+    }
+
+    fclose (fp);
+}
+
+
+/* write the cache next to the old one and swap it in */
+static void
+probe_cache_save (probe_cache *cache)
+{
+    probe_header header;
+    char *tmp_path;
+    size_t len;
+    FILE *fp;
+    bool ok;
+
+    len = strlen (cache->path) + sizeof (".tmp");
+    tmp_path = malloc (len);
+    if (tmp_path == NULL)
+        return;
+    snprintf (tmp_path, len, "%s.tmp", cache->path);
+
+    memset (&header, 0, sizeof (probe_header));
+    memcpy (header.magic, s_probe_magic, sizeof (s_probe_magic));
+    header.version = PROBE_VERSION;
+    header.count = (uint32_t)cache->count;
+    header.clock = cache->clock;
+
+    fp = fopen (tmp_path, "wb");
+    if (fp == NULL)
+    {
+        free (tmp_path);
+        return;
+    }
+    ok = (fwrite (&header, sizeof (probe_header), 1, fp) == 1) &&
+         (fwrite (cache->entries, sizeof (probe_entry), (size_t)cache->count, fp) == (size_t)cache->count);
+    ok = (fclose (fp) == 0) && ok;
+
+    if (!ok || (rename (tmp_path, cache->path) != 0))
+        remove (tmp_path);
+    free (tmp_path);
+}
+
+
+static bool
+probe_cache_lookup (probe_cache *cache, const cache_key *key, image_info *info)
+{
+    probe_entry *entry;
+    bool hit = false;
+    int i;
+
+    if (!cache->enabled)
+        return false;
+
+    SDL_LockMutex (cache->lock);
+    i = table_find (cache, key->hash);
+    if (i >= 0)
+    {
+        entry = &cache->entries[i];
+        if ((entry->key.size == key->size) && (entry->key.mtime == key->mtime))
+        {
+            *info = entry->info;
+            entry->used = ++cache->clock;
+            cache->dirty = true;
+            hit = true;
+        }
+    }
+    SDL_UnlockMutex (cache->lock);
+
+    return hit;
+}
+
+
+static void
+probe_cache_store (probe_cache *cache, const cache_key *key, const image_info *info)
+{
+    int i;
+
+    if (!cache->enabled)
+        return;
+
+    SDL_LockMutex (cache->lock);
+    i = table_find (cache, key->hash);
+    if (i < 0)
+    {
+        if (cache->count == cache->capacity)
+            probe_cache_forget (cache);
+        i = cache->count++;
+        cache->entries[i].key = *key;
+        table_insert (cache, i);
+    }
+    cache->entries[i].key = *key;
+    cache->entries[i].info = *info;
+    cache->entries[i].used = ++cache->clock;
+    cache->dirty = true;
+    SDL_UnlockMutex (cache->lock);
+}
+
+
+static void
+probe_batch_job (void *arg)
+{
+    probe_batch *batch = (probe_batch *)arg;
+    image_info *info;
+    cache_key key;
+    bool keyed;
+    int i;
+
+    for (i = batch->first; i < batch->first + batch->count; i++)
+    {
+        info = &batch->infos[i];
+        keyed = cache_key_for (batch->files->paths[i], &key);
+        if (keyed && probe_cache_lookup (batch->cache, &key, info))
+            continue;
+
+        /* failures are worth remembering too, the file is not an image
+           we can read without decoding */
+        probe_file (batch->files->paths[i], info);
+        if (keyed)
+            probe_cache_store (batch->cache, &key, info);
+    }
+}
+
+
+static int
+compare_ranks (const void *a, const void *b)
+{
+    const probe_rank *ra = (const probe_rank *)a;
+    const probe_rank *rb = (const probe_rank *)b;
+
+    if (ra->key != rb->key)
+        return (ra->key < rb->key) ? -1 : 1;
+    return ra->index - rb->index;
+}
+
+
+static int
+compare_used (const void *a, const void *b)
+{
+    uint64_t ua = *(const uint64_t *)a;
+    uint64_t ub = *(const uint64_t *)b;
+
+    return (ua < ub) ? -1 : (ua > ub);
+}
+
+
+/* function definitions */
+/* probe an image already in memory */
+int
+probe_mem (const unsigned char *data, size_t len, image_info *info)
+{
+    probe_src src;
+
+    memset (info, 0, sizeof (image_info));
+    memset (&src, 0, sizeof (probe_src));
+    src.data = data;
+    src.len = len;
+    src.fd = -1;
+
+    return probe_src_run (&src, info);
+}
+
+
+/* probe a file, reading only its headers */
+int
+probe_file (const char *path, image_info *info)
+{
+    struct stat st;
+    int result;
+#ifndef _WIN32
+    zip_archive *zip;
+    probe_src src;
+    int index;
+
+    memset (info, 0, sizeof (image_info));
+    memset (&src, 0, sizeof (probe_src));
+
+    /* archive entries are inflated up to the headers and no further */
+    if (zip_find (path, &zip, &index))
+    {
+        src.fd = -1;
+        src.len = (size_t)zip->entries[index].size;
+        src.rw = zip_rw (zip, index);
+        src.buf = malloc (PROBE_BUFFER);
+        result = EXIT_FAILURE;
+        if ((src.rw != NULL) && (src.buf != NULL))
+            result = probe_src_run (&src, info);
+        info->mtime = zip->mtime;
+
+        free (src.buf);
+        if (src.rw != NULL)
+            SDL_RWclose (src.rw);
+        zip_close (zip);
+        return result;
+    }
+
+    src.fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (src.fd < 0)
+        return EXIT_FAILURE;
+    if ((fstat (src.fd, &st) != 0) || !S_ISREG (st.st_mode))
+    {
+        close (src.fd);
+        return EXIT_FAILURE;
+    }
+    src.len = (size_t)st.st_size;
+    src.buf = malloc (PROBE_BUFFER);
+    if (src.buf == NULL)
+    {
+        close (src.fd);
+        return EXIT_FAILURE;
+    }
+
+    result = probe_src_run (&src, info);
+    info->mtime = (int64_t)st.st_mtime;
+
+    free (src.buf);
+    close (src.fd);
+#else
+    mapped_file map;
+
+    memset (info, 0, sizeof (image_info));
+    if ((stat (path, &st) != 0) || (mapfile_open (&map, path) != EXIT_SUCCESS))
+        return EXIT_FAILURE;
+
+    result = probe_mem (map.data, map.len, info);
+    info->mtime = (int64_t)st.st_mtime;
+
+    mapfile_close (&map);
+#endif
+
+    return result;
+}
+
+
+/* open (or create) the probe cache.  on failure the cache is left
+   disabled and every lookup misses */
+int
+probe_cache_open (probe_cache *cache)
+{
+    char *directory;
+    size_t len;
+
+    memset (cache, 0, sizeof (probe_cache));
+
+    directory = cache_directory ();
+    if (directory == NULL)
+        goto probe_cache_open_failure_0;
+
+    len = strlen (directory) + sizeof ("/probe");
+    cache->path = malloc (len);
+    if (cache->path == NULL)
+        goto probe_cache_open_failure_1;
+    snprintf (cache->path, len, "%s/probe", directory);
+
+    cache->capacity = PROBE_CACHE_ENTRIES;
+    cache->table_size = 1;
+    while (cache->table_size < cache->capacity * 2)
+    {
+        cache->table_size *= 2;
+    }
+    cache->entries = malloc ((size_t)cache->capacity * sizeof (probe_entry));
+    cache->table = malloc ((size_t)cache->table_size * sizeof (int));
+    if ((cache->entries == NULL) || (cache->table == NULL))
+        goto probe_cache_open_failure_2;
+
+    cache->lock = SDL_CreateMutex ();
+    if (cache->lock == NULL)
+        goto probe_cache_open_failure_2;
+
+    probe_cache_load (cache);
+    table_rebuild (cache);
+    cache->enabled = true;
+    free (directory);
+
+/* probe_cache_open_success_0: */
+    return EXIT_SUCCESS;
+
+probe_cache_open_failure_2:
+    free (cache->table);
+    free (cache->entries);
+    free (cache->path);
+probe_cache_open_failure_1:
+    free (directory);
+probe_cache_open_failure_0:
+    memset (cache, 0, sizeof (probe_cache));
+    return EXIT_FAILURE;
+}
+
+
+void
+probe_cache_close (probe_cache *cache)
+{
+    if (!cache->enabled)
+        return;
+
+    if (cache->dirty)
+        probe_cache_save (cache);
+
+    SDL_DestroyMutex (cache->lock);
+    free (cache->table);
+    free (cache->entries);
+    free (cache->path);
+    memset (cache, 0, sizeof (probe_cache));
+}
+
+
+/* fill infos[i] for every file, in parallel, from the cache where it
+   can.  files that can not be probed are left with w and h 0 */
+int
+probe_directory (probe_cache *cache, const filelist *files, image_info *infos)
+{
+    probe_batch *batches;
+    worker_pool *pool;
+    int batch_count;
+    int i;
+
+    if (files->count == 0)
+        return EXIT_SUCCESS;
+
+    batch_count = (files->count + PROBE_BATCH - 1) / PROBE_BATCH;
+    batches = calloc ((size_t)batch_count, sizeof (probe_batch));
+    if (batches == NULL)
+        goto probe_directory_failure_0;
+    for (i = 0; i < batch_count; i++)
+    {
+        batches[i].cache = cache;
+        batches[i].files = files;
+        batches[i].infos = infos;
+        batches[i].first = i * PROBE_BATCH;
+        batches[i].count = SDL_min (PROBE_BATCH, files->count - batches[i].first);
+    }
+
+    /* not worth starting threads for */
+    if (batch_count == 1)
+    {
+        probe_batch_job (&batches[0]);
+        free (batches);
+        return EXIT_SUCCESS;
+    }
+
+    pool = workers_create (SDL_min (workers_default_count (), batch_count), (worker_rank_fn)NULL);
+    if (pool == NULL)
+        goto probe_directory_failure_1;
+    for (i = 0; i < batch_count; i++)
+    {
+        if (workers_submit (pool, probe_batch_job, &batches[i]) != EXIT_SUCCESS)
+            probe_batch_job (&batches[i]);
+    }
+    workers_wait (pool);
+    workers_destroy (pool);
+
+    free (batches);
+
+/* probe_directory_success_0: */
+    return EXIT_SUCCESS;
+
+probe_directory_failure_1:
+    free (batches);
+probe_directory_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+/* reorder files by what their headers say, ties (and files that could
+   not be probed) keep their current order */
+int
+probe_sort (probe_cache *cache, filelist *files, probe_order order)
+{
+    image_info *infos;
+    probe_rank *ranks;
+    char **paths;
+    int i;
+
+    if ((order == PROBE_ORDER_NAME) || (files->count < 2))
+        return EXIT_SUCCESS;
+
+    infos = calloc ((size_t)files->count, sizeof (image_info));
+    ranks = malloc ((size_t)files->count * sizeof (probe_rank));
+    paths = malloc ((size_t)files->count * sizeof (char *));
+    if ((infos == NULL) || (ranks == NULL) || (paths == NULL))
+        goto probe_sort_failure_0;
+
+    if (probe_directory (cache, files, infos) != EXIT_SUCCESS)
+        goto probe_sort_failure_0;
+
+    for (i = 0; i < files->count; i++)
+    {
+        ranks[i].index = i;
+        if (order == PROBE_ORDER_TAKEN)
+            ranks[i].key = (infos[i].taken != 0) ? infos[i].taken : infos[i].mtime;
+        else
+            ranks[i].key = -((int64_t)infos[i].w * (int64_t)infos[i].h);
+    }
+    qsort (ranks, (size_t)files->count, sizeof (probe_rank), compare_ranks);
+
+    for (i = 0; i < files->count; i++)
+    {
+        paths[i] = files->paths[ranks[i].index];
+    }
+    memcpy (files->paths, paths, (size_t)files->count * sizeof (char *));
+
+    free (paths);
+    free (ranks);
+    free (infos);
+
+/* probe_sort_success_0: */
+    return EXIT_SUCCESS;
+
+probe_sort_failure_0:
+    free (paths);
+    free (ranks);
+    free (infos);
+    return EXIT_FAILURE;
+}
+
+
+/* End of File */
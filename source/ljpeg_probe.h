@@ -0,0 +1,111 @@
+/*
+   source/ljpeg_probe.h
+   LJPEG image header probing header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_PROBE_HEADER__
+#define __LJPEG_PROBE_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_filelist.h"
+
+
+/* custom datatypes */
+typedef enum probe_format
+{
+    PROBE_UNKNOWN,
+    PROBE_JPEG,
+    PROBE_PNG,
+    PROBE_GIF,
+    PROBE_WEBP
+} probe_format;
+
+typedef enum probe_order
+{
+    PROBE_ORDER_NAME,
+    PROBE_ORDER_TAKEN,      /* capture date, oldest first */
+    PROBE_ORDER_PIXELS,     /* largest first */
+    PROBE_ORDER_COUNT
+} probe_order;
+
+/* what the headers say, fixed size so it can be cached as is */
+typedef struct image_info
+{
+    uint32_t w, h;          /* 0 when the headers could not be read */
+    uint32_t format;        /* probe_format */
+    uint32_t orientation;   /* exif 1-8, 1 when not given */
+    int64_t  taken;         /* exif capture date, the camera's clock read
+                               as utc, 0 when not given */
+    int64_t  mtime;
+} image_info;
+
+/* one cache record */
+typedef struct probe_entry
+{
+    cache_key  key;
+    uint64_t   used;        /* lru clock */
+    image_info info;
+} probe_entry;
+
+typedef struct probe_cache
+{
+    bool         enabled;
+    char        *path;
+
+    SDL_mutex   *lock;
+    probe_entry *entries;
+    int          count;
+    int          capacity;
+    int         *table;     /* open addressing, entry numbers or -1 */
+    int          table_size;
+    uint64_t     clock;
+    bool         dirty;
+} probe_cache;
+
+
+/* constants */
+
+
+/* global variables */
+extern probe_cache g_probe;
+
+
+/* external function prototypes */
+int probe_mem  (const unsigned char *data, size_t len, image_info *info);
+int probe_file (const char *path, image_info *info);
+
+int  probe_cache_open  (probe_cache *cache);
+void probe_cache_close (probe_cache *cache);
+
+int probe_directory (probe_cache *cache, const filelist *files, image_info *infos);
+int probe_sort      (probe_cache *cache, filelist *files, probe_order order);
+
+#endif /* end run once */
+
+
+/* End of File */
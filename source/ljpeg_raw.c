@@ -0,0 +1,393 @@
+/*
+   source/ljpeg_raw.c
+   LJPEG raw shared memory buffer input source code.
+
+   For producers that already have pixels in memory (a memfd, a POSIX
+   shm object or any plain file) and do not want to encode them just to
+   look at them.  The buffer is mapped shared and copied straight into a
+   streaming texture, nothing is decoded.  With --notify-fd the producer
+   says when it has written something new: an eventfd write re-uploads
+   the whole image, on a pipe or socket each message is two native
+   endian uint32s, the first dirty row and the number of dirty rows (0
+   for all of them), and only those rows are re-uploaded.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* mmap, shm_open, poll and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_raw.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_graphics.h"
+
+
+/* global variable declarations */
+raw_input g_raw;
+Uint32    g_raw_event = (Uint32)-1;
+
+
+/* file static variables */
+/* names are the order of the bytes in memory */
+static const struct
+{
+    const char *name;
+    Uint32      format;
+} s_raw_formats[] = {
+    { "rgba", SDL_PIXELFORMAT_RGBA32 },
+    { "bgra", SDL_PIXELFORMAT_BGRA32 },
+    { "argb", SDL_PIXELFORMAT_ARGB32 },
+    { "abgr", SDL_PIXELFORMAT_ABGR32 },
+    { "rgb",  SDL_PIXELFORMAT_RGB24  },
+    { "bgr",  SDL_PIXELFORMAT_BGR24  },
+};
+
+
+/* file static function prototypes */
+#ifndef _WIN32
+static int  raw_open_fd (const char *name);
+static bool raw_fd_is_eventfd (int fd);
+static void raw_mark_dirty (raw_input *raw, Uint32 first, Uint32 count);
+static int  raw_watcher (void *data);
+#endif
+
+
+/* static function definitions */
+#ifndef _WIN32
+/* "fd:N" for an inherited descriptor (a memfd), a path, or a POSIX shm
+   name ("/name") */
+static int
+raw_open_fd (const char *name)
+{
+    int fd;
+
+    if (strncmp (name, "fd:", 3) == 0)
+        return dup (atoi (name + 3));
+
+    fd = open (name, O_RDONLY);
+    if ((fd < 0) && (errno == ENOENT) && (name[0] == '/') && (strchr (name + 1, '/') == NULL))
+        fd = shm_open (name, O_RDONLY, 0);
+
+    return fd;
+}
+
+
+/* eventfds only say "something changed", so there are no rows to read */
+static bool
+raw_fd_is_eventfd (int fd)
+{
+    char link[64];
+    char target[64];
+    ssize_t len;
+
+    snprintf (link, sizeof (link), "/proc/self/fd/%d", fd);
+    len = readlink (link, target, sizeof (target) - 1);
+    if (len < 0)
+        return false;
+    target[len] = '\0';
+
+    return strcmp (target, "anon_inode:[eventfd]") == 0;
+}
+
+
+/* grow the dirty range and wake the main thread if it is not already
+   on its way */
+static void
+raw_mark_dirty (raw_input *raw, Uint32 first, Uint32 count)
+{
+    SDL_Event evt;
+    int h = raw->params.h;
+    int last;
+
+    if ((count == 0) || (first >= (Uint32)h))
+    {
+        first = 0;
+        count = (Uint32)h;
+    }
+    last = (count > (Uint32)h - first) ? h : (int)(first + count);
+
+    SDL_LockMutex (raw->lock);
+    if (raw->dirty_first >= raw->dirty_last)
+    {
+        raw->dirty_first = (int)first;
+        raw->dirty_last = last;
+    }
+    else
+    {
+        raw->dirty_first = SDL_min (raw->dirty_first, (int)first);
+        raw->dirty_last = SDL_max (raw->dirty_last, last);
+    }
+    SDL_UnlockMutex (raw->lock);
+
+    if (SDL_AtomicSet (&raw->notified, 1) == 0)
+    {
+        SDL_zero (evt);
+        evt.type = g_raw_event;
+        SDL_PushEvent (&evt);
+    }
+}
+
+
+/* wait on the notify descriptor, turning each message into dirty rows */
+static int
+raw_watcher (void *data)
+{
+    raw_input *raw = (raw_input *)data;
+    unsigned char buf[256];
+    size_t have = 0;
+    size_t used;
+    struct pollfd pfd;
+    uint64_t counter;
+    Uint32 msg[2];
+    ssize_t got;
+    bool quit = false;
+
+    while (!quit)
+    {
+        /* poll so raw_close never waits on a producer that went quiet */
+        pfd.fd = raw->params.notify_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll (&pfd, 1, 100) <= 0)
+        {
+            SDL_LockMutex (raw->lock);
+            quit = raw->quit;
+            SDL_UnlockMutex (raw->lock);
+            continue;
+        }
+
+        if (raw->is_eventfd)
+        {
+            got = read (pfd.fd, &counter, sizeof (counter));
+            if (got == (ssize_t)sizeof (counter))
+                raw_mark_dirty (raw, 0, 0);
+        }
+        else
+        {
+            got = read (pfd.fd, buf + have, sizeof (buf) - have);
+            if (got > 0)
+            {
+                /* messages may come split across reads on a stream socket */
+                have += (size_t)got;
+                for (used = 0; have - used >= sizeof (msg); used += sizeof (msg))
+                {
+                    memcpy (msg, buf + used, sizeof (msg));
+                    raw_mark_dirty (raw, msg[0], msg[1]);
+                }
+                memmove (buf, buf + used, have - used);
+                have -= used;
+            }
+        }
+
+        if ((got < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+            continue;
+        if (got <= 0)
+            break;      /* the producer is gone, the last frame stays up */
+
+        SDL_LockMutex (raw->lock);
+        quit = raw->quit;
+        SDL_UnlockMutex (raw->lock);
+    }
+
+    return 0;
+}
+#endif
+
+
+/* function definitions */
+/* map the producer's buffer and upload it once */
+int
+raw_open (raw_input *raw, const char *name, const raw_params *params)
+{
+#ifdef _WIN32
+    memset (raw, 0, sizeof (raw_input));
+    (void)name;
+    (void)params;
+    fprintf (stderr, "raw buffer input is not supported on this platform\n");
+    return EXIT_FAILURE;
+#else
+    const char *format_name = (params->format != NULL) ? params->format : "rgba";
+    struct stat st;
+    size_t row_bytes;
+    size_t i;
+    void *map;
+    int fd;
+
+    memset (raw, 0, sizeof (raw_input));
+    raw->params = *params;
+    if (g_raw_event == (Uint32)-1)
+        g_raw_event = SDL_RegisterEvents (1);
+
+    for (i = 0; i < SDL_arraysize (s_raw_formats); i++)
+    {
+        if (strcmp (format_name, s_raw_formats[i].name) == 0)
+            raw->format = s_raw_formats[i].format;
+    }
+    if (raw->format == 0)
+    {
+        fprintf (stderr, "%s: unknown pixel format (rgba, bgra, argb, abgr, rgb, bgr)\n", format_name);
+        goto raw_open_failure_0;
+    }
+    if ((params->w <= 0) || (params->h <= 0))
+    {
+        fprintf (stderr, "%s: --raw needs the buffer size, eg: --raw 1920x1080\n", name);
+        goto raw_open_failure_0;
+    }
+
+    row_bytes = (size_t)params->w * SDL_BYTESPERPIXEL (raw->format);
+    if (raw->params.stride == 0)
+        raw->params.stride = (int)row_bytes;
+    if ((size_t)raw->params.stride < row_bytes)
+    {
+        fprintf (stderr, "%s: stride %d is shorter than a row (%zu bytes)\n", name, raw->params.stride, row_bytes);
+        goto raw_open_failure_0;
+    }
+
+    /* map the whole buffer, shared so the producer's writes show through */
+    fd = raw_open_fd (name);
+    if (fd < 0)
+    {
+        perror (name);
+        goto raw_open_failure_0;
+    }
+    raw->len = (size_t)raw->params.stride * (size_t)(params->h - 1) + row_bytes;
+    if ((fstat (fd, &st) != 0) || ((size_t)st.st_size < raw->len))
+    {
+        fprintf (stderr, "%s: buffer is smaller than %dx%d %s\n", name, params->w, params->h, format_name);
+        close (fd);
+        goto raw_open_failure_0;
+    }
+    map = mmap (NULL, raw->len, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+    {
+        perror (name);
+        goto raw_open_failure_0;
+    }
+    raw->pixels = map;
+
+    raw->texture = SDL_CreateTexture (g_rend, raw->format, SDL_TEXTUREACCESS_STREAMING, params->w, params->h);
+    if (raw->texture == NULL)
+    {
+        fprintf (stderr, "%s: %s\n", name, SDL_GetError ());
+        goto raw_open_failure_1;
+    }
+    SDL_UpdateTexture (raw->texture, NULL, raw->pixels, raw->params.stride);
+
+    /* without a notify descriptor it is a still image */
+    if (params->notify_fd >= 0)
+    {
+        raw->is_eventfd = raw_fd_is_eventfd (params->notify_fd);
+        raw->lock = SDL_CreateMutex ();
+        if (raw->lock == NULL)
+            goto raw_open_failure_2;
+        raw->watcher = SDL_CreateThread (raw_watcher, "ljpeg-raw", raw);
+        if (raw->watcher == NULL)
+            goto raw_open_failure_3;
+    }
+    raw->active = true;
+
+/* raw_open_success_0: */
+    return EXIT_SUCCESS;
+
+raw_open_failure_3:
+    SDL_DestroyMutex (raw->lock);
+raw_open_failure_2:
+    fprintf (stderr, "%s: %s\n", name, SDL_GetError ());
+    SDL_DestroyTexture (raw->texture);
+raw_open_failure_1:
+    munmap ((void *)raw->pixels, raw->len);
+raw_open_failure_0:
+    memset (raw, 0, sizeof (raw_input));
+    return EXIT_FAILURE;
+#endif
+}
+
+
+/* stop watching and unmap.  the texture is owned by whoever displays it
+   (g_img) and is left alone */
+void
+raw_close (raw_input *raw)
+{
+    if (!raw->active)
+        return;
+
+#ifndef _WIN32
+    if (raw->watcher != NULL)
+    {
+        SDL_LockMutex (raw->lock);
+        raw->quit = true;
+        SDL_UnlockMutex (raw->lock);
+        SDL_WaitThread (raw->watcher, NULL);
+        SDL_DestroyMutex (raw->lock);
+    }
+    munmap ((void *)raw->pixels, raw->len);
+#endif
+    memset (raw, 0, sizeof (raw_input));
+}
+
+
+/* re-upload the rows the producer said it changed.  returns true when
+   the texture changed */
+bool
+raw_update (raw_input *raw)
+{
+    SDL_Rect rows;
+
+    if (!raw->active || (raw->watcher == NULL))
+        return false;
+    if (SDL_AtomicSet (&raw->notified, 0) == 0)
+        return false;
+
+    SDL_LockMutex (raw->lock);
+    rows.y = raw->dirty_first;
+    rows.h = raw->dirty_last - raw->dirty_first;
+    raw->dirty_first = 0;
+    raw->dirty_last = 0;
+    SDL_UnlockMutex (raw->lock);
+    if (rows.h <= 0)
+        return false;
+
+    rows.x = 0;
+    rows.w = raw->params.w;
+    SDL_UpdateTexture (raw->texture, &rows,
+                       raw->pixels + (size_t)rows.y * (size_t)raw->params.stride,
+                       raw->params.stride);
+
+    return true;
+}
+
+
+/* End of File */
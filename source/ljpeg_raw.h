@@ -0,0 +1,82 @@
+/*
+   source/ljpeg_raw.h
+   LJPEG raw shared memory buffer input header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_RAW_HEADER__
+#define __LJPEG_RAW_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+/* what the producer told us about its buffer (--raw, --format, ...) */
+typedef struct raw_params
+{
+    int         w, h;
+    int         stride;         /* bytes per row, 0 for tightly packed */
+    const char *format;         /* byte order name, NULL for rgba */
+    int         notify_fd;      /* eventfd, pipe or socket, -1 for none */
+} raw_params;
+
+typedef struct raw_input
+{
+    bool           active;
+    raw_params     params;
+    Uint32         format;
+    const unsigned char *pixels;    /* MAP_SHARED, the producer writes here */
+    size_t         len;
+
+    /* filled by the notify thread */
+    SDL_mutex     *lock;
+    SDL_Thread    *watcher;
+    bool           is_eventfd;
+    bool           quit;
+    int            dirty_first;     /* dirty rows [first, last) */
+    int            dirty_last;
+    SDL_atomic_t   notified;
+
+    SDL_Texture   *texture;         /* streaming, owned by g_img */
+} raw_input;
+
+
+/* constants */
+
+
+/* global variables */
+extern raw_input g_raw;
+extern Uint32    g_raw_event;
+
+
+/* external function prototypes */
+int  raw_open   (raw_input *raw, const char *name, const raw_params *params);
+void raw_close  (raw_input *raw);
+bool raw_update (raw_input *raw);
+
+#endif /* end run once */
+
+
+/* End of File */
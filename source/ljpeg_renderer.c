@@ -0,0 +1,393 @@
+/*
+   source/ljpeg_renderer.c
+   LJPEG renderer selection source code.
+
+   SDL's first accelerated driver is not always the fastest one, and on
+   some machines it is not there at all.  The first time ljpeg runs on a
+   machine (per video driver) each render driver is timed uploading a
+   texture and drawing it scaled and turned, and the fastest is kept in
+   $XDG_CACHE_HOME/ljpeg/renderer.  Whatever is picked, the software
+   renderer is the last resort.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* gethostname is hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_renderer.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_decode.h"
+
+
+/* file static variables */
+/* the probe draws a texture this big, halved and turned, for this many
+   frames after a warm up one */
+#define RENDERER_PROBE_SIZE   1024
+#define RENDERER_PROBE_FRAMES 12
+
+#define RENDERER_KEY_MAX  256
+#define RENDERER_LINE_MAX 512
+
+
+/* file static function prototypes */
+static int    renderer_find (const char *name);
+static double renderer_time (int index);
+static int    renderer_probe (void);
+static void   renderer_key (char *key, size_t size);
+static char  *renderer_cache_path (void);
+static bool   renderer_cache_read (const char *key, char *name, size_t size);
+static void   renderer_cache_write (const char *key, const char *name);
+
+
+/* static function definitions */
+/* index of the render driver called name, or -1 */
+static int
+renderer_find (const char *name)
+{
+    SDL_RendererInfo info;
+    int i;
+
+    for (i = 0; i < SDL_GetNumRenderDrivers (); i++)
+    {
+        if ((SDL_GetRenderDriverInfo (i, &info) == 0) && (strcmp (info.name, name) == 0))
+            return i;
+    }
+
+    return -1;
+}
+
+
+/* milliseconds a frame takes driver index, or a negative number when it
+   does not work here.  each frame uploads the texture, draws it halved
+   and then turned, and reads a pixel back so the gpu has to finish */
+static double
+renderer_time (int index)
+{
+    SDL_Window *win;
+    SDL_Renderer *rend;
+    SDL_Texture *tex;
+    SDL_Rect dst;
+    SDL_Rect one = { 0, 0, 1, 1 };
+    Uint32 *pixels;
+    Uint32 pixel;
+    Uint64 start = 0;
+    double ms = -1.0;
+    int frame;
+    int i;
+
+    win = SDL_CreateWindow ("", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                            RENDERER_PROBE_SIZE / 2, RENDERER_PROBE_SIZE / 2,
+                            SDL_WINDOW_HIDDEN | SDL_WINDOW_BORDERLESS);
+    if (win == NULL)
+        goto renderer_time_exit_0;
+    rend = SDL_CreateRenderer (win, index, 0);
+    if (rend == NULL)
+        goto renderer_time_exit_1;
+    tex = SDL_CreateTexture (rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING,
+                             RENDERER_PROBE_SIZE, RENDERER_PROBE_SIZE);
+    if (tex == NULL)
+        goto renderer_time_exit_2;
+    pixels = malloc ((size_t)RENDERER_PROBE_SIZE * RENDERER_PROBE_SIZE * sizeof (Uint32));
+    if (pixels == NULL)
+        goto renderer_time_exit_3;
+
+    for (i = 0; i < RENDERER_PROBE_SIZE * RENDERER_PROBE_SIZE; i++)
+    {
+        pixels[i] = (Uint32)i * 2654435761u;
+    }
+
+    for (frame = 0; frame <= RENDERER_PROBE_FRAMES; frame++)
+    {
+        /* frame 0 warms the driver up and is not counted */
+        if (frame == 1)
+            start = SDL_GetPerformanceCounter ();
+
+        if (SDL_UpdateTexture (tex, NULL, pixels, RENDERER_PROBE_SIZE * (int)sizeof (Uint32)) != 0)
+            goto renderer_time_exit_4;
+
+        dst.x = 0;
+        dst.y = 0;
+        dst.w = RENDERER_PROBE_SIZE / 2;
+        dst.h = RENDERER_PROBE_SIZE / 2;
+        SDL_RenderClear (rend);
+        SDL_RenderCopyEx (rend, tex, NULL, &dst, 0.0, NULL, SDL_FLIP_NONE);
+        dst.x = RENDERER_PROBE_SIZE / 8;
+        dst.y = RENDERER_PROBE_SIZE / 8;
+        dst.w = RENDERER_PROBE_SIZE / 4;
+        dst.h = RENDERER_PROBE_SIZE / 4;
+        SDL_RenderCopyEx (rend, tex, NULL, &dst, 90.0 * (frame % 4), NULL, SDL_FLIP_NONE);
+        if (SDL_RenderReadPixels (rend, &one, DECODE_PIXELFORMAT, &pixel, (int)sizeof (Uint32)) != 0)
+            goto renderer_time_exit_4;
+    }
+
+    ms = (double)(SDL_GetPerformanceCounter () - start) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency () / RENDERER_PROBE_FRAMES;
+
+renderer_time_exit_4:
+    free (pixels);
+renderer_time_exit_3:
+    SDL_DestroyTexture (tex);
+renderer_time_exit_2:
+    SDL_DestroyRenderer (rend);
+renderer_time_exit_1:
+    SDL_DestroyWindow (win);
+renderer_time_exit_0:
+    return ms;
+}
+
+
+/* index of the fastest driver that works, or -1 */
+static int
+renderer_probe (void)
+{
+    SDL_RendererInfo info;
+    double best_ms = 0.0;
+    double ms;
+    int best = -1;
+    int i;
+
+    for (i = 0; i < SDL_GetNumRenderDrivers (); i++)
+    {
+        if (SDL_GetRenderDriverInfo (i, &info) != 0)
+            continue;
+        ms = renderer_time (i);
+        if (ms < 0.0)
+            continue;
+        if ((best < 0) || (ms < best_ms))
+        {
+            best = i;
+            best_ms = ms;
+        }
+    }
+
+    return best;
+}
+
+
+/* what the cached choice holds for: this machine and video driver */
+static void
+renderer_key (char *key, size_t size)
+{
+    const char *video = SDL_GetCurrentVideoDriver ();
+    char host[128] = "";
+
+#ifndef _WIN32
+    if (gethostname (host, sizeof (host)) != 0)
+        host[0] = '\0';
+    host[sizeof (host) - 1] = '\0';
+#else
+    if (getenv ("COMPUTERNAME") != NULL)
+        snprintf (host, sizeof (host), "%s", getenv ("COMPUTERNAME"));
+#endif
+
+    snprintf (key, size, "%s/%s", (host[0] != '\0') ? host : "localhost",
+              (video != NULL) ? video : "none");
+}
+
+
+static char *
+renderer_cache_path (void)
+{
+    char *directory;
+    char *path;
+    size_t len;
+
+    directory = cache_directory ();
+    if (directory == NULL)
+        return (char *)NULL;
+
+    len = strlen (directory) + sizeof ("/renderer");
+    path = malloc (len);
+    if (path != NULL)
+        snprintf (path, len, "%s/renderer", directory);
+    free (directory);
+
+    return path;
+}
+
+
+/* the cache is a line of "key driver" for each machine and video driver */
+static bool
+renderer_cache_read (const char *key, char *name, size_t size)
+{
+    char line[RENDERER_LINE_MAX];
+    char line_key[RENDERER_KEY_MAX];
+    char line_name[RENDERER_KEY_MAX];
+    char *path;
+    FILE *fp;
+    bool found = false;
+
+    path = renderer_cache_path ();
+    if (path == NULL)
+        return false;
+    fp = fopen (path, "r");
+    free (path);
+    if (fp == NULL)
+        return false;
+
+    while (!found && (fgets (line, sizeof (line), fp) != NULL))
+    {
+        if ((sscanf (line, "%255s %255s", line_key, line_name) == 2) &&
+            (strcmp (line_key, key) == 0))
+        {
+            snprintf (name, size, "%s", line_name);
+            found = true;
+        }
+    }
+    fclose (fp);
+
+    return found;
+}
+
+
+/* replace key's line, keeping the other machines' */
+static void
+renderer_cache_write (const char *key, const char *name)
+{
+    char line[RENDERER_LINE_MAX];
+    char line_key[RENDERER_KEY_MAX];
+    char *path;
+    char *tmp_path;
+    FILE *in;
+    FILE *out;
+    size_t len;
+    bool ok;
+
+    path = renderer_cache_path ();
+    if (path == NULL)
+        return;
+    len = strlen (path) + sizeof (".tmp");
+    tmp_path = malloc (len);
+    if (tmp_path == NULL)
+        goto renderer_cache_write_exit_0;
+    snprintf (tmp_path, len, "%s.tmp", path);
+
+    out = fopen (tmp_path, "w");
+    if (out == NULL)
+        goto renderer_cache_write_exit_1;
+
+    in = fopen (path, "r");
+    if (in != NULL)
+    {
+        while (fgets (line, sizeof (line), in) != NULL)
+        {
+            if ((sscanf (line, "%255s", line_key) == 1) && (strcmp (line_key, key) != 0))
+                fputs (line, out);
+        }
+        fclose (in);
+    }
+    fprintf (out, "%s %s\n", key, name);
+
+    ok = (ferror (out) == 0);
+    ok = (fclose (out) == 0) && ok;
+    if (!ok || (rename (tmp_path, path) != 0))
+        remove (tmp_path);
+
+renderer_cache_write_exit_1:
+    free (tmp_path);
+renderer_cache_write_exit_0:
+    free (path);
+}
+
+
+/* function definitions */
+/* create win's renderer: the named driver, or the fastest one for
+   "auto", falling back to SDL's accelerated choice and then software */
+SDL_Renderer *
+renderer_create (SDL_Window *win, const char *name)
+{
+    SDL_Renderer *rend = NULL;
+    SDL_RendererInfo info;
+    char key[RENDERER_KEY_MAX];
+    char cached[RENDERER_KEY_MAX];
+    int index = -1;
+
+    renderer_key (key, sizeof (key));
+
+    if ((name == NULL) || (strcmp (name, "auto") == 0) || (strcmp (name, "probe") == 0))
+    {
+        /* a cached driver that has since gone away is probed for again */
+        if ((name == NULL) || (strcmp (name, "probe") != 0))
+        {
+            if (renderer_cache_read (key, cached, sizeof (cached)))
+                index = renderer_find (cached);
+        }
+        if (index < 0)
+        {
+            index = renderer_probe ();
+            if ((index >= 0) && (SDL_GetRenderDriverInfo (index, &info) == 0))
+                renderer_cache_write (key, info.name);
+        }
+    }
+    else
+    {
+        index = renderer_find (name);
+        if (index < 0)
+        {
+            fprintf (stderr, "%s: no such renderer, available are:\n", name);
+            renderer_list (stderr);
+        }
+    }
+
+    if (index >= 0)
+    {
+        rend = SDL_CreateRenderer (win, index, 0);
+        if (rend == NULL)
+            fprintf (stderr, "could not create renderer: %s\n", SDL_GetError ());
+    }
+    if (rend == NULL)
+        rend = SDL_CreateRenderer (win, -1, SDL_RENDERER_ACCELERATED);
+    if (rend == NULL)
+        rend = SDL_CreateRenderer (win, -1, SDL_RENDERER_SOFTWARE);
+
+    return rend;
+}
+
+
+/* the render drivers SDL has here, one a line */
+void
+renderer_list (FILE *fp)
+{
+    SDL_RendererInfo info;
+    int i;
+
+    for (i = 0; i < SDL_GetNumRenderDrivers (); i++)
+    {
+        if (SDL_GetRenderDriverInfo (i, &info) == 0)
+            fprintf (fp, "    %s%s\n", info.name,
+                     ((info.flags & SDL_RENDERER_SOFTWARE) != 0) ? " (software)" : "");
+    }
+    fflush (fp);
+}
+
+
+/* End of File */
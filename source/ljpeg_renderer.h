@@ -0,0 +1,52 @@
+/*
+   source/ljpeg_renderer.h
+   LJPEG renderer selection header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_RENDERER_HEADER__
+#define __LJPEG_RENDERER_HEADER__
+
+/* include headers */
+#include <stdio.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+/* name is "auto" (the fastest driver, probed once and cached), "probe"
+   (probe again) or a driver name as renderer_list prints them */
+SDL_Renderer *renderer_create (SDL_Window *win, const char *name);
+void renderer_list (FILE *fp);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,629 @@
+/*
+   source/ljpeg_sequence.c
+   LJPEG numbered image sequence playback source code.
+
+   Frames go through three stages: one reader thread loads the files in
+   order (disks like sequential reads), the worker pool decodes them in
+   parallel, and the main thread uploads them into a streaming texture.
+   Every frame has a tick and a slot (tick % slot_count), so frames that
+   finish decoding out of order are still shown in order.  A frame is
+   only dropped when a later one is ready and already due, or when it
+   is due before the reader even gets to it.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_sequence.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+sequence g_seq;
+Uint32   g_seq_event = (Uint32)-1;
+
+
+/* file static variables */
+
+
+/* file static function prototypes */
+static int  sequence_find_frames (sequence *seq, const char *path);
+static int  sequence_reader (void *data);
+static void sequence_decode_job (void *arg);
+static void sequence_release (seq_slot *slot);
+static void sequence_wake_main (sequence *seq);
+static void sequence_report (sequence *seq, Uint64 now);
+
+
+/* static function definitions */
+/* list the files sharing path's numbering pattern, e.g. shot_0001.jpg
+   matches shot_0002.jpg but not shot_01.jpg or shot_0001.png */
+static int
+sequence_find_frames (sequence *seq, const char *path)
+{
+    filelist all;
+    char *directory;
+    const char *base, *name;
+    const char *digits = NULL;
+    size_t prefix_len, digits_len, suffix_len, name_len, dir_len;
+    size_t i;
+    bool padded;
+    int index;
+
+    /* split off the directory, the rest is prefix, digits and suffix */
+    base = strrchr (path, '/');
+    base = (base == NULL) ? path : base + 1;
+    for (name = base; *name != '\0'; name++)
+    {
+        if (isdigit ((unsigned char)*name) && ((name == base) || !isdigit ((unsigned char)name[-1])))
+            digits = name;
+    }
+    if (digits == NULL)
+    {
+        fprintf (stderr, "%s: no frame number in the file name\n", path);
+        return EXIT_FAILURE;
+    }
+    prefix_len = (size_t)(digits - base);
+    for (digits_len = 0; isdigit ((unsigned char)digits[digits_len]); digits_len++);
+    suffix_len = strlen (digits + digits_len);
+    padded = (digits[0] == '0') && (digits_len > 1);
+
+    dir_len = (size_t)(base - path);
+    directory = malloc (dir_len + 2);
+    if (directory == NULL)
+        return EXIT_FAILURE;
+    if (dir_len == 0)
+        strcpy (directory, ".");
+    else if (dir_len == 1)
+        strcpy (directory, "/");
+    else
+    {
+        memcpy (directory, path, dir_len - 1);
+        directory[dir_len - 1] = '\0';
+    }
+
+    if (filelist_load (&all, directory) != EXIT_SUCCESS)
+    {
+        free (directory);
+        return EXIT_FAILURE;
+    }
+    free (directory);
+
+    /* the natural sort already puts same-pattern names in number order */
+    memset (&seq->frames, 0, sizeof (filelist));
+    seq->first = 0;
+    for (index = 0; index < all.count; index++)
+    {
+        name = strrchr (all.paths[index], '/') + 1;
+        name_len = strlen (name);
+        if ((name_len <= prefix_len + suffix_len) ||
+            (strncmp (name, base, prefix_len) != 0) ||
+            (strcmp (name + name_len - suffix_len, digits + digits_len) != 0))
+            continue;
+
+        for (i = prefix_len; i < name_len - suffix_len; i++)
+        {
+            if (!isdigit ((unsigned char)name[i]))
+                break;
+        }
+        if (i < name_len - suffix_len)
+            continue;
+        if ((padded && (name_len - prefix_len - suffix_len != digits_len)) ||
+            (!padded && (name[prefix_len] == '0') && (name_len - prefix_len - suffix_len > 1)))
+            continue;
+
+        /* playback starts at the frame that was asked for */
+        if (strcmp (name, base) == 0)
+            seq->first = seq->frames.count;
+        if (filelist_add (&seq->frames, all.paths[index]) != EXIT_SUCCESS)
+        {
+            filelist_free (&all);
+            filelist_free (&seq->frames);
+            return EXIT_FAILURE;
+        }
+    }
+    filelist_free (&all);
+
+    if (seq->frames.count == 0)
+    {
+        fprintf (stderr, "%s: no frames found\n", path);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* let the main loop know a frame arrived while it was waiting on one */
+static void
+sequence_wake_main (sequence *seq)
+{
+    SDL_Event evt;
+
+    if (SDL_AtomicSet (&seq->starved, 0) == 0)
+        return;
+
+    SDL_zero (evt);
+    evt.type = g_seq_event;
+    SDL_PushEvent (&evt);
+}
+
+
+/* stage one, load each file whole and in order, as slots free up */
+static int
+sequence_reader (void *data)
+{
+    sequence *seq = (sequence *)data;
+    seq_slot *slot;
+    const char *path;
+    void *bytes;
+    size_t len;
+
+    for (;;)
+    {
+        SDL_LockMutex (seq->lock);
+        while (!seq->quit && (seq->slots[seq->read_tick % seq->slot_count].state != SEQ_SLOT_FREE))
+        {
+            SDL_CondWait (seq->changed, seq->lock);
+        }
+        if (seq->quit)
+        {
+            SDL_UnlockMutex (seq->lock);
+            break;
+        }
+        slot = &seq->slots[seq->read_tick % seq->slot_count];
+        slot->tick = seq->read_tick;
+
+        /* decoding slower than the frame rate, don't spend time on
+           frames that are late before they are read */
+        if (seq->read_tick < seq->due_tick)
+        {
+            slot->state = SEQ_SLOT_SKIPPED;
+            seq->read_tick++;
+            SDL_UnlockMutex (seq->lock);
+            sequence_wake_main (seq);
+            continue;
+        }
+        slot->state = SEQ_SLOT_READING;
+        path = seq->frames.paths[(seq->first + seq->read_tick) % seq->frames.count];
+        seq->read_tick++;
+        SDL_UnlockMutex (seq->lock);
+
+        bytes = SDL_LoadFile (path, &len);
+
+        SDL_LockMutex (seq->lock);
+        if (slot->state == SEQ_SLOT_DROPPED)
+        {
+            SDL_free (bytes);
+            slot->state = SEQ_SLOT_FREE;
+            SDL_UnlockMutex (seq->lock);
+            continue;
+        }
+        if (bytes == NULL)
+        {
+            fprintf (stderr, "%s: %s\n", path, SDL_GetError ());
+            slot->state = SEQ_SLOT_FAILED;
+            SDL_UnlockMutex (seq->lock);
+            sequence_wake_main (seq);
+            continue;
+        }
+        slot->data = bytes;
+        slot->data_len = len;
+        slot->state = SEQ_SLOT_DECODING;
+        SDL_UnlockMutex (seq->lock);
+
+        /* stage two */
+        if (workers_submit (seq->pool, sequence_decode_job, slot) != EXIT_SUCCESS)
+        {
+            SDL_LockMutex (seq->lock);
+            SDL_free (slot->data);
+            slot->data = NULL;
+            slot->state = (slot->state == SEQ_SLOT_DROPPED) ? SEQ_SLOT_FREE : SEQ_SLOT_FAILED;
+            SDL_UnlockMutex (seq->lock);
+            sequence_wake_main (seq);
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+sequence_decode_job (void *arg)
+{
+    seq_slot *slot = (seq_slot *)arg;
+    sequence *seq = slot->seq;
+    SDL_Surface *surface = NULL;
+    bool late;
+
+    /* same as the reader, a frame that is already overdue is not worth
+       decoding when the one after it is due too */
+    SDL_LockMutex (seq->lock);
+    late = (slot->tick < seq->due_tick) || (slot->state == SEQ_SLOT_DROPPED);
+    SDL_UnlockMutex (seq->lock);
+
+    if (!late)
+        surface = decode_load_mem (slot->data, slot->data_len);
+
+    /* one streaming texture holds every frame, so sizes must agree */
+    if ((surface != NULL) && ((surface->w != seq->w) || (surface->h != seq->h)))
+    {
+        SDL_FreeSurface (surface);
+        surface = NULL;
+    }
+
+    SDL_LockMutex (seq->lock);
+    SDL_free (slot->data);
+    slot->data = NULL;
+    if (slot->state == SEQ_SLOT_DROPPED)
+    {
+        if (surface != NULL)
+            SDL_FreeSurface (surface);
+        slot->state = SEQ_SLOT_FREE;
+    }
+    else if (late)
+    {
+        slot->state = SEQ_SLOT_SKIPPED;
+    }
+    else
+    {
+        slot->surface = surface;
+        slot->state = (surface != NULL) ? SEQ_SLOT_READY : SEQ_SLOT_FAILED;
+    }
+    SDL_CondBroadcast (seq->changed);
+    SDL_UnlockMutex (seq->lock);
+
+    sequence_wake_main (seq);
+}
+
+
+/* hand a slot back to the reader, or mark it for whoever still holds
+   it.  seq->lock must be held */
+static void
+sequence_release (seq_slot *slot)
+{
+    switch (slot->state)
+    {
+    case SEQ_SLOT_READING:
+    case SEQ_SLOT_DECODING:
+        slot->state = SEQ_SLOT_DROPPED;
+        break;
+    case SEQ_SLOT_READY:
+        SDL_FreeSurface (slot->surface);
+        slot->surface = NULL;
+        slot->state = SEQ_SLOT_FREE;
+        break;
+    case SEQ_SLOT_FAILED:
+    case SEQ_SLOT_SKIPPED:
+        slot->state = SEQ_SLOT_FREE;
+        break;
+    default:
+        break;
+    }
+}
+
+
+/* achieved frame rate in the title, once a second */
+static void
+sequence_report (sequence *seq, Uint64 now)
+{
+    Uint64 freq = SDL_GetPerformanceFrequency ();
+    char title[128];
+    double fps;
+
+    if (now - seq->report_time < freq)
+        return;
+
+    fps = (double)(seq->shown - seq->report_shown) * (double)freq / (double)(now - seq->report_time);
+    snprintf (title, sizeof (title), "LJPEG - frame %ld/%d - %.2f/%.2f fps - %ld dropped",
+              (seq->first + seq->show_tick - 1) % seq->frames.count + 1, seq->frames.count,
+              fps, seq->fps, seq->dropped);
+    SDL_SetWindowTitle (g_win, title);
+
+    seq->report_time = now;
+    seq->report_shown = seq->shown;
+}
+
+
+/* function definitions */
+/* play the numbered files around path at fps, starting from path */
+int
+sequence_open (sequence *seq, const char *path, double fps)
+{
+    SDL_Surface *first;
+    void *bytes;
+    size_t len, frame_bytes;
+    int i;
+
+    memset (seq, 0, sizeof (sequence));
+    if (g_seq_event == (Uint32)-1)
+        g_seq_event = SDL_RegisterEvents (1);
+    seq->fps = (fps > 0) ? fps : SEQUENCE_FPS;
+
+    if (sequence_find_frames (seq, path) != EXIT_SUCCESS)
+        goto sequence_open_failure_0;
+
+    /* the first frame is decoded up front, it fixes the frame size */
+    bytes = SDL_LoadFile (seq->frames.paths[seq->first], &len);
+    if (bytes == NULL)
+    {
+        fprintf (stderr, "%s: %s\n", seq->frames.paths[seq->first], SDL_GetError ());
+        goto sequence_open_failure_1;
+    }
+    first = decode_load_mem (bytes, len);
+    SDL_free (bytes);
+    if (first == NULL)
+    {
+        fprintf (stderr, "%s: %s\n", seq->frames.paths[seq->first], SDL_GetError ());
+        goto sequence_open_failure_1;
+    }
+    seq->w = first->w;
+    seq->h = first->h;
+
+    seq->texture = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING,
+                                      seq->w, seq->h);
+    if (seq->texture == NULL)
+    {
+        SDL_FreeSurface (first);
+        goto sequence_open_failure_1;
+    }
+    SDL_SetTextureBlendMode (seq->texture, SDL_BLENDMODE_BLEND);
+    SDL_UpdateTexture (seq->texture, NULL, first->pixels, first->pitch);
+    SDL_FreeSurface (first);
+
+    /* as many frames in flight as the budget allows */
+    frame_bytes = (size_t)seq->w * (size_t)seq->h * 4;
+    seq->slot_count = (int)(((size_t)SEQUENCE_BUDGET_MB << 20) / frame_bytes);
+    if (seq->slot_count < 3)
+        seq->slot_count = 3;
+    if (seq->slot_count > SEQUENCE_MAX_AHEAD)
+        seq->slot_count = SEQUENCE_MAX_AHEAD;
+
+    seq->slots = calloc ((size_t)seq->slot_count, sizeof (seq_slot));
+    if (seq->slots == NULL)
+        goto sequence_open_failure_2;
+    for (i = 0; i < seq->slot_count; i++)
+    {
+        seq->slots[i].seq = seq;
+        seq->slots[i].tick = -1;
+    }
+
+    seq->lock = SDL_CreateMutex ();
+    seq->changed = SDL_CreateCond ();
+    if ((seq->lock == NULL) || (seq->changed == NULL))
+        goto sequence_open_failure_3;
+
+    seq->pool = workers_create (workers_default_count (), NULL);
+    if (seq->pool == NULL)
+        goto sequence_open_failure_3;
+
+    /* tick 0 is already on screen */
+    seq->read_tick = 1;
+    seq->show_tick = 1;
+    seq->shown = 1;
+    seq->start = SDL_GetPerformanceCounter ();
+    seq->opened = seq->start;
+    seq->report_time = seq->start;
+
+    seq->reader = SDL_CreateThread (sequence_reader, "ljpeg-seq-reader", seq);
+    if (seq->reader == NULL)
+        goto sequence_open_failure_4;
+
+    seq->active = true;
+
+/* sequence_open_success_0: */
+    return EXIT_SUCCESS;
+
+sequence_open_failure_4:
+    workers_destroy (seq->pool);
+sequence_open_failure_3:
+    if (seq->changed != NULL)
+        SDL_DestroyCond (seq->changed);
+    if (seq->lock != NULL)
+        SDL_DestroyMutex (seq->lock);
+    free (seq->slots);
+sequence_open_failure_2:
+    SDL_DestroyTexture (seq->texture);
+sequence_open_failure_1:
+    filelist_free (&seq->frames);
+sequence_open_failure_0:
+    memset (seq, 0, sizeof (sequence));
+    return EXIT_FAILURE;
+}
+
+
+/* stop the pipeline and print the playback statistics.  the texture is
+   owned by whoever displays it (g_img) and is left alone */
+void
+sequence_close (sequence *seq)
+{
+    Uint64 elapsed;
+    int i;
+
+    if (!seq->active)
+        return;
+
+    SDL_LockMutex (seq->lock);
+    seq->quit = true;
+    SDL_CondBroadcast (seq->changed);
+    SDL_UnlockMutex (seq->lock);
+    SDL_WaitThread (seq->reader, NULL);
+
+    /* queued decodes are dropped, running ones finish first */
+    workers_destroy (seq->pool);
+
+    elapsed = SDL_GetPerformanceCounter () - seq->opened;
+    if (elapsed > 0)
+    {
+        printf ("sequence: %ld frames shown, %ld dropped, %.2f fps (target %.2f)\n",
+                seq->shown, seq->dropped,
+                (double)seq->shown * (double)SDL_GetPerformanceFrequency () / (double)elapsed,
+                seq->fps);
+    }
+
+    for (i = 0; i < seq->slot_count; i++)
+    {
+        SDL_free (seq->slots[i].data);
+        if (seq->slots[i].surface != NULL)
+            SDL_FreeSurface (seq->slots[i].surface);
+    }
+    free (seq->slots);
+    SDL_DestroyCond (seq->changed);
+    SDL_DestroyMutex (seq->lock);
+    filelist_free (&seq->frames);
+    memset (seq, 0, sizeof (sequence));
+}
+
+
+/* stage three, upload the frame that is due.  when the pipeline falls
+   behind, the newest due frame that is ready wins and the ones before
+   it are dropped.  returns true when the texture changed */
+bool
+sequence_update (sequence *seq)
+{
+    Uint64 now, freq;
+    seq_slot *slot;
+    long target, last, best, t;
+
+    if (!seq->active || seq->paused)
+        return false;
+
+    now = SDL_GetPerformanceCounter ();
+    freq = SDL_GetPerformanceFrequency ();
+    if (now < seq->start + (Uint64)((double)seq->show_tick * (double)freq / seq->fps))
+        return false;
+    target = (long)((double)(now - seq->start) * seq->fps / (double)freq);
+
+    SDL_LockMutex (seq->lock);
+    seq->due_tick = target;
+sequence_update_retry_0:
+    last = target;
+    if (last > seq->show_tick + seq->slot_count - 1)
+        last = seq->show_tick + seq->slot_count - 1;
+
+    best = -1;
+    for (t = last; t >= seq->show_tick; t--)
+    {
+        slot = &seq->slots[t % seq->slot_count];
+        if ((slot->tick == t) && (slot->state == SEQ_SLOT_READY))
+        {
+            best = t;
+            break;
+        }
+    }
+
+    if (best < 0)
+    {
+        /* a frame that will never come is skipped straight away */
+        slot = &seq->slots[seq->show_tick % seq->slot_count];
+        if ((slot->tick == seq->show_tick) &&
+            ((slot->state == SEQ_SLOT_FAILED) || (slot->state == SEQ_SLOT_SKIPPED)))
+        {
+            sequence_release (slot);
+            seq->show_tick++;
+            seq->dropped++;
+            SDL_CondBroadcast (seq->changed);
+            if (seq->show_tick <= target)
+                goto sequence_update_retry_0;
+            SDL_UnlockMutex (seq->lock);
+            return false;
+        }
+
+        /* nothing due is ready, the workers send g_seq_event when one is */
+        SDL_AtomicSet (&seq->starved, 1);
+        SDL_UnlockMutex (seq->lock);
+        return false;
+    }
+
+    for (t = seq->show_tick; t < best; t++)
+    {
+        sequence_release (&seq->slots[t % seq->slot_count]);
+        seq->dropped++;
+    }
+    slot = &seq->slots[best % seq->slot_count];
+    SDL_UnlockMutex (seq->lock);
+
+    /* a ready slot is only ever touched by this thread */
+    SDL_UpdateTexture (seq->texture, NULL, slot->surface->pixels, slot->surface->pitch);
+
+    SDL_LockMutex (seq->lock);
+    sequence_release (slot);
+    SDL_CondBroadcast (seq->changed);
+    SDL_UnlockMutex (seq->lock);
+
+    seq->show_tick = best + 1;
+    seq->shown++;
+    sequence_report (seq, now);
+
+    return true;
+}
+
+
+/* milliseconds the main loop may sleep before the next frame is due,
+   -1 to wait on events alone */
+int
+sequence_timeout (sequence *seq)
+{
+    Uint64 now, due, freq;
+
+    if (!seq->active || seq->paused || (SDL_AtomicGet (&seq->starved) != 0))
+        return -1;
+
+    now = SDL_GetPerformanceCounter ();
+    freq = SDL_GetPerformanceFrequency ();
+    due = seq->start + (Uint64)((double)seq->show_tick * (double)freq / seq->fps);
+    if (now >= due)
+        return 0;
+
+    /* round up, waking early would only spin */
+    return (int)(((due - now) * 1000 + freq - 1) / freq);
+}
+
+
+void
+sequence_toggle_pause (sequence *seq)
+{
+    Uint64 now;
+
+    if (!seq->active)
+        return;
+
+    seq->paused = !seq->paused;
+    if (!seq->paused)
+    {
+        /* pick the clock up where the sequence was left */
+        now = SDL_GetPerformanceCounter ();
+        seq->start = now - (Uint64)((double)seq->show_tick * (double)SDL_GetPerformanceFrequency () / seq->fps);
+        seq->report_time = now;
+        seq->report_shown = seq->shown;
+    }
+}
+
+
+/* End of File */
@@ -0,0 +1,114 @@
+/*
+   source/ljpeg_sequence.h
+   LJPEG numbered image sequence playback header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_SEQUENCE_HEADER__
+#define __LJPEG_SEQUENCE_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+typedef enum seq_slot_state
+{
+    SEQ_SLOT_FREE,
+    SEQ_SLOT_READING,   /* the reader thread is loading the file */
+    SEQ_SLOT_DECODING,  /* queued on or running in the worker pool */
+    SEQ_SLOT_READY,     /* decoded, waiting for its turn on screen */
+    SEQ_SLOT_FAILED,
+    SEQ_SLOT_SKIPPED,   /* already late when its turn to be read came */
+    SEQ_SLOT_DROPPED    /* given up on, whoever holds it frees it */
+} seq_slot_state;
+
+/* frame tick t always lives in slots[t % slot_count] */
+typedef struct seq_slot
+{
+    struct sequence *seq;
+    long             tick;
+    seq_slot_state   state;
+    void            *data;
+    size_t           data_len;
+    SDL_Surface     *surface;
+} seq_slot;
+
+typedef struct sequence
+{
+    bool          active;
+    filelist      frames;       /* the numbered files in playback order */
+    int           first;        /* frames index of tick 0 */
+    double        fps;
+    int           w, h;
+
+    /* read -> decode -> upload pipeline */
+    seq_slot     *slots;
+    int           slot_count;
+    long          read_tick;
+    long          show_tick;
+    long          due_tick;     /* newest tick whose time has come */
+    bool          quit;
+    SDL_mutex    *lock;
+    SDL_cond     *changed;
+    SDL_Thread   *reader;
+    worker_pool  *pool;
+    SDL_atomic_t  starved;
+
+    /* presentation */
+    SDL_Texture  *texture;
+    Uint64        start;        /* performance counter at tick 0 */
+    bool          paused;
+
+    /* statistics */
+    long          shown;
+    long          dropped;
+    Uint64        opened;
+    Uint64        report_time;
+    long          report_shown;
+} sequence;
+
+
+/* constants */
+
+
+/* global variables */
+extern sequence g_seq;
+extern Uint32   g_seq_event;
+
+
+/* external function prototypes */
+int  sequence_open  (sequence *seq, const char *path, double fps);
+void sequence_close (sequence *seq);
+
+bool sequence_update  (sequence *seq);
+int  sequence_timeout (sequence *seq);
+void sequence_toggle_pause (sequence *seq);
+
+#endif /* end run once */
+
+
+/* End of File */
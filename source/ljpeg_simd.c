@@ -0,0 +1,1979 @@
+/*
+   source/ljpeg_simd.c
+   LJPEG vector kernels source code.
+
+   The inner loops of the built-in decoders, each written once plainly
+   and again for SSE2, AVX2 and NEON.  The vector versions are only
+   compiled where the target has them and only used once the cpu is
+   known to, so one binary runs everywhere.  With gcc and clang the
+   AVX2 functions are built for AVX2 on their own, the rest of the
+   program keeps the baseline instruction set.
+
+   The idct is the floating point AAN one libjpeg ships as JDCT_FLOAT,
+   run over all eight columns (then rows) of a block at once.  The
+   image difference the compare mode draws and measures lives here too,
+   as do the luma and clipping the histogram overlay counts, the tone
+   mapping of 16-bit and HDR images and the png row filters.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_simd.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_ARM
+#include <arm_neon.h>
+#endif
+
+#include "ljpeg_config.h"
+
+
+/* global variable declarations */
+simd_kernels g_simd;
+
+
+/* file static variables */
+/* gcc and clang only let a function use instructions past the baseline
+   when it is marked for them */
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(isa) __attribute__ ((target (isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+/* one pass of the AAN idct over v[0..7], on whatever V is: a float for
+   one column, or a vector of columns */
+#define SIMD_IDCT_1D(V, ADD, SUB, MUL, K, v)                                    \
+    do                                                                          \
+    {                                                                           \
+        V t0, t1, t2, t3, t4, t5, t6, t7, t10, t11, t12, t13;                   \
+        V z5, z10, z11, z12, z13;                                               \
+                                                                                \
+        /* even part */                                                         \
+        t10 = ADD (v[0], v[4]);                                                 \
+        t11 = SUB (v[0], v[4]);                                                 \
+        t13 = ADD (v[2], v[6]);                                                 \
+        t12 = SUB (MUL (SUB (v[2], v[6]), K (1.414213562f)), t13);              \
+        t0 = ADD (t10, t13);                                                    \
+        t3 = SUB (t10, t13);                                                    \
+        t1 = ADD (t11, t12);                                                    \
+        t2 = SUB (t11, t12);                                                    \
+                                                                                \
+        /* odd part */                                                          \
+        z13 = ADD (v[5], v[3]);                                                 \
+        z10 = SUB (v[5], v[3]);                                                 \
+        z11 = ADD (v[1], v[7]);                                                 \
+        z12 = SUB (v[1], v[7]);                                                 \
+        t7 = ADD (z11, z13);                                                    \
+        t11 = MUL (SUB (z11, z13), K (1.414213562f));                           \
+        z5 = MUL (ADD (z10, z12), K (1.847759065f));                            \
+        t10 = SUB (MUL (z12, K (1.082392200f)), z5);                            \
+        t12 = ADD (MUL (z10, K (-2.613125930f)), z5);                           \
+        t6 = SUB (t12, t7);                                                     \
+        t5 = SUB (t11, t6);                                                     \
+        t4 = ADD (t10, t5);                                                     \
+                                                                                \
+        v[0] = ADD (t0, t7);                                                    \
+        v[7] = SUB (t0, t7);                                                    \
+        v[1] = ADD (t1, t6);                                                    \
+        v[6] = SUB (t1, t6);                                                    \
+        v[2] = ADD (t2, t5);                                                    \
+        v[5] = SUB (t2, t5);                                                    \
+        v[4] = ADD (t3, t4);                                                    \
+        v[3] = SUB (t3, t4);                                                    \
+    } while (0)
+
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_SUB(a, b) ((a) - (b))
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_K(x)      (x)
+
+/* jfif ycbcr to rgb */
+#define YCC_CR_R  1.402f
+#define YCC_CB_G  0.344136f
+#define YCC_CR_G  0.714136f
+#define YCC_CB_B  1.772f
+
+
+/* half floats are widened by moving their exponent and mantissa into
+   place and multiplying by 2^(127 - 15), which gets denormals right too */
+#define SIMD_HALF_SCALE 0x1p112f
+
+/* lut3d table levels back to bytes, rounded */
+#define SIMD_LUT3D_SCALE ((SIMD_LUT3D_MAX - SIMD_LUT3D_MIN) * 255.0f / 1023.0f)
+#define SIMD_LUT3D_BIAS  (SIMD_LUT3D_MIN * 255.0f + 0.5f)
+
+#define SIMD_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define SIMD_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+
+/* file static function prototypes */
+static uint8_t simd_clamp (float value);
+static float   simd_half (uint16_t h);
+static void    idct_8x8_scalar (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride);
+static void    upsample_h2v1_span (const uint8_t *in, uint8_t *out, int in_w, int x0, int x1);
+static void    upsample_h2v1_scalar (const uint8_t *in, uint8_t *out, int in_w);
+static void    upsample_h2v2_span (const uint8_t *near, const uint8_t *far, uint8_t *out,
+                                   int in_w, int x0, int x1);
+static void    upsample_h2v2_scalar (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w);
+static void    ycc_to_rgba_scalar (const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                                   uint8_t *rgba, int w);
+static uint64_t diff_rgba_scalar (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w);
+static void    luma_rgba_scalar (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped);
+static void    tonemap_rgba_scalar (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm);
+static void    unfilter_span (uint8_t *row, const uint8_t *prev, int x0, int len, int bpp, int filter);
+static void    unfilter_row_scalar (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter);
+static void    rgb_to_rgba_scalar (const uint8_t *rgb, uint8_t *rgba, int w);
+static void    lut3d_rgba_scalar (uint8_t *rgba, int w, const simd_lut3d *lut);
+#ifdef SIMD_X86
+static void    idct_8x8_sse2 (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride);
+static void    upsample_h2v1_sse2 (const uint8_t *in, uint8_t *out, int in_w);
+static void    upsample_h2v2_sse2 (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w);
+static void    ycc_to_rgba_sse2 (const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                                 uint8_t *rgba, int w);
+static uint64_t diff_rgba_sse2 (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w);
+static void    luma_rgba_sse2 (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped);
+static void    tonemap_rgba_sse2 (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm);
+static void    unfilter_row_sse2 (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter);
+static void    lut3d_rgba_sse2 (uint8_t *rgba, int w, const simd_lut3d *lut);
+static void    idct_8x8_avx2 (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride);
+static void    ycc_to_rgba_avx2 (const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                                 uint8_t *rgba, int w);
+static uint64_t diff_rgba_avx2 (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w);
+static void    luma_rgba_avx2 (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped);
+static void    tonemap_rgba_avx2 (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm);
+static void    rgb_to_rgba_avx2 (const uint8_t *rgb, uint8_t *rgba, int w);
+static void    lut3d_rgba_avx2 (uint8_t *rgba, int w, const simd_lut3d *lut);
+#endif
+#ifdef SIMD_ARM
+static void    idct_8x8_neon (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride);
+static void    upsample_h2v1_neon (const uint8_t *in, uint8_t *out, int in_w);
+static void    upsample_h2v2_neon (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w);
+static void    ycc_to_rgba_neon (const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                                 uint8_t *rgba, int w);
+static uint64_t diff_rgba_neon (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w);
+static void    luma_rgba_neon (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped);
+static void    tonemap_rgba_neon (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm);
+static void    unfilter_row_neon (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter);
+static void    rgb_to_rgba_neon (const uint8_t *rgb, uint8_t *rgba, int w);
+static void    lut3d_rgba_neon (uint8_t *rgba, int w, const simd_lut3d *lut);
+#endif
+static bool    simd_supported (simd_level level);
+
+
+/* static function definitions */
+/* rounded to nearest even, like the vector conversions.  adding and
+   taking away 1.5 * 2^23 leaves no fraction bits, which is the same
+   rounding as lrintf without the library call */
+static uint8_t
+simd_clamp (float value)
+{
+    if (value <= 0.0f)
+        return 0;
+    if (value >= 255.0f)
+        return 255;
+
+    return (uint8_t)((value + 12582912.0f) - 12582912.0f);
+}
+
+
+/* the sign is left to the caller */
+static float
+simd_half (uint16_t h)
+{
+    union { uint32_t u; float f; } v;
+
+    v.u = (uint32_t)(h & 0x7FFF) << 13;
+    v.f *= SIMD_HALF_SCALE;
+
+    return v.f;
+}
+
+
+static void
+idct_8x8_scalar (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride)
+{
+    float ws[64];
+    float v[8];
+    int r, c, k;
+
+    for (c = 0; c < 8; c++)
+    {
+        for (k = 0; k < 8; k++)
+        {
+            v[k] = (float)coef[k * 8 + c] * qt[k * 8 + c];
+        }
+        SIMD_IDCT_1D (float, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_K, v);
+        for (k = 0; k < 8; k++)
+        {
+            ws[k * 8 + c] = v[k];
+        }
+    }
+
+    for (r = 0; r < 8; r++)
+    {
+        memcpy (v, ws + r * 8, sizeof (v));
+        SIMD_IDCT_1D (float, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_K, v);
+        for (k = 0; k < 8; k++)
+        {
+            out[r * stride + k] = simd_clamp (v[k] + 128.0f);
+        }
+    }
+}
+
+
+/* output columns 2 * x0 up to 2 * x1, the edges repeat the first and
+   last samples */
+static void
+upsample_h2v1_span (const uint8_t *in, uint8_t *out, int in_w, int x0, int x1)
+{
+    int prev, next;
+    int x;
+
+    for (x = x0; x < x1; x++)
+    {
+        prev = (x > 0) ? in[x - 1] : -1;
+        next = (x + 1 < in_w) ? in[x + 1] : -1;
+        out[x * 2 + 0] = (prev < 0) ? in[x] : (uint8_t)((in[x] * 3 + prev + 1) >> 2);
+        out[x * 2 + 1] = (next < 0) ? in[x] : (uint8_t)((in[x] * 3 + next + 2) >> 2);
+    }
+}
+
+
+static void
+upsample_h2v1_scalar (const uint8_t *in, uint8_t *out, int in_w)
+{
+    upsample_h2v1_span (in, out, in_w, 0, in_w);
+}
+
+
+static void
+upsample_h2v2_span (const uint8_t *near, const uint8_t *far, uint8_t *out,
+                    int in_w, int x0, int x1)
+{
+    int sum, prev, next;
+    int x;
+
+    for (x = x0; x < x1; x++)
+    {
+        sum = near[x] * 3 + far[x];
+        prev = (x > 0) ? near[x - 1] * 3 + far[x - 1] : sum;
+        next = (x + 1 < in_w) ? near[x + 1] * 3 + far[x + 1] : sum;
+        out[x * 2 + 0] = (uint8_t)((sum * 3 + prev + 8) >> 4);
+        out[x * 2 + 1] = (uint8_t)((sum * 3 + next + 7) >> 4);
+    }
+}
+
+
+static void
+upsample_h2v2_scalar (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w)
+{
+    upsample_h2v2_span (near, far, out, in_w, 0, in_w);
+}
+
+
+static void
+ycc_to_rgba_scalar (const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgba, int w)
+{
+    float yf, cbf, crf;
+    int x;
+
+    for (x = 0; x < w; x++)
+    {
+        yf = (float)y[x];
+        cbf = (float)cb[x] - 128.0f;
+        crf = (float)cr[x] - 128.0f;
+        rgba[x * 4 + 0] = simd_clamp (yf + crf * YCC_CR_R);
+        rgba[x * 4 + 1] = simd_clamp (yf - cbf * YCC_CB_G - crf * YCC_CR_G);
+        rgba[x * 4 + 2] = simd_clamp (yf + cbf * YCC_CB_B);
+        rgba[x * 4 + 3] = 0xFF;
+    }
+}
+
+
+static uint64_t
+diff_rgba_scalar (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w)
+{
+    uint64_t sse = 0;
+    int d, m;
+    int x, c;
+
+    for (x = 0; x < w; x++)
+    {
+        m = 0;
+        for (c = 0; c < 3; c++)
+        {
+            d = abs ((int)a[x * 4 + c] - (int)b[x * 4 + c]);
+            sse += (uint64_t)(d * d);
+            m = (d > m) ? d : m;
+        }
+        mag[x] = (uint8_t)m;
+    }
+
+    return sse;
+}
+
+
+/* the luma weights add up to 256 */
+static void
+luma_rgba_scalar (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped)
+{
+    const uint8_t *p;
+    int x;
+
+    for (x = 0; x < w; x++)
+    {
+        p = rgba + x * 4;
+        luma[x] = (uint8_t)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        clipped[0] += ((p[0] == 0) || (p[1] == 0) || (p[2] == 0));
+        clipped[1] += ((p[0] == 0xFF) || (p[1] == 0xFF) || (p[2] == 0xFF));
+    }
+}
+
+
+static void
+tonemap_rgba_scalar (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm)
+{
+    float v;
+    int i;
+
+    for (i = 0; i < w * 4; i++)
+    {
+        v = ((half[i] & 0x8000) != 0) ? 0.0f : simd_half (half[i]);
+        if ((i & 3) != 3)
+        {
+            v *= tm->gain;
+            if (tm->curve)
+                v = v * (1.0f + v * tm->k) / (1.0f + v);
+        }
+        v = (v < 0.0f) ? 0.0f : (v > 1.0f) ? 1.0f : v;
+
+        if ((i & 3) == 3)
+            rgba[i] = (uint8_t)(int32_t)(v * 255.0f + 0.5f);
+        else
+            rgba[i] = tm->lut[(int32_t)(v * (SIMD_TONEMAP_LUT - 1) + 0.5f)];
+    }
+}
+
+
+/* bytes x0 up to len of unfilter_row, the ones before x0 are done */
+static void
+unfilter_span (uint8_t *row, const uint8_t *prev, int x0, int len, int bpp, int filter)
+{
+    int a, b, c;
+    int pa, pb, pc;
+    int i;
+
+    switch (filter)
+    {
+    case 1:
+        for (i = SDL_max (x0, bpp); i < len; i++)
+        {
+            row[i] = (uint8_t)(row[i] + row[i - bpp]);
+        }
+        break;
+
+    case 2:
+        for (i = x0; i < len; i++)
+        {
+            row[i] = (uint8_t)(row[i] + prev[i]);
+        }
+        break;
+
+    case 3:
+        for (i = x0; (i < bpp) && (i < len); i++)
+        {
+            row[i] = (uint8_t)(row[i] + (prev[i] >> 1));
+        }
+        for (; i < len; i++)
+        {
+            row[i] = (uint8_t)(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+        }
+        break;
+
+    case 4:
+        /* nothing to the left, paeth picks the byte above */
+        for (i = x0; (i < bpp) && (i < len); i++)
+        {
+            row[i] = (uint8_t)(row[i] + prev[i]);
+        }
+        for (; i < len; i++)
+        {
+            a = row[i - bpp];
+            b = prev[i];
+            c = prev[i - bpp];
+            pa = abs (b - c);
+            pb = abs (a - c);
+            pc = abs (a + b - c - c);
+            row[i] = (uint8_t)(row[i] + (((pa <= pb) && (pa <= pc)) ? a : (pb <= pc) ? b : c));
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static void
+unfilter_row_scalar (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter)
+{
+    unfilter_span (row, prev, 0, len, bpp, filter);
+}
+
+
+static void
+rgb_to_rgba_scalar (const uint8_t *rgb, uint8_t *rgba, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+    {
+        rgba[x * 4 + 0] = rgb[x * 3 + 0];
+        rgba[x * 4 + 1] = rgb[x * 3 + 1];
+        rgba[x * 4 + 2] = rgb[x * 3 + 2];
+        rgba[x * 4 + 3] = 0xFF;
+    }
+}
+
+
+/* the three fractions sorted give the tetrahedron: from the cell's
+   corner along the channel furthest in (near), then the next, then to
+   the far corner, the step left out (skip) being the channel least in.
+   every kernel does the same float math in the same order, so they all
+   come out alike */
+static void
+lut3d_rgba_scalar (uint8_t *rgba, int w, const simd_lut3d *lut)
+{
+    const int n = lut->n;
+    const int stride[3] = { n * n, n, 1 };
+    const int far = n * n + n + 1;
+    const float step = (float)(n - 1) / 255.0f;
+    const float top = (float)(n - 2);
+    float f[3], t, hi, mid, lo, v;
+    uint32_t c[4];
+    int x, i, k, base, near, skip;
+
+    for (x = 0; x < w; x++)
+    {
+        base = 0;
+        for (i = 0; i < 3; i++)
+        {
+            t = (float)rgba[x * 4 + i] * step;
+            k = (int)((t < top) ? t : top);
+            f[i] = t - (float)k;
+            base += k * stride[i];
+        }
+
+        hi = SIMD_MAX (f[0], SIMD_MAX (f[1], f[2]));
+        lo = SIMD_MIN (f[0], SIMD_MIN (f[1], f[2]));
+        mid = SIMD_MAX (SIMD_MIN (f[0], f[1]), SIMD_MIN (SIMD_MAX (f[0], f[1]), f[2]));
+        near = ((f[0] >= f[1]) && (f[0] >= f[2])) ? stride[0] : (f[1] >= f[2]) ? stride[1] : stride[2];
+        skip = ((f[0] < f[1]) && (f[0] < f[2])) ? stride[0] : (f[1] < f[2]) ? stride[1] : stride[2];
+
+        c[0] = lut->table[base];
+        c[1] = lut->table[base + near];
+        c[2] = lut->table[base + far - skip];
+        c[3] = lut->table[base + far];
+        for (i = 0; i < 3; i++)
+        {
+            v = (float)((c[0] >> (i * 10)) & 0x3FF) * (1.0f - hi)
+              + (float)((c[1] >> (i * 10)) & 0x3FF) * (hi - mid);
+            v = v + (float)((c[2] >> (i * 10)) & 0x3FF) * (mid - lo);
+            v = v + (float)((c[3] >> (i * 10)) & 0x3FF) * lo;
+            v = v * SIMD_LUT3D_SCALE + SIMD_LUT3D_BIAS;
+            rgba[x * 4 + i] = (uint8_t)(int32_t)SIMD_MIN (SIMD_MAX (v, 0.0f), 255.0f);
+        }
+    }
+}
+
+
+#ifdef SIMD_X86
+/* the block is held as eight rows of two four column halves */
+SIMD_TARGET ("sse2")
+static void
+idct_8x8_sse2 (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride)
+{
+    __m128 lo[8], hi[8];
+    __m128 swap;
+    __m128i c;
+    __m128i packed;
+    const __m128 bias = _mm_set1_ps (128.0f);
+    int k;
+
+    for (k = 0; k < 8; k++)
+    {
+        c = _mm_loadu_si128 ((const __m128i *)(coef + k * 8));
+        lo[k] = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (c, c), 16)),
+                            _mm_loadu_ps (qt + k * 8));
+        hi[k] = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (c, c), 16)),
+                            _mm_loadu_ps (qt + k * 8 + 4));
+    }
+
+    /* columns, transpose, rows, transpose back */
+    for (k = 0; k < 2; k++)
+    {
+        SIMD_IDCT_1D (__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, lo);
+        SIMD_IDCT_1D (__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, hi);
+
+        _MM_TRANSPOSE4_PS (lo[0], lo[1], lo[2], lo[3]);
+        _MM_TRANSPOSE4_PS (hi[0], hi[1], hi[2], hi[3]);
+        _MM_TRANSPOSE4_PS (lo[4], lo[5], lo[6], lo[7]);
+        _MM_TRANSPOSE4_PS (hi[4], hi[5], hi[6], hi[7]);
+        swap = hi[0]; hi[0] = lo[4]; lo[4] = swap;
+        swap = hi[1]; hi[1] = lo[5]; lo[5] = swap;
+        swap = hi[2]; hi[2] = lo[6]; lo[6] = swap;
+        swap = hi[3]; hi[3] = lo[7]; lo[7] = swap;
+    }
+
+    for (k = 0; k < 8; k++)
+    {
+        packed = _mm_packs_epi32 (_mm_cvtps_epi32 (_mm_add_ps (lo[k], bias)),
+                                  _mm_cvtps_epi32 (_mm_add_ps (hi[k], bias)));
+        _mm_storel_epi64 ((__m128i *)(out + k * stride), _mm_packus_epi16 (packed, packed));
+    }
+}
+
+
+SIMD_TARGET ("sse2")
+static void
+upsample_h2v1_sse2 (const uint8_t *in, uint8_t *out, int in_w)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i one = _mm_set1_epi16 (1);
+    const __m128i two = _mm_set1_epi16 (2);
+    __m128i cur, prev, next, cur3, even, odd;
+    int x;
+
+    upsample_h2v1_span (in, out, in_w, 0, 1);
+    for (x = 1; x + 8 < in_w; x += 8)
+    {
+        cur = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(in + x)), zero);
+        prev = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(in + x - 1)), zero);
+        next = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(in + x + 1)), zero);
+        cur3 = _mm_add_epi16 (cur, _mm_add_epi16 (cur, cur));
+
+        even = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (cur3, prev), one), 2);
+        odd = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (cur3, next), two), 2);
+        even = _mm_packus_epi16 (even, even);
+        odd = _mm_packus_epi16 (odd, odd);
+        _mm_storeu_si128 ((__m128i *)(out + x * 2), _mm_unpacklo_epi8 (even, odd));
+    }
+    upsample_h2v1_span (in, out, in_w, (x < in_w) ? x : in_w, in_w);
+}
+
+
+SIMD_TARGET ("sse2")
+static void
+upsample_h2v2_sse2 (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i seven = _mm_set1_epi16 (7);
+    const __m128i eight = _mm_set1_epi16 (8);
+    __m128i sum, prev, next, sum3, even, odd, n, f;
+    int x;
+
+/* 3 * near + far for the 8 columns from at */
+#define COLSUM(at)                                                              \
+    (n = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(near + (at))), zero), \
+     f = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(far + (at))), zero),  \
+     _mm_add_epi16 (_mm_add_epi16 (n, _mm_add_epi16 (n, n)), f))
+
+    upsample_h2v2_span (near, far, out, in_w, 0, 1);
+    for (x = 1; x + 8 < in_w; x += 8)
+    {
+        sum = COLSUM (x);
+        prev = COLSUM (x - 1);
+        next = COLSUM (x + 1);
+        sum3 = _mm_add_epi16 (sum, _mm_add_epi16 (sum, sum));
+
+        even = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (sum3, prev), eight), 4);
+        odd = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (sum3, next), seven), 4);
+        even = _mm_packus_epi16 (even, even);
+        odd = _mm_packus_epi16 (odd, odd);
+        _mm_storeu_si128 ((__m128i *)(out + x * 2), _mm_unpacklo_epi8 (even, odd));
+    }
+    upsample_h2v2_span (near, far, out, in_w, (x < in_w) ? x : in_w, in_w);
+
+#undef COLSUM
+}
+
+
+SIMD_TARGET ("sse2")
+static void
+ycc_to_rgba_sse2 (const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgba, int w)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i offset = _mm_set1_epi16 (128);
+    const __m128i alpha = _mm_set1_epi8 ((char)0xFF);
+    const __m128 cr_r = _mm_set1_ps (YCC_CR_R);
+    const __m128 cb_g = _mm_set1_ps (YCC_CB_G);
+    const __m128 cr_g = _mm_set1_ps (YCC_CR_G);
+    const __m128 cb_b = _mm_set1_ps (YCC_CB_B);
+    __m128i y16, cb16, cr16;
+    __m128i r16, g16, b16;
+    __m128i rg, ba;
+    __m128 yf[2], cbf[2], crf[2];
+    int x, h;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        y16 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(y + x)), zero);
+        cb16 = _mm_sub_epi16 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(cb + x)), zero), offset);
+        cr16 = _mm_sub_epi16 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)(cr + x)), zero), offset);
+
+        yf[0] = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (y16, zero));
+        yf[1] = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (y16, zero));
+        cbf[0] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (cb16, cb16), 16));
+        cbf[1] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (cb16, cb16), 16));
+        crf[0] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (cr16, cr16), 16));
+        crf[1] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (cr16, cr16), 16));
+
+        r16 = g16 = b16 = zero;
+        for (h = 0; h < 2; h++)
+        {
+            __m128i r = _mm_cvtps_epi32 (_mm_add_ps (yf[h], _mm_mul_ps (crf[h], cr_r)));
+            __m128i g = _mm_cvtps_epi32 (_mm_sub_ps (_mm_sub_ps (yf[h], _mm_mul_ps (cbf[h], cb_g)),
+                                                     _mm_mul_ps (crf[h], cr_g)));
+            __m128i b = _mm_cvtps_epi32 (_mm_add_ps (yf[h], _mm_mul_ps (cbf[h], cb_b)));
+
+            if (h == 0)
+            {
+                r16 = r;
+                g16 = g;
+                b16 = b;
+            }
+            else
+            {
+                r16 = _mm_packs_epi32 (r16, r);
+                g16 = _mm_packs_epi32 (g16, g);
+                b16 = _mm_packs_epi32 (b16, b);
+            }
+        }
+
+        /* saturate to bytes and interleave r g b a */
+        rg = _mm_unpacklo_epi8 (_mm_packus_epi16 (r16, r16), _mm_packus_epi16 (g16, g16));
+        ba = _mm_unpacklo_epi8 (_mm_packus_epi16 (b16, b16), alpha);
+        _mm_storeu_si128 ((__m128i *)(rgba + x * 4), _mm_unpacklo_epi16 (rg, ba));
+        _mm_storeu_si128 ((__m128i *)(rgba + x * 4 + 16), _mm_unpackhi_epi16 (rg, ba));
+    }
+    ycc_to_rgba_scalar (y + x, cb + x, cr + x, rgba + x * 4, w - x);
+}
+
+
+/* sixteen pixels a pass, four to a register.  the squares are summed
+   in 32 bits for a pass and in 64 bits across them */
+SIMD_TARGET ("sse2")
+static uint64_t
+diff_rgba_sse2 (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i rgb = _mm_set1_epi32 (0x00FFFFFF);
+    const __m128i low = _mm_set1_epi32 (0xFF);
+    __m128i sum = zero;
+    __m128i va, vb, d, lo, hi, sq;
+    __m128i m[4];
+    uint64_t lanes[2];
+    int x, i;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        sq = zero;
+        for (i = 0; i < 4; i++)
+        {
+            va = _mm_loadu_si128 ((const __m128i *)(a + (x + i * 4) * 4));
+            vb = _mm_loadu_si128 ((const __m128i *)(b + (x + i * 4) * 4));
+            d = _mm_and_si128 (_mm_or_si128 (_mm_subs_epu8 (va, vb), _mm_subs_epu8 (vb, va)), rgb);
+
+            lo = _mm_unpacklo_epi8 (d, zero);
+            hi = _mm_unpackhi_epi8 (d, zero);
+            sq = _mm_add_epi32 (sq, _mm_add_epi32 (_mm_madd_epi16 (lo, lo), _mm_madd_epi16 (hi, hi)));
+
+            /* the largest of r g b, in each pixel's low byte */
+            m[i] = _mm_max_epu8 (d, _mm_max_epu8 (_mm_srli_epi32 (d, 8), _mm_srli_epi32 (d, 16)));
+            m[i] = _mm_and_si128 (m[i], low);
+        }
+        sum = _mm_add_epi64 (sum, _mm_unpacklo_epi32 (sq, zero));
+        sum = _mm_add_epi64 (sum, _mm_unpackhi_epi32 (sq, zero));
+        _mm_storeu_si128 ((__m128i *)(mag + x),
+                          _mm_packus_epi16 (_mm_packs_epi32 (m[0], m[1]), _mm_packs_epi32 (m[2], m[3])));
+    }
+    _mm_storeu_si128 ((__m128i *)lanes, sum);
+
+    return lanes[0] + lanes[1] + diff_rgba_scalar (a + x * 4, b + x * 4, mag + x, w - x);
+}
+
+
+/* sixteen pixels a pass, the channels pulled out into 16 bit lanes for
+   the weighted sum (which tops out at 65408, so it stays unsigned).  a
+   pixel is clipped when any of its r g b bytes compare equal */
+SIMD_TARGET ("sse2")
+static void
+luma_rgba_sse2 (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i full = _mm_set1_epi8 ((char)0xFF);
+    const __m128i rgb = _mm_set1_epi32 (0x00FFFFFF);
+    const __m128i low = _mm_set1_epi32 (0xFF);
+    const __m128i one = _mm_set1_epi32 (1);
+    const __m128i kr = _mm_set1_epi16 (77);
+    const __m128i kg = _mm_set1_epi16 (150);
+    const __m128i kb = _mm_set1_epi16 (29);
+    const __m128i half = _mm_set1_epi16 (128);
+    __m128i dark = zero, bright = zero;
+    __m128i p[4], y[2];
+    __m128i r, g, b, t;
+    uint32_t lanes[4];
+    int x, i;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            p[i] = _mm_loadu_si128 ((const __m128i *)(rgba + (x + i * 4) * 4));
+
+            t = _mm_and_si128 (_mm_cmpeq_epi8 (p[i], zero), rgb);
+            dark = _mm_add_epi32 (dark, _mm_andnot_si128 (_mm_cmpeq_epi32 (t, zero), one));
+            t = _mm_and_si128 (_mm_cmpeq_epi8 (p[i], full), rgb);
+            bright = _mm_add_epi32 (bright, _mm_andnot_si128 (_mm_cmpeq_epi32 (t, zero), one));
+        }
+        for (i = 0; i < 2; i++)
+        {
+            r = _mm_packs_epi32 (_mm_and_si128 (p[i * 2], low),
+                                 _mm_and_si128 (p[i * 2 + 1], low));
+            g = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p[i * 2], 8), low),
+                                 _mm_and_si128 (_mm_srli_epi32 (p[i * 2 + 1], 8), low));
+            b = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p[i * 2], 16), low),
+                                 _mm_and_si128 (_mm_srli_epi32 (p[i * 2 + 1], 16), low));
+            y[i] = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (r, kr), _mm_mullo_epi16 (g, kg)),
+                                  _mm_add_epi16 (_mm_mullo_epi16 (b, kb), half));
+            y[i] = _mm_srli_epi16 (y[i], 8);
+        }
+        _mm_storeu_si128 ((__m128i *)(luma + x), _mm_packus_epi16 (y[0], y[1]));
+    }
+
+    _mm_storeu_si128 ((__m128i *)lanes, dark);
+    clipped[0] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128 ((__m128i *)lanes, bright);
+    clipped[1] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    luma_rgba_scalar (rgba + x * 4, luma + x, w - x, clipped);
+}
+
+
+/* a pixel to a register, the alpha lane skipping the gain and the
+   curve.  sse2 has no gather, the lut is read a byte at a time */
+SIMD_TARGET ("sse2")
+static void
+tonemap_rgba_sse2 (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i magnitude = _mm_set1_epi32 (0x7FFF);
+    const __m128i sign = _mm_set1_epi32 (0x8000);
+    const __m128 scale = _mm_set1_ps (SIMD_HALF_SCALE);
+    const __m128 gain = _mm_setr_ps (tm->gain, tm->gain, tm->gain, 1.0f);
+    const __m128 k = _mm_set1_ps (tm->k);
+    const __m128 one = _mm_set1_ps (1.0f);
+    const __m128 color = _mm_castsi128_ps (_mm_setr_epi32 (-1, -1, -1, 0));
+    const __m128 steps = _mm_setr_ps (SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, 255.0f);
+    const __m128 round = _mm_set1_ps (0.5f);
+    __m128i h;
+    __m128 v, t;
+    int32_t idx[16];
+    int x, i;
+
+    for (x = 0; x + 4 <= w; x += 4)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            h = _mm_unpacklo_epi16 (_mm_loadl_epi64 ((const __m128i *)(half + (x + i) * 4)), zero);
+            v = _mm_mul_ps (_mm_castsi128_ps (_mm_slli_epi32 (_mm_and_si128 (h, magnitude), 13)), scale);
+            v = _mm_and_ps (v, _mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_and_si128 (h, sign), zero)));
+            v = _mm_mul_ps (v, gain);
+            if (tm->curve)
+            {
+                t = _mm_div_ps (_mm_mul_ps (v, _mm_add_ps (one, _mm_mul_ps (v, k))), _mm_add_ps (one, v));
+                v = _mm_or_ps (_mm_and_ps (color, t), _mm_andnot_ps (color, v));
+            }
+            v = _mm_min_ps (_mm_max_ps (v, _mm_setzero_ps ()), one);
+            _mm_storeu_si128 ((__m128i *)(idx + i * 4),
+                              _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (v, steps), round)));
+        }
+        for (i = 0; i < 16; i++)
+        {
+            rgba[x * 4 + i] = ((i & 3) == 3) ? (uint8_t)idx[i] : tm->lut[idx[i]];
+        }
+    }
+
+    tonemap_rgba_scalar (half + x * 4, rgba + x * 4, w - x, tm);
+}
+
+
+/* up is sixteen bytes a pass.  the rest need the finished pixel to
+   their left: sub adds it in and sums along the pixels of a register,
+   average and paeth go a pixel at a time (paeth in 16 bit lanes).  3
+   byte pixels are still read and worked on 4 bytes at a time, but only
+   3 are written, the 4th is the next pixel, still filtered.  pixels of
+   other sizes are left to unfilter_span */
+SIMD_TARGET ("sse2")
+static void
+unfilter_row_sse2 (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i one = _mm_set1_epi8 (1);
+    const __m128i three = _mm_cvtsi32_si128 (0xFFFFFF);
+    __m128i a = zero, b, c = zero;
+    __m128i d, r, pa, pb, pc, least, pick;
+    int32_t v;
+    int x = 0;
+
+    if (filter == 2)
+    {
+        for (; x + 16 <= len; x += 16)
+        {
+            _mm_storeu_si128 ((__m128i *)(row + x),
+                              _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *)(row + x)),
+                                            _mm_loadu_si128 ((const __m128i *)(prev + x))));
+        }
+    }
+    else if ((filter == 1) && (bpp == 4))
+    {
+        for (; x + 16 <= len; x += 16)
+        {
+            d = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *)(row + x)), a);
+            d = _mm_add_epi8 (d, _mm_slli_si128 (d, 4));
+            d = _mm_add_epi8 (d, _mm_slli_si128 (d, 8));
+            _mm_storeu_si128 ((__m128i *)(row + x), d);
+            a = _mm_srli_si128 (d, 12);
+        }
+    }
+    else if ((filter == 1) && (bpp == 3))
+    {
+        /* four pixels, 12 bytes, a pass */
+        for (; x + 16 <= len; x += 12)
+        {
+            d = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *)(row + x)), a);
+            d = _mm_add_epi8 (d, _mm_slli_si128 (d, 3));
+            d = _mm_add_epi8 (d, _mm_slli_si128 (d, 6));
+            _mm_storel_epi64 ((__m128i *)(row + x), d);
+            v = _mm_cvtsi128_si32 (_mm_srli_si128 (d, 8));
+            memcpy (row + x + 8, &v, 4);
+            a = _mm_and_si128 (_mm_srli_si128 (d, 9), three);
+        }
+    }
+    else if ((filter == 3) && ((bpp == 3) || (bpp == 4)))
+    {
+        /* _mm_avg_epu8 rounds up, the filter rounds down */
+        for (; x + 4 <= len; x += bpp)
+        {
+            memcpy (&v, prev + x, 4);
+            b = _mm_cvtsi32_si128 (v);
+            memcpy (&v, row + x, 4);
+            r = _mm_cvtsi32_si128 (v);
+            a = _mm_add_epi8 (r, _mm_sub_epi8 (_mm_avg_epu8 (a, b),
+                                               _mm_and_si128 (_mm_xor_si128 (a, b), one)));
+            v = _mm_cvtsi128_si32 (a);
+            memcpy (row + x, &v, (size_t)bpp);
+        }
+    }
+    else if ((filter == 4) && ((bpp == 3) || (bpp == 4)))
+    {
+        for (; x + 4 <= len; x += bpp)
+        {
+            memcpy (&v, prev + x, 4);
+            b = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (v), zero);
+            memcpy (&v, row + x, 4);
+            r = _mm_cvtsi32_si128 (v);
+
+            pa = _mm_sub_epi16 (b, c);
+            pb = _mm_sub_epi16 (a, c);
+            pc = _mm_add_epi16 (pa, pb);
+            pa = _mm_max_epi16 (pa, _mm_sub_epi16 (zero, pa));
+            pb = _mm_max_epi16 (pb, _mm_sub_epi16 (zero, pb));
+            pc = _mm_max_epi16 (pc, _mm_sub_epi16 (zero, pc));
+            least = _mm_min_epi16 (_mm_min_epi16 (pa, pb), pc);
+
+            pick = _mm_cmpeq_epi16 (pb, least);
+            d = _mm_or_si128 (_mm_and_si128 (pick, b), _mm_andnot_si128 (pick, c));
+            pick = _mm_cmpeq_epi16 (pa, least);
+            d = _mm_or_si128 (_mm_and_si128 (pick, a), _mm_andnot_si128 (pick, d));
+
+            r = _mm_add_epi8 (r, _mm_packus_epi16 (d, d));
+            v = _mm_cvtsi128_si32 (r);
+            memcpy (row + x, &v, (size_t)bpp);
+            a = _mm_unpacklo_epi8 (r, zero);
+            c = b;
+        }
+    }
+
+    unfilter_span (row, prev, x, len, bpp, filter);
+}
+
+
+/* four pixels a pass, a channel to a register.  the table has no gather
+   to read it with, so the corners go through memory */
+SIMD_TARGET ("sse2")
+static void
+lut3d_rgba_sse2 (uint8_t *rgba, int w, const simd_lut3d *lut)
+{
+    const int n = lut->n;
+    const __m128i low = _mm_set1_epi32 (0xFF);
+    const __m128i level = _mm_set1_epi32 (0x3FF);
+    const __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    const __m128i sr = _mm_set1_epi32 (n * n);
+    const __m128i sg = _mm_set1_epi32 (n);
+    const __m128i sb = _mm_set1_epi32 (1);
+    const __m128i far = _mm_set1_epi32 (n * n + n + 1);
+    const __m128 step = _mm_set1_ps ((float)(n - 1) / 255.0f);
+    const __m128 top = _mm_set1_ps ((float)(n - 2));
+    const __m128 nn = _mm_set1_ps ((float)(n * n));
+    const __m128 ng = _mm_set1_ps ((float)n);
+    const __m128 one = _mm_set1_ps (1.0f);
+    const __m128 scale = _mm_set1_ps (SIMD_LUT3D_SCALE);
+    const __m128 bias = _mm_set1_ps (SIMD_LUT3D_BIAS);
+    const __m128 white = _mm_set1_ps (255.0f);
+    __m128i p, base, near, skip, m, out;
+    __m128i c[4];
+    __m128 t, k[3], f[3], wt[4], hi, mid, lo, v;
+    int32_t idx[16];
+    uint32_t corner[16];
+    int x, i, j;
+
+    for (x = 0; x + 4 <= w; x += 4)
+    {
+        p = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4));
+        for (i = 0; i < 3; i++)
+        {
+            t = _mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (p, i * 8), low)), step);
+            k[i] = _mm_cvtepi32_ps (_mm_cvttps_epi32 (_mm_min_ps (t, top)));
+            f[i] = _mm_sub_ps (t, k[i]);
+        }
+        base = _mm_cvttps_epi32 (_mm_add_ps (_mm_add_ps (_mm_mul_ps (k[0], nn), _mm_mul_ps (k[1], ng)), k[2]));
+
+        hi = _mm_max_ps (f[0], _mm_max_ps (f[1], f[2]));
+        lo = _mm_min_ps (f[0], _mm_min_ps (f[1], f[2]));
+        mid = _mm_max_ps (_mm_min_ps (f[0], f[1]), _mm_min_ps (_mm_max_ps (f[0], f[1]), f[2]));
+
+        m = _mm_castps_si128 (_mm_cmpge_ps (f[1], f[2]));
+        near = _mm_or_si128 (_mm_and_si128 (m, sg), _mm_andnot_si128 (m, sb));
+        m = _mm_castps_si128 (_mm_and_ps (_mm_cmpge_ps (f[0], f[1]), _mm_cmpge_ps (f[0], f[2])));
+        near = _mm_or_si128 (_mm_and_si128 (m, sr), _mm_andnot_si128 (m, near));
+        m = _mm_castps_si128 (_mm_cmplt_ps (f[1], f[2]));
+        skip = _mm_or_si128 (_mm_and_si128 (m, sg), _mm_andnot_si128 (m, sb));
+        m = _mm_castps_si128 (_mm_and_ps (_mm_cmplt_ps (f[0], f[1]), _mm_cmplt_ps (f[0], f[2])));
+        skip = _mm_or_si128 (_mm_and_si128 (m, sr), _mm_andnot_si128 (m, skip));
+
+        _mm_storeu_si128 ((__m128i *)(idx + 0), base);
+        _mm_storeu_si128 ((__m128i *)(idx + 4), _mm_add_epi32 (base, near));
+        _mm_storeu_si128 ((__m128i *)(idx + 8), _mm_add_epi32 (base, _mm_sub_epi32 (far, skip)));
+        _mm_storeu_si128 ((__m128i *)(idx + 12), _mm_add_epi32 (base, far));
+        for (j = 0; j < 16; j++)
+            corner[j] = lut->table[idx[j]];
+
+        wt[0] = _mm_sub_ps (one, hi);
+        wt[1] = _mm_sub_ps (hi, mid);
+        wt[2] = _mm_sub_ps (mid, lo);
+        wt[3] = lo;
+        for (j = 0; j < 4; j++)
+            c[j] = _mm_loadu_si128 ((const __m128i *)(corner + j * 4));
+
+        out = _mm_and_si128 (p, alpha);
+        for (i = 0; i < 3; i++)
+        {
+            v = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (c[0], i * 10), level)), wt[0]),
+                            _mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (c[1], i * 10), level)), wt[1]));
+            v = _mm_add_ps (v, _mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (c[2], i * 10), level)), wt[2]));
+            v = _mm_add_ps (v, _mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (c[3], i * 10), level)), wt[3]));
+            v = _mm_min_ps (_mm_max_ps (_mm_add_ps (_mm_mul_ps (v, scale), bias), _mm_setzero_ps ()), white);
+            out = _mm_or_si128 (out, _mm_slli_epi32 (_mm_cvttps_epi32 (v), i * 8));
+        }
+        _mm_storeu_si128 ((__m128i *)(rgba + x * 4), out);
+    }
+
+    lut3d_rgba_scalar (rgba + x * 4, w - x, lut);
+}
+
+
+/* a whole row of the block per register, so no halves */
+SIMD_TARGET ("avx2")
+static void
+idct_8x8_avx2 (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride)
+{
+    __m256 v[8];
+    __m256 t[8];
+    __m256 s[8];
+    __m256i rounded;
+    __m128i packed;
+    const __m256 bias = _mm256_set1_ps (128.0f);
+    int k;
+
+    for (k = 0; k < 8; k++)
+    {
+        v[k] = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *)(coef + k * 8)))),
+                              _mm256_loadu_ps (qt + k * 8));
+    }
+
+    for (k = 0; k < 2; k++)
+    {
+        SIMD_IDCT_1D (__m256, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, v);
+
+        /* 8x8 transpose */
+        t[0] = _mm256_unpacklo_ps (v[0], v[1]);
+        t[1] = _mm256_unpackhi_ps (v[0], v[1]);
+        t[2] = _mm256_unpacklo_ps (v[2], v[3]);
+        t[3] = _mm256_unpackhi_ps (v[2], v[3]);
+        t[4] = _mm256_unpacklo_ps (v[4], v[5]);
+        t[5] = _mm256_unpackhi_ps (v[4], v[5]);
+        t[6] = _mm256_unpacklo_ps (v[6], v[7]);
+        t[7] = _mm256_unpackhi_ps (v[6], v[7]);
+        s[0] = _mm256_shuffle_ps (t[0], t[2], _MM_SHUFFLE (1, 0, 1, 0));
+        s[1] = _mm256_shuffle_ps (t[0], t[2], _MM_SHUFFLE (3, 2, 3, 2));
+        s[2] = _mm256_shuffle_ps (t[1], t[3], _MM_SHUFFLE (1, 0, 1, 0));
+        s[3] = _mm256_shuffle_ps (t[1], t[3], _MM_SHUFFLE (3, 2, 3, 2));
+        s[4] = _mm256_shuffle_ps (t[4], t[6], _MM_SHUFFLE (1, 0, 1, 0));
+        s[5] = _mm256_shuffle_ps (t[4], t[6], _MM_SHUFFLE (3, 2, 3, 2));
+        s[6] = _mm256_shuffle_ps (t[5], t[7], _MM_SHUFFLE (1, 0, 1, 0));
+        s[7] = _mm256_shuffle_ps (t[5], t[7], _MM_SHUFFLE (3, 2, 3, 2));
+        v[0] = _mm256_permute2f128_ps (s[0], s[4], 0x20);
+        v[1] = _mm256_permute2f128_ps (s[1], s[5], 0x20);
+        v[2] = _mm256_permute2f128_ps (s[2], s[6], 0x20);
+        v[3] = _mm256_permute2f128_ps (s[3], s[7], 0x20);
+        v[4] = _mm256_permute2f128_ps (s[0], s[4], 0x31);
+        v[5] = _mm256_permute2f128_ps (s[1], s[5], 0x31);
+        v[6] = _mm256_permute2f128_ps (s[2], s[6], 0x31);
+        v[7] = _mm256_permute2f128_ps (s[3], s[7], 0x31);
+    }
+
+    for (k = 0; k < 8; k++)
+    {
+        rounded = _mm256_cvtps_epi32 (_mm256_add_ps (v[k], bias));
+        packed = _mm_packs_epi32 (_mm256_castsi256_si128 (rounded), _mm256_extracti128_si256 (rounded, 1));
+        _mm_storel_epi64 ((__m128i *)(out + k * stride), _mm_packus_epi16 (packed, packed));
+    }
+}
+
+
+/* eight pixels a register, each packed into one 32 bit r g b a word */
+SIMD_TARGET ("avx2")
+static void
+ycc_to_rgba_avx2 (const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgba, int w)
+{
+    const __m256 offset = _mm256_set1_ps (128.0f);
+    const __m256 cr_r = _mm256_set1_ps (YCC_CR_R);
+    const __m256 cb_g = _mm256_set1_ps (YCC_CB_G);
+    const __m256 cr_g = _mm256_set1_ps (YCC_CR_G);
+    const __m256 cb_b = _mm256_set1_ps (YCC_CB_B);
+    const __m256i low = _mm256_setzero_si256 ();
+    const __m256i high = _mm256_set1_epi32 (255);
+    const __m256i alpha = _mm256_set1_epi32 ((int)0xFF000000u);
+    __m256 yf, cbf, crf;
+    __m256i r, g, b;
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        yf = _mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(y + x))));
+        cbf = _mm256_sub_ps (_mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(cb + x)))), offset);
+        crf = _mm256_sub_ps (_mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(cr + x)))), offset);
+
+        r = _mm256_cvtps_epi32 (_mm256_add_ps (yf, _mm256_mul_ps (crf, cr_r)));
+        g = _mm256_cvtps_epi32 (_mm256_sub_ps (_mm256_sub_ps (yf, _mm256_mul_ps (cbf, cb_g)),
+                                               _mm256_mul_ps (crf, cr_g)));
+        b = _mm256_cvtps_epi32 (_mm256_add_ps (yf, _mm256_mul_ps (cbf, cb_b)));
+        r = _mm256_min_epi32 (_mm256_max_epi32 (r, low), high);
+        g = _mm256_min_epi32 (_mm256_max_epi32 (g, low), high);
+        b = _mm256_min_epi32 (_mm256_max_epi32 (b, low), high);
+
+        _mm256_storeu_si256 ((__m256i *)(rgba + x * 4),
+                             _mm256_or_si256 (_mm256_or_si256 (r, _mm256_slli_epi32 (g, 8)),
+                                              _mm256_or_si256 (_mm256_slli_epi32 (b, 16), alpha)));
+    }
+    ycc_to_rgba_scalar (y + x, cb + x, cr + x, rgba + x * 4, w - x);
+}
+
+
+/* as the sse2 one with 32 pixels a pass.  the packs work within each
+   128 bit half, so the pixel groups come out of order and are put back
+   with a permute */
+SIMD_TARGET ("avx2")
+static uint64_t
+diff_rgba_avx2 (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    const __m256i rgb = _mm256_set1_epi32 (0x00FFFFFF);
+    const __m256i low = _mm256_set1_epi32 (0xFF);
+    const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i sum = zero;
+    __m256i va, vb, d, lo, hi, sq;
+    __m256i m[4];
+    uint64_t lanes[4];
+    int x, i;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        sq = zero;
+        for (i = 0; i < 4; i++)
+        {
+            va = _mm256_loadu_si256 ((const __m256i *)(a + (x + i * 8) * 4));
+            vb = _mm256_loadu_si256 ((const __m256i *)(b + (x + i * 8) * 4));
+            d = _mm256_and_si256 (_mm256_or_si256 (_mm256_subs_epu8 (va, vb), _mm256_subs_epu8 (vb, va)), rgb);
+
+            lo = _mm256_unpacklo_epi8 (d, zero);
+            hi = _mm256_unpackhi_epi8 (d, zero);
+            sq = _mm256_add_epi32 (sq, _mm256_add_epi32 (_mm256_madd_epi16 (lo, lo), _mm256_madd_epi16 (hi, hi)));
+
+            m[i] = _mm256_max_epu8 (d, _mm256_max_epu8 (_mm256_srli_epi32 (d, 8), _mm256_srli_epi32 (d, 16)));
+            m[i] = _mm256_and_si256 (m[i], low);
+        }
+        sum = _mm256_add_epi64 (sum, _mm256_unpacklo_epi32 (sq, zero));
+        sum = _mm256_add_epi64 (sum, _mm256_unpackhi_epi32 (sq, zero));
+        _mm256_storeu_si256 ((__m256i *)(mag + x),
+                             _mm256_permutevar8x32_epi32 (
+                                 _mm256_packus_epi16 (_mm256_packs_epi32 (m[0], m[1]),
+                                                      _mm256_packs_epi32 (m[2], m[3])),
+                                 order));
+    }
+    _mm256_storeu_si256 ((__m256i *)lanes, sum);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           diff_rgba_sse2 (a + x * 4, b + x * 4, mag + x, w - x);
+}
+
+
+/* as the sse2 one with 32 pixels a pass, put back in order as in
+   diff_rgba_avx2 */
+SIMD_TARGET ("avx2")
+static void
+luma_rgba_avx2 (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    const __m256i full = _mm256_set1_epi8 ((char)0xFF);
+    const __m256i rgb = _mm256_set1_epi32 (0x00FFFFFF);
+    const __m256i low = _mm256_set1_epi32 (0xFF);
+    const __m256i one = _mm256_set1_epi32 (1);
+    const __m256i kr = _mm256_set1_epi16 (77);
+    const __m256i kg = _mm256_set1_epi16 (150);
+    const __m256i kb = _mm256_set1_epi16 (29);
+    const __m256i half = _mm256_set1_epi16 (128);
+    const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i dark = zero, bright = zero;
+    __m256i p[4], y[2];
+    __m256i r, g, b, t;
+    uint32_t lanes[8];
+    int x, i;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            p[i] = _mm256_loadu_si256 ((const __m256i *)(rgba + (x + i * 8) * 4));
+
+            t = _mm256_and_si256 (_mm256_cmpeq_epi8 (p[i], zero), rgb);
+            dark = _mm256_add_epi32 (dark, _mm256_andnot_si256 (_mm256_cmpeq_epi32 (t, zero), one));
+            t = _mm256_and_si256 (_mm256_cmpeq_epi8 (p[i], full), rgb);
+            bright = _mm256_add_epi32 (bright, _mm256_andnot_si256 (_mm256_cmpeq_epi32 (t, zero), one));
+        }
+        for (i = 0; i < 2; i++)
+        {
+            r = _mm256_packs_epi32 (_mm256_and_si256 (p[i * 2], low),
+                                    _mm256_and_si256 (p[i * 2 + 1], low));
+            g = _mm256_packs_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (p[i * 2], 8), low),
+                                    _mm256_and_si256 (_mm256_srli_epi32 (p[i * 2 + 1], 8), low));
+            b = _mm256_packs_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (p[i * 2], 16), low),
+                                    _mm256_and_si256 (_mm256_srli_epi32 (p[i * 2 + 1], 16), low));
+            y[i] = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (r, kr), _mm256_mullo_epi16 (g, kg)),
+                                     _mm256_add_epi16 (_mm256_mullo_epi16 (b, kb), half));
+            y[i] = _mm256_srli_epi16 (y[i], 8);
+        }
+        _mm256_storeu_si256 ((__m256i *)(luma + x),
+                             _mm256_permutevar8x32_epi32 (_mm256_packus_epi16 (y[0], y[1]), order));
+    }
+
+    _mm256_storeu_si256 ((__m256i *)lanes, dark);
+    for (i = 0; i < 8; i++)
+        clipped[0] += lanes[i];
+    _mm256_storeu_si256 ((__m256i *)lanes, bright);
+    for (i = 0; i < 8; i++)
+        clipped[1] += lanes[i];
+    luma_rgba_sse2 (rgba + x * 4, luma + x, w - x, clipped);
+}
+
+
+/* two pixels to a register and eight a pass, the lut read with a
+   gather (four bytes at each index, hence the padding).  the packs
+   leave the pixels out of order as in diff_rgba_avx2 */
+SIMD_TARGET ("avx2")
+static void
+tonemap_rgba_avx2 (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    const __m256i magnitude = _mm256_set1_epi32 (0x7FFF);
+    const __m256i sign = _mm256_set1_epi32 (0x8000);
+    const __m256i low = _mm256_set1_epi32 (0xFF);
+    const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256 scale = _mm256_set1_ps (SIMD_HALF_SCALE);
+    const __m256 gain = _mm256_setr_ps (tm->gain, tm->gain, tm->gain, 1.0f,
+                                        tm->gain, tm->gain, tm->gain, 1.0f);
+    const __m256 k = _mm256_set1_ps (tm->k);
+    const __m256 one = _mm256_set1_ps (1.0f);
+    const __m256 color = _mm256_castsi256_ps (_mm256_setr_epi32 (-1, -1, -1, 0, -1, -1, -1, 0));
+    const __m256 steps = _mm256_setr_ps (SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, 255.0f,
+                                         SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, 255.0f);
+    const __m256 round = _mm256_set1_ps (0.5f);
+    __m256i h, idx, level;
+    __m256i r[4];
+    __m256 v, t;
+    int x, i;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            h = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *)(half + (x + i * 2) * 4)));
+            v = _mm256_mul_ps (_mm256_castsi256_ps (_mm256_slli_epi32 (_mm256_and_si256 (h, magnitude), 13)), scale);
+            v = _mm256_and_ps (v, _mm256_castsi256_ps (_mm256_cmpeq_epi32 (_mm256_and_si256 (h, sign), zero)));
+            v = _mm256_mul_ps (v, gain);
+            if (tm->curve)
+            {
+                t = _mm256_div_ps (_mm256_mul_ps (v, _mm256_add_ps (one, _mm256_mul_ps (v, k))), _mm256_add_ps (one, v));
+                v = _mm256_blendv_ps (v, t, color);
+            }
+            v = _mm256_min_ps (_mm256_max_ps (v, _mm256_setzero_ps ()), one);
+            idx = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_mul_ps (v, steps), round));
+
+            level = _mm256_and_si256 (_mm256_i32gather_epi32 ((const int *)tm->lut, idx, 1), low);
+            r[i] = _mm256_castps_si256 (_mm256_blendv_ps (_mm256_castsi256_ps (idx),
+                                                          _mm256_castsi256_ps (level), color));
+        }
+        _mm256_storeu_si256 ((__m256i *)(rgba + x * 4),
+                             _mm256_permutevar8x32_epi32 (
+                                 _mm256_packus_epi16 (_mm256_packus_epi32 (r[0], r[1]),
+                                                      _mm256_packus_epi32 (r[2], r[3])),
+                                 order));
+    }
+
+    tonemap_rgba_sse2 (half + x * 4, rgba + x * 4, w - x, tm);
+}
+
+/* sixteen pixels (48 bytes) a pass, four to a register, spread out
+   with the byte shuffle sse2 lacks */
+SIMD_TARGET ("avx2")
+static void
+rgb_to_rgba_avx2 (const uint8_t *rgb, uint8_t *rgba, int w)
+{
+    const __m128i spread = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    __m128i in[3], p[4];
+    int x, i;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        in[0] = _mm_loadu_si128 ((const __m128i *)(rgb + x * 3));
+        in[1] = _mm_loadu_si128 ((const __m128i *)(rgb + x * 3 + 16));
+        in[2] = _mm_loadu_si128 ((const __m128i *)(rgb + x * 3 + 32));
+        p[0] = in[0];
+        p[1] = _mm_alignr_epi8 (in[1], in[0], 12);
+        p[2] = _mm_alignr_epi8 (in[2], in[1], 8);
+        p[3] = _mm_srli_si128 (in[2], 4);
+        for (i = 0; i < 4; i++)
+        {
+            _mm_storeu_si128 ((__m128i *)(rgba + (x + i * 4) * 4),
+                              _mm_or_si128 (_mm_shuffle_epi8 (p[i], spread), alpha));
+        }
+    }
+
+    rgb_to_rgba_scalar (rgb + x * 3, rgba + x * 4, w - x);
+}
+
+/* as the sse2 one, eight pixels a pass with the corners gathered */
+SIMD_TARGET ("avx2")
+static void
+lut3d_rgba_avx2 (uint8_t *rgba, int w, const simd_lut3d *lut)
+{
+    const int n = lut->n;
+    const int *table = (const int *)lut->table;
+    const __m256i low = _mm256_set1_epi32 (0xFF);
+    const __m256i level = _mm256_set1_epi32 (0x3FF);
+    const __m256i alpha = _mm256_set1_epi32 ((int)0xFF000000);
+    const __m256i sr = _mm256_set1_epi32 (n * n);
+    const __m256i sg = _mm256_set1_epi32 (n);
+    const __m256i sb = _mm256_set1_epi32 (1);
+    const __m256i far = _mm256_set1_epi32 (n * n + n + 1);
+    const __m256 step = _mm256_set1_ps ((float)(n - 1) / 255.0f);
+    const __m256 top = _mm256_set1_ps ((float)(n - 2));
+    const __m256 nn = _mm256_set1_ps ((float)(n * n));
+    const __m256 ng = _mm256_set1_ps ((float)n);
+    const __m256 one = _mm256_set1_ps (1.0f);
+    const __m256 scale = _mm256_set1_ps (SIMD_LUT3D_SCALE);
+    const __m256 bias = _mm256_set1_ps (SIMD_LUT3D_BIAS);
+    const __m256 white = _mm256_set1_ps (255.0f);
+    __m256i p, base, near, skip, out;
+    __m256i c[4];
+    __m256 t, k[3], f[3], wt[4], hi, mid, lo, v;
+    int x, i;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        p = _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4));
+        for (i = 0; i < 3; i++)
+        {
+            t = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (p, i * 8), low)), step);
+            k[i] = _mm256_cvtepi32_ps (_mm256_cvttps_epi32 (_mm256_min_ps (t, top)));
+            f[i] = _mm256_sub_ps (t, k[i]);
+        }
+        base = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (k[0], nn),
+                                                                  _mm256_mul_ps (k[1], ng)), k[2]));
+
+        hi = _mm256_max_ps (f[0], _mm256_max_ps (f[1], f[2]));
+        lo = _mm256_min_ps (f[0], _mm256_min_ps (f[1], f[2]));
+        mid = _mm256_max_ps (_mm256_min_ps (f[0], f[1]), _mm256_min_ps (_mm256_max_ps (f[0], f[1]), f[2]));
+
+        near = _mm256_blendv_epi8 (sb, sg, _mm256_castps_si256 (_mm256_cmp_ps (f[1], f[2], _CMP_GE_OQ)));
+        near = _mm256_blendv_epi8 (near, sr, _mm256_castps_si256 (_mm256_and_ps (_mm256_cmp_ps (f[0], f[1], _CMP_GE_OQ),
+                                                                                 _mm256_cmp_ps (f[0], f[2], _CMP_GE_OQ))));
+        skip = _mm256_blendv_epi8 (sb, sg, _mm256_castps_si256 (_mm256_cmp_ps (f[1], f[2], _CMP_LT_OQ)));
+        skip = _mm256_blendv_epi8 (skip, sr, _mm256_castps_si256 (_mm256_and_ps (_mm256_cmp_ps (f[0], f[1], _CMP_LT_OQ),
+                                                                                 _mm256_cmp_ps (f[0], f[2], _CMP_LT_OQ))));
+
+        c[0] = _mm256_i32gather_epi32 (table, base, 4);
+        c[1] = _mm256_i32gather_epi32 (table, _mm256_add_epi32 (base, near), 4);
+        c[2] = _mm256_i32gather_epi32 (table, _mm256_add_epi32 (base, _mm256_sub_epi32 (far, skip)), 4);
+        c[3] = _mm256_i32gather_epi32 (table, _mm256_add_epi32 (base, far), 4);
+
+        wt[0] = _mm256_sub_ps (one, hi);
+        wt[1] = _mm256_sub_ps (hi, mid);
+        wt[2] = _mm256_sub_ps (mid, lo);
+        wt[3] = lo;
+
+        out = _mm256_and_si256 (p, alpha);
+        for (i = 0; i < 3; i++)
+        {
+            v = _mm256_add_ps (_mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (c[0], i * 10), level)), wt[0]),
+                               _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (c[1], i * 10), level)), wt[1]));
+            v = _mm256_add_ps (v, _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (c[2], i * 10), level)), wt[2]));
+            v = _mm256_add_ps (v, _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (c[3], i * 10), level)), wt[3]));
+            v = _mm256_min_ps (_mm256_max_ps (_mm256_add_ps (_mm256_mul_ps (v, scale), bias), _mm256_setzero_ps ()), white);
+            out = _mm256_or_si256 (out, _mm256_slli_epi32 (_mm256_cvttps_epi32 (v), i * 8));
+        }
+        _mm256_storeu_si256 ((__m256i *)(rgba + x * 4), out);
+    }
+
+    lut3d_rgba_sse2 (rgba + x * 4, w - x, lut);
+}
+
+#endif
+
+
+#ifdef SIMD_ARM
+/* transpose the 4x4 floats in a b c d */
+#define NEON_TRANSPOSE4(a, b, c, d)                                             \
+    do                                                                          \
+    {                                                                           \
+        float32x4x2_t p_ = vtrnq_f32 ((a), (b));                                \
+        float32x4x2_t q_ = vtrnq_f32 ((c), (d));                                \
+        (a) = vcombine_f32 (vget_low_f32 (p_.val[0]), vget_low_f32 (q_.val[0]));   \
+        (b) = vcombine_f32 (vget_low_f32 (p_.val[1]), vget_low_f32 (q_.val[1]));   \
+        (c) = vcombine_f32 (vget_high_f32 (p_.val[0]), vget_high_f32 (q_.val[0])); \
+        (d) = vcombine_f32 (vget_high_f32 (p_.val[1]), vget_high_f32 (q_.val[1])); \
+    } while (0)
+
+static void
+idct_8x8_neon (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride)
+{
+    float32x4_t lo[8], hi[8];
+    float32x4_t swap;
+    int16x8_t c;
+    int16x8_t packed;
+    const float32x4_t bias = vdupq_n_f32 (128.0f);
+    int k;
+
+    for (k = 0; k < 8; k++)
+    {
+        c = vld1q_s16 (coef + k * 8);
+        lo[k] = vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (c))), vld1q_f32 (qt + k * 8));
+        hi[k] = vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (c))), vld1q_f32 (qt + k * 8 + 4));
+    }
+
+    for (k = 0; k < 2; k++)
+    {
+        SIMD_IDCT_1D (float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, lo);
+        SIMD_IDCT_1D (float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, hi);
+
+        NEON_TRANSPOSE4 (lo[0], lo[1], lo[2], lo[3]);
+        NEON_TRANSPOSE4 (hi[0], hi[1], hi[2], hi[3]);
+        NEON_TRANSPOSE4 (lo[4], lo[5], lo[6], lo[7]);
+        NEON_TRANSPOSE4 (hi[4], hi[5], hi[6], hi[7]);
+        swap = hi[0]; hi[0] = lo[4]; lo[4] = swap;
+        swap = hi[1]; hi[1] = lo[5]; lo[5] = swap;
+        swap = hi[2]; hi[2] = lo[6]; lo[6] = swap;
+        swap = hi[3]; hi[3] = lo[7]; lo[7] = swap;
+    }
+
+    for (k = 0; k < 8; k++)
+    {
+        packed = vcombine_s16 (vqmovn_s32 (vcvtnq_s32_f32 (vaddq_f32 (lo[k], bias))),
+                               vqmovn_s32 (vcvtnq_s32_f32 (vaddq_f32 (hi[k], bias))));
+        vst1_u8 (out + k * stride, vqmovun_s16 (packed));
+    }
+}
+
+
+static void
+upsample_h2v1_neon (const uint8_t *in, uint8_t *out, int in_w)
+{
+    uint16x8_t cur, cur3;
+    uint8x8x2_t pair;
+    int x;
+
+    upsample_h2v1_span (in, out, in_w, 0, 1);
+    for (x = 1; x + 8 < in_w; x += 8)
+    {
+        cur = vmovl_u8 (vld1_u8 (in + x));
+        cur3 = vaddq_u16 (cur, vaddq_u16 (cur, cur));
+        pair.val[0] = vmovn_u16 (vshrq_n_u16 (vaddq_u16 (vaddw_u8 (cur3, vld1_u8 (in + x - 1)), vdupq_n_u16 (1)), 2));
+        pair.val[1] = vmovn_u16 (vshrq_n_u16 (vaddq_u16 (vaddw_u8 (cur3, vld1_u8 (in + x + 1)), vdupq_n_u16 (2)), 2));
+        vst2_u8 (out + x * 2, pair);
+    }
+    upsample_h2v1_span (in, out, in_w, (x < in_w) ? x : in_w, in_w);
+}
+
+
+static void
+upsample_h2v2_neon (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w)
+{
+    uint16x8_t sum, sum3, prev, next;
+    uint8x8x2_t pair;
+    int x;
+
+/* 3 * near + far for the 8 columns from at */
+#define COLSUM(at) \
+    vaddw_u8 (vmull_u8 (vld1_u8 (near + (at)), vdup_n_u8 (3)), vld1_u8 (far + (at)))
+
+    upsample_h2v2_span (near, far, out, in_w, 0, 1);
+    for (x = 1; x + 8 < in_w; x += 8)
+    {
+        sum = COLSUM (x);
+        prev = COLSUM (x - 1);
+        next = COLSUM (x + 1);
+        sum3 = vaddq_u16 (sum, vaddq_u16 (sum, sum));
+        pair.val[0] = vmovn_u16 (vshrq_n_u16 (vaddq_u16 (vaddq_u16 (sum3, prev), vdupq_n_u16 (8)), 4));
+        pair.val[1] = vmovn_u16 (vshrq_n_u16 (vaddq_u16 (vaddq_u16 (sum3, next), vdupq_n_u16 (7)), 4));
+        vst2_u8 (out + x * 2, pair);
+    }
+    upsample_h2v2_span (near, far, out, in_w, (x < in_w) ? x : in_w, in_w);
+
+#undef COLSUM
+}
+
+
+static void
+ycc_to_rgba_neon (const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgba, int w)
+{
+    const int16x8_t offset = vdupq_n_s16 (128);
+    float32x4_t yf[2], cbf[2], crf[2];
+    int32x4_t r[2], g[2], b[2];
+    int16x8_t y16, cb16, cr16;
+    uint8x8x4_t px;
+    int x, h;
+
+    px.val[3] = vdup_n_u8 (0xFF);
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        y16 = vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (y + x)));
+        cb16 = vsubq_s16 (vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (cb + x))), offset);
+        cr16 = vsubq_s16 (vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (cr + x))), offset);
+
+        yf[0] = vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (y16)));
+        yf[1] = vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (y16)));
+        cbf[0] = vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (cb16)));
+        cbf[1] = vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (cb16)));
+        crf[0] = vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (cr16)));
+        crf[1] = vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (cr16)));
+
+        for (h = 0; h < 2; h++)
+        {
+            r[h] = vcvtnq_s32_f32 (vmlaq_n_f32 (yf[h], crf[h], YCC_CR_R));
+            g[h] = vcvtnq_s32_f32 (vmlsq_n_f32 (vmlsq_n_f32 (yf[h], cbf[h], YCC_CB_G), crf[h], YCC_CR_G));
+            b[h] = vcvtnq_s32_f32 (vmlaq_n_f32 (yf[h], cbf[h], YCC_CB_B));
+        }
+
+        /* saturate to bytes, vst4 interleaves r g b a */
+        px.val[0] = vqmovun_s16 (vcombine_s16 (vqmovn_s32 (r[0]), vqmovn_s32 (r[1])));
+        px.val[1] = vqmovun_s16 (vcombine_s16 (vqmovn_s32 (g[0]), vqmovn_s32 (g[1])));
+        px.val[2] = vqmovun_s16 (vcombine_s16 (vqmovn_s32 (b[0]), vqmovn_s32 (b[1])));
+        vst4_u8 (rgba + x * 4, px);
+    }
+    ycc_to_rgba_scalar (y + x, cb + x, cr + x, rgba + x * 4, w - x);
+}
+
+
+/* vld4 splits sixteen pixels into r g b a registers.  the squares are
+   summed in 32 bits for a pass and in 64 bits across them */
+static uint64_t
+diff_rgba_neon (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w)
+{
+    uint64x2_t sum = vdupq_n_u64 (0);
+    uint32x4_t sq;
+    uint8x16x4_t pa, pb;
+    uint8x16_t d[3];
+    int x, c;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        pa = vld4q_u8 (a + x * 4);
+        pb = vld4q_u8 (b + x * 4);
+        sq = vdupq_n_u32 (0);
+        for (c = 0; c < 3; c++)
+        {
+            d[c] = vabdq_u8 (pa.val[c], pb.val[c]);
+            sq = vpadalq_u16 (sq, vmull_u8 (vget_low_u8 (d[c]), vget_low_u8 (d[c])));
+            sq = vpadalq_u16 (sq, vmull_u8 (vget_high_u8 (d[c]), vget_high_u8 (d[c])));
+        }
+        sum = vpadalq_u32 (sum, sq);
+        vst1q_u8 (mag + x, vmaxq_u8 (vmaxq_u8 (d[0], d[1]), d[2]));
+    }
+
+    return vgetq_lane_u64 (sum, 0) + vgetq_lane_u64 (sum, 1) +
+           diff_rgba_scalar (a + x * 4, b + x * 4, mag + x, w - x);
+}
+
+
+/* vld4 splits sixteen pixels into r g b a registers, a pixel is
+   clipped when the least (or the most) of its r g b is */
+static void
+luma_rgba_neon (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped)
+{
+    const uint8x8_t kr = vdup_n_u8 (77);
+    const uint8x8_t kg = vdup_n_u8 (150);
+    const uint8x8_t kb = vdup_n_u8 (29);
+    uint8x16x4_t p;
+    uint16x8_t lo, hi;
+    uint8x16_t least, most;
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        p = vld4q_u8 (rgba + x * 4);
+
+        lo = vmull_u8 (vget_low_u8 (p.val[0]), kr);
+        lo = vmlal_u8 (lo, vget_low_u8 (p.val[1]), kg);
+        lo = vmlal_u8 (lo, vget_low_u8 (p.val[2]), kb);
+        hi = vmull_u8 (vget_high_u8 (p.val[0]), kr);
+        hi = vmlal_u8 (hi, vget_high_u8 (p.val[1]), kg);
+        hi = vmlal_u8 (hi, vget_high_u8 (p.val[2]), kb);
+        vst1q_u8 (luma + x, vcombine_u8 (vrshrn_n_u16 (lo, 8), vrshrn_n_u16 (hi, 8)));
+
+        least = vminq_u8 (vminq_u8 (p.val[0], p.val[1]), p.val[2]);
+        most = vmaxq_u8 (vmaxq_u8 (p.val[0], p.val[1]), p.val[2]);
+        clipped[0] += vaddvq_u8 (vshrq_n_u8 (vceqq_u8 (least, vdupq_n_u8 (0)), 7));
+        clipped[1] += vaddvq_u8 (vshrq_n_u8 (vceqq_u8 (most, vdupq_n_u8 (0xFF)), 7));
+    }
+
+    luma_rgba_scalar (rgba + x * 4, luma + x, w - x, clipped);
+}
+
+
+/* two pixels a pass, a pixel to a register as in the sse2 one */
+static void
+tonemap_rgba_neon (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm)
+{
+    const float gains[4] = { tm->gain, tm->gain, tm->gain, 1.0f };
+    const float levels[4] = { SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, SIMD_TONEMAP_LUT - 1, 255.0f };
+    const uint32_t colors[4] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0 };
+    const uint32x4_t magnitude = vdupq_n_u32 (0x7FFF);
+    const uint32x4_t sign = vdupq_n_u32 (0x8000);
+    const uint32x4_t color = vld1q_u32 (colors);
+    const float32x4_t scale = vdupq_n_f32 (SIMD_HALF_SCALE);
+    const float32x4_t gain = vld1q_f32 (gains);
+    const float32x4_t k = vdupq_n_f32 (tm->k);
+    const float32x4_t one = vdupq_n_f32 (1.0f);
+    const float32x4_t steps = vld1q_f32 (levels);
+    const float32x4_t round = vdupq_n_f32 (0.5f);
+    uint16x8_t h;
+    uint32x4_t u;
+    float32x4_t v, t;
+    uint32_t idx[8];
+    int x, i;
+
+    for (x = 0; x + 2 <= w; x += 2)
+    {
+        h = vld1q_u16 (half + x * 4);
+        for (i = 0; i < 2; i++)
+        {
+            u = vmovl_u16 ((i == 0) ? vget_low_u16 (h) : vget_high_u16 (h));
+            v = vmulq_f32 (vreinterpretq_f32_u32 (vshlq_n_u32 (vandq_u32 (u, magnitude), 13)), scale);
+            v = vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (v),
+                                                  vceqq_u32 (vandq_u32 (u, sign), vdupq_n_u32 (0))));
+            v = vmulq_f32 (v, gain);
+            if (tm->curve)
+            {
+                t = vdivq_f32 (vmulq_f32 (v, vaddq_f32 (one, vmulq_f32 (v, k))), vaddq_f32 (one, v));
+                v = vbslq_f32 (color, t, v);
+            }
+            v = vminq_f32 (vmaxq_f32 (v, vdupq_n_f32 (0.0f)), one);
+            vst1q_u32 (idx + i * 4, vcvtq_u32_f32 (vaddq_f32 (vmulq_f32 (v, steps), round)));
+        }
+        for (i = 0; i < 8; i++)
+        {
+            rgba[x * 4 + i] = ((i & 3) == 3) ? (uint8_t)idx[i] : tm->lut[idx[i]];
+        }
+    }
+
+    tonemap_rgba_scalar (half + x * 4, rgba + x * 4, w - x, tm);
+}
+
+/* as the sse2 one, vhadd_u8 already rounds down for average */
+static void
+unfilter_row_neon (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter)
+{
+    const uint8x16_t zero = vdupq_n_u8 (0);
+    const uint8x16_t three = vreinterpretq_u8_u32 (vsetq_lane_u32 (0xFFFFFF, vdupq_n_u32 (0), 0));
+    uint8x16_t d, carry = zero;
+    uint8x8_t a = vdup_n_u8 (0), b, r;
+    int16x8_t sa = vdupq_n_s16 (0), sb, sc = vdupq_n_s16 (0);
+    int16x8_t pa, pb, pc, least, pick;
+    uint32_t v;
+    int x = 0;
+
+    if (filter == 2)
+    {
+        for (; x + 16 <= len; x += 16)
+        {
+            vst1q_u8 (row + x, vaddq_u8 (vld1q_u8 (row + x), vld1q_u8 (prev + x)));
+        }
+    }
+    else if ((filter == 1) && (bpp == 4))
+    {
+        for (; x + 16 <= len; x += 16)
+        {
+            d = vaddq_u8 (vld1q_u8 (row + x), carry);
+            d = vaddq_u8 (d, vextq_u8 (zero, d, 12));
+            d = vaddq_u8 (d, vextq_u8 (zero, d, 8));
+            vst1q_u8 (row + x, d);
+            carry = vextq_u8 (d, zero, 12);
+        }
+    }
+    else if ((filter == 1) && (bpp == 3))
+    {
+        for (; x + 16 <= len; x += 12)
+        {
+            d = vaddq_u8 (vld1q_u8 (row + x), carry);
+            d = vaddq_u8 (d, vextq_u8 (zero, d, 13));
+            d = vaddq_u8 (d, vextq_u8 (zero, d, 10));
+            vst1_u8 (row + x, vget_low_u8 (d));
+            v = vgetq_lane_u32 (vreinterpretq_u32_u8 (d), 2);
+            memcpy (row + x + 8, &v, 4);
+            carry = vandq_u8 (vextq_u8 (d, zero, 9), three);
+        }
+    }
+    else if ((filter == 3) && ((bpp == 3) || (bpp == 4)))
+    {
+        for (; x + 4 <= len; x += bpp)
+        {
+            memcpy (&v, prev + x, 4);
+            b = vreinterpret_u8_u32 (vdup_n_u32 (v));
+            memcpy (&v, row + x, 4);
+            r = vreinterpret_u8_u32 (vdup_n_u32 (v));
+            a = vadd_u8 (r, vhadd_u8 (a, b));
+            v = vget_lane_u32 (vreinterpret_u32_u8 (a), 0);
+            memcpy (row + x, &v, (size_t)bpp);
+        }
+    }
+    else if ((filter == 4) && ((bpp == 3) || (bpp == 4)))
+    {
+        for (; x + 4 <= len; x += bpp)
+        {
+            memcpy (&v, prev + x, 4);
+            sb = vreinterpretq_s16_u16 (vmovl_u8 (vreinterpret_u8_u32 (vdup_n_u32 (v))));
+            memcpy (&v, row + x, 4);
+            r = vreinterpret_u8_u32 (vdup_n_u32 (v));
+
+            pa = vsubq_s16 (sb, sc);
+            pb = vsubq_s16 (sa, sc);
+            pc = vabsq_s16 (vaddq_s16 (pa, pb));
+            pa = vabsq_s16 (pa);
+            pb = vabsq_s16 (pb);
+            least = vminq_s16 (vminq_s16 (pa, pb), pc);
+
+            pick = vbslq_s16 (vceqq_s16 (pb, least), sb, sc);
+            pick = vbslq_s16 (vceqq_s16 (pa, least), sa, pick);
+
+            r = vadd_u8 (r, vqmovun_s16 (pick));
+            v = vget_lane_u32 (vreinterpret_u32_u8 (r), 0);
+            memcpy (row + x, &v, (size_t)bpp);
+            sa = vreinterpretq_s16_u16 (vmovl_u8 (r));
+            sc = sb;
+        }
+    }
+
+    unfilter_span (row, prev, x, len, bpp, filter);
+}
+
+
+/* vld3 splits sixteen pixels into r g b registers */
+static void
+rgb_to_rgba_neon (const uint8_t *rgb, uint8_t *rgba, int w)
+{
+    uint8x16x3_t in;
+    uint8x16x4_t out;
+    int x;
+
+    out.val[3] = vdupq_n_u8 (0xFF);
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        in = vld3q_u8 (rgb + x * 3);
+        out.val[0] = in.val[0];
+        out.val[1] = in.val[1];
+        out.val[2] = in.val[2];
+        vst4q_u8 (rgba + x * 4, out);
+    }
+
+    rgb_to_rgba_scalar (rgb + x * 3, rgba + x * 4, w - x);
+}
+
+/* as the sse2 one */
+static void
+lut3d_rgba_neon (uint8_t *rgba, int w, const simd_lut3d *lut)
+{
+    const int n = lut->n;
+    const uint32x4_t low = vdupq_n_u32 (0xFF);
+    const uint32x4_t level = vdupq_n_u32 (0x3FF);
+    const uint32x4_t alpha = vdupq_n_u32 (0xFF000000);
+    const uint32x4_t sr = vdupq_n_u32 ((uint32_t)(n * n));
+    const uint32x4_t sg = vdupq_n_u32 ((uint32_t)n);
+    const uint32x4_t sb = vdupq_n_u32 (1);
+    const uint32x4_t far = vdupq_n_u32 ((uint32_t)(n * n + n + 1));
+    const float32x4_t step = vdupq_n_f32 ((float)(n - 1) / 255.0f);
+    const float32x4_t top = vdupq_n_f32 ((float)(n - 2));
+    const float32x4_t nn = vdupq_n_f32 ((float)(n * n));
+    const float32x4_t ng = vdupq_n_f32 ((float)n);
+    const float32x4_t one = vdupq_n_f32 (1.0f);
+    const float32x4_t scale = vdupq_n_f32 (SIMD_LUT3D_SCALE);
+    const float32x4_t bias = vdupq_n_f32 (SIMD_LUT3D_BIAS);
+    const float32x4_t white = vdupq_n_f32 (255.0f);
+    uint32x4_t p, base, near, skip, out;
+    uint32x4_t c[4];
+    float32x4_t t, k[3], f[3], wt[4], hi, mid, lo, v;
+    uint32_t idx[16];
+    uint32_t corner[16];
+    int x, i, j;
+
+    for (x = 0; x + 4 <= w; x += 4)
+    {
+        p = vld1q_u32 ((const uint32_t *)(rgba + x * 4));
+        for (i = 0; i < 3; i++)
+        {
+            t = vmulq_f32 (vcvtq_f32_u32 (vandq_u32 (vshlq_u32 (p, vdupq_n_s32 (-i * 8)), low)), step);
+            k[i] = vcvtq_f32_u32 (vcvtq_u32_f32 (vminq_f32 (t, top)));
+            f[i] = vsubq_f32 (t, k[i]);
+        }
+        base = vcvtq_u32_f32 (vaddq_f32 (vaddq_f32 (vmulq_f32 (k[0], nn), vmulq_f32 (k[1], ng)), k[2]));
+
+        hi = vmaxq_f32 (f[0], vmaxq_f32 (f[1], f[2]));
+        lo = vminq_f32 (f[0], vminq_f32 (f[1], f[2]));
+        mid = vmaxq_f32 (vminq_f32 (f[0], f[1]), vminq_f32 (vmaxq_f32 (f[0], f[1]), f[2]));
+
+        near = vbslq_u32 (vcgeq_f32 (f[1], f[2]), sg, sb);
+        near = vbslq_u32 (vandq_u32 (vcgeq_f32 (f[0], f[1]), vcgeq_f32 (f[0], f[2])), sr, near);
+        skip = vbslq_u32 (vcltq_f32 (f[1], f[2]), sg, sb);
+        skip = vbslq_u32 (vandq_u32 (vcltq_f32 (f[0], f[1]), vcltq_f32 (f[0], f[2])), sr, skip);
+
+        vst1q_u32 (idx + 0, base);
+        vst1q_u32 (idx + 4, vaddq_u32 (base, near));
+        vst1q_u32 (idx + 8, vaddq_u32 (base, vsubq_u32 (far, skip)));
+        vst1q_u32 (idx + 12, vaddq_u32 (base, far));
+        for (j = 0; j < 16; j++)
+            corner[j] = lut->table[idx[j]];
+
+        wt[0] = vsubq_f32 (one, hi);
+        wt[1] = vsubq_f32 (hi, mid);
+        wt[2] = vsubq_f32 (mid, lo);
+        wt[3] = lo;
+        for (j = 0; j < 4; j++)
+            c[j] = vld1q_u32 (corner + j * 4);
+
+        out = vandq_u32 (p, alpha);
+        for (i = 0; i < 3; i++)
+        {
+            v = vaddq_f32 (vmulq_f32 (vcvtq_f32_u32 (vandq_u32 (vshlq_u32 (c[0], vdupq_n_s32 (-i * 10)), level)), wt[0]),
+                           vmulq_f32 (vcvtq_f32_u32 (vandq_u32 (vshlq_u32 (c[1], vdupq_n_s32 (-i * 10)), level)), wt[1]));
+            v = vaddq_f32 (v, vmulq_f32 (vcvtq_f32_u32 (vandq_u32 (vshlq_u32 (c[2], vdupq_n_s32 (-i * 10)), level)), wt[2]));
+            v = vaddq_f32 (v, vmulq_f32 (vcvtq_f32_u32 (vandq_u32 (vshlq_u32 (c[3], vdupq_n_s32 (-i * 10)), level)), wt[3]));
+            v = vminq_f32 (vmaxq_f32 (vaddq_f32 (vmulq_f32 (v, scale), bias), vdupq_n_f32 (0.0f)), white);
+            out = vorrq_u32 (out, vshlq_u32 (vcvtq_u32_f32 (v), vdupq_n_s32 (i * 8)));
+        }
+        vst1q_u32 ((uint32_t *)(rgba + x * 4), out);
+    }
+
+    lut3d_rgba_scalar (rgba + x * 4, w - x, lut);
+}
+
+#endif
+
+
+static bool
+simd_supported (simd_level level)
+{
+    switch (level)
+    {
+    case SIMD_SCALAR:
+        return true;
+#ifdef SIMD_X86
+    case SIMD_SSE2:
+        return SDL_HasSSE2 ();
+    case SIMD_AVX2:
+        return SDL_HasAVX2 ();
+#endif
+#ifdef SIMD_ARM
+    case SIMD_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/* function definitions */
+/* the best the cpu can do, called once before any decoding */
+void
+simd_init (void)
+{
+    if (!simd_select (SIMD_AVX2) && !simd_select (SIMD_SSE2) && !simd_select (SIMD_NEON))
+        simd_select (SIMD_SCALAR);
+}
+
+
+/* switch every kernel to level, false if the cpu (or the build) does
+   not have it.  not safe while anything is decoding */
+bool
+simd_select (simd_level level)
+{
+    if (!simd_supported (level))
+        return false;
+
+    g_simd.level = level;
+    g_simd.idct_8x8 = idct_8x8_scalar;
+    g_simd.upsample_h2v1 = upsample_h2v1_scalar;
+    g_simd.upsample_h2v2 = upsample_h2v2_scalar;
+    g_simd.ycc_to_rgba = ycc_to_rgba_scalar;
+    g_simd.diff_rgba = diff_rgba_scalar;
+    g_simd.luma_rgba = luma_rgba_scalar;
+    g_simd.tonemap_rgba = tonemap_rgba_scalar;
+    g_simd.unfilter_row = unfilter_row_scalar;
+    g_simd.rgb_to_rgba = rgb_to_rgba_scalar;
+    g_simd.lut3d_rgba = lut3d_rgba_scalar;
+
+    switch (level)
+    {
+#ifdef SIMD_X86
+    /* the upsamplers are memory bound and most png filters wait on the
+       pixel to the left, AVX2 keeps the SSE2 ones */
+    case SIMD_AVX2:
+        g_simd.idct_8x8 = idct_8x8_avx2;
+        g_simd.upsample_h2v1 = upsample_h2v1_sse2;
+        g_simd.upsample_h2v2 = upsample_h2v2_sse2;
+        g_simd.ycc_to_rgba = ycc_to_rgba_avx2;
+        g_simd.diff_rgba = diff_rgba_avx2;
+        g_simd.luma_rgba = luma_rgba_avx2;
+        g_simd.tonemap_rgba = tonemap_rgba_avx2;
+        g_simd.unfilter_row = unfilter_row_sse2;
+        g_simd.rgb_to_rgba = rgb_to_rgba_avx2;
+        g_simd.lut3d_rgba = lut3d_rgba_avx2;
+        break;
+    case SIMD_SSE2:
+        g_simd.idct_8x8 = idct_8x8_sse2;
+        g_simd.upsample_h2v1 = upsample_h2v1_sse2;
+        g_simd.upsample_h2v2 = upsample_h2v2_sse2;
+        g_simd.ycc_to_rgba = ycc_to_rgba_sse2;
+        g_simd.diff_rgba = diff_rgba_sse2;
+        g_simd.luma_rgba = luma_rgba_sse2;
+        g_simd.tonemap_rgba = tonemap_rgba_sse2;
+        g_simd.unfilter_row = unfilter_row_sse2;
+        g_simd.lut3d_rgba = lut3d_rgba_sse2;
+        break;
+#endif
+#ifdef SIMD_ARM
+    case SIMD_NEON:
+        g_simd.idct_8x8 = idct_8x8_neon;
+        g_simd.upsample_h2v1 = upsample_h2v1_neon;
+        g_simd.upsample_h2v2 = upsample_h2v2_neon;
+        g_simd.ycc_to_rgba = ycc_to_rgba_neon;
+        g_simd.diff_rgba = diff_rgba_neon;
+        g_simd.luma_rgba = luma_rgba_neon;
+        g_simd.tonemap_rgba = tonemap_rgba_neon;
+        g_simd.unfilter_row = unfilter_row_neon;
+        g_simd.rgb_to_rgba = rgb_to_rgba_neon;
+        g_simd.lut3d_rgba = lut3d_rgba_neon;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return true;
+}
+
+
+const char *
+simd_name (simd_level level)
+{
+    static const char *const names[SIMD_LEVEL_COUNT] = { "scalar", "sse2", "avx2", "neon" };
+
+    return ((level >= 0) && (level < SIMD_LEVEL_COUNT)) ? names[level] : "?";
+}
+
+
+/* dequantization table for idct_8x8: the AAN idct leaves each
+   coefficient short by cos(k*pi/16)*sqrt(2) in each direction, and the
+   output by 8 */
+void
+simd_idct_table (const uint16_t *quant, float *qt)
+{
+    double scale[8];
+    int r, c;
+
+    scale[0] = 1.0;
+    for (r = 1; r < 8; r++)
+    {
+        scale[r] = cos (r * 3.14159265358979323846 / 16.0) * sqrt (2.0);
+    }
+
+    for (r = 0; r < 8; r++)
+    {
+        for (c = 0; c < 8; c++)
+        {
+            qt[r * 8 + c] = (float)(quant[r * 8 + c] * scale[r] * scale[c] / 8.0);
+        }
+    }
+}
+
+
+/* End of File */
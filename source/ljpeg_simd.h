@@ -0,0 +1,140 @@
+/*
+   source/ljpeg_simd.h
+   LJPEG vector kernels header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_SIMD_HEADER__
+#define __LJPEG_SIMD_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+typedef enum simd_level
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON,
+    SIMD_LEVEL_COUNT
+} simd_level;
+
+/* how tonemap_rgba turns linear light into display levels: times gain,
+   through x (1 + x k) / (1 + x) with curve set (k is 1 / white squared,
+   white being the level that comes out white), clamped, and to srgb
+   through lut, which is SIMD_TONEMAP_LUT entries over 0 to 1 and can be
+   read 3 bytes past its end */
+typedef struct simd_tonemap
+{
+    float          gain;
+    float          k;
+    bool           curve;
+    const uint8_t *lut;
+} simd_tonemap;
+
+/* a colour transform sampled n times along each of r, g and b over 0 to
+   255 (n at least 2), table[(r * n + g) * n + b] holding the r, g and b
+   it becomes as r | g << 10 | b << 20.  the levels, 0 to 1023, run from
+   SIMD_LUT3D_MIN to SIMD_LUT3D_MAX so that points just outside the
+   gamut still pull the pixels inside it the right way, the pixels are
+   clipped to 0 to 1 once interpolated */
+typedef struct simd_lut3d
+{
+    const uint32_t *table;
+    int             n;
+} simd_lut3d;
+
+/* filled in by simd_init, which has to run before any decoding */
+typedef struct simd_kernels
+{
+    simd_level level;
+
+    /* coef in natural order times qt (dequantization with the idct's
+       scaling folded in, see simd_idct_table), 8x8 pixels to out */
+    void (*idct_8x8) (const int16_t *coef, const float *qt, uint8_t *out, ptrdiff_t stride);
+
+    /* libjpeg's "fancy" triangle filter, in_w samples to 2 * in_w.
+       h2v2 takes the nearer and the further of the two rows around
+       the output row */
+    void (*upsample_h2v1) (const uint8_t *in, uint8_t *out, int in_w);
+    void (*upsample_h2v2) (const uint8_t *near, const uint8_t *far, uint8_t *out, int in_w);
+
+    /* jfif ycbcr to DECODE_PIXELFORMAT, w pixels */
+    void (*ycc_to_rgba) (const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgba, int w);
+
+    /* w DECODE_PIXELFORMAT pixels of a against b: the largest of each
+       pixel's r, g and b differences to mag, returns the squared
+       differences summed over r, g and b */
+    uint64_t (*diff_rgba) (const uint8_t *a, const uint8_t *b, uint8_t *mag, int w);
+
+    /* w DECODE_PIXELFORMAT pixels: each one's bt.601 luma to luma, and
+       the pixels with r, g or b at 0 added to clipped[0], at 255 to
+       clipped[1] */
+    void (*luma_rgba) (const uint8_t *rgba, uint8_t *luma, int w, uint32_t *clipped);
+
+    /* w pixels of half float rgba to DECODE_PIXELFORMAT as tm says.
+       alpha is only clamped, negative values and infinities count as 0
+       and 65536 */
+    void (*tonemap_rgba) (const uint16_t *half, uint8_t *rgba, int w, const simd_tonemap *tm);
+
+    /* png filter type filter (1 sub, 2 up, 3 average, 4 paeth, others
+       none) taken off the len bytes of row in place.  prev is the row
+       above, already unfiltered (zeros above the first), bpp the bytes
+       a pixel, at least 1 */
+    void (*unfilter_row) (uint8_t *row, const uint8_t *prev, int len, int bpp, int filter);
+
+    /* w rgb pixels to DECODE_PIXELFORMAT, opaque */
+    void (*rgb_to_rgba) (const uint8_t *rgb, uint8_t *rgba, int w);
+
+    /* w DECODE_PIXELFORMAT pixels in place through lut, interpolated
+       between the 4 points of the tetrahedron around each.  alpha is
+       left alone */
+    void (*lut3d_rgba) (uint8_t *rgba, int w, const simd_lut3d *lut);
+} simd_kernels;
+
+
+/* constants */
+#define SIMD_TONEMAP_LUT 4096
+#define SIMD_LUT3D_MIN   (-0.25f)
+#define SIMD_LUT3D_MAX   1.25f
+
+
+/* global variables */
+extern simd_kernels g_simd;
+
+
+/* external function prototypes */
+void        simd_init (void);
+bool        simd_select (simd_level level);
+const char *simd_name (simd_level level);
+
+void simd_idct_table (const uint16_t *quant, float *qt);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,436 @@
+/*
+   source/ljpeg_stats.c
+   LJPEG histogram and pixel statistics source code.
+
+   As a still image is decoded its surface is handed here before it is
+   uploaded, and the worker threads count it in bands of rows while the
+   texture is made: the vector kernels work out each pixel's luma and
+   whether it is clipped, the histograms are plain counting.  Nothing
+   waits on them, the image is shown as soon as it is uploaded and the
+   figures are kept with it until the next image, so the overlay costs
+   nothing to bring up again.  The workers are started once, by
+   stats_init, and are shared by every image after.
+
+   The overlay is the r, g and b histograms (luma as a line over them)
+   in the bottom left corner, the figures go in the title.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_stats.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+image_stats g_stats;
+Uint32      g_stats_event = (Uint32)-1;
+
+
+/* file static variables */
+/* rows a worker counts at once, and pixels the luma is worked out for
+   at once */
+#define STATS_BAND 128
+#define STATS_SPAN 1024
+
+/* the overlay's distance from the window's corner */
+#define STATS_MARGIN 8
+
+
+/* file static function prototypes */
+static void stats_band_job (void *arg);
+static void stats_figures (image_stats *st);
+static int  stats_draw (image_stats *st, SDL_Renderer *rend);
+static void stats_report (image_stats *st);
+
+
+/* static function definitions */
+/* worker side: the band's rows a span at a time, the main thread is
+   woken once the last band is in */
+static void
+stats_band_job (void *arg)
+{
+    stats_band *band = (stats_band *)arg;
+    image_stats *st = band->st;
+    pixel_counts *counts = &band->counts;
+    uint8_t luma[STATS_SPAN];
+    uint32_t clipped[2];
+    const uint8_t *row, *p;
+    SDL_Event evt;
+    int w = st->surface->w;
+    int x0, n;
+    int x, y;
+
+    for (y = band->y0; y < band->y1; y++)
+    {
+        row = (const uint8_t *)st->surface->pixels + (size_t)y * (size_t)st->surface->pitch;
+        clipped[0] = clipped[1] = 0;
+        for (x0 = 0; x0 < w; x0 += STATS_SPAN)
+        {
+            n = SDL_min (STATS_SPAN, w - x0);
+            p = row + (size_t)x0 * 4;
+            g_simd.luma_rgba (p, luma, n, clipped);
+            for (x = 0; x < n; x++)
+            {
+                counts->hist[STATS_RED][p[x * 4]]++;
+                counts->hist[STATS_GREEN][p[x * 4 + 1]]++;
+                counts->hist[STATS_BLUE][p[x * 4 + 2]]++;
+                counts->hist[STATS_LUMA][luma[x]]++;
+            }
+        }
+        counts->clipped[0] += clipped[0];
+        counts->clipped[1] += clipped[1];
+    }
+    counts->pixels = (uint64_t)w * (uint64_t)(band->y1 - band->y0);
+
+    if (SDL_AtomicAdd (&st->bands_left, -1) == 1)
+    {
+        SDL_zero (evt);
+        evt.type = g_stats_event;
+        SDL_PushEvent (&evt);
+    }
+}
+
+
+/* add up the bands, the lowest, highest and mean levels come from the
+   histograms */
+static void
+stats_figures (image_stats *st)
+{
+    pixel_counts *counts = &st->counts;
+    uint64_t sum;
+    int i, c, v;
+
+    memset (counts, 0, sizeof (pixel_counts));
+    for (i = 0; i < st->band_count; i++)
+    {
+        for (c = 0; c < STATS_CHANNELS; c++)
+        {
+            for (v = 0; v < 256; v++)
+            {
+                counts->hist[c][v] += st->bands[i].counts.hist[c][v];
+            }
+        }
+        counts->pixels += st->bands[i].counts.pixels;
+        counts->clipped[0] += st->bands[i].counts.clipped[0];
+        counts->clipped[1] += st->bands[i].counts.clipped[1];
+    }
+
+    for (c = 0; c < STATS_CHANNELS; c++)
+    {
+        st->min[c] = 255;
+        st->max[c] = 0;
+        sum = 0;
+        for (v = 0; v < 256; v++)
+        {
+            if (counts->hist[c][v] == 0)
+                continue;
+            st->min[c] = SDL_min (st->min[c], v);
+            st->max[c] = v;
+            sum += (uint64_t)counts->hist[c][v] * (uint64_t)v;
+        }
+        st->mean[c] = (counts->pixels > 0) ? (double)sum / (double)counts->pixels : 0.0;
+    }
+}
+
+
+/* the histograms over a dark background, r g and b added together
+   where they overlap.  scaled to the highest bin short of the ends, so
+   a clipped image still shows the rest */
+static int
+stats_draw (image_stats *st, SDL_Renderer *rend)
+{
+    const int h = HISTOGRAM_HEIGHT;
+    SDL_Surface *panel;
+    Uint32 *row;
+    uint32_t peak = 1;
+    int bar[STATS_CHANNELS];
+    int level;
+    int c, v, y;
+
+    for (c = 0; c < STATS_CHANNELS; c++)
+    {
+        for (v = 1; v < 255; v++)
+        {
+            peak = SDL_max (peak, st->counts.hist[c][v]);
+        }
+    }
+
+    panel = SDL_CreateRGBSurfaceWithFormat (0, 256, h, 32, DECODE_PIXELFORMAT);
+    if (panel == NULL)
+        goto stats_draw_failure_0;
+
+    for (v = 0; v < 256; v++)
+    {
+        for (c = 0; c < STATS_CHANNELS; c++)
+        {
+            bar[c] = (int)SDL_min ((uint64_t)st->counts.hist[c][v] * (uint64_t)h / peak, (uint64_t)h);
+        }
+        for (y = 0; y < h; y++)
+        {
+            row = (Uint32 *)((Uint8 *)panel->pixels + (size_t)y * (size_t)panel->pitch);
+            level = h - y;
+            if ((bar[STATS_LUMA] > 0) && (level == bar[STATS_LUMA]))
+                row[v] = SDL_MapRGBA (panel->format, 240, 240, 240, SDL_ALPHA_OPAQUE);
+            else
+                row[v] = SDL_MapRGBA (panel->format,
+                                      (bar[STATS_RED] >= level) ? 220 : 0,
+                                      (bar[STATS_GREEN] >= level) ? 220 : 0,
+                                      (bar[STATS_BLUE] >= level) ? 220 : 0,
+                                      ((bar[STATS_RED] >= level) || (bar[STATS_GREEN] >= level) ||
+                                       (bar[STATS_BLUE] >= level)) ? 220 : 160);
+        }
+    }
+
+    st->texture = SDL_CreateTextureFromSurface (rend, panel);
+    SDL_FreeSurface (panel);
+    if (st->texture == NULL)
+        goto stats_draw_failure_0;
+    SDL_SetTextureBlendMode (st->texture, SDL_BLENDMODE_BLEND);
+
+/* stats_draw_success_0: */
+    return EXIT_SUCCESS;
+
+stats_draw_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+/* the figures in the title while the overlay is up */
+static void
+stats_report (image_stats *st)
+{
+    static const char names[STATS_CHANNELS] = { 'R', 'G', 'B', 'Y' };
+    char title[256];
+    size_t len;
+    int c;
+
+    if (!st->active)
+    {
+        SDL_SetWindowTitle (g_win, "LJPEG - no statistics for this image");
+        return;
+    }
+    if (!st->ready)
+    {
+        SDL_SetWindowTitle (g_win, "LJPEG - counting pixels");
+        return;
+    }
+
+    len = (size_t)snprintf (title, sizeof (title), "LJPEG");
+    for (c = 0; (c < STATS_CHANNELS) && (len < sizeof (title)); c++)
+    {
+        len += (size_t)snprintf (title + len, sizeof (title) - len, " - %c %d-%d mean %.1f",
+                                 names[c], st->min[c], st->max[c], st->mean[c]);
+    }
+    if (len < sizeof (title))
+        snprintf (title + len, sizeof (title) - len, " - clipped %.2f%% black %.2f%% white",
+                  (double)st->counts.clipped[0] * 100.0 / (double)st->counts.pixels,
+                  (double)st->counts.clipped[1] * 100.0 / (double)st->counts.pixels);
+    SDL_SetWindowTitle (g_win, title);
+}
+
+
+/* function definitions */
+void
+stats_init (image_stats *st)
+{
+    memset (st, 0, sizeof (image_stats));
+
+    /* without workers there are no statistics */
+    st->pool = workers_create (workers_default_count (), (worker_rank_fn)NULL);
+}
+
+
+void
+stats_shutdown (image_stats *st)
+{
+    stats_close (st);
+    workers_destroy (st->pool);
+    memset (st, 0, sizeof (image_stats));
+}
+
+
+/* start counting surface on the workers.  a reference to it is held
+   until they are done, so the caller can free it as usual once it is
+   uploaded */
+int
+stats_open (image_stats *st, SDL_Surface *surface)
+{
+    worker_pool *pool = st->pool;
+    bool shown = st->shown;
+    stats_band *band;
+    int i;
+
+    /* the overlay stays up from one image to the next */
+    memset (st, 0, sizeof (image_stats));
+    st->pool = pool;
+    st->shown = shown;
+    if (g_stats_event == (Uint32)-1)
+        g_stats_event = SDL_RegisterEvents (1);
+
+    if (st->pool == NULL)
+    {
+        SDL_SetError ("statistics: no workers");
+        goto stats_open_failure_0;
+    }
+    if (surface->format->format != DECODE_PIXELFORMAT)
+    {
+        SDL_SetError ("statistics: unexpected pixel format");
+        goto stats_open_failure_0;
+    }
+
+    st->band_count = SDL_max ((surface->h + STATS_BAND - 1) / STATS_BAND, 1);
+    st->bands = calloc ((size_t)st->band_count, sizeof (stats_band));
+    if (st->bands == NULL)
+        goto stats_open_failure_0;
+    for (i = 0; i < st->band_count; i++)
+    {
+        band = &st->bands[i];
+        band->st = st;
+        band->y0 = i * STATS_BAND;
+        band->y1 = SDL_min (band->y0 + STATS_BAND, surface->h);
+    }
+
+    surface->refcount++;
+    st->surface = surface;
+    st->opened = SDL_GetPerformanceCounter ();
+    SDL_AtomicSet (&st->bands_left, st->band_count);
+    st->active = true;
+
+    for (i = 0; i < st->band_count; i++)
+    {
+        if (workers_submit (st->pool, stats_band_job, &st->bands[i]) != EXIT_SUCCESS)
+            goto stats_open_failure_1;
+    }
+
+    if (st->shown)
+        stats_report (st);
+
+/* stats_open_success_0: */
+    return EXIT_SUCCESS;
+
+stats_open_failure_1:
+    workers_cancel (st->pool);
+    workers_wait (st->pool);
+    SDL_FreeSurface (st->surface);
+    free (st->bands);
+stats_open_failure_0:
+    memset (st, 0, sizeof (image_stats));
+    st->pool = pool;
+    st->shown = shown;
+    if (shown)
+        stats_report (st);
+    return EXIT_FAILURE;
+}
+
+
+void
+stats_close (image_stats *st)
+{
+    worker_pool *pool = st->pool;
+    bool shown = st->shown;
+
+    if (!st->active)
+        return;
+
+    /* queued bands are dropped, running ones finish first */
+    workers_cancel (st->pool);
+    workers_wait (st->pool);
+
+    if (st->surface != NULL)
+        SDL_FreeSurface (st->surface);
+    if (st->texture != NULL)
+        SDL_DestroyTexture (st->texture);
+    free (st->bands);
+    memset (st, 0, sizeof (image_stats));
+    st->pool = pool;
+    st->shown = shown;
+}
+
+
+/* take in the figures once every band is counted, true when they came
+   in with this call */
+bool
+stats_update (image_stats *st)
+{
+    if (!st->active || st->ready || (SDL_AtomicGet (&st->bands_left) > 0))
+        return false;
+
+    stats_figures (st);
+
+    /* the last band may still be on its way out of its job, the pixels
+       are not needed any more */
+    workers_wait (st->pool);
+    SDL_FreeSurface (st->surface);
+    st->surface = NULL;
+    free (st->bands);
+    st->bands = NULL;
+    st->ready = true;
+
+    if (st->shown)
+        stats_report (st);
+
+    return true;
+}
+
+
+/* the overlay in the bottom left corner, when it is up */
+void
+stats_render (image_stats *st, SDL_Renderer *rend)
+{
+    SDL_Rect dst;
+    int out_w, out_h;
+
+    if (!st->shown || !st->ready)
+        return;
+    if ((st->texture == NULL) && (stats_draw (st, rend) != EXIT_SUCCESS))
+        return;
+
+    SDL_GetRendererOutputSize (rend, &out_w, &out_h);
+    dst.w = 256;
+    dst.h = HISTOGRAM_HEIGHT;
+    dst.x = STATS_MARGIN;
+    dst.y = out_h - dst.h - STATS_MARGIN;
+    SDL_RenderCopy (rend, st->texture, NULL, &dst);
+}
+
+
+/* the overlay and the figures on or off */
+void
+stats_toggle (image_stats *st)
+{
+    st->shown = !st->shown;
+    if (st->shown)
+        stats_report (st);
+    else
+        SDL_SetWindowTitle (g_win, "LJPEG Image Viewer");
+}
+
+
+/* End of File */
@@ -0,0 +1,105 @@
+/*
+   source/ljpeg_stats.h
+   LJPEG histogram and pixel statistics header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_STATS_HEADER__
+#define __LJPEG_STATS_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+typedef enum stats_channel
+{
+    STATS_RED,
+    STATS_GREEN,
+    STATS_BLUE,
+    STATS_LUMA,
+    STATS_CHANNELS
+} stats_channel;
+
+typedef struct pixel_counts
+{
+    uint32_t hist[STATS_CHANNELS][256];
+    uint64_t pixels;
+    uint64_t clipped[2];        /* r, g or b at 0, and at 255 */
+} pixel_counts;
+
+/* STATS_BAND rows of the surface, counted on a worker */
+typedef struct stats_band
+{
+    struct image_stats *st;
+    int           y0, y1;
+    pixel_counts  counts;
+} stats_band;
+
+typedef struct image_stats
+{
+    bool          active;       /* counting, or counted */
+    bool          ready;        /* the figures cover the whole image */
+    bool          shown;        /* the overlay is up */
+
+    SDL_Surface  *surface;      /* a reference, held until the bands are in */
+    stats_band   *bands;
+    int           band_count;
+    worker_pool  *pool;
+    SDL_atomic_t  bands_left;
+
+    /* the figures, once ready */
+    pixel_counts  counts;
+    int           min[STATS_CHANNELS];
+    int           max[STATS_CHANNELS];
+    double        mean[STATS_CHANNELS];
+    SDL_Texture  *texture;      /* the histograms, drawn on first show */
+    Uint64        opened;
+} image_stats;
+
+
+/* constants */
+
+
+/* global variables */
+extern image_stats g_stats;
+extern Uint32      g_stats_event;
+
+
+/* external function prototypes */
+void stats_init     (image_stats *st);
+void stats_shutdown (image_stats *st);
+
+int  stats_open  (image_stats *st, SDL_Surface *surface);
+void stats_close (image_stats *st);
+
+bool stats_update (image_stats *st);
+void stats_render (image_stats *st, SDL_Renderer *rend);
+void stats_toggle (image_stats *st);
+
+#endif /* end run once */
+
+
+/* End of File */
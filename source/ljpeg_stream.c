@@ -0,0 +1,699 @@
+/*
+   source/ljpeg_stream.c
+   LJPEG streaming (stdin and pipe) input source code.
+
+   A reader thread collects whatever arrives on the descriptor, the main
+   thread feeds it to libjpeg through a suspending data source: when the
+   decoder runs out of bytes it backs out and is simply called again
+   once more have arrived.  Baseline jpegs are shown row by row as they
+   decode, progressive ones are decoded in buffered image mode and the
+   newest completed scan is shown each time one finishes.  Formats with
+   no DECODE_INCREMENTAL backend are collected whole and decoded at the
+   end of the stream.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* poll, read and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_stream.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include <SDL2/SDL.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_graphics.h"
+
+
+/* global variable declarations */
+stream_input g_stream;
+Uint32       g_stream_event = (Uint32)-1;
+
+
+/* file static variables */
+/* cinfo has to come first, the libjpeg callbacks cast back from it */
+typedef struct stream_jpeg
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr         err;
+    struct jpeg_source_mgr        src;
+    jmp_buf                       jump;
+    stream_input                 *stream;
+    size_t                        skip;         /* skipped past the data so far */
+    int                           completed_scan;
+    unsigned char                *row;
+} stream_jpeg;
+
+static const JOCTET s_fake_eoi[2] = { 0xFF, JPEG_EOI };
+
+
+/* file static function prototypes */
+#ifndef _WIN32
+static int  stream_reader (void *data);
+#endif
+static void stream_take_pending (stream_input *stream);
+static bool stream_step (stream_input *stream);
+static bool stream_step_jpeg (stream_input *stream);
+static int  stream_create_canvas (stream_input *stream, int w, int h);
+static void stream_free_decoder (stream_input *stream);
+
+static void    jpeg_stream_error_exit (j_common_ptr cinfo);
+static void    jpeg_stream_noop (j_decompress_ptr cinfo);
+static boolean jpeg_stream_fill (j_decompress_ptr cinfo);
+static void    jpeg_stream_skip (j_decompress_ptr cinfo, long num_bytes);
+
+
+/* static function definitions */
+static void
+jpeg_stream_error_exit (j_common_ptr cinfo)
+{
+    stream_jpeg *sj = (stream_jpeg *)cinfo;
+
+    (*cinfo->err->output_message) (cinfo);
+    longjmp (sj->jump, 1);
+}
+
+
+static void
+jpeg_stream_noop (j_decompress_ptr cinfo)
+{
+    (void)cinfo;
+}
+
+
+/* out of bytes: suspend, unless the stream has ended in which case the
+   image is cut short with a fake end of image marker */
+static boolean
+jpeg_stream_fill (j_decompress_ptr cinfo)
+{
+    stream_jpeg *sj = (stream_jpeg *)cinfo;
+
+    if (!sj->stream->ended)
+        return FALSE;
+
+    WARNMS (cinfo, JWRN_JPEG_EOF);
+    sj->src.next_input_byte = s_fake_eoi;
+    sj->src.bytes_in_buffer = sizeof (s_fake_eoi);
+    return TRUE;
+}
+
+
+/* skips may reach past what has arrived, the rest is owed to later data */
+static void
+jpeg_stream_skip (j_decompress_ptr cinfo, long num_bytes)
+{
+    stream_jpeg *sj = (stream_jpeg *)cinfo;
+
+    if (num_bytes <= 0)
+        return;
+
+    if ((size_t)num_bytes <= sj->src.bytes_in_buffer)
+    {
+        sj->src.next_input_byte += num_bytes;
+        sj->src.bytes_in_buffer -= (size_t)num_bytes;
+        return;
+    }
+
+    sj->skip += (size_t)num_bytes - sj->src.bytes_in_buffer;
+    sj->src.next_input_byte += sj->src.bytes_in_buffer;
+    sj->src.bytes_in_buffer = 0;
+}
+
+
+#ifndef _WIN32
+/* collect whatever arrives, waking the main thread each time */
+static int
+stream_reader (void *data)
+{
+    stream_input *stream = (stream_input *)data;
+    unsigned char *grown;
+    unsigned char *chunk;
+    struct pollfd pfd;
+    SDL_Event evt;
+    ssize_t got;
+    size_t new_cap;
+    bool quit = false;
+
+    chunk = malloc (STREAM_CHUNK);
+    if (chunk == NULL)
+        goto stream_reader_exit_0;
+
+    while (!quit)
+    {
+        /* poll so stream_close never waits on a writer that went quiet */
+        pfd.fd = stream->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll (&pfd, 1, 100) <= 0)
+        {
+            SDL_LockMutex (stream->lock);
+            quit = stream->quit;
+            SDL_UnlockMutex (stream->lock);
+            continue;
+        }
+
+        got = read (stream->fd, chunk, STREAM_CHUNK);
+        if ((got < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+            continue;
+        if (got < 0)
+            perror ("stdin");
+        if (got <= 0)
+            break;
+
+        SDL_LockMutex (stream->lock);
+        if (stream->pending_len + (size_t)got > stream->pending_cap)
+        {
+            new_cap = (stream->pending_cap == 0) ? STREAM_CHUNK * 4 : stream->pending_cap * 2;
+            while (new_cap < stream->pending_len + (size_t)got)
+                new_cap *= 2;
+            grown = realloc (stream->pending, new_cap);
+            if (grown == NULL)
+            {
+                SDL_UnlockMutex (stream->lock);
+                break;
+            }
+            stream->pending = grown;
+            stream->pending_cap = new_cap;
+        }
+        memcpy (stream->pending + stream->pending_len, chunk, (size_t)got);
+        stream->pending_len += (size_t)got;
+        quit = stream->quit;
+        SDL_CondBroadcast (stream->arrived);
+        SDL_UnlockMutex (stream->lock);
+
+        if (SDL_AtomicSet (&stream->notified, 1) == 0)
+        {
+            SDL_zero (evt);
+            evt.type = g_stream_event;
+            SDL_PushEvent (&evt);
+        }
+    }
+    free (chunk);
+
+stream_reader_exit_0:
+    SDL_LockMutex (stream->lock);
+    stream->eof = true;
+    SDL_CondBroadcast (stream->arrived);
+    SDL_UnlockMutex (stream->lock);
+
+    SDL_zero (evt);
+    evt.type = g_stream_event;
+    SDL_PushEvent (&evt);
+
+    return 0;
+}
+#endif
+
+
+/* move what the reader collected onto the end of stream->data, keeping
+   libjpeg's view of the buffer in step */
+static void
+stream_take_pending (stream_input *stream)
+{
+    stream_jpeg *sj = (stream_jpeg *)stream->decoder;
+    unsigned char *grown;
+    size_t consumed = 0;
+    size_t new_cap, skip;
+
+    SDL_AtomicSet (&stream->notified, 0);
+
+    /* where libjpeg got up to, it only ever needs what is after it */
+    if ((sj != NULL) && (sj->src.next_input_byte != s_fake_eoi) &&
+        (sj->src.next_input_byte != s_fake_eoi + sizeof (s_fake_eoi)))
+    {
+        consumed = (size_t)(sj->src.next_input_byte - stream->data);
+        if (consumed > STREAM_CHUNK * 4)
+        {
+            memmove (stream->data, stream->data + consumed, stream->data_len - consumed);
+            stream->data_len -= consumed;
+            consumed = 0;
+        }
+    }
+
+    SDL_LockMutex (stream->lock);
+    if (stream->pending_len > 0)
+    {
+        if (stream->data_len + stream->pending_len > stream->data_cap)
+        {
+            new_cap = (stream->data_cap == 0) ? STREAM_CHUNK * 4 : stream->data_cap * 2;
+            while (new_cap < stream->data_len + stream->pending_len)
+                new_cap *= 2;
+            grown = realloc (stream->data, new_cap);
+            if (grown != NULL)
+            {
+                stream->data = grown;
+                stream->data_cap = new_cap;
+            }
+        }
+        if (stream->data_len + stream->pending_len <= stream->data_cap)
+        {
+            memcpy (stream->data + stream->data_len, stream->pending, stream->pending_len);
+            stream->data_len += stream->pending_len;
+            stream->pending_len = 0;
+        }
+    }
+    SDL_UnlockMutex (stream->lock);
+
+    if ((sj == NULL) || (sj->src.next_input_byte == s_fake_eoi) ||
+        (sj->src.next_input_byte == s_fake_eoi + sizeof (s_fake_eoi)))
+        return;
+
+    /* pay off any skip that ran past the end last time */
+    skip = sj->skip;
+    if (skip > stream->data_len - consumed)
+        skip = stream->data_len - consumed;
+    consumed += skip;
+    sj->skip -= skip;
+
+    sj->src.next_input_byte = stream->data + consumed;
+    sj->src.bytes_in_buffer = stream->data_len - consumed;
+}
+
+
+static int
+stream_create_canvas (stream_input *stream, int w, int h)
+{
+    stream->canvas = SDL_CreateRGBSurfaceWithFormat (0, w, h, 32, DECODE_PIXELFORMAT);
+    if (stream->canvas == NULL)
+        return EXIT_FAILURE;
+    SDL_FillRect (stream->canvas, NULL, 0);
+
+    stream->texture = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT, SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (stream->texture == NULL)
+    {
+        SDL_FreeSurface (stream->canvas);
+        stream->canvas = NULL;
+        return EXIT_FAILURE;
+    }
+    SDL_SetTextureBlendMode (stream->texture, SDL_BLENDMODE_BLEND);
+    SDL_UpdateTexture (stream->texture, NULL, stream->canvas->pixels, stream->canvas->pitch);
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+stream_free_decoder (stream_input *stream)
+{
+    stream_jpeg *sj = (stream_jpeg *)stream->decoder;
+
+    if (sj == NULL)
+        return;
+
+    jpeg_destroy_decompress (&sj->cinfo);
+    free (sj->row);
+    free (sj);
+    stream->decoder = NULL;
+
+    if (stream->canvas != NULL)
+        SDL_FreeSurface (stream->canvas);
+    stream->canvas = NULL;
+}
+
+
+/* run the jpeg decoder as far as the data allows.  returns true when
+   the texture changed */
+static bool
+stream_step_jpeg (stream_input *stream)
+{
+    stream_jpeg *sj = (stream_jpeg *)stream->decoder;
+    struct jpeg_decompress_struct *cinfo = &sj->cinfo;
+    volatile bool changed = false;
+    int first_row;
+    unsigned char *dst;
+    JSAMPROW row;
+    JDIMENSION x;
+    SDL_Rect rows;
+    int status;
+
+    if (setjmp (sj->jump))
+    {
+        /* keep showing whatever made it */
+        stream->phase = STREAM_FAILED;
+        stream_free_decoder (stream);
+        return changed;
+    }
+
+    for (;;)
+    {
+        switch (stream->phase)
+        {
+        case STREAM_HEADER:
+            if (jpeg_read_header (cinfo, TRUE) == JPEG_SUSPENDED)
+                return changed;
+            cinfo->out_color_space = JCS_RGB;
+            cinfo->buffered_image = jpeg_has_multiple_scans (cinfo);
+            jpeg_calc_output_dimensions (cinfo);
+            sj->row = malloc ((size_t)cinfo->output_width * 3);
+            if ((sj->row == NULL) ||
+                (stream_create_canvas (stream, (int)cinfo->output_width, (int)cinfo->output_height) != EXIT_SUCCESS))
+                longjmp (sj->jump, 1);
+            stream->phase = STREAM_START;
+            changed = true;
+            break;
+
+        case STREAM_START:
+            if (!jpeg_start_decompress (cinfo))
+                return changed;
+            stream->phase = cinfo->buffered_image ? STREAM_OUTPUT_START : STREAM_SCANLINES;
+            break;
+
+        case STREAM_OUTPUT_START:
+            /* soak up all the input there is, then show the newest scan
+               that is complete.  scans that arrived together are skipped */
+            do
+            {
+                status = jpeg_consume_input (cinfo);
+                if ((status == JPEG_SCAN_COMPLETED) || (status == JPEG_REACHED_EOI))
+                    sj->completed_scan = cinfo->input_scan_number;
+            } while ((status != JPEG_SUSPENDED) && (status != JPEG_REACHED_EOI));
+
+            if (sj->completed_scan <= stream->shown_scan)
+                return changed;
+            if (!jpeg_start_output (cinfo, sj->completed_scan))
+                return changed;
+            stream->phase = STREAM_SCANLINES;
+            break;
+
+        case STREAM_SCANLINES:
+            first_row = (int)cinfo->output_scanline;
+            while (cinfo->output_scanline < cinfo->output_height)
+            {
+                dst = (unsigned char *)stream->canvas->pixels +
+                      (size_t)cinfo->output_scanline * (size_t)stream->canvas->pitch;
+                row = sj->row;
+                if (jpeg_read_scanlines (cinfo, &row, 1) == 0)
+                    break;
+                for (x = 0; x < cinfo->output_width; x++)
+                {
+                    dst[x * 4 + 0] = sj->row[x * 3 + 0];
+                    dst[x * 4 + 1] = sj->row[x * 3 + 1];
+                    dst[x * 4 + 2] = sj->row[x * 3 + 2];
+                    dst[x * 4 + 3] = 0xFF;
+                }
+            }
+
+            /* baseline images are shown as the rows come in */
+            if (!cinfo->buffered_image && ((int)cinfo->output_scanline > first_row))
+            {
+                rows.x = 0;
+                rows.y = first_row;
+                rows.w = stream->canvas->w;
+                rows.h = (int)cinfo->output_scanline - first_row;
+                SDL_UpdateTexture (stream->texture, &rows,
+                                   (unsigned char *)stream->canvas->pixels + (size_t)rows.y * (size_t)stream->canvas->pitch,
+                                   stream->canvas->pitch);
+                changed = true;
+            }
+            if (cinfo->output_scanline < cinfo->output_height)
+                return changed;
+            stream->phase = cinfo->buffered_image ? STREAM_OUTPUT_FINISH : STREAM_FINISH;
+            break;
+
+        case STREAM_OUTPUT_FINISH:
+            if (!jpeg_finish_output (cinfo))
+                return changed;
+            stream->shown_scan = cinfo->output_scan_number;
+            SDL_UpdateTexture (stream->texture, NULL, stream->canvas->pixels, stream->canvas->pitch);
+            changed = true;
+
+            if (jpeg_input_complete (cinfo) && (cinfo->output_scan_number == cinfo->input_scan_number))
+                stream->phase = STREAM_FINISH;
+            else
+                stream->phase = STREAM_OUTPUT_START;
+            break;
+
+        case STREAM_FINISH:
+            if (!jpeg_finish_decompress (cinfo))
+                return changed;
+            stream->phase = STREAM_DONE;
+            stream_free_decoder (stream);
+            return changed;
+
+        default:
+            return changed;
+        }
+    }
+}
+
+
+/* take in what has arrived and decode as much of it as possible */
+static bool
+stream_step (stream_input *stream)
+{
+    stream_jpeg *sj;
+    SDL_Surface *surface;
+
+    stream_take_pending (stream);
+    SDL_LockMutex (stream->lock);
+    stream->ended = stream->eof && (stream->pending_len == 0);
+    SDL_UnlockMutex (stream->lock);
+
+    switch (stream->phase)
+    {
+    case STREAM_SNIFF:
+        if ((stream->data_len < 3) && !stream->ended)
+            return false;
+        /* what the registry has no incremental decoder for is
+           decoded once it is all there */
+        if (!decode_can (stream->data, stream->data_len, DECODE_INCREMENTAL))
+        {
+            stream->phase = STREAM_WHOLE;
+            return stream_step (stream);
+        }
+
+        sj = calloc (1, sizeof (stream_jpeg));
+        if (sj == NULL)
+        {
+            stream->phase = STREAM_FAILED;
+            return false;
+        }
+        sj->stream = stream;
+        sj->cinfo.err = jpeg_std_error (&sj->err);
+        sj->err.error_exit = jpeg_stream_error_exit;
+        jpeg_create_decompress (&sj->cinfo);
+        sj->src.init_source = jpeg_stream_noop;
+        sj->src.fill_input_buffer = jpeg_stream_fill;
+        sj->src.skip_input_data = jpeg_stream_skip;
+        sj->src.resync_to_restart = jpeg_resync_to_restart;
+        sj->src.term_source = jpeg_stream_noop;
+        sj->src.next_input_byte = stream->data;
+        sj->src.bytes_in_buffer = stream->data_len;
+        sj->cinfo.src = &sj->src;
+        stream->decoder = sj;
+        stream->phase = STREAM_HEADER;
+        return stream_step_jpeg (stream);
+
+    case STREAM_WHOLE:
+        if (!stream->ended)
+            return false;
+        surface = decode_load_mem (stream->data, stream->data_len);
+        if (surface == NULL)
+        {
+            fprintf (stderr, "could not decode stream: %s\n", SDL_GetError ());
+            stream->phase = STREAM_FAILED;
+            return false;
+        }
+        stream->texture = SDL_CreateTextureFromSurface (g_rend, surface);
+        SDL_FreeSurface (surface);
+        stream->phase = (stream->texture != NULL) ? STREAM_DONE : STREAM_FAILED;
+        return (stream->texture != NULL);
+
+    case STREAM_DONE:
+    case STREAM_FAILED:
+        return false;
+
+    default:
+        return stream_step_jpeg (stream);
+    }
+}
+
+
+/* function definitions */
+/* "-" and anything that is not a regular file (pipes, ttys, sockets) */
+bool
+stream_is_stream (const char *path)
+{
+    struct stat st;
+
+    if (strcmp (path, "-") == 0)
+        return true;
+    if (stat (path, &st) != 0)
+        return false;
+
+    return !S_ISREG (st.st_mode) && !S_ISDIR (st.st_mode);
+}
+
+
+/* true when something is being piped in, so no file name is needed */
+bool
+stream_stdin_is_pipe (void)
+{
+#ifdef _WIN32
+    return false;
+#else
+    return !isatty (STDIN_FILENO);
+#endif
+}
+
+
+/* start reading path ("-" for stdin) and return once there is something
+   to show, usually after the first few kb */
+int
+stream_open (stream_input *stream, const char *path)
+{
+    memset (stream, 0, sizeof (stream_input));
+    stream->fd = -1;
+    if (g_stream_event == (Uint32)-1)
+        g_stream_event = SDL_RegisterEvents (1);
+
+#ifdef _WIN32
+    (void)path;
+    fprintf (stderr, "reading from a pipe is not supported on this platform\n");
+    return EXIT_FAILURE;
+#else
+    stream->fd = (strcmp (path, "-") == 0) ? STDIN_FILENO : open (path, O_RDONLY);
+    if (stream->fd < 0)
+    {
+        perror (path);
+        goto stream_open_failure_0;
+    }
+
+    stream->lock = SDL_CreateMutex ();
+    stream->arrived = SDL_CreateCond ();
+    if ((stream->lock == NULL) || (stream->arrived == NULL))
+        goto stream_open_failure_1;
+
+    stream->reader = SDL_CreateThread (stream_reader, "ljpeg-stream", stream);
+    if (stream->reader == NULL)
+        goto stream_open_failure_1;
+    stream->active = true;
+
+    /* header first, so the window can be sized */
+    while ((stream->texture == NULL) && (stream->phase != STREAM_FAILED) && (stream->phase != STREAM_DONE))
+    {
+        SDL_LockMutex (stream->lock);
+        while ((stream->pending_len == 0) && !stream->eof)
+        {
+            SDL_CondWait (stream->arrived, stream->lock);
+        }
+        SDL_UnlockMutex (stream->lock);
+        stream_step (stream);
+    }
+    if (stream->texture == NULL)
+    {
+        fprintf (stderr, "%s: no image in the stream\n", path);
+        stream_close (stream);
+        return EXIT_FAILURE;
+    }
+
+/* stream_open_success_0: */
+    return EXIT_SUCCESS;
+
+stream_open_failure_1:
+    if (stream->arrived != NULL)
+        SDL_DestroyCond (stream->arrived);
+    if (stream->lock != NULL)
+        SDL_DestroyMutex (stream->lock);
+    if (stream->fd != STDIN_FILENO)
+        close (stream->fd);
+stream_open_failure_0:
+    memset (stream, 0, sizeof (stream_input));
+    return EXIT_FAILURE;
+#endif
+}
+
+
+/* stop reading and drop the decoder.  the texture is owned by whoever
+   displays it (g_img) and is left alone */
+void
+stream_close (stream_input *stream)
+{
+    if (!stream->active)
+        return;
+
+    SDL_LockMutex (stream->lock);
+    stream->quit = true;
+    SDL_UnlockMutex (stream->lock);
+    SDL_WaitThread (stream->reader, NULL);
+
+#ifndef _WIN32
+    if (stream->fd != STDIN_FILENO)
+        close (stream->fd);
+#endif
+    stream_free_decoder (stream);
+    SDL_DestroyCond (stream->arrived);
+    SDL_DestroyMutex (stream->lock);
+    free (stream->pending);
+    free (stream->data);
+    memset (stream, 0, sizeof (stream_input));
+}
+
+
+/* decode whatever arrived since last time.  returns true when the
+   texture changed */
+bool
+stream_update (stream_input *stream)
+{
+    bool changed;
+
+    if (!stream->active || (stream->phase == STREAM_DONE) || (stream->phase == STREAM_FAILED))
+        return false;
+    if (SDL_AtomicGet (&stream->notified) == 0)
+    {
+        /* nothing new, unless the stream just ended */
+        SDL_LockMutex (stream->lock);
+        changed = stream->eof;
+        SDL_UnlockMutex (stream->lock);
+        if (!changed)
+            return false;
+    }
+
+    changed = stream_step (stream);
+
+    /* the whole stream is in, nothing left to wait on */
+    if ((stream->phase == STREAM_DONE) || (stream->phase == STREAM_FAILED))
+    {
+        free (stream->data);
+        stream->data = NULL;
+        stream->data_len = 0;
+        stream->data_cap = 0;
+    }
+
+    return changed;
+}
+
+
+/* End of File */
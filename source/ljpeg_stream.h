@@ -0,0 +1,101 @@
+/*
+   source/ljpeg_stream.h
+   LJPEG streaming (stdin and pipe) input header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_STREAM_HEADER__
+#define __LJPEG_STREAM_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+typedef enum stream_phase
+{
+    STREAM_SNIFF,           /* waiting on the first bytes */
+    STREAM_HEADER,          /* jpeg_read_header */
+    STREAM_START,           /* jpeg_start_decompress */
+    STREAM_OUTPUT_START,    /* progressive, waiting for a finished scan */
+    STREAM_SCANLINES,
+    STREAM_OUTPUT_FINISH,
+    STREAM_FINISH,
+    STREAM_WHOLE,           /* not a jpeg, decoded once the stream ends */
+    STREAM_DONE,
+    STREAM_FAILED
+} stream_phase;
+
+typedef struct stream_input
+{
+    bool           active;
+    int            fd;
+    stream_phase   phase;
+
+    /* filled by the reader thread */
+    SDL_mutex     *lock;
+    SDL_cond      *arrived;
+    SDL_Thread    *reader;
+    unsigned char *pending;
+    size_t         pending_len;
+    size_t         pending_cap;
+    bool           eof;
+    bool           quit;
+    SDL_atomic_t   notified;
+
+    /* owned by the main thread, everything received so far */
+    unsigned char *data;
+    size_t         data_len;
+    size_t         data_cap;
+    bool           ended;       /* eof seen and everything taken in */
+    void          *decoder;     /* libjpeg state, see ljpeg_stream.c */
+
+    SDL_Surface   *canvas;
+    SDL_Texture   *texture;
+    int            shown_scan;
+} stream_input;
+
+
+/* constants */
+/* bytes the reader thread asks for per read */
+#define STREAM_CHUNK 65536
+
+
+/* global variables */
+extern stream_input g_stream;
+extern Uint32       g_stream_event;
+
+
+/* external function prototypes */
+bool stream_is_stream (const char *path);
+bool stream_stdin_is_pipe (void);
+
+int  stream_open   (stream_input *stream, const char *path);
+void stream_close  (stream_input *stream);
+bool stream_update (stream_input *stream);
+
+#endif /* end run once */
+
+
+/* End of File */
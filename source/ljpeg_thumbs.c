@@ -0,0 +1,808 @@
+/*
+   source/ljpeg_thumbs.c
+   LJPEG thumbnail grid (directory view) source code.
+
+   Thumbnails are decoded by the worker pool at reduced size, then packed
+   by the main thread into a handful of atlas textures, so the whole
+   visible grid is drawn with one SDL_RenderGeometry call per atlas.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_thumbs.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_arena.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_graphics.h"
+#include "ljpeg_io.h"
+#include "ljpeg_mapfile.h"
+#include "ljpeg_probe.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+thumb_grid g_grid;
+Uint32     g_thumbs_event = (Uint32)-1;
+
+
+/* file static variables */
+
+
+/* file static function prototypes */
+static int  thumb_distance (thumb_grid *grid, int index);
+static int  thumb_rank (void *arg);
+static void thumb_job (void *arg);
+static void thumb_read_done (io_request *req);
+static void thumb_decode_job (void *arg);
+static void thumb_finish (thumb *th, SDL_Surface *pixels);
+static void thumbs_layout (thumb_grid *grid);
+static int  thumbs_reserve (thumb_grid *grid);
+static void thumbs_queue_range (thumb_grid *grid);
+static int  thumbs_take_slot (thumb_grid *grid, int index);
+static void thumbs_upload (thumb_grid *grid, thumb *th);
+static void thumbs_slot_rect (thumb_grid *grid, int slot, SDL_Rect *rect);
+static void thumbs_cell_rect (thumb_grid *grid, int index, SDL_Rect *rect);
+
+
+/* static function definitions */
+/* how many thumbnails away from the visible range index is, 0 when visible */
+static int
+thumb_distance (thumb_grid *grid, int index)
+{
+    int first = SDL_AtomicGet (&grid->first_visible);
+    int last = SDL_AtomicGet (&grid->last_visible);
+
+    if (index < first)
+        return first - index;
+    if (index > last)
+        return index - last;
+    return 0;
+}
+
+
+static int
+thumb_rank (void *arg)
+{
+    thumb *th = (thumb *)arg;
+
+    return thumb_distance (th->grid, th->index);
+}
+
+
+/* worker side: look one thumbnail up in the cache, unless it scrolled
+   out of range.  misses are read by the io engine and come back to the
+   pool through thumb_read_done */
+static void
+thumb_job (void *arg)
+{
+    thumb *th = (thumb *)arg;
+    thumb_grid *grid = th->grid;
+    const char *path = grid->files.paths[th->index];
+    SDL_Surface *pixels = NULL;
+    mapped_file map;
+    cache_key key;
+
+    SDL_LockMutex (grid->lock);
+    if (thumb_distance (grid, th->index) > SDL_AtomicGet (&grid->margin))
+    {
+        th->state = THUMB_EMPTY;
+        SDL_UnlockMutex (grid->lock);
+        return;
+    }
+    th->state = THUMB_DECODING;
+    SDL_UnlockMutex (grid->lock);
+
+    /* a cache hit maps the stored pixels, only misses are decoded */
+    if (cache_key_for (path, &key))
+        pixels = cache_lookup (&grid->cache, &key);
+    if (pixels != NULL)
+    {
+        thumb_finish (th, pixels);
+        return;
+    }
+
+    SDL_LockMutex (grid->lock);
+    th->state = THUMB_READING;
+    SDL_UnlockMutex (grid->lock);
+
+    /* counted before closing is checked, so thumbs_close either sees
+       this read or this job sees it closing */
+    th->io.path = path;
+    th->io.done = thumb_read_done;
+    th->io.arg = th;
+    th->io.cancel = &grid->closing;
+    SDL_AtomicAdd (&grid->reading, 1);
+    if ((SDL_AtomicGet (&grid->closing) == 0) && (io_submit (&g_io, &th->io) == EXIT_SUCCESS))
+        return;
+    SDL_AtomicAdd (&grid->reading, -1);
+    if (SDL_AtomicGet (&grid->closing) != 0)
+        return;
+
+    /* no io engine, read it here */
+    if (mapfile_open (&map, path) == EXIT_SUCCESS)
+    {
+        pixels = decode_load_scaled (map.data, map.len, THUMB_SIZE, THUMB_SIZE);
+        mapfile_close (&map);
+    }
+    if ((pixels != NULL) && cache_key_for (path, &key))
+        cache_store (&grid->cache, &key, pixels);
+    thumb_finish (th, pixels);
+}
+
+
+/* io thread side: pass the file on to the pool for decoding.  nothing
+   may touch the grid after reading is counted down */
+static void
+thumb_read_done (io_request *req)
+{
+    thumb *th = (thumb *)req->arg;
+    thumb_grid *grid = th->grid;
+
+    if ((req->error == 0) && (SDL_AtomicGet (&grid->closing) == 0) &&
+        (workers_submit (grid->pool, thumb_decode_job, th) == EXIT_SUCCESS))
+    {
+        SDL_AtomicAdd (&grid->reading, -1);
+        return;
+    }
+
+    SDL_free (req->data);
+    req->data = NULL;
+    SDL_LockMutex (grid->lock);
+    th->state = ((req->error == 0) || (req->error == ECANCELED)) ? THUMB_EMPTY : THUMB_FAILED;
+    SDL_UnlockMutex (grid->lock);
+    SDL_AtomicAdd (&grid->reading, -1);
+}
+
+
+/* worker side: decode a thumbnail the io engine read */
+static void
+thumb_decode_job (void *arg)
+{
+    thumb *th = (thumb *)arg;
+    thumb_grid *grid = th->grid;
+    SDL_Surface *pixels = NULL;
+    cache_key key;
+
+    SDL_LockMutex (grid->lock);
+    if (thumb_distance (grid, th->index) > SDL_AtomicGet (&grid->margin))
+    {
+        th->state = THUMB_EMPTY;
+        SDL_UnlockMutex (grid->lock);
+        goto thumb_decode_job_exit_0;
+    }
+    th->state = THUMB_DECODING;
+    SDL_UnlockMutex (grid->lock);
+
+    pixels = decode_load_scaled (th->io.data, th->io.len, THUMB_SIZE, THUMB_SIZE);
+    if ((pixels != NULL) && cache_key_for (grid->files.paths[th->index], &key))
+        cache_store (&grid->cache, &key, pixels);
+    thumb_finish (th, pixels);
+
+thumb_decode_job_exit_0:
+    SDL_free (th->io.data);
+    th->io.data = NULL;
+}
+
+
+/* hand a decoded (or failed) thumbnail to the main thread */
+static void
+thumb_finish (thumb *th, SDL_Surface *pixels)
+{
+    thumb_grid *grid = th->grid;
+    SDL_Event evt;
+
+    SDL_LockMutex (grid->lock);
+    th->pixels = pixels;
+    th->state = (pixels != NULL) ? THUMB_READY : THUMB_FAILED;
+    SDL_UnlockMutex (grid->lock);
+
+    if (pixels == NULL)
+        return;
+
+    /* wake the main thread up so it can upload the thumbnail */
+    SDL_AtomicAdd (&grid->ready_count, 1);
+    SDL_zero (evt);
+    evt.type = g_thumbs_event;
+    SDL_PushEvent (&evt);
+}
+
+
+/* recalculate the columns and visible range after a resize or scroll */
+static void
+thumbs_layout (thumb_grid *grid)
+{
+    int rows, max_scroll;
+    int first, last;
+    int margin;
+    int i;
+
+    grid->columns = grid->view_w / THUMB_CELL;
+    if (grid->columns < 1)
+        grid->columns = 1;
+
+    rows = (grid->files.count + grid->columns - 1) / grid->columns;
+    max_scroll = rows * THUMB_CELL + THUMB_PADDING - grid->view_h;
+    if (grid->scroll > max_scroll)
+        grid->scroll = max_scroll;
+    if (grid->scroll < 0)
+        grid->scroll = 0;
+
+    first = (grid->scroll / THUMB_CELL) * grid->columns;
+    last = ((grid->scroll + grid->view_h) / THUMB_CELL + 1) * grid->columns - 1;
+    if (last >= grid->files.count)
+        last = grid->files.count - 1;
+
+    /* parked thumbnails may find a slot from the new view */
+    if ((grid->parked > 0) &&
+        ((first != SDL_AtomicGet (&grid->first_visible)) || (last != SDL_AtomicGet (&grid->last_visible))))
+    {
+        SDL_LockMutex (grid->lock);
+        for (i = 0; i < grid->files.count; i++)
+        {
+            if (grid->thumbs[i].state == THUMB_PARKED)
+                grid->thumbs[i].state = THUMB_EMPTY;
+        }
+        SDL_UnlockMutex (grid->lock);
+        grid->parked = 0;
+    }
+
+    /* no more is prefetched than the atlases hold, past that the far
+       edges would take each other's slots on every upload */
+    margin = THUMB_PREFETCH_SCREENS * (last - first + 1);
+    margin = SDL_min (margin, (grid->slot_count - (last - first + 1)) / 2);
+    margin = SDL_max (margin, 0);
+
+    SDL_AtomicSet (&grid->first_visible, first);
+    SDL_AtomicSet (&grid->last_visible, last);
+    SDL_AtomicSet (&grid->margin, margin);
+}
+
+
+/* grow the scratch for one frame worth of cells to what the view can
+   show, it is never shrunk */
+static int
+thumbs_reserve (thumb_grid *grid)
+{
+    SDL_Vertex *vertices;
+    SDL_Rect *placeholders;
+    int *indices;
+    int cells;
+
+    cells = (grid->view_w / THUMB_CELL + 2) * (grid->view_h / THUMB_CELL + 2);
+    if (cells <= grid->cell_capacity)
+        return EXIT_SUCCESS;
+
+    vertices = realloc (grid->vertices, (size_t)cells * 4 * sizeof (SDL_Vertex));
+    if (vertices == NULL)
+        return EXIT_FAILURE;
+    grid->vertices = vertices;
+    indices = realloc (grid->indices, (size_t)cells * 6 * sizeof (int));
+    if (indices == NULL)
+        return EXIT_FAILURE;
+    grid->indices = indices;
+    placeholders = realloc (grid->placeholders, (size_t)cells * sizeof (SDL_Rect));
+    if (placeholders == NULL)
+        return EXIT_FAILURE;
+    grid->placeholders = placeholders;
+
+    grid->cell_capacity = cells;
+    return EXIT_SUCCESS;
+}
+
+
+/* hand every empty thumbnail near the view to the workers */
+static void
+thumbs_queue_range (thumb_grid *grid)
+{
+    int margin = SDL_AtomicGet (&grid->margin);
+    int first = SDL_AtomicGet (&grid->first_visible) - margin;
+    int last = SDL_AtomicGet (&grid->last_visible) + margin;
+    int i;
+
+    if (first < 0)
+        first = 0;
+    if (last >= grid->files.count)
+        last = grid->files.count - 1;
+
+    SDL_LockMutex (grid->lock);
+    for (i = first; i <= last; i++)
+    {
+        if (grid->thumbs[i].state != THUMB_EMPTY)
+            continue;
+        if (workers_submit (grid->pool, thumb_job, &grid->thumbs[i]) == EXIT_SUCCESS)
+            grid->thumbs[i].state = THUMB_QUEUED;
+    }
+    SDL_UnlockMutex (grid->lock);
+}
+
+
+/* find an atlas slot for index, evicting the thumbnail furthest from the
+   view when every slot is taken.  returns -1 when nothing is worth evicting */
+static int
+thumbs_take_slot (thumb_grid *grid, int index)
+{
+    int victim = -1;
+    int victim_distance;
+    int distance;
+    int slot;
+
+    victim_distance = thumb_distance (grid, index);
+    for (slot = 0; slot < grid->slot_count; slot++)
+    {
+        if (grid->slot_owner[slot] < 0)
+            return slot;
+
+        distance = thumb_distance (grid, grid->slot_owner[slot]);
+        if (distance > victim_distance)
+        {
+            victim = slot;
+            victim_distance = distance;
+        }
+    }
+
+    if (victim >= 0)
+    {
+        thumb *old = &grid->thumbs[grid->slot_owner[victim]];
+        old->slot = -1;
+        old->state = THUMB_EMPTY;
+        grid->slot_owner[victim] = -1;
+    }
+
+    return victim;
+}
+
+
+/* main thread side: copy a decoded thumbnail into its atlas slot */
+static void
+thumbs_upload (thumb_grid *grid, thumb *th)
+{
+    SDL_Surface *pixels = th->pixels;
+    SDL_Rect rect;
+    int atlas;
+    int slot;
+
+    th->pixels = NULL;
+    slot = thumbs_take_slot (grid, th->index);
+    if (slot < 0)
+    {
+        /* decoding it again would only lose the same way */
+        th->state = THUMB_PARKED;
+        grid->parked++;
+        goto thumbs_upload_exit_0;
+    }
+
+    atlas = slot / grid->slots_per_atlas;
+    if (grid->atlases[atlas] == NULL)
+    {
+        grid->atlases[atlas] = SDL_CreateTexture (g_rend, DECODE_PIXELFORMAT,
+                                                  SDL_TEXTUREACCESS_STATIC,
+                                                  grid->atlas_size, grid->atlas_size);
+        if (grid->atlases[atlas] == NULL)
+        {
+            fprintf (stderr, "could not create thumbnail atlas: %s\n", SDL_GetError ());
+            th->state = THUMB_FAILED;
+            goto thumbs_upload_exit_0;
+        }
+        SDL_SetTextureBlendMode (grid->atlases[atlas], SDL_BLENDMODE_BLEND);
+        arena_account ((ptrdiff_t)grid->atlas_size * grid->atlas_size * 4);
+    }
+
+    thumbs_slot_rect (grid, slot, &rect);
+    rect.w = pixels->w;
+    rect.h = pixels->h;
+    if (SDL_UpdateTexture (grid->atlases[atlas], &rect, pixels->pixels, pixels->pitch) != 0)
+    {
+        th->state = THUMB_FAILED;
+        goto thumbs_upload_exit_0;
+    }
+
+    th->w = pixels->w;
+    th->h = pixels->h;
+    th->slot = slot;
+    th->state = THUMB_RESIDENT;
+    grid->slot_owner[slot] = th->index;
+
+thumbs_upload_exit_0:
+    cache_free_surface (&grid->cache, pixels);
+}
+
+
+static void
+thumbs_slot_rect (thumb_grid *grid, int slot, SDL_Rect *rect)
+{
+    int local = slot % grid->slots_per_atlas;
+
+    rect->x = (local % grid->slots_per_row) * THUMB_SIZE;
+    rect->y = (local / grid->slots_per_row) * THUMB_SIZE;
+    rect->w = THUMB_SIZE;
+    rect->h = THUMB_SIZE;
+}
+
+
+/* on screen cell of index, relative to the window */
+static void
+thumbs_cell_rect (thumb_grid *grid, int index, SDL_Rect *rect)
+{
+    int origin_x = (grid->view_w - grid->columns * THUMB_CELL) / 2;
+
+    rect->x = origin_x + (index % grid->columns) * THUMB_CELL + THUMB_PADDING / 2;
+    rect->y = (index / grid->columns) * THUMB_CELL - grid->scroll + THUMB_PADDING / 2;
+    rect->w = THUMB_SIZE;
+    rect->h = THUMB_SIZE;
+}
+
+
+/* function definitions */
+int
+thumbs_open (thumb_grid *grid, const char *directory, int view_w, int view_h,
+             probe_order order)
+{
+    SDL_RendererInfo info;
+    int i;
+
+    memset (grid, 0, sizeof (thumb_grid));
+    grid->view_w = view_w;
+    grid->view_h = view_h;
+
+    if (g_thumbs_event == (Uint32)-1)
+        g_thumbs_event = SDL_RegisterEvents (1);
+
+    if (filelist_load (&grid->files, directory) != EXIT_SUCCESS)
+        goto thumbs_open_failure_0;
+    if (grid->files.count == 0)
+    {
+        fprintf (stderr, "%s: no images found\n", directory);
+        goto thumbs_open_failure_1;
+    }
+
+    /* sorting by anything but name reads the image headers, when that
+       fails the grid stays in name order */
+    probe_sort (&g_probe, &grid->files, order);
+
+    grid->thumbs = calloc ((size_t)grid->files.count, sizeof (thumb));
+    if (grid->thumbs == NULL)
+        goto thumbs_open_failure_1;
+    for (i = 0; i < grid->files.count; i++)
+    {
+        grid->thumbs[i].grid = grid;
+        grid->thumbs[i].index = i;
+        grid->thumbs[i].slot = -1;
+    }
+
+    /* atlases can not be larger than the renderer allows */
+    grid->atlas_size = THUMB_ATLAS_SIZE;
+    if ((SDL_GetRendererInfo (g_rend, &info) == 0) && (info.max_texture_width > 0))
+    {
+        if (info.max_texture_width < grid->atlas_size)
+            grid->atlas_size = info.max_texture_width;
+        if (info.max_texture_height < grid->atlas_size)
+            grid->atlas_size = info.max_texture_height;
+    }
+    grid->slots_per_row = grid->atlas_size / THUMB_SIZE;
+    grid->slots_per_atlas = grid->slots_per_row * grid->slots_per_row;
+    grid->slot_count = grid->slots_per_atlas * THUMB_ATLAS_COUNT;
+    if (grid->slot_count == 0)
+    {
+        fprintf (stderr, "thumbnail atlas is smaller than THUMB_SIZE\n");
+        goto thumbs_open_failure_2;
+    }
+    grid->slot_owner = malloc ((size_t)grid->slot_count * sizeof (int));
+    if (grid->slot_owner == NULL)
+        goto thumbs_open_failure_2;
+    for (i = 0; i < grid->slot_count; i++)
+    {
+        grid->slot_owner[i] = -1;
+    }
+
+    /* scratch for one frame worth of cells, grown with the window */
+    if (thumbs_reserve (grid) != EXIT_SUCCESS)
+        goto thumbs_open_failure_3;
+
+    grid->lock = SDL_CreateMutex ();
+    if (grid->lock == NULL)
+        goto thumbs_open_failure_3;
+
+    /* the grid works without the cache, just slower */
+    if (THUMB_CACHE_MAX_MB > 0)
+        cache_open (&grid->cache, THUMB_SIZE);
+
+    grid->pool = workers_create (workers_default_count (), thumb_rank);
+    if (grid->pool == NULL)
+        goto thumbs_open_failure_5;
+
+    thumbs_layout (grid);
+    thumbs_queue_range (grid);
+
+/* thumbs_open_success_0: */
+    return EXIT_SUCCESS;
+
+thumbs_open_failure_5:
+    cache_close (&grid->cache);
+/* thumbs_open_failure_4: */
+    SDL_DestroyMutex (grid->lock);
+thumbs_open_failure_3:
+    free (grid->placeholders);
+    free (grid->indices);
+    free (grid->vertices);
+    free (grid->slot_owner);
+thumbs_open_failure_2:
+    free (grid->thumbs);
+thumbs_open_failure_1:
+    filelist_free (&grid->files);
+thumbs_open_failure_0:
+    memset (grid, 0, sizeof (thumb_grid));
+    return EXIT_FAILURE;
+}
+
+
+void
+thumbs_close (thumb_grid *grid)
+{
+    int i;
+
+    if (grid->thumbs == NULL)
+        return;
+
+    /* let the reads in flight call back (the rest are cancelled), they
+       hand their files to the workers */
+    SDL_AtomicSet (&grid->closing, 1);
+    while (SDL_AtomicGet (&grid->reading) > 0)
+    {
+        SDL_Delay (1);
+    }
+
+    /* stop the workers before touching anything they may be using */
+    workers_destroy (grid->pool);
+
+    for (i = 0; i < grid->files.count; i++)
+    {
+        cache_free_surface (&grid->cache, grid->thumbs[i].pixels);
+        SDL_free (grid->thumbs[i].io.data);
+    }
+    cache_close (&grid->cache);
+    for (i = 0; i < THUMB_ATLAS_COUNT; i++)
+    {
+        if (grid->atlases[i] == NULL)
+            continue;
+        SDL_DestroyTexture (grid->atlases[i]);
+        arena_account (-(ptrdiff_t)grid->atlas_size * grid->atlas_size * 4);
+    }
+
+    SDL_DestroyMutex (grid->lock);
+    free (grid->placeholders);
+    free (grid->indices);
+    free (grid->vertices);
+    free (grid->slot_owner);
+    free (grid->thumbs);
+    filelist_free (&grid->files);
+    memset (grid, 0, sizeof (thumb_grid));
+}
+
+
+/* upload finished thumbnails and queue the ones that came into range,
+   call from the main thread after every event */
+void
+thumbs_update (thumb_grid *grid)
+{
+    int view_w, view_h;
+    int i;
+
+    if (grid->thumbs == NULL)
+        return;
+
+    SDL_GetWindowSize (g_win, &view_w, &view_h);
+    if ((view_w != grid->view_w) || (view_h != grid->view_h))
+    {
+        grid->view_w = view_w;
+        grid->view_h = view_h;
+        thumbs_layout (grid);
+
+        /* short of memory the bottom rows go undrawn until it frees */
+        if (thumbs_reserve (grid) != EXIT_SUCCESS)
+            fprintf (stderr, "could not grow the thumbnail grid\n");
+    }
+
+    if (SDL_AtomicGet (&grid->ready_count) > 0)
+    {
+        SDL_AtomicSet (&grid->ready_count, 0);
+
+        SDL_LockMutex (grid->lock);
+        for (i = 0; i < grid->files.count; i++)
+        {
+            if (grid->thumbs[i].state == THUMB_READY)
+                thumbs_upload (grid, &grid->thumbs[i]);
+        }
+        SDL_UnlockMutex (grid->lock);
+    }
+
+    thumbs_queue_range (grid);
+}
+
+
+void
+thumbs_render (SDL_Renderer *rend, thumb_grid *grid)
+{
+    SDL_Vertex *v;
+    SDL_Rect cell, src;
+    float scale;
+    int first, last;
+    int verts, rects;
+    int atlas;
+    int i, n;
+
+    if (grid->thumbs == NULL)
+        return;
+
+    first = SDL_AtomicGet (&grid->first_visible);
+    last = SDL_AtomicGet (&grid->last_visible);
+    if (last - first + 1 > grid->cell_capacity)
+        last = first + grid->cell_capacity - 1;
+    scale = 1.0f / (float)grid->atlas_size;
+
+    /* grey boxes for everything that is not loaded yet, in one call */
+    rects = 0;
+    SDL_LockMutex (grid->lock);
+    for (i = first; i <= last; i++)
+    {
+        if (grid->thumbs[i].state == THUMB_RESIDENT)
+            continue;
+        thumbs_cell_rect (grid, i, &grid->placeholders[rects++]);
+    }
+    SDL_SetRenderDrawColor (rend, 0x80, 0x80, 0x80, SDL_ALPHA_OPAQUE);
+    SDL_RenderFillRects (rend, grid->placeholders, rects);
+
+    /* then every loaded thumbnail, batched as one draw per atlas */
+    for (atlas = 0; atlas < THUMB_ATLAS_COUNT; atlas++)
+    {
+        if (grid->atlases[atlas] == NULL)
+            continue;
+
+        verts = 0;
+        for (i = first; i <= last; i++)
+        {
+            thumb *th = &grid->thumbs[i];
+            if ((th->state != THUMB_RESIDENT) || (th->slot / grid->slots_per_atlas != atlas))
+                continue;
+
+            thumbs_cell_rect (grid, i, &cell);
+            thumbs_slot_rect (grid, th->slot, &src);
+            cell.x += (THUMB_SIZE - th->w) / 2;
+            cell.y += (THUMB_SIZE - th->h) / 2;
+
+            v = &grid->vertices[verts];
+            for (n = 0; n < 4; n++)
+            {
+                v[n].color.r = v[n].color.g = v[n].color.b = v[n].color.a = 0xFF;
+                v[n].position.x = (float)(cell.x + ((n & 1) ? th->w : 0));
+                v[n].position.y = (float)(cell.y + ((n & 2) ? th->h : 0));
+                v[n].tex_coord.x = (float)(src.x + ((n & 1) ? th->w : 0)) * scale;
+                v[n].tex_coord.y = (float)(src.y + ((n & 2) ? th->h : 0)) * scale;
+            }
+            grid->indices[verts / 4 * 6 + 0] = verts + 0;
+            grid->indices[verts / 4 * 6 + 1] = verts + 1;
+            grid->indices[verts / 4 * 6 + 2] = verts + 2;
+            grid->indices[verts / 4 * 6 + 3] = verts + 1;
+            grid->indices[verts / 4 * 6 + 4] = verts + 3;
+            grid->indices[verts / 4 * 6 + 5] = verts + 2;
+            verts += 4;
+        }
+
+        if (verts > 0)
+            SDL_RenderGeometry (rend, grid->atlases[atlas], grid->vertices, verts,
+                                grid->indices, verts / 4 * 6);
+    }
+    SDL_UnlockMutex (grid->lock);
+
+    /* outline the selection */
+    if ((grid->selected >= first) && (grid->selected <= last))
+    {
+        thumbs_cell_rect (grid, grid->selected, &cell);
+        cell.x -= THUMB_PADDING / 4;
+        cell.y -= THUMB_PADDING / 4;
+        cell.w += THUMB_PADDING / 2;
+        cell.h += THUMB_PADDING / 2;
+        SDL_SetRenderDrawColor (rend, 0x30, 0x60, 0xC0, SDL_ALPHA_OPAQUE);
+        SDL_RenderDrawRect (rend, &cell);
+    }
+
+    SDL_SetRenderDrawColor (rend, BACKGROUND_RED, BACKGROUND_GREEN, BACKGROUND_BLUE, SDL_ALPHA_OPAQUE);
+}
+
+
+void
+thumbs_scroll (thumb_grid *grid, int pixels)
+{
+    if (grid->thumbs == NULL)
+        return;
+
+    grid->scroll += pixels;
+    thumbs_layout (grid);
+    thumbs_queue_range (grid);
+}
+
+
+/* move the selection, scrolling it into view */
+void
+thumbs_select (thumb_grid *grid, int index)
+{
+    int top;
+
+    if (grid->thumbs == NULL)
+        return;
+
+    if (index < 0)
+        index = 0;
+    if (index >= grid->files.count)
+        index = grid->files.count - 1;
+    grid->selected = index;
+
+    top = (index / grid->columns) * THUMB_CELL;
+    if (top < grid->scroll)
+        grid->scroll = top;
+    else if (top + THUMB_CELL + THUMB_PADDING > grid->scroll + grid->view_h)
+        grid->scroll = top + THUMB_CELL + THUMB_PADDING - grid->view_h;
+
+    thumbs_layout (grid);
+    thumbs_queue_range (grid);
+}
+
+
+/* thumbnail under window coordinates x, y or -1 */
+int
+thumbs_index_at (thumb_grid *grid, int x, int y)
+{
+    int origin_x = (grid->view_w - grid->columns * THUMB_CELL) / 2;
+    int column, row, index;
+
+    if ((grid->thumbs == NULL) || (x < origin_x))
+        return -1;
+
+    column = (x - origin_x) / THUMB_CELL;
+    row = (y + grid->scroll) / THUMB_CELL;
+    if (column >= grid->columns)
+        return -1;
+
+    index = row * grid->columns + column;
+    if (index >= grid->files.count)
+        return -1;
+
+    return index;
+}
+
+
+const char *
+thumbs_path (thumb_grid *grid, int index)
+{
+    if ((grid->thumbs == NULL) || (index < 0) || (index >= grid->files.count))
+        return (const char *)NULL;
+
+    return grid->files.paths[index];
+}
+
+
+/* End of File */
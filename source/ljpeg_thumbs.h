@@ -0,0 +1,123 @@
+/*
+   source/ljpeg_thumbs.h
+   LJPEG thumbnail grid (directory view) header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_THUMBS_HEADER__
+#define __LJPEG_THUMBS_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_io.h"
+#include "ljpeg_probe.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+typedef enum thumb_state
+{
+    THUMB_EMPTY,        /* nothing decoded */
+    THUMB_QUEUED,       /* waiting on a worker */
+    THUMB_READING,      /* not in the cache, the file is being read */
+    THUMB_DECODING,     /* a worker is decoding it */
+    THUMB_READY,        /* decoded, waiting for the main thread to upload */
+    THUMB_RESIDENT,     /* in an atlas slot */
+    THUMB_PARKED,       /* no slot was worth taking, left until the view moves */
+    THUMB_FAILED
+} thumb_state;
+
+typedef struct thumb
+{
+    struct thumb_grid *grid;
+    int                index;
+    thumb_state        state;
+    SDL_Surface       *pixels;
+    int                slot;
+    int                w, h;
+    io_request         io;      /* io.data is the file while it is decoded */
+} thumb;
+
+typedef struct thumb_grid
+{
+    filelist      files;
+    thumb        *thumbs;
+    thumb_cache   cache;
+
+    worker_pool  *pool;
+    SDL_mutex    *lock;
+    SDL_atomic_t  first_visible;
+    SDL_atomic_t  last_visible;
+    SDL_atomic_t  margin;
+    SDL_atomic_t  ready_count;
+    SDL_atomic_t  reading;      /* reads that have not called back yet */
+    SDL_atomic_t  closing;
+
+    SDL_Texture  *atlases[THUMB_ATLAS_COUNT];
+    int           atlas_size;
+    int           slots_per_row;
+    int           slots_per_atlas;
+    int          *slot_owner;
+    int           slot_count;
+    int           parked;       /* thumbnails THUMB_PARKED */
+
+    SDL_Vertex   *vertices;
+    int          *indices;
+    SDL_Rect     *placeholders;
+    int           cell_capacity;
+
+    int           view_w, view_h;
+    int           columns;
+    int           scroll;
+    int           selected;
+} thumb_grid;
+
+
+/* constants */
+#define THUMB_CELL (THUMB_SIZE + THUMB_PADDING)
+
+
+/* global variables */
+extern thumb_grid g_grid;
+extern Uint32     g_thumbs_event;
+
+
+/* external function prototypes */
+int  thumbs_open  (thumb_grid *grid, const char *directory, int view_w, int view_h,
+                   probe_order order);
+void thumbs_close (thumb_grid *grid);
+
+void thumbs_update (thumb_grid *grid);
+void thumbs_render (SDL_Renderer *rend, thumb_grid *grid);
+
+void thumbs_scroll    (thumb_grid *grid, int pixels);
+void thumbs_select    (thumb_grid *grid, int index);
+int  thumbs_index_at  (thumb_grid *grid, int x, int y);
+const char *thumbs_path (thumb_grid *grid, int index);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,1204 @@
+/*
+   source/ljpeg_tiff.c
+   LJPEG multi-page tiff source code.
+
+   A tiff is a chain of image file directories, one for each page.
+   tiff_open walks the chain once, reading each directory's size and
+   the offset of the next and nothing else, so a 500 page scan opens as
+   fast as a one page one.  Pages are decoded as they are turned to,
+   the one after the shown page on a thread of its own while the shown
+   one is looked at.  Reduced resolution directories (thumbnails) are
+   not pages.
+
+   The built-in decoder takes uncompressed, LZW, Deflate and PackBits
+   strips or tiles of 1 to 8 bit greyscale or palette samples, of 16 bit
+   greyscale, and of 8 or 16 bit RGB(A), with or without the horizontal
+   predictor (which at 8 bits undoes like a png Sub filter, through the
+   same kernel).  A page bigger than TIFF_PARALLEL_PIXELS has its strips
+   or tiles shared out among the workers, each decoding whole ones
+   straight into the surface.  16 bit pages keep their high byte in a
+   surface; tiff_page_wide decodes them at full depth for ljpeg_hdr.
+   Any other page (JPEG or fax compressed, CMYK, BigTIFF files) goes to
+   SDL_image, shown a copy of the header that puts that page first.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_tiff.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+
+#include "ljpeg_config.h"
+#include "ljpeg_decode.h"
+#include "ljpeg_simd.h"
+#include "ljpeg_workers.h"
+
+
+/* global variable declarations */
+tiff_doc g_tiff;
+
+
+/* file static variables */
+/* directories walked before the chain is taken to be damaged */
+#define TIFF_MAX_PAGES 65536
+
+/* the tags read */
+enum
+{
+    TIFF_SUBFILE_TYPE   = 254,
+    TIFF_WIDTH          = 256,
+    TIFF_HEIGHT         = 257,
+    TIFF_BITS           = 258,
+    TIFF_COMPRESSION    = 259,
+    TIFF_PHOTOMETRIC    = 262,
+    TIFF_FILL_ORDER     = 266,
+    TIFF_STRIP_OFFSETS  = 273,
+    TIFF_SAMPLES        = 277,
+    TIFF_ROWS_PER_STRIP = 278,
+    TIFF_STRIP_COUNTS   = 279,
+    TIFF_PLANAR         = 284,
+    TIFF_PREDICTOR      = 317,
+    TIFF_COLORMAP       = 320,
+    TIFF_TILE_WIDTH     = 322,
+    TIFF_TILE_HEIGHT    = 323,
+    TIFF_TILE_OFFSETS   = 324,
+    TIFF_TILE_COUNTS    = 325,
+    TIFF_EXTRA_SAMPLES  = 338,
+    TIFF_SAMPLE_FORMAT  = 339
+};
+
+/* a tag's values, where they lie in the file */
+typedef struct tiff_array
+{
+    const uint8_t *p;
+    uint32_t       count;
+    int            type;        /* 1 byte, 3 short, 4 long */
+} tiff_array;
+
+/* one page, as the decoder needs it */
+typedef struct tiff_layout
+{
+    const uint8_t *data;
+    size_t        len;
+    bool          le;
+
+    int           w, h;
+    int           bits, spp;
+    int           compression;
+    int           photometric;
+    int           predictor;
+    int           alpha;            /* the first extra sample: 1 premultiplied, 2 straight */
+
+    int           unit_w, unit_h;   /* a strip (w x rows per strip) or a tile */
+    int           across;           /* units in a row of them */
+    int           units;
+    tiff_array    offsets, counts;
+    size_t        stride;           /* bytes in a row of a unit */
+    uint8_t       lut[256][4];      /* greyscale and palette samples to pixels */
+
+    SDL_Surface  *surface;
+    uint16_t     *wide;             /* or 16 bit rgba samples, w x h */
+    SDL_atomic_t  next;             /* the next unit to be taken */
+    SDL_atomic_t  failed;
+} tiff_layout;
+
+/* the file behind a header that starts at another page, for SDL_image */
+typedef struct tiff_rw
+{
+    const uint8_t *data;
+    size_t         len;
+    size_t         pos;
+    uint8_t        head[8];
+} tiff_rw;
+
+
+/* file static function prototypes */
+static uint16_t tiff_get16 (const uint8_t *p, bool le);
+static uint32_t tiff_get32 (const uint8_t *p, bool le);
+static bool     tiff_header (const uint8_t *data, size_t len, bool *le, uint32_t *first);
+static bool     tiff_entry (const uint8_t *data, size_t len, bool le, const uint8_t *e, tiff_array *arr);
+static uint32_t tiff_value (const tiff_array *arr, uint32_t i, bool le);
+
+static int      tiff_parse (tiff_layout *t, uint32_t ifd);
+static size_t   tiff_lzw (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static size_t   tiff_packbits (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static size_t   tiff_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+static void     tiff_emit_row (const tiff_layout *t, const uint8_t *row, uint8_t *rgba, int w);
+static void     tiff_emit_wide (const tiff_layout *t, const uint8_t *row, uint16_t *rgba, int w);
+static int      tiff_unit (tiff_layout *t, int unit, uint8_t *scratch);
+static void     tiff_units_job (void *arg);
+static int      tiff_run (tiff_layout *t, worker_pool *pool);
+static SDL_Surface *tiff_decode_ifd (const uint8_t *data, size_t len, bool le, uint32_t ifd,
+                                     worker_pool *pool);
+
+static Sint64   tiff_rw_size (SDL_RWops *rw);
+static Sint64   tiff_rw_seek (SDL_RWops *rw, Sint64 offset, int whence);
+static size_t   tiff_rw_read (SDL_RWops *rw, void *ptr, size_t size, size_t maxnum);
+static size_t   tiff_rw_write (SDL_RWops *rw, const void *ptr, size_t size, size_t num);
+static int      tiff_rw_close (SDL_RWops *rw);
+static SDL_Surface *tiff_fallback (const tiff_doc *doc, int page);
+static SDL_Surface *tiff_load_page (tiff_doc *doc, int page);
+static int      tiff_prefetch_thread (void *arg);
+static SDL_Surface *tiff_take_ahead (tiff_doc *doc, int page);
+static void     tiff_prefetch (tiff_doc *doc, int page);
+
+
+/* static function definitions */
+static uint16_t
+tiff_get16 (const uint8_t *p, bool le)
+{
+    if (le)
+        return (uint16_t)(p[0] | (p[1] << 8));
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+static uint32_t
+tiff_get32 (const uint8_t *p, bool le)
+{
+    if (le)
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+/* "II*\0" or "MM\0*", and where the first directory is */
+static bool
+tiff_header (const uint8_t *data, size_t len, bool *le, uint32_t *first)
+{
+    if (len < 8)
+        return false;
+    if ((data[0] == 'I') && (data[1] == 'I'))
+        *le = true;
+    else if ((data[0] == 'M') && (data[1] == 'M'))
+        *le = false;
+    else
+        return false;
+    if (tiff_get16 (data + 2, *le) != 42)
+        return false;
+
+    *first = tiff_get32 (data + 4, *le);
+    return true;
+}
+
+
+/* the values of the 12 byte entry at e, false when they are of a type
+   not read or lie outside the file */
+static bool
+tiff_entry (const uint8_t *data, size_t len, bool le, const uint8_t *e, tiff_array *arr)
+{
+    uint64_t bytes;
+    uint32_t off;
+
+    arr->type = tiff_get16 (e + 2, le);
+    arr->count = tiff_get32 (e + 4, le);
+    switch (arr->type)
+    {
+    case 1:  bytes = arr->count;     break;
+    case 3:  bytes = (uint64_t)arr->count * 2; break;
+    case 4:  bytes = (uint64_t)arr->count * 4; break;
+    default: return false;
+    }
+
+    if (bytes <= 4)
+    {
+        arr->p = e + 8;
+        return true;
+    }
+    off = tiff_get32 (e + 8, le);
+    if ((off > len) || (bytes > len - off))
+        return false;
+
+    arr->p = data + off;
+    return true;
+}
+
+
+/* value i of arr, 0 past its end */
+static uint32_t
+tiff_value (const tiff_array *arr, uint32_t i, bool le)
+{
+    if (i >= arr->count)
+        return 0;
+
+    switch (arr->type)
+    {
+    case 1:  return arr->p[i];
+    case 3:  return tiff_get16 (arr->p + (size_t)i * 2, le);
+    default: return tiff_get32 (arr->p + (size_t)i * 4, le);
+    }
+}
+
+
+/* read the directory at ifd into t, EXIT_FAILURE when the page is not
+   one the built-in decoder handles */
+static int
+tiff_parse (tiff_layout *t, uint32_t ifd)
+{
+    tiff_array arr;
+    tiff_array colormap = { NULL, 0, 0 };
+    const uint8_t *e;
+    uint32_t rows_per_strip = UINT32_MAX;
+    uint32_t tile_w = 0, tile_h = 0;
+    uint32_t width = 0, height = 0;
+    int fill_order = 1, planar = 1, sample_format = 1;
+    int levels;
+    int count;
+    int i;
+
+    t->bits = 1;
+    t->spp = 1;
+    t->compression = 1;
+    t->photometric = -1;
+    t->predictor = 1;
+
+    if ((ifd > t->len) || (t->len - ifd < 2))
+        return EXIT_FAILURE;
+    count = tiff_get16 (t->data + ifd, t->le);
+    if ((size_t)count * 12 > t->len - ifd - 2)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < count; i++)
+    {
+        e = t->data + ifd + 2 + i * 12;
+        if (!tiff_entry (t->data, t->len, t->le, e, &arr) || (arr.count == 0))
+            continue;
+
+        switch (tiff_get16 (e, t->le))
+        {
+        case TIFF_WIDTH:          width = tiff_value (&arr, 0, t->le);                 break;
+        case TIFF_HEIGHT:         height = tiff_value (&arr, 0, t->le);                break;
+        case TIFF_BITS:           t->bits = (int)tiff_value (&arr, 0, t->le);          break;
+        case TIFF_COMPRESSION:    t->compression = (int)tiff_value (&arr, 0, t->le);   break;
+        case TIFF_PHOTOMETRIC:    t->photometric = (int)tiff_value (&arr, 0, t->le);   break;
+        case TIFF_FILL_ORDER:     fill_order = (int)tiff_value (&arr, 0, t->le);       break;
+        case TIFF_SAMPLES:        t->spp = (int)tiff_value (&arr, 0, t->le);           break;
+        case TIFF_ROWS_PER_STRIP: rows_per_strip = tiff_value (&arr, 0, t->le);        break;
+        case TIFF_PLANAR:         planar = (int)tiff_value (&arr, 0, t->le);           break;
+        case TIFF_PREDICTOR:      t->predictor = (int)tiff_value (&arr, 0, t->le);     break;
+        case TIFF_SAMPLE_FORMAT:  sample_format = (int)tiff_value (&arr, 0, t->le);    break;
+        case TIFF_EXTRA_SAMPLES:  t->alpha = (int)tiff_value (&arr, 0, t->le);         break;
+        case TIFF_TILE_WIDTH:     tile_w = tiff_value (&arr, 0, t->le);                break;
+        case TIFF_TILE_HEIGHT:    tile_h = tiff_value (&arr, 0, t->le);                break;
+        case TIFF_COLORMAP:       colormap = arr;                                      break;
+        case TIFF_STRIP_OFFSETS:
+        case TIFF_TILE_OFFSETS:   t->offsets = arr;                                    break;
+        case TIFF_STRIP_COUNTS:
+        case TIFF_TILE_COUNTS:    t->counts = arr;                                     break;
+        }
+    }
+
+    if ((width == 0) || (height == 0) || (width > 0x10000) || (height > 0x10000))
+        return EXIT_FAILURE;
+    t->w = (int)width;
+    t->h = (int)height;
+
+    /* sample layouts */
+    if ((fill_order != 1) || (sample_format != 1) || ((planar != 1) && (t->spp != 1)) ||
+        (t->spp < 1) || (t->spp > 8))
+        return EXIT_FAILURE;
+    switch (t->photometric)
+    {
+    case 0:
+    case 1:
+    case 3:
+        if ((t->bits != 1) && (t->bits != 2) && (t->bits != 4) && (t->bits != 8) &&
+            ((t->bits != 16) || (t->photometric == 3)))
+            return EXIT_FAILURE;
+        if ((t->bits < 8) && (t->spp != 1))
+            return EXIT_FAILURE;
+        if ((t->photometric == 3) && (colormap.count < 3u << t->bits))
+            return EXIT_FAILURE;
+        break;
+    case 2:
+        if (((t->bits != 8) && (t->bits != 16)) || (t->spp < 3))
+            return EXIT_FAILURE;
+        break;
+    default:
+        return EXIT_FAILURE;
+    }
+    if (t->spp == ((t->photometric == 2) ? 3 : 1))
+        t->alpha = 0;
+    if ((t->bits == 16) && (t->spp > 8))    /* as many as tiff_emit_wide keeps */
+        return EXIT_FAILURE;
+
+    /* compression */
+    switch (t->compression)
+    {
+    case 1:
+    case 5:
+    case 8:
+    case 32946:
+    case 32773:
+        break;
+    default:
+        return EXIT_FAILURE;
+    }
+    if ((t->predictor != 1) && ((t->predictor != 2) || (t->bits < 8)))
+        return EXIT_FAILURE;
+
+    /* strips or tiles */
+    if ((tile_w != 0) || (tile_h != 0))
+    {
+        if ((tile_w == 0) || (tile_h == 0) || (tile_w > 0x10000) || (tile_h > 0x10000))
+            return EXIT_FAILURE;
+        t->unit_w = (int)tile_w;
+        t->unit_h = (int)tile_h;
+        t->across = (t->w + t->unit_w - 1) / t->unit_w;
+        if ((int64_t)t->across * ((t->h + t->unit_h - 1) / t->unit_h) > INT_MAX)
+            return EXIT_FAILURE;
+        t->units = t->across * ((t->h + t->unit_h - 1) / t->unit_h);
+    }
+    else
+    {
+        if (rows_per_strip == 0)
+            return EXIT_FAILURE;
+        t->unit_w = t->w;
+        t->unit_h = (int)SDL_min (rows_per_strip, (uint32_t)t->h);
+        t->across = 1;
+        t->units = (t->h + t->unit_h - 1) / t->unit_h;
+    }
+    if ((t->offsets.count < (uint32_t)t->units) || (t->counts.count < (uint32_t)t->units))
+        return EXIT_FAILURE;
+    t->stride = ((size_t)t->unit_w * (size_t)t->spp * (size_t)t->bits + 7) / 8;
+
+    /* what each greyscale or palette sample comes out as, 16 bit ones
+       are worked out as they are read */
+    if ((t->photometric != 2) && (t->bits <= 8))
+    {
+        levels = (1 << t->bits) - 1;
+        for (i = 0; i <= levels; i++)
+        {
+            if (t->photometric == 3)
+            {
+                t->lut[i][0] = (uint8_t)(tiff_value (&colormap, (uint32_t)i, t->le) >> 8);
+                t->lut[i][1] = (uint8_t)(tiff_value (&colormap, (uint32_t)(levels + 1 + i), t->le) >> 8);
+                t->lut[i][2] = (uint8_t)(tiff_value (&colormap, (uint32_t)(2 * (levels + 1) + i), t->le) >> 8);
+            }
+            else
+            {
+                t->lut[i][0] = (uint8_t)(i * 255 / levels);
+                if (t->photometric == 0)
+                    t->lut[i][0] = (uint8_t)(255 - t->lut[i][0]);
+                t->lut[i][1] = t->lut[i][2] = t->lut[i][0];
+            }
+            t->lut[i][3] = 255;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* lzw as tiff has it: msb first codes of 9 to 12 bits, the width going
+   up a code early.  the bytes written to out, which stops when full */
+static size_t
+tiff_lzw (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+    uint16_t prefix[4096];
+    uint16_t length[4096];
+    uint8_t suffix[4096];
+    uint8_t first[4096];
+    uint32_t bits = 0;
+    int held = 0;
+    int width = 9;
+    int next = 258;
+    int old = -1;
+    int code, c, i;
+    size_t ip = 0, op = 0;
+
+    /* the old lsb first flavour, from before tiff 5.0 */
+    if ((in_len >= 2) && (in[0] == 0) && (in[1] & 1))
+        return 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        suffix[i] = first[i] = (uint8_t)i;
+        prefix[i] = 0;
+        length[i] = 1;
+    }
+
+    while (op < out_len)
+    {
+        while (held < width)
+        {
+            if (ip >= in_len)
+                return op;
+            bits = (bits << 8) | in[ip++];
+            held += 8;
+        }
+        code = (int)((bits >> (held - width)) & ((1u << width) - 1));
+        held -= width;
+
+        if (code == 257)
+            break;
+        if (code == 256)
+        {
+            width = 9;
+            next = 258;
+            old = -1;
+            continue;
+        }
+        if (old < 0)
+        {
+            if (code > 255)
+                return 0;
+            out[op++] = (uint8_t)code;
+            old = code;
+            continue;
+        }
+        if ((code > next) || ((code == next) && (next == 4096)))
+            return 0;
+
+        /* old and the first byte of code, which when code is the entry
+           being made is old's own */
+        if (next < 4096)
+        {
+            prefix[next] = (uint16_t)old;
+            suffix[next] = first[(code == next) ? old : code];
+            first[next] = first[old];
+            length[next] = (uint16_t)(length[old] + 1);
+            next++;
+        }
+
+        /* the string is written back to front, cut at the end of out */
+        for (c = code, i = length[code] - 1; i >= 0; i--)
+        {
+            if (op + (size_t)i < out_len)
+                out[op + (size_t)i] = suffix[c];
+            c = prefix[c];
+        }
+        op = SDL_min (op + length[code], out_len);
+        old = code;
+
+        if ((next >= (1 << width) - 1) && (width < 12))
+            width++;
+    }
+
+    return op;
+}
+
+
+/* the bytes written to out, which stops when full */
+static size_t
+tiff_packbits (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+    size_t ip = 0, op = 0;
+    size_t n;
+    int run;
+
+    while ((ip < in_len) && (op < out_len))
+    {
+        run = (int8_t)in[ip++];
+        if (run >= 0)
+        {
+            /* run + 1 bytes as they are */
+            n = SDL_min ((size_t)run + 1, SDL_min (in_len - ip, out_len - op));
+            memcpy (out + op, in + ip, n);
+            ip += n;
+            op += n;
+        }
+        else if ((run != -128) && (ip < in_len))
+        {
+            /* the next byte 1 - run times */
+            n = SDL_min ((size_t)(1 - run), out_len - op);
+            memset (out + op, in[ip++], n);
+            op += n;
+        }
+    }
+
+    return op;
+}
+
+
+/* one zlib stream, the bytes written to out, 0 on bad data */
+static size_t
+tiff_inflate (const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+#ifdef USE_LIBDEFLATE
+    struct libdeflate_decompressor *inflater;
+    enum libdeflate_result result;
+    size_t got = 0;
+
+    inflater = libdeflate_alloc_decompressor ();
+    if (inflater == NULL)
+        return 0;
+    result = libdeflate_zlib_decompress (inflater, in, in_len, out, out_len, &got);
+    libdeflate_free_decompressor (inflater);
+
+    return (result == LIBDEFLATE_SUCCESS) ? got : 0;
+#else
+    uLongf got = (uLongf)out_len;
+
+    if ((in_len > ULONG_MAX) || (out_len > ULONG_MAX))
+        return 0;
+    if (uncompress (out, &got, in, (uLong)in_len) != Z_OK)
+        return 0;
+
+    return (size_t)got;
+#endif
+}
+
+
+/* w pixels of a decoded row to DECODE_PIXELFORMAT */
+static void
+tiff_emit_row (const tiff_layout *t, const uint8_t *row, uint8_t *rgba, int w)
+{
+    const uint8_t *p;
+    int mask = (1 << t->bits) - 1;
+    int a, x, pos;
+
+    if ((t->photometric == 2) && (t->spp == 3))
+    {
+        g_simd.rgb_to_rgba (row, rgba, w);
+        return;
+    }
+
+    for (x = 0; x < w; x++, rgba += 4)
+    {
+        p = row + (size_t)x * (size_t)t->spp;
+        if (t->photometric == 2)
+        {
+            rgba[0] = p[0];
+            rgba[1] = p[1];
+            rgba[2] = p[2];
+            rgba[3] = t->alpha ? p[3] : 255;
+        }
+        else if (t->bits == 8)
+        {
+            memcpy (rgba, t->lut[p[0]], 4);
+            if (t->alpha)
+                rgba[3] = p[1];
+        }
+        else
+        {
+            pos = x * t->bits;
+            memcpy (rgba, t->lut[(row[pos >> 3] >> (8 - t->bits - (pos & 7))) & mask], 4);
+        }
+
+        /* SDL blends straight alpha */
+        a = rgba[3];
+        if ((t->alpha == 1) && (a != 0) && (a != 255))
+        {
+            rgba[0] = (uint8_t)SDL_min ((rgba[0] * 255 + a / 2) / a, 255);
+            rgba[1] = (uint8_t)SDL_min ((rgba[1] * 255 + a / 2) / a, 255);
+            rgba[2] = (uint8_t)SDL_min ((rgba[2] * 255 + a / 2) / a, 255);
+        }
+    }
+}
+
+
+/* w pixels of a decoded 16 bit row to rgba of 16 bit samples, undoing
+   the predictor on the way */
+static void
+tiff_emit_wide (const tiff_layout *t, const uint8_t *row, uint16_t *rgba, int w)
+{
+    uint32_t sum[8] = { 0 };
+    uint32_t v[8];
+    uint32_t a;
+    int x, c;
+
+    for (x = 0; x < w; x++, rgba += 4)
+    {
+        for (c = 0; c < t->spp; c++)
+        {
+            v[c] = tiff_get16 (row + ((size_t)x * (size_t)t->spp + (size_t)c) * 2, t->le);
+            if (t->predictor == 2)
+                v[c] = sum[c] = (sum[c] + v[c]) & 0xFFFF;
+        }
+
+        if (t->photometric == 2)
+        {
+            rgba[0] = (uint16_t)v[0];
+            rgba[1] = (uint16_t)v[1];
+            rgba[2] = (uint16_t)v[2];
+            a = t->alpha ? v[3] : 0xFFFF;
+        }
+        else
+        {
+            rgba[0] = (uint16_t)((t->photometric == 0) ? 0xFFFF - v[0] : v[0]);
+            rgba[1] = rgba[2] = rgba[0];
+            a = t->alpha ? v[1] : 0xFFFF;
+        }
+        rgba[3] = (uint16_t)a;
+
+        /* straight alpha, as for 8 bits */
+        if ((t->alpha == 1) && (a != 0) && (a != 0xFFFF))
+        {
+            for (c = 0; c < 3; c++)
+            {
+                rgba[c] = (uint16_t)SDL_min ((rgba[c] * 0xFFFFu + a / 2) / a, 0xFFFFu);
+            }
+        }
+    }
+}
+
+
+/* decode strip or tile unit into its place in the surface (or wide),
+   through scratch unless it is stored as is.  16 bit rows bound for
+   the surface go by way of a row of wide samples after the unit */
+static int
+tiff_unit (tiff_layout *t, int unit, uint8_t *scratch)
+{
+    uint32_t off = tiff_value (&t->offsets, (uint32_t)unit, t->le);
+    uint32_t count = tiff_value (&t->counts, (uint32_t)unit, t->le);
+    const uint8_t *in = t->data + off;
+    const uint8_t *raw = scratch;
+    uint8_t *pixels;
+    uint8_t *row;
+    uint16_t *wide;
+    size_t room = t->stride * (size_t)t->unit_h;
+    size_t need;
+    size_t got = 0;
+    int x0 = (unit % t->across) * t->unit_w;
+    int y0 = (unit / t->across) * t->unit_h;
+    int cols = SDL_min (t->unit_w, t->w - x0);
+    int rows = SDL_min (t->unit_h, t->h - y0);
+    int r, i;
+
+    if ((off > t->len) || (count > t->len - off))
+        return EXIT_FAILURE;
+    need = t->stride * (size_t)rows;
+
+    switch (t->compression)
+    {
+    case 1:
+        got = SDL_min ((size_t)count, need);
+        if ((t->predictor == 1) || (t->bits == 16))
+            raw = in;
+        else
+            memcpy (scratch, in, got);
+        break;
+    case 5:
+        got = tiff_lzw (in, count, scratch, room);
+        break;
+    case 8:
+    case 32946:
+        got = tiff_inflate (in, count, scratch, room);
+        break;
+    case 32773:
+        got = tiff_packbits (in, count, scratch, room);
+        break;
+    }
+    if (got < need)
+        return EXIT_FAILURE;
+
+    if (t->bits == 16)
+    {
+        for (r = 0; r < rows; r++)
+        {
+            row = (uint8_t *)raw + (size_t)r * t->stride;
+            if (t->wide != NULL)
+            {
+                wide = t->wide + ((size_t)(y0 + r) * (size_t)t->w + (size_t)x0) * 4;
+                tiff_emit_wide (t, row, wide, cols);
+                continue;
+            }
+            wide = (uint16_t *)(scratch + room);
+            tiff_emit_wide (t, row, wide, cols);
+            pixels = (uint8_t *)t->surface->pixels + (size_t)(y0 + r) * (size_t)t->surface->pitch;
+            for (i = 0; i < cols * 4; i++)
+            {
+                pixels[x0 * 4 + i] = (uint8_t)(wide[i] >> 8);
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    pixels = (uint8_t *)t->surface->pixels + (size_t)x0 * 4;
+    for (r = 0; r < rows; r++)
+    {
+        row = (uint8_t *)raw + (size_t)r * t->stride;
+        if (t->predictor == 2)
+            g_simd.unfilter_row (row, row, cols * t->spp, t->spp, 1);
+        tiff_emit_row (t, row, pixels + (size_t)(y0 + r) * (size_t)t->surface->pitch, cols);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* take units until none are left, on a worker or the thread that asked
+   for the page */
+static void
+tiff_units_job (void *arg)
+{
+    tiff_layout *t = (tiff_layout *)arg;
+    uint8_t *scratch = NULL;
+    size_t row = 0;
+    int unit;
+
+    if ((t->bits == 16) && (t->wide == NULL))
+        row = (size_t)t->unit_w * 4 * sizeof (uint16_t);
+    if ((t->compression != 1) || ((t->predictor != 1) && (t->bits != 16)) || (row != 0))
+    {
+        if ((size_t)t->unit_h > (SIZE_MAX - row) / t->stride)
+            goto tiff_units_job_failure_0;
+        scratch = SDL_malloc (t->stride * (size_t)t->unit_h + row);
+        if (scratch == NULL)
+            goto tiff_units_job_failure_0;
+    }
+
+    while (SDL_AtomicGet (&t->failed) == 0)
+    {
+        unit = SDL_AtomicAdd (&t->next, 1);
+        if (unit >= t->units)
+            break;
+        if (tiff_unit (t, unit, scratch) != EXIT_SUCCESS)
+            SDL_AtomicSet (&t->failed, 1);
+    }
+
+/* tiff_units_job_success_0: */
+    SDL_free (scratch);
+    return;
+
+tiff_units_job_failure_0:
+    SDL_AtomicSet (&t->failed, 1);
+}
+
+
+/* every unit of t, with pool's help when the page is large.  pool is
+   only used by one page at a time */
+static int
+tiff_run (tiff_layout *t, worker_pool *pool)
+{
+    int helpers = 0;
+
+    SDL_AtomicSet (&t->next, 0);
+    SDL_AtomicSet (&t->failed, 0);
+
+    /* the workers take units alongside this thread, which does them all
+       itself if none can be queued */
+    if ((pool != NULL) && (t->units > 1) &&
+        ((size_t)t->w * (size_t)t->h >= TIFF_PARALLEL_PIXELS))
+    {
+        for (; helpers < SDL_min (pool->thread_count, t->units - 1); helpers++)
+        {
+            if (workers_submit (pool, tiff_units_job, t) != EXIT_SUCCESS)
+                break;
+        }
+    }
+    tiff_units_job (t);
+    if (helpers > 0)
+        workers_wait (pool);
+
+    return (SDL_AtomicGet (&t->failed) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* the page whose directory is at ifd, as a surface */
+static SDL_Surface *
+tiff_decode_ifd (const uint8_t *data, size_t len, bool le, uint32_t ifd, worker_pool *pool)
+{
+    tiff_layout *t;
+    SDL_Surface *surface = NULL;
+
+    t = SDL_calloc (1, sizeof (tiff_layout));
+    if (t == NULL)
+        return (SDL_Surface *)NULL;
+    t->data = data;
+    t->len = len;
+    t->le = le;
+    if (tiff_parse (t, ifd) != EXIT_SUCCESS)
+        goto tiff_decode_ifd_failure_0;
+
+    surface = SDL_CreateRGBSurfaceWithFormat (0, t->w, t->h, 32, DECODE_PIXELFORMAT);
+    if (surface == NULL)
+        goto tiff_decode_ifd_failure_0;
+    t->surface = surface;
+    if (tiff_run (t, pool) != EXIT_SUCCESS)
+        goto tiff_decode_ifd_failure_1;
+
+/* tiff_decode_ifd_success_0: */
+    SDL_free (t);
+    return surface;
+
+tiff_decode_ifd_failure_1:
+    SDL_FreeSurface (surface);
+tiff_decode_ifd_failure_0:
+    SDL_free (t);
+    return (SDL_Surface *)NULL;
+}
+
+
+static Sint64
+tiff_rw_size (SDL_RWops *rw)
+{
+    return (Sint64)((tiff_rw *)rw->hidden.unknown.data1)->len;
+}
+
+
+static Sint64
+tiff_rw_seek (SDL_RWops *rw, Sint64 offset, int whence)
+{
+    tiff_rw *state = (tiff_rw *)rw->hidden.unknown.data1;
+    Sint64 pos;
+
+    switch (whence)
+    {
+    case RW_SEEK_SET: pos = offset;                        break;
+    case RW_SEEK_CUR: pos = (Sint64)state->pos + offset;   break;
+    case RW_SEEK_END: pos = (Sint64)state->len + offset;   break;
+    default:          return SDL_SetError ("bad seek");
+    }
+    if ((pos < 0) || (pos > (Sint64)state->len))
+        return SDL_SetError ("seek outside the file");
+
+    state->pos = (size_t)pos;
+    return pos;
+}
+
+
+/* the file, with the patched header in front */
+static size_t
+tiff_rw_read (SDL_RWops *rw, void *ptr, size_t size, size_t maxnum)
+{
+    tiff_rw *state = (tiff_rw *)rw->hidden.unknown.data1;
+    uint8_t *out = (uint8_t *)ptr;
+    size_t n, head;
+
+    if ((size == 0) || (state->pos >= state->len))
+        return 0;
+    n = SDL_min (maxnum, (state->len - state->pos) / size) * size;
+
+    head = (state->pos < 8) ? SDL_min (8 - state->pos, n) : 0;
+    memcpy (out, state->head + state->pos, head);
+    memcpy (out + head, state->data + state->pos + head, n - head);
+    state->pos += n;
+
+    return n / size;
+}
+
+
+static size_t
+tiff_rw_write (SDL_RWops *rw, const void *ptr, size_t size, size_t num)
+{
+    SDL_SetError ("read only");
+    return 0;
+}
+
+
+static int
+tiff_rw_close (SDL_RWops *rw)
+{
+    SDL_free (rw->hidden.unknown.data1);
+    SDL_FreeRW (rw);
+    return 0;
+}
+
+
+/* SDL_image has no page to ask for, it reads the first directory the
+   header names, so it is shown a header naming this page's */
+static SDL_Surface *
+tiff_fallback (const tiff_doc *doc, int page)
+{
+    tiff_rw *state;
+    SDL_RWops *rw;
+    uint32_t ifd = doc->pages[page].ifd;
+
+    state = SDL_malloc (sizeof (tiff_rw));
+    if (state == NULL)
+        return (SDL_Surface *)NULL;
+    rw = SDL_AllocRW ();
+    if (rw == NULL)
+    {
+        SDL_free (state);
+        return (SDL_Surface *)NULL;
+    }
+
+    state->data = doc->data;
+    state->len = doc->len;
+    state->pos = 0;
+    memcpy (state->head, doc->data, 4);
+    state->head[4] = (uint8_t)(doc->le ? ifd : ifd >> 24);
+    state->head[5] = (uint8_t)(doc->le ? ifd >> 8 : ifd >> 16);
+    state->head[6] = (uint8_t)(doc->le ? ifd >> 16 : ifd >> 8);
+    state->head[7] = (uint8_t)(doc->le ? ifd >> 24 : ifd);
+
+    rw->size = tiff_rw_size;
+    rw->seek = tiff_rw_seek;
+    rw->read = tiff_rw_read;
+    rw->write = tiff_rw_write;
+    rw->close = tiff_rw_close;
+    rw->type = SDL_RWOPS_UNKNOWN;
+    rw->hidden.unknown.data1 = state;
+
+    return IMG_LoadTyped_RW (rw, 1, "TIF");
+}
+
+
+static SDL_Surface *
+tiff_load_page (tiff_doc *doc, int page)
+{
+#if NATIVE_TIFF
+    SDL_Surface *surface;
+
+    surface = tiff_decode_ifd (doc->data, doc->len, doc->le, doc->pages[page].ifd, doc->pool);
+    if (surface != NULL)
+        return surface;
+#endif
+
+    return tiff_fallback (doc, page);
+}
+
+
+/* decode the page after the one shown, collected by tiff_page_surface */
+static int
+tiff_prefetch_thread (void *arg)
+{
+    tiff_doc *doc = (tiff_doc *)arg;
+
+    doc->ahead_surface = tiff_load_page (doc, doc->ahead);
+    return 0;
+}
+
+
+/* the page decoded ahead when it is page, else NULL with it dropped */
+static SDL_Surface *
+tiff_take_ahead (tiff_doc *doc, int page)
+{
+    SDL_Surface *surface = NULL;
+
+    SDL_WaitThread (doc->prefetch, (int *)NULL);
+    doc->prefetch = NULL;
+    if (doc->ahead == page)
+        surface = doc->ahead_surface;
+    else if (doc->ahead_surface != NULL)
+        SDL_FreeSurface (doc->ahead_surface);
+    doc->ahead_surface = NULL;
+    doc->ahead = -1;
+
+    return surface;
+}
+
+
+/* start decoding page on a thread of its own, deep pages are left to
+   tiff_page_wide */
+static void
+tiff_prefetch (tiff_doc *doc, int page)
+{
+    if ((page >= doc->page_count) || doc->pages[page].deep)
+        return;
+
+    doc->ahead = page;
+    doc->prefetch = SDL_CreateThread (tiff_prefetch_thread, "ljpeg-tiff", doc);
+    if (doc->prefetch == NULL)
+        doc->ahead = -1;
+}
+
+
+/* function definitions */
+/* index the pages of data when it is a tiff, nothing is decoded */
+int
+tiff_open (tiff_doc *doc, const unsigned char *data, size_t len)
+{
+    tiff_page *pages;
+    tiff_array arr;
+    const uint8_t *e;
+    uint32_t off, next, seen = 0;
+    uint32_t subfile;
+    int bits;
+    int cap = 0;
+    int steps;
+    int count;
+    int w, h;
+    int i;
+
+    memset (doc, 0, sizeof (tiff_doc));
+    if (!tiff_header (data, len, &doc->le, &off))
+        goto tiff_open_failure_0;
+
+    for (steps = 1; (off != 0) && (steps <= TIFF_MAX_PAGES); steps++)
+    {
+        /* a directory that does not fit ends the chain early */
+        if ((off > len) || (len - off < 2))
+            break;
+        count = tiff_get16 (data + off, doc->le);
+        if ((size_t)count * 12 + 6 > len - off)
+            break;
+
+        w = h = 0;
+        bits = 1;
+        subfile = 0;
+        for (i = 0; i < count; i++)
+        {
+            e = data + off + 2 + i * 12;
+            if (!tiff_entry (data, len, doc->le, e, &arr))
+                continue;
+            switch (tiff_get16 (e, doc->le))
+            {
+            case TIFF_SUBFILE_TYPE: subfile = tiff_value (&arr, 0, doc->le);      break;
+            case TIFF_WIDTH:        w = (int)tiff_value (&arr, 0, doc->le);       break;
+            case TIFF_HEIGHT:       h = (int)tiff_value (&arr, 0, doc->le);       break;
+            case TIFF_BITS:         bits = (int)tiff_value (&arr, 0, doc->le);    break;
+            }
+        }
+
+        /* reduced resolution copies are left out */
+        if (((subfile & 1) == 0) && (w > 0) && (h > 0))
+        {
+            if (doc->page_count == cap)
+            {
+                cap = cap ? cap * 2 : 16;
+                pages = SDL_realloc (doc->pages, (size_t)cap * sizeof (tiff_page));
+                if (pages == NULL)
+                    goto tiff_open_failure_1;
+                doc->pages = pages;
+            }
+            doc->pages[doc->page_count].ifd = off;
+            doc->pages[doc->page_count].w = w;
+            doc->pages[doc->page_count].h = h;
+            doc->pages[doc->page_count].deep = (NATIVE_TIFF && (bits == 16));
+            doc->page_count++;
+        }
+
+        /* a chain that loops back comes round to the directory last
+           noted, noted again every power of two steps */
+        next = tiff_get32 (data + off + 2 + (size_t)count * 12, doc->le);
+        if ((steps & (steps - 1)) == 0)
+            seen = off;
+        if (next == seen)
+            break;
+        off = next;
+    }
+    if (doc->page_count == 0)
+        goto tiff_open_failure_1;
+
+    /* without workers large pages are decoded on one thread */
+    doc->pool = workers_create (workers_default_count (), (worker_rank_fn)NULL);
+
+    doc->data = data;
+    doc->len = len;
+    doc->shown = -1;
+    doc->ahead = -1;
+    doc->active = true;
+
+/* tiff_open_success_0: */
+    return EXIT_SUCCESS;
+
+tiff_open_failure_1:
+    SDL_free (doc->pages);
+    memset (doc, 0, sizeof (tiff_doc));
+tiff_open_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+void
+tiff_close (tiff_doc *doc)
+{
+    if (!doc->active)
+        return;
+
+    SDL_WaitThread (doc->prefetch, (int *)NULL);
+    if (doc->ahead_surface != NULL)
+        SDL_FreeSurface (doc->ahead_surface);
+    workers_destroy (doc->pool);
+    SDL_free (doc->pages);
+    memset (doc, 0, sizeof (tiff_doc));
+}
+
+
+/* the page decoded ahead when it is the one asked for, else decoded
+   now.  the page after it is started on before returning */
+SDL_Surface *
+tiff_page_surface (tiff_doc *doc, int page)
+{
+    SDL_Surface *surface;
+
+    if (!doc->active || (page < 0) || (page >= doc->page_count))
+        return (SDL_Surface *)NULL;
+
+    surface = tiff_take_ahead (doc, page);
+    if (surface == NULL)
+        surface = tiff_load_page (doc, page);
+    if (surface == NULL)
+        return (SDL_Surface *)NULL;
+    doc->shown = page;
+    tiff_prefetch (doc, page + 1);
+
+    return surface;
+}
+
+
+int
+tiff_page_wide (tiff_doc *doc, int page, uint16_t *rgba)
+{
+    tiff_layout *t;
+
+    if (!doc->active || (page < 0) || (page >= doc->page_count) || !doc->pages[page].deep)
+        return EXIT_FAILURE;
+
+    t = SDL_calloc (1, sizeof (tiff_layout));
+    if (t == NULL)
+        return EXIT_FAILURE;
+    t->data = doc->data;
+    t->len = doc->len;
+    t->le = doc->le;
+    if ((tiff_parse (t, doc->pages[page].ifd) != EXIT_SUCCESS) || (t->bits != 16) ||
+        (t->w != doc->pages[page].w) || (t->h != doc->pages[page].h))
+        goto tiff_page_wide_failure_0;
+
+    /* the prefetch thread is done with the pool before it is used */
+    SDL_FreeSurface (tiff_take_ahead (doc, -1));
+    t->wide = rgba;
+    if (tiff_run (t, doc->pool) != EXIT_SUCCESS)
+        goto tiff_page_wide_failure_0;
+    doc->shown = page;
+    tiff_prefetch (doc, page + 1);
+
+/* tiff_page_wide_success_0: */
+    SDL_free (t);
+    return EXIT_SUCCESS;
+
+tiff_page_wide_failure_0:
+    SDL_free (t);
+    SDL_SetError ("tiff: page %d is not one the built-in decoder handles", page + 1);
+    return EXIT_FAILURE;
+}
+
+
+SDL_Surface *
+tiff_decode (const unsigned char *data, size_t len)
+{
+#if NATIVE_TIFF
+    uint32_t first;
+    bool le;
+
+    if (tiff_header (data, len, &le, &first))
+        return tiff_decode_ifd (data, len, le, first, (worker_pool *)NULL);
+#endif
+
+    return (SDL_Surface *)NULL;
+}
+
+
+/* End of File */
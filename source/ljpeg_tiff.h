@@ -0,0 +1,93 @@
+/*
+   source/ljpeg_tiff.h
+   LJPEG multi-page tiff header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_TIFF_HEADER__
+#define __LJPEG_TIFF_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_workers.h"
+
+
+/* custom datatypes */
+typedef struct tiff_page
+{
+    uint32_t      ifd;          /* offset of the page's directory */
+    int           w, h;
+    bool          deep;         /* 16 bits a sample, see tiff_page_wide */
+} tiff_page;
+
+typedef struct tiff_doc
+{
+    bool          active;
+    const unsigned char *data;  /* the whole file, borrowed */
+    size_t        len;
+    bool          le;           /* "II", little endian */
+
+    /* every page's directory, found without decoding any of them */
+    tiff_page    *pages;
+    int           page_count;
+    int           shown;
+
+    worker_pool  *pool;         /* strips and tiles of large pages */
+
+    /* the page after the one shown, decoded ahead */
+    SDL_Thread   *prefetch;
+    int           ahead;        /* -1 for none */
+    SDL_Surface  *ahead_surface;
+} tiff_doc;
+
+
+/* constants */
+
+
+/* global variables */
+extern tiff_doc g_tiff;
+
+
+/* external function prototypes */
+/* data stays borrowed until tiff_close */
+int  tiff_open  (tiff_doc *doc, const unsigned char *data, size_t len);
+void tiff_close (tiff_doc *doc);
+
+/* the page, decoded, for the caller to free.  it becomes the page shown
+   and the one after it is started on */
+SDL_Surface *tiff_page_surface (tiff_doc *doc, int page);
+
+/* a deep page's w x h rgba pixels of 16 bit samples (straight alpha)
+   into rgba, at full depth.  otherwise as tiff_page_surface */
+int tiff_page_wide (tiff_doc *doc, int page, uint16_t *rgba);
+
+/* the first page on the calling thread, NULL when it is not one the
+   built-in decoder handles.  safe to call from workers */
+SDL_Surface *tiff_decode (const unsigned char *data, size_t len);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,290 @@
+/*
+   source/ljpeg_watch.c
+   LJPEG open file change watcher source code.
+
+   Watches the open image (and its directory, see WATCH_DIRECTORY) with
+   inotify on a background thread.  Writes are debounced: the main loop
+   is only told once the file has gone WATCH_DEBOUNCE_MS without being
+   touched, and is still there.  Saving through a temporary file and a
+   rename replaces the inode under the file watch, the directory watch
+   sees the new name arrive and the file watch is put back on it.
+   inotify is Linux only, elsewhere nothing is watched.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* poll, read and friends are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_watch.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* global variable declarations */
+file_watch g_watch;
+Uint32     g_watch_event = (Uint32)-1;
+
+
+/* file static variables */
+#ifdef __linux__
+#define WATCH_FILE_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#define WATCH_DIR_MASK  (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE)
+#endif
+
+
+/* file static function prototypes */
+#ifdef __linux__
+static bool watch_event (file_watch *watch, const struct inotify_event *ev);
+static void watch_fire (file_watch *watch);
+static int  watch_thread (void *data);
+#endif
+
+
+/* static function definitions */
+#ifdef __linux__
+/* true when ev says the image may have changed */
+static bool
+watch_event (file_watch *watch, const struct inotify_event *ev)
+{
+    if ((ev->wd == watch->file_wd) && (watch->file_wd >= 0))
+    {
+        /* moved away or deleted, wait for something to take its place */
+        if ((ev->mask & IN_MOVE_SELF) != 0)
+            inotify_rm_watch (watch->fd, watch->file_wd);
+        if ((ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) != 0)
+            watch->file_wd = -1;
+
+        return (ev->mask & ~IN_IGNORED) != 0;
+    }
+
+    if ((ev->wd == watch->dir_wd) && (ev->len > 0) && (strcmp (ev->name, watch->name) == 0))
+    {
+        /* a new file under our name, eg: renamed over the old one */
+        if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0)
+            watch->file_wd = inotify_add_watch (watch->fd, watch->path, WATCH_FILE_MASK);
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/* the writes have settled, tell the main loop if there is still a file
+   to reload */
+static void
+watch_fire (file_watch *watch)
+{
+    SDL_Event evt;
+
+    if (watch->file_wd < 0)
+        watch->file_wd = inotify_add_watch (watch->fd, watch->path, WATCH_FILE_MASK);
+    if (watch->file_wd < 0)
+        return;
+
+    if (SDL_AtomicSet (&watch->changed, 1) == 0)
+    {
+        SDL_zero (evt);
+        evt.type = g_watch_event;
+        SDL_PushEvent (&evt);
+    }
+}
+
+
+static int
+watch_thread (void *data)
+{
+    file_watch *watch = (file_watch *)data;
+    union
+    {
+        struct inotify_event ev;
+        char                 bytes[4096];
+    } buf;
+    const struct inotify_event *ev;
+    struct pollfd pfd;
+    Uint32 deadline = 0;
+    Uint32 now;
+    bool pending = false;
+    bool quit = false;
+    ssize_t got;
+    ssize_t pos;
+    int timeout;
+
+    while (!quit)
+    {
+        /* wake at the end of the quiet period, or now and then to see
+           if watch_close is waiting on us */
+        timeout = 100;
+        if (pending)
+        {
+            now = SDL_GetTicks ();
+            timeout = SDL_TICKS_PASSED (now, deadline) ? 0 : (int)SDL_min (deadline - now, 100u);
+        }
+
+        pfd.fd = watch->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll (&pfd, 1, timeout) > 0)
+        {
+            got = read (watch->fd, &buf, sizeof (buf));
+            for (pos = 0; pos < got; pos += (ssize_t)(sizeof (struct inotify_event) + ev->len))
+            {
+                ev = (const struct inotify_event *)(buf.bytes + pos);
+                if (watch_event (watch, ev))
+                {
+                    /* still being written, start the quiet period over */
+                    pending = true;
+                    deadline = SDL_GetTicks () + WATCH_DEBOUNCE_MS;
+                }
+            }
+        }
+
+        if (pending && SDL_TICKS_PASSED (SDL_GetTicks (), deadline))
+        {
+            pending = false;
+            watch_fire (watch);
+        }
+
+        SDL_LockMutex (watch->lock);
+        quit = watch->quit;
+        SDL_UnlockMutex (watch->lock);
+    }
+
+    return 0;
+}
+#endif
+
+
+/* function definitions */
+/* start watching path, failing quietly leaves the image as it is */
+int
+watch_open (file_watch *watch, const char *path)
+{
+#ifdef __linux__
+    char *slash;
+    char *dir;
+
+    memset (watch, 0, sizeof (file_watch));
+    watch->fd = -1;
+    watch->file_wd = -1;
+    watch->dir_wd = -1;
+    if (g_watch_event == (Uint32)-1)
+        g_watch_event = SDL_RegisterEvents (1);
+
+    watch->path = strdup (path);
+    if (watch->path == NULL)
+        goto watch_open_failure_0;
+    slash = strrchr (watch->path, '/');
+    watch->name = (slash != NULL) ? slash + 1 : watch->path;
+
+    watch->fd = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if (watch->fd < 0)
+        goto watch_open_failure_1;
+    watch->file_wd = inotify_add_watch (watch->fd, watch->path, WATCH_FILE_MASK);
+    if (watch->file_wd < 0)
+        goto watch_open_failure_2;
+
+    if (WATCH_DIRECTORY)
+    {
+        if (slash == NULL)
+            dir = strdup (".");
+        else if (slash == watch->path)
+            dir = strdup ("/");
+        else
+            dir = strndup (watch->path, (size_t)(slash - watch->path));
+        if (dir != NULL)
+        {
+            watch->dir_wd = inotify_add_watch (watch->fd, dir, WATCH_DIR_MASK);
+            free (dir);
+        }
+    }
+
+    watch->lock = SDL_CreateMutex ();
+    if (watch->lock == NULL)
+        goto watch_open_failure_2;
+    watch->watcher = SDL_CreateThread (watch_thread, "ljpeg-watch", watch);
+    if (watch->watcher == NULL)
+        goto watch_open_failure_3;
+    watch->active = true;
+
+/* watch_open_success_0: */
+    return EXIT_SUCCESS;
+
+watch_open_failure_3:
+    SDL_DestroyMutex (watch->lock);
+watch_open_failure_2:
+    close (watch->fd);
+watch_open_failure_1:
+    free (watch->path);
+watch_open_failure_0:
+    memset (watch, 0, sizeof (file_watch));
+    return EXIT_FAILURE;
+#else
+    (void)path;
+    memset (watch, 0, sizeof (file_watch));
+    return EXIT_FAILURE;
+#endif
+}
+
+
+void
+watch_close (file_watch *watch)
+{
+    if (!watch->active)
+        return;
+
+#ifdef __linux__
+    SDL_LockMutex (watch->lock);
+    watch->quit = true;
+    SDL_UnlockMutex (watch->lock);
+    SDL_WaitThread (watch->watcher, NULL);
+
+    SDL_DestroyMutex (watch->lock);
+    close (watch->fd);
+    free (watch->path);
+#endif
+    memset (watch, 0, sizeof (file_watch));
+}
+
+
+/* true, once, when the file has changed and settled since last time */
+bool
+watch_update (file_watch *watch)
+{
+    if (!watch->active)
+        return false;
+
+    return SDL_AtomicSet (&watch->changed, 0) != 0;
+}
+
+
+/* End of File */
@@ -0,0 +1,67 @@
+/*
+   source/ljpeg_watch.h
+   LJPEG open file change watcher header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_WATCH_HEADER__
+#define __LJPEG_WATCH_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+typedef struct file_watch
+{
+    bool          active;
+    char         *path;
+    char         *name;         /* points into path, after the last '/' */
+    int           fd;           /* inotify instance */
+    int           file_wd;      /* -1 while the file is being replaced */
+    int           dir_wd;
+
+    SDL_mutex    *lock;
+    SDL_Thread   *watcher;
+    bool          quit;
+    SDL_atomic_t  changed;      /* set once the writes have settled */
+} file_watch;
+
+
+/* constants */
+
+
+/* global variables */
+extern file_watch g_watch;
+extern Uint32     g_watch_event;
+
+
+/* external function prototypes */
+int  watch_open   (file_watch *watch, const char *path);
+void watch_close  (file_watch *watch);
+bool watch_update (file_watch *watch);
+
+#endif /* end run once */
+
+
+/* End of File */
@@ -0,0 +1,265 @@
+/*
+   source/ljpeg_workers.c
+   LJPEG background worker thread pool source code.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+#include "ljpeg_workers.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* file static variables */
+
+
+/* file static function prototypes */
+static int  worker_main (void *data);
+static bool worker_take (worker_pool *pool, worker_job *job);
+
+
+/* static function definitions */
+/* pick the next job off the queue, pool must be locked */
+static bool
+worker_take (worker_pool *pool, worker_job *job)
+{
+    int pick = 0;
+    int best, rank;
+    int i;
+
+    if (pool->queue_len == 0)
+        return false;
+
+    /* without a rank function the queue is plain FIFO */
+    if (pool->rank != NULL)
+    {
+        best = pool->rank (pool->queue[0].arg);
+        for (i = 1; i < pool->queue_len; i++)
+        {
+            rank = pool->rank (pool->queue[i].arg);
+            if (rank < best)
+            {
+                best = rank;
+                pick = i;
+            }
+        }
+    }
+
+    *job = pool->queue[pick];
+    pool->queue_len--;
+    memmove (&pool->queue[pick], &pool->queue[pick + 1],
+             (size_t)(pool->queue_len - pick) * sizeof (worker_job));
+
+    return true;
+}
+
+
+static int
+worker_main (void *data)
+{
+    worker_pool *pool = (worker_pool *)data;
+    worker_job job;
+
+    SDL_SetThreadPriority (SDL_THREAD_PRIORITY_LOW);
+
+    SDL_LockMutex (pool->lock);
+    while (!pool->quit)
+    {
+        if (!worker_take (pool, &job))
+        {
+            SDL_CondWait (pool->job_ready, pool->lock);
+            continue;
+        }
+
+        /* run the job unlocked */
+        pool->busy++;
+        SDL_UnlockMutex (pool->lock);
+
+        job.fn (job.arg);
+
+        SDL_LockMutex (pool->lock);
+        pool->busy--;
+        SDL_CondBroadcast (pool->job_done);
+    }
+    SDL_UnlockMutex (pool->lock);
+
+    return 0;
+}
+
+
+/* function definitions */
+/* number of threads to use when WORKER_THREADS is left at 0,
+   one less than the cpu count so the main thread keeps a core */
+int
+workers_default_count (void)
+{
+    int count = WORKER_THREADS;
+
+    if (count <= 0)
+        count = SDL_GetCPUCount () - 1;
+    if (count < 1)
+        count = 1;
+
+    return count;
+}
+
+
+worker_pool *
+workers_create (int thread_count, worker_rank_fn rank)
+{
+    worker_pool *pool;
+    char name[32];
+    int i;
+
+    pool = calloc (1, sizeof (worker_pool));
+    if (pool == NULL)
+        goto workers_create_failure_0;
+
+    pool->rank = rank;
+    pool->lock = SDL_CreateMutex ();
+    pool->job_ready = SDL_CreateCond ();
+    pool->job_done = SDL_CreateCond ();
+    if ((pool->lock == NULL) || (pool->job_ready == NULL) || (pool->job_done == NULL))
+        goto workers_create_failure_1;
+
+    pool->threads = calloc ((size_t)thread_count, sizeof (SDL_Thread *));
+    if (pool->threads == NULL)
+        goto workers_create_failure_1;
+
+    for (i = 0; i < thread_count; i++)
+    {
+        snprintf (name, sizeof (name), "ljpeg-worker-%d", i);
+        pool->threads[i] = SDL_CreateThread (worker_main, name, pool);
+        if (pool->threads[i] == NULL)
+            break;
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0)
+    {
+        fprintf (stderr, "could not start worker threads: %s\n", SDL_GetError ());
+        goto workers_create_failure_1;
+    }
+
+/* workers_create_success_0: */
+    return pool;
+
+workers_create_failure_1:
+    workers_destroy (pool);
+workers_create_failure_0:
+    return (worker_pool *)NULL;
+}
+
+
+int
+workers_submit (worker_pool *pool, worker_job_fn fn, void *arg)
+{
+    worker_job *grown;
+    int new_cap;
+
+    SDL_LockMutex (pool->lock);
+
+    if (pool->queue_len == pool->queue_cap)
+    {
+        new_cap = (pool->queue_cap == 0) ? 64 : pool->queue_cap * 2;
+        grown = realloc (pool->queue, (size_t)new_cap * sizeof (worker_job));
+        if (grown == NULL)
+        {
+            SDL_UnlockMutex (pool->lock);
+            return EXIT_FAILURE;
+        }
+        pool->queue = grown;
+        pool->queue_cap = new_cap;
+    }
+
+    pool->queue[pool->queue_len].fn = fn;
+    pool->queue[pool->queue_len].arg = arg;
+    pool->queue_len++;
+
+    SDL_CondSignal (pool->job_ready);
+    SDL_UnlockMutex (pool->lock);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* drop every job that has not started yet, the caller still owns their args */
+void
+workers_cancel (worker_pool *pool)
+{
+    SDL_LockMutex (pool->lock);
+    pool->queue_len = 0;
+    SDL_UnlockMutex (pool->lock);
+}
+
+
+/* block until the queue is empty and no job is running */
+void
+workers_wait (worker_pool *pool)
+{
+    SDL_LockMutex (pool->lock);
+    while ((pool->queue_len > 0) || (pool->busy > 0))
+    {
+        SDL_CondWait (pool->job_done, pool->lock);
+    }
+    SDL_UnlockMutex (pool->lock);
+}
+
+
+/* stop the threads, running jobs finish and queued jobs are dropped */
+void
+workers_destroy (worker_pool *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    if (pool->lock != NULL)
+    {
+        SDL_LockMutex (pool->lock);
+        pool->quit = true;
+        pool->queue_len = 0;
+        SDL_CondBroadcast (pool->job_ready);
+        SDL_UnlockMutex (pool->lock);
+    }
+
+    for (i = 0; i < pool->thread_count; i++)
+    {
+        SDL_WaitThread (pool->threads[i], NULL);
+    }
+
+    if (pool->job_done != NULL)
+        SDL_DestroyCond (pool->job_done);
+    if (pool->job_ready != NULL)
+        SDL_DestroyCond (pool->job_ready);
+    if (pool->lock != NULL)
+        SDL_DestroyMutex (pool->lock);
+
+    free (pool->threads);
+    free (pool->queue);
+    free (pool);
+}
+
+
+/* End of File */
@@ -0,0 +1,86 @@
+/*
+   source/ljpeg_workers.h
+   LJPEG background worker thread pool header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_WORKERS_HEADER__
+#define __LJPEG_WORKERS_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+
+
+/* custom datatypes */
+/* a unit of work, run on one of the pool's threads */
+typedef void (*worker_job_fn) (void *arg);
+
+/* optional job ranking, lower ranks are dequeued first.
+   called with the pool locked, every time a worker picks a job, so the
+   order can follow state that changes after submission (eg: scrolling) */
+typedef int (*worker_rank_fn) (void *arg);
+
+typedef struct worker_job
+{
+    worker_job_fn  fn;
+    void          *arg;
+} worker_job;
+
+typedef struct worker_pool
+{
+    SDL_Thread   **threads;
+    int            thread_count;
+
+    SDL_mutex     *lock;
+    SDL_cond      *job_ready;
+    SDL_cond      *job_done;
+
+    worker_job    *queue;
+    int            queue_len;
+    int            queue_cap;
+    int            busy;
+
+    worker_rank_fn rank;
+    bool           quit;
+} worker_pool;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+int workers_default_count (void);
+
+worker_pool *workers_create  (int thread_count, worker_rank_fn rank);
+int          workers_submit  (worker_pool *pool, worker_job_fn fn, void *arg);
+void         workers_cancel  (worker_pool *pool);
+void         workers_wait    (worker_pool *pool);
+void         workers_destroy (worker_pool *pool);
+
+#endif /* end run once */
+
+
+/* End of File */
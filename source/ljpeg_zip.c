@@ -0,0 +1,825 @@
+/*
+   source/ljpeg_zip.c
+   LJPEG ZIP/CBZ archive input source code.
+
+   The central directory is read once, when the archive is opened, into
+   an index of the images in it.  Nothing is extracted: each entry is
+   read through an SDL_RWops that preads the compressed bytes straight
+   from the archive and inflates them as they are asked for.  Entries
+   are addressed as ARCHIVE/NAME (eg: scans.cbz/0001.jpg), and every
+   open archive is registered here, so the rest of the viewer can pass
+   such paths around like any other (see mapfile_open, cache_key_for).
+   Stored and deflated entries are supported, including zip64 archives;
+   encrypted entries are skipped.  Needs pread, so not on _WIN32.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* pread and realpath are hidden by -std=c99 otherwise */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include "ljpeg_zip.h"
+
+/* include headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <zlib.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_filelist.h"
+#include "ljpeg_mapfile.h"
+
+
+/* file static variables */
+/* compressed bytes read at a time */
+#define ZIP_CHUNK 65536
+
+/* one open entry, behind an SDL_RWops */
+typedef struct zip_stream
+{
+    zip_archive   *zip;
+    zip_entry     *entry;
+    uint64_t       data;        /* compressed data offset */
+    z_stream       z;
+    bool           inflating;
+    uint64_t       comp_pos;    /* compressed bytes handed to zlib */
+    uint64_t       pos;         /* uncompressed position */
+    unsigned char  in[ZIP_CHUNK];
+} zip_stream;
+
+#define ZIP_EOCD_SIG    0x06054b50u
+#define ZIP64_LOC_SIG   0x07064b50u
+#define ZIP64_EOCD_SIG  0x06064b50u
+#define ZIP_CENTRAL_SIG 0x02014b50u
+#define ZIP_LOCAL_SIG   0x04034b50u
+
+/* the end record is 22 bytes, followed by up to 64 KiB of comment */
+#define ZIP_EOCD_SCAN (22 + 65535)
+
+static zip_archive  *s_archives;
+static SDL_SpinLock  s_archives_lock;
+
+
+/* file static function prototypes */
+#ifndef _WIN32
+static uint32_t zip_get16 (const unsigned char *p);
+static uint32_t zip_get32 (const unsigned char *p);
+static uint64_t zip_get64 (const unsigned char *p);
+static bool     zip_pread (zip_archive *zip, void *buf, size_t len, uint64_t off);
+static int      zip_read_directory (zip_archive *zip);
+static void     zip_extra64 (const unsigned char *p, size_t len, zip_entry *entry,
+                             bool want_size, bool want_comp, bool want_header);
+static int      zip_locate (zip_archive *zip, zip_entry *entry, uint64_t *data);
+static int      compare_entries (const void *a, const void *b);
+
+static Sint64 zip_rw_size  (SDL_RWops *rw);
+static Sint64 zip_rw_seek  (SDL_RWops *rw, Sint64 offset, int whence);
+static size_t zip_rw_read  (SDL_RWops *rw, void *ptr, size_t size, size_t maxnum);
+static size_t zip_rw_write (SDL_RWops *rw, const void *ptr, size_t size, size_t num);
+static int    zip_rw_close (SDL_RWops *rw);
+#endif
+
+
+/* static function definitions */
+#ifndef _WIN32
+static uint32_t
+zip_get16 (const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+
+static uint32_t
+zip_get32 (const unsigned char *p)
+{
+    return zip_get16 (p) | (zip_get16 (p + 2) << 16);
+}
+
+
+static uint64_t
+zip_get64 (const unsigned char *p)
+{
+    return (uint64_t)zip_get32 (p) | ((uint64_t)zip_get32 (p + 4) << 32);
+}
+
+
+static bool
+zip_pread (zip_archive *zip, void *buf, size_t len, uint64_t off)
+{
+    size_t done = 0;
+    ssize_t got;
+
+    while (done < len)
+    {
+        got = pread (zip->fd, (unsigned char *)buf + done, len - done, (off_t)(off + done));
+        if ((got < 0) && (errno == EINTR))
+            continue;
+        if (got <= 0)
+            return false;
+        done += (size_t)got;
+    }
+
+    return true;
+}
+
+
+/* pull the fields that did not fit out of a zip64 extra field */
+static void
+zip_extra64 (const unsigned char *p, size_t len, zip_entry *entry,
+             bool want_size, bool want_comp, bool want_header)
+{
+    uint32_t id, size;
+    size_t pos = 0;
+    size_t at;
+
+    while (pos + 4 <= len)
+    {
+        id = zip_get16 (p + pos);
+        size = zip_get16 (p + pos + 2);
+        if (pos + 4 + size > len)
+            return;
+
+        if (id == 0x0001)
+        {
+            /* only the fields that were 0xFFFFFFFF are present, in order */
+            at = pos + 4;
+            if (want_size && (at + 8 <= pos + 4 + size))
+            {
+                entry->size = zip_get64 (p + at);
+                at += 8;
+            }
+            if (want_comp && (at + 8 <= pos + 4 + size))
+            {
+                entry->comp_size = zip_get64 (p + at);
+                at += 8;
+            }
+            if (want_header && (at + 8 <= pos + 4 + size))
+                entry->header = zip_get64 (p + at);
+            return;
+        }
+        pos += 4 + size;
+    }
+}
+
+
+/* find the end record and read the whole central directory in one go,
+   keeping the images it lists */
+static int
+zip_read_directory (zip_archive *zip)
+{
+    unsigned char *tail = NULL;
+    unsigned char *dir = NULL;
+    unsigned char rec[56];
+    const unsigned char *p;
+    struct stat st;
+    uint64_t dir_off, dir_size, total, pos;
+    size_t tail_len;
+    size_t name_len, extra_len, comment_len;
+    zip_entry entry;
+    int64_t i;
+
+    if (fstat (zip->fd, &st) != 0)
+        goto zip_read_directory_failure_0;
+    zip->mtime = (int64_t)st.st_mtime;
+    if (st.st_size < 22)
+        goto zip_read_directory_failure_0;
+
+    tail_len = SDL_min ((size_t)st.st_size, (size_t)ZIP_EOCD_SCAN);
+    tail = malloc (tail_len);
+    if ((tail == NULL) || !zip_pread (zip, tail, tail_len, (uint64_t)st.st_size - tail_len))
+        goto zip_read_directory_failure_1;
+
+    for (i = (int64_t)tail_len - 22; i >= 0; i--)
+    {
+        if (zip_get32 (tail + i) == ZIP_EOCD_SIG)
+            break;
+    }
+    if (i < 0)
+    {
+        SDL_SetError ("%s: not a zip archive", zip->path);
+        goto zip_read_directory_failure_1;
+    }
+    p = tail + i;
+    total = zip_get16 (p + 10);
+    dir_size = zip_get32 (p + 12);
+    dir_off = zip_get32 (p + 16);
+
+    /* zip64, the real numbers are in a record the locator points at */
+    if (((total == 0xFFFF) || (dir_size == 0xFFFFFFFF) || (dir_off == 0xFFFFFFFF)) &&
+        (i >= 20) && (zip_get32 (p - 20) == ZIP64_LOC_SIG))
+    {
+        if (!zip_pread (zip, rec, 56, zip_get64 (p - 20 + 8)) || (zip_get32 (rec) != ZIP64_EOCD_SIG))
+            goto zip_read_directory_failure_1;
+        total = zip_get64 (rec + 32);
+        dir_size = zip_get64 (rec + 40);
+        dir_off = zip_get64 (rec + 48);
+    }
+    free (tail);
+    tail = NULL;
+
+    if ((dir_off + dir_size > (uint64_t)st.st_size) || (total > (uint64_t)INT_MAX / 2) ||
+        (dir_size > (uint64_t)SIZE_MAX))
+    {
+        SDL_SetError ("%s: damaged zip archive", zip->path);
+        goto zip_read_directory_failure_0;
+    }
+
+    dir = malloc ((size_t)dir_size + 1);
+    zip->entries = calloc ((size_t)total + 1, sizeof (zip_entry));
+    if ((dir == NULL) || (zip->entries == NULL) || !zip_pread (zip, dir, (size_t)dir_size, dir_off))
+        goto zip_read_directory_failure_1;
+
+    for (pos = 0; (pos + 46 <= dir_size) && ((uint64_t)zip->count < total); )
+    {
+        p = dir + pos;
+        if (zip_get32 (p) != ZIP_CENTRAL_SIG)
+            break;
+        name_len = zip_get16 (p + 28);
+        extra_len = zip_get16 (p + 30);
+        comment_len = zip_get16 (p + 32);
+        if (pos + 46 + name_len + extra_len + comment_len > dir_size)
+            break;
+        pos += 46 + name_len + extra_len + comment_len;
+
+        memset (&entry, 0, sizeof (zip_entry));
+        entry.method = (int)zip_get16 (p + 10);
+        entry.crc = zip_get32 (p + 16);
+        entry.comp_size = zip_get32 (p + 20);
+        entry.size = zip_get32 (p + 24);
+        entry.header = zip_get32 (p + 42);
+        zip_extra64 (p + 46 + name_len, extra_len, &entry,
+                     entry.size == 0xFFFFFFFF, entry.comp_size == 0xFFFFFFFF,
+                     entry.header == 0xFFFFFFFF);
+
+        /* encrypted, or compressed some way zlib can not undo */
+        if (((zip_get16 (p + 8) & 0x0001) != 0) || ((entry.method != 0) && (entry.method != 8)))
+            continue;
+        if ((name_len == 0) || (p[46 + name_len - 1] == '/') || (entry.size == 0))
+            continue;
+
+        entry.name = malloc (name_len + 1);
+        if (entry.name == NULL)
+            goto zip_read_directory_failure_1;
+        memcpy (entry.name, p + 46, name_len);
+        entry.name[name_len] = '\0';
+        if (!filelist_is_image (entry.name))
+        {
+            free (entry.name);
+            continue;
+        }
+        zip->entries[zip->count++] = entry;
+    }
+
+    free (dir);
+    qsort (zip->entries, (size_t)zip->count, sizeof (zip_entry), compare_entries);
+
+/* zip_read_directory_success_0: */
+    return EXIT_SUCCESS;
+
+zip_read_directory_failure_1:
+    free (dir);
+    free (tail);
+zip_read_directory_failure_0:
+    return EXIT_FAILURE;
+}
+
+
+/* the local header repeats the name and has its own extra field, the
+   data starts after both */
+static int
+zip_locate (zip_archive *zip, zip_entry *entry, uint64_t *data)
+{
+    unsigned char header[30];
+
+    if (!zip_pread (zip, header, 30, entry->header) || (zip_get32 (header) != ZIP_LOCAL_SIG))
+    {
+        SDL_SetError ("%s/%s: damaged zip entry", zip->path, entry->name);
+        return EXIT_FAILURE;
+    }
+    *data = entry->header + 30 + zip_get16 (header + 26) + zip_get16 (header + 28);
+
+    return EXIT_SUCCESS;
+}
+
+
+static int
+compare_entries (const void *a, const void *b)
+{
+    return strcmp (((const zip_entry *)a)->name, ((const zip_entry *)b)->name);
+}
+
+
+static Sint64
+zip_rw_size (SDL_RWops *rw)
+{
+    zip_stream *s = (zip_stream *)rw->hidden.unknown.data1;
+
+    return (Sint64)s->entry->size;
+}
+
+
+/* forward seeks inflate and throw the bytes away, backward ones start
+   over (image loaders only ever step back a few bytes, to the start) */
+static Sint64
+zip_rw_seek (SDL_RWops *rw, Sint64 offset, int whence)
+{
+    zip_stream *s = (zip_stream *)rw->hidden.unknown.data1;
+    unsigned char skip[4096];
+    Sint64 target;
+    size_t want;
+
+    if (whence == RW_SEEK_SET)
+        target = offset;
+    else if (whence == RW_SEEK_CUR)
+        target = (Sint64)s->pos + offset;
+    else if (whence == RW_SEEK_END)
+        target = (Sint64)s->entry->size + offset;
+    else
+        return SDL_SetError ("zip: bad whence");
+    if (target < 0)
+        return SDL_SetError ("zip: seek before start");
+    if ((uint64_t)target > s->entry->size)
+        target = (Sint64)s->entry->size;
+
+    if (s->entry->method == 0)
+    {
+        s->pos = (uint64_t)target;
+        return target;
+    }
+
+    if ((uint64_t)target < s->pos)
+    {
+        inflateReset (&s->z);
+        s->z.avail_in = 0;
+        s->comp_pos = 0;
+        s->pos = 0;
+    }
+    while (s->pos < (uint64_t)target)
+    {
+        want = (size_t)SDL_min ((uint64_t)sizeof (skip), (uint64_t)target - s->pos);
+        if (zip_rw_read (rw, skip, 1, want) != want)
+            return -1;
+    }
+
+    return (Sint64)s->pos;
+}
+
+
+static size_t
+zip_rw_read (SDL_RWops *rw, void *ptr, size_t size, size_t maxnum)
+{
+    zip_stream *s = (zip_stream *)rw->hidden.unknown.data1;
+    zip_entry *entry = s->entry;
+    uint64_t left = entry->size - s->pos;
+    size_t want;
+    size_t chunk;
+    int status;
+
+    if (size == 0)
+        return 0;
+    want = (size_t)SDL_min ((uint64_t)size * maxnum, left);
+    want -= want % size;
+    if (want == 0)
+        return 0;
+
+    if (entry->method == 0)
+    {
+        if (!zip_pread (s->zip, ptr, want, s->data + s->pos))
+        {
+            SDL_SetError ("%s/%s: %s", s->zip->path, entry->name, strerror (errno));
+            return 0;
+        }
+        s->pos += want;
+        return want / size;
+    }
+
+    s->z.next_out = (Bytef *)ptr;
+    s->z.avail_out = (uInt)want;
+    while (s->z.avail_out > 0)
+    {
+        if ((s->z.avail_in == 0) && (s->comp_pos < entry->comp_size))
+        {
+            chunk = (size_t)SDL_min ((uint64_t)ZIP_CHUNK, entry->comp_size - s->comp_pos);
+            if (!zip_pread (s->zip, s->in, chunk, s->data + s->comp_pos))
+            {
+                SDL_SetError ("%s/%s: %s", s->zip->path, entry->name, strerror (errno));
+                break;
+            }
+            s->comp_pos += chunk;
+            s->z.next_in = s->in;
+            s->z.avail_in = (uInt)chunk;
+        }
+
+        status = inflate (&s->z, Z_NO_FLUSH);
+        if ((status != Z_OK) && (status != Z_STREAM_END))
+        {
+            SDL_SetError ("%s/%s: damaged zip entry", s->zip->path, entry->name);
+            break;
+        }
+        if ((status == Z_STREAM_END) || ((s->z.avail_in == 0) && (s->comp_pos >= entry->comp_size)))
+            break;
+    }
+
+    /* whole items only, a short read is an error anyway */
+    chunk = want - s->z.avail_out;
+    s->pos += chunk;
+    return chunk / size;
+}
+
+
+static size_t
+zip_rw_write (SDL_RWops *rw, const void *ptr, size_t size, size_t num)
+{
+    (void)rw;
+    (void)ptr;
+    (void)size;
+    (void)num;
+    SDL_SetError ("zip entries are read only");
+    return 0;
+}
+
+
+static int
+zip_rw_close (SDL_RWops *rw)
+{
+    zip_stream *s = (zip_stream *)rw->hidden.unknown.data1;
+
+    if (s->inflating)
+        inflateEnd (&s->z);
+    zip_close (s->zip);
+    free (s);
+    SDL_FreeRW (rw);
+
+    return 0;
+}
+#endif
+
+
+/* function definitions */
+/* an archive, by its extension */
+bool
+zip_is_archive (const char *path)
+{
+#ifndef _WIN32
+    const char *dot = strrchr (path, '.');
+    struct stat st;
+    char ext[4];
+    int i;
+
+    if ((dot == NULL) || (strlen (dot + 1) != 3))
+        return false;
+    for (i = 0; i < 3; i++)
+    {
+        ext[i] = (char)tolower ((unsigned char)dot[1 + i]);
+    }
+    ext[3] = '\0';
+    if ((strcmp (ext, "zip") != 0) && (strcmp (ext, "cbz") != 0))
+        return false;
+
+    return (stat (path, &st) == 0) && S_ISREG (st.st_mode);
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+
+/* read the index of path and register it, NULL (SDL_GetError says why)
+   when it is not an archive we can read.  opening an archive that is
+   already open hands out the same one again */
+zip_archive *
+zip_open (const char *path)
+{
+#ifndef _WIN32
+    char resolved[PATH_MAX];
+    const unsigned char *c;
+    zip_archive *zip;
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+
+    SDL_AtomicLock (&s_archives_lock);
+    for (zip = s_archives; zip != NULL; zip = zip->next)
+    {
+        if (strcmp (zip->path, path) == 0)
+        {
+            zip->refs++;
+            SDL_AtomicUnlock (&s_archives_lock);
+            return zip;
+        }
+    }
+    SDL_AtomicUnlock (&s_archives_lock);
+
+    zip = calloc (1, sizeof (zip_archive));
+    if (zip == NULL)
+        goto zip_open_failure_0;
+    zip->refs = 1;
+    zip->path = strdup (path);
+    if (zip->path == NULL)
+        goto zip_open_failure_1;
+    if (realpath (path, resolved) == NULL)
+    {
+        SDL_SetError ("%s: %s", path, strerror (errno));
+        goto zip_open_failure_2;
+    }
+    for (c = (const unsigned char *)resolved; *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    zip->hash = hash;
+
+    zip->fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (zip->fd < 0)
+    {
+        SDL_SetError ("%s: %s", path, strerror (errno));
+        goto zip_open_failure_2;
+    }
+    if (zip_read_directory (zip) != EXIT_SUCCESS)
+        goto zip_open_failure_3;
+
+    SDL_AtomicLock (&s_archives_lock);
+    zip->next = s_archives;
+    s_archives = zip;
+    SDL_AtomicUnlock (&s_archives_lock);
+
+/* zip_open_success_0: */
+    return zip;
+
+zip_open_failure_3:
+    for (i = 0; i < zip->count; i++)
+    {
+        free (zip->entries[i].name);
+    }
+    free (zip->entries);
+    close (zip->fd);
+zip_open_failure_2:
+    free (zip->path);
+zip_open_failure_1:
+    free (zip);
+zip_open_failure_0:
+    return (zip_archive *)NULL;
+#else
+    SDL_SetError ("%s: archives are not supported on this platform", path);
+    return (zip_archive *)NULL;
+#endif
+}
+
+
+/* drop a reference, the last one unregisters and closes the archive */
+void
+zip_close (zip_archive *zip)
+{
+#ifndef _WIN32
+    zip_archive **link;
+    int i;
+
+    if (zip == NULL)
+        return;
+
+    SDL_AtomicLock (&s_archives_lock);
+    if (--zip->refs > 0)
+    {
+        SDL_AtomicUnlock (&s_archives_lock);
+        return;
+    }
+    for (link = &s_archives; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == zip)
+        {
+            *link = zip->next;
+            break;
+        }
+    }
+    SDL_AtomicUnlock (&s_archives_lock);
+
+    for (i = 0; i < zip->count; i++)
+    {
+        free (zip->entries[i].name);
+    }
+    free (zip->entries);
+    close (zip->fd);
+    free (zip->path);
+    free (zip);
+#else
+    (void)zip;
+#endif
+}
+
+
+/* true when path is ARCHIVE/NAME for an open archive, zip and index
+   (both optional) say which entry.  *zip comes back with a reference
+   held, zip_close it when done */
+bool
+zip_find (const char *path, zip_archive **zip, int *index)
+{
+#ifndef _WIN32
+    zip_archive *it;
+    zip_entry key;
+    zip_entry *found = NULL;
+    size_t len;
+
+    SDL_AtomicLock (&s_archives_lock);
+    for (it = s_archives; it != NULL; it = it->next)
+    {
+        len = strlen (it->path);
+        if ((strncmp (path, it->path, len) != 0) || (path[len] != '/'))
+            continue;
+
+        key.name = (char *)path + len + 1;
+        found = bsearch (&key, it->entries, (size_t)it->count, sizeof (zip_entry), compare_entries);
+        if (found != NULL)
+            break;
+    }
+    if ((found != NULL) && (zip != NULL))
+        it->refs++;
+    SDL_AtomicUnlock (&s_archives_lock);
+
+    if (found == NULL)
+        return false;
+    if (zip != NULL)
+        *zip = it;
+    if (index != NULL)
+        *index = (int)(found - it->entries);
+    return true;
+#else
+    (void)path;
+    (void)zip;
+    (void)index;
+    return false;
+#endif
+}
+
+
+/* a read only stream of the uncompressed entry, it holds a reference
+   to the archive until it is closed */
+SDL_RWops *
+zip_rw (zip_archive *zip, int index)
+{
+#ifndef _WIN32
+    zip_entry *entry = &zip->entries[index];
+    zip_stream *s;
+    SDL_RWops *rw;
+    uint64_t data;
+
+    if (zip_locate (zip, entry, &data) != EXIT_SUCCESS)
+        goto zip_rw_failure_0;
+
+    s = calloc (1, sizeof (zip_stream));
+    if (s == NULL)
+    {
+        SDL_OutOfMemory ();
+        goto zip_rw_failure_0;
+    }
+    s->zip = zip;
+    s->entry = entry;
+    s->data = data;
+    if (entry->method == 8)
+    {
+        /* raw deflate, zip keeps its own headers */
+        if (inflateInit2 (&s->z, -MAX_WBITS) != Z_OK)
+        {
+            SDL_OutOfMemory ();
+            goto zip_rw_failure_1;
+        }
+        s->inflating = true;
+    }
+
+    rw = SDL_AllocRW ();
+    if (rw == NULL)
+        goto zip_rw_failure_2;
+    rw->size = zip_rw_size;
+    rw->seek = zip_rw_seek;
+    rw->read = zip_rw_read;
+    rw->write = zip_rw_write;
+    rw->close = zip_rw_close;
+    rw->type = SDL_RWOPS_UNKNOWN;
+    rw->hidden.unknown.data1 = s;
+
+    SDL_AtomicLock (&s_archives_lock);
+    zip->refs++;
+    SDL_AtomicUnlock (&s_archives_lock);
+
+/* zip_rw_success_0: */
+    return rw;
+
+zip_rw_failure_2:
+    if (s->inflating)
+        inflateEnd (&s->z);
+zip_rw_failure_1:
+    free (s);
+zip_rw_failure_0:
+    return (SDL_RWops *)NULL;
+#else
+    (void)zip;
+    (void)index;
+    SDL_Unsupported ();
+    return (SDL_RWops *)NULL;
+#endif
+}
+
+
+/* inflate a whole entry into memory (out->mapped is false), checking
+   it against the crc the archive recorded */
+int
+zip_read (zip_archive *zip, int index, mapped_file *out)
+{
+    zip_entry *entry = &zip->entries[index];
+    SDL_RWops *rw;
+    size_t got;
+
+    memset (out, 0, sizeof (mapped_file));
+    if (entry->size > (uint64_t)SIZE_MAX)
+    {
+        SDL_OutOfMemory ();
+        return EXIT_FAILURE;
+    }
+
+    rw = zip_rw (zip, index);
+    if (rw == NULL)
+        return EXIT_FAILURE;
+
+    out->data = SDL_malloc ((size_t)entry->size);
+    if (out->data == NULL)
+    {
+        SDL_OutOfMemory ();
+        SDL_RWclose (rw);
+        return EXIT_FAILURE;
+    }
+    got = SDL_RWread (rw, out->data, 1, (size_t)entry->size);
+    SDL_RWclose (rw);
+
+    if ((got != entry->size) ||
+        (crc32 (crc32 (0L, Z_NULL, 0), out->data, (uInt)got) != entry->crc))
+    {
+        if (got == entry->size)
+            SDL_SetError ("%s/%s: crc mismatch", zip->path, entry->name);
+        SDL_free (out->data);
+        memset (out, 0, sizeof (mapped_file));
+        return EXIT_FAILURE;
+    }
+    out->len = got;
+
+    return EXIT_SUCCESS;
+}
+
+
+/* thumbnail cache key for an entry, the name and crc stand in for the
+   path and the archive's mtime for the entry's */
+bool
+zip_key (zip_archive *zip, int index, cache_key *key)
+{
+    const unsigned char *c;
+    uint64_t hash = zip->hash;
+    int i;
+
+    hash ^= '/';
+    hash *= 1099511628211ULL;
+    for (c = (const unsigned char *)zip->entries[index].name; *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        hash ^= (zip->entries[index].crc >> (i * 8)) & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+
+    key->hash = (hash != 0) ? hash : 1;
+    key->size = (int64_t)zip->entries[index].size;
+    key->mtime = zip->mtime;
+
+    return true;
+}
+
+
+/* End of File */
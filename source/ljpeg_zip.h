@@ -0,0 +1,82 @@
+/*
+   source/ljpeg_zip.h
+   LJPEG ZIP/CBZ archive input header.
+
+   Copyright 2023 Sage I. Hendricks
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+
+/* run once */
+#pragma once
+#ifndef __LJPEG_ZIP_HEADER__
+#define __LJPEG_ZIP_HEADER__
+
+/* include headers */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "ljpeg_config.h"
+#include "ljpeg_cache.h"
+#include "ljpeg_mapfile.h"
+
+
+/* custom datatypes */
+typedef struct zip_entry
+{
+    char     *name;
+    uint64_t  header;       /* local header offset */
+    uint64_t  comp_size;
+    uint64_t  size;
+    uint32_t  crc;
+    int       method;       /* 0 stored, 8 deflated */
+} zip_entry;
+
+typedef struct zip_archive
+{
+    char             *path;
+    int               fd;
+    int64_t           mtime;
+    uint64_t          hash;     /* fnv-1a of the absolute path */
+    zip_entry        *entries;  /* images only, sorted by name */
+    int               count;
+    int               refs;
+    struct zip_archive *next;
+} zip_archive;
+
+
+/* constants */
+
+
+/* global variables */
+
+
+/* external function prototypes */
+bool zip_is_archive (const char *path);
+
+zip_archive *zip_open  (const char *path);
+void         zip_close (zip_archive *zip);
+
+bool        zip_find (const char *path, zip_archive **zip, int *index);
+SDL_RWops  *zip_rw   (zip_archive *zip, int index);
+int         zip_read (zip_archive *zip, int index, mapped_file *out);
+bool        zip_key  (zip_archive *zip, int index, cache_key *key);
+
+#endif /* end run once */
+
+
+/* End of File */